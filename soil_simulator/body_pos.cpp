@@ -5,40 +5,264 @@ Copyright, 2023, Vilella Kenny.
 */
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 #include "soil_simulator/body_pos.hpp"
 #include "soil_simulator/types.hpp"
 #include "soil_simulator/utils.hpp"
 
-/// The bucket position is calculated based on its reference pose stored in
+/// The body walls are first listed as surfaces using `CalcBodySurfaces`, and
+/// the position of each surface is then determined one after the other.
+template <typename T>
+void soil_simulator::CalcBodyPos(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, T* body,
+    const SimParam& sim_param, float tol, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Calculating the surfaces composing the body walls
+    auto& surfaces = workspace->body_surfaces_;
+    soil_simulator::CalcBodySurfaces(
+        pos, ori, grid, body, tol, &surfaces, workspace);
+
+    // Updating the body position
+    soil_simulator::CalcBodyPos(
+        sim_out, surfaces, grid, sim_param, tol, workspace);
+}
+template void soil_simulator::CalcBodyPos(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Body* body,
+    const SimParam& sim_param, float tol, Workspace* workspace);
+template void soil_simulator::CalcBodyPos(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Bucket* body,
+    const SimParam& sim_param, float tol, Workspace* workspace);
+template void soil_simulator::CalcBodyPos(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Blade* body,
+    const SimParam& sim_param, float tol, Workspace* workspace);
+template void soil_simulator::CalcBodyPos(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, MeshBody* body,
+    const SimParam& sim_param, float tol, Workspace* workspace);
+
+void soil_simulator::CalcBodyPos(
+    SimOut* sim_out, const std::vector<BodySurface>& surfaces,
+    const Grid& grid, const SimParam& sim_param, float tol,
+    Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Reinitializing body position
+    // When the body position is updated incrementally, body_ is only
+    // modified once the new position has been calculated
+    int body_area_prev[2][2] = {
+        {sim_out->body_area_[0][0], sim_out->body_area_[0][1]},
+        {sim_out->body_area_[1][0], sim_out->body_area_[1][1]}};
+    if (!sim_param.incremental_body_)
+        for (auto ii = body_area_prev[0][0]; ii < body_area_prev[0][1]; ii++)
+            for (auto jj = body_area_prev[1][0]; jj < body_area_prev[1][1];
+                jj++)
+                sim_out->body_.ClearCell(ii, jj);
+
+    // Updating body_area
+    soil_simulator::CalcBodyArea(
+        surfaces, grid, sim_param, sim_out->body_area_);
+
+    // Preparing the buffers where the body position is calculated
+    auto& columns = workspace->surface_columns_;
+    auto& footprint = workspace->body_footprint_;
+    soil_simulator::ResetSurfaceColumns(sim_out->body_area_, grid, &columns);
+    if (sim_param.incremental_body_)
+        soil_simulator::ResetBodyFootprint(
+            sim_out->body_area_, body_area_prev, grid, &footprint);
+
+    // Determining where each surface of the body is located and updating
+    // the body position, one surface at a time
+    // The surfaces of a closed body are located all together afterwards
+    bool closed = false;
+    for (auto nn = 0; nn < surfaces.size(); nn++) {
+        if (surfaces[nn].closed) {
+            closed = true;
+            continue;
+        }
+        soil_simulator::CalcSurfacePos(
+            surfaces[nn], grid, tol, &columns, workspace);
+        if (sim_param.incremental_body_)
+            soil_simulator::UpdateBody(columns, &footprint, grid, tol);
+        else
+            soil_simulator::UpdateBody(columns, sim_out, grid, tol);
+        columns.Clear();
+    }
+
+    if (closed) {
+        // Updating the body position with the space enclosed by the surfaces
+        if (sim_param.incremental_body_)
+            soil_simulator::UpdateClosedBody(
+                surfaces, sim_out->body_area_, grid, tol, &footprint,
+                workspace);
+        else
+            soil_simulator::UpdateClosedBody(
+                surfaces, sim_out->body_area_, grid, tol, sim_out, workspace);
+    }
+
+    if (sim_param.incremental_body_) {
+        // Writing the columns where the body position has changed
+        soil_simulator::ApplyBodyFootprint(footprint, sim_out);
+    }
+}
+
+/// The columns covered by `footprint` are the ones covered by the surfaces,
+/// see `ResetSurfaceColumns`.
+void soil_simulator::CalcBodyFootprint(
+    const std::vector<BodySurface>& surfaces, const Grid& grid,
+    const SimParam& sim_param, float tol, int body_area[2][2],
+    BodyFootprint* footprint, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Calculating the body area
+    soil_simulator::CalcBodyArea(surfaces, grid, sim_param, body_area);
+
+    // Preparing the buffers where the body position is calculated
+    auto& columns = workspace->surface_columns_;
+    soil_simulator::ResetSurfaceColumns(body_area, grid, &columns);
+    soil_simulator::ResetBodyFootprint(body_area, body_area, grid, footprint);
+
+    // Determining where each surface of the body is located and updating
+    // the body position, one surface at a time
+    // The surfaces of a closed body are located all together afterwards
+    bool closed = false;
+    for (auto nn = 0; nn < surfaces.size(); nn++) {
+        if (surfaces[nn].closed) {
+            closed = true;
+            continue;
+        }
+        soil_simulator::CalcSurfacePos(
+            surfaces[nn], grid, tol, &columns, workspace);
+        soil_simulator::UpdateBody(columns, footprint, grid, tol);
+        columns.Clear();
+    }
+
+    if (closed) {
+        // Updating the body position with the space enclosed by the surfaces
+        soil_simulator::UpdateClosedBody(
+            surfaces, body_area, grid, tol, footprint, workspace);
+    }
+}
+
+/// The body area is the 2D bounding box of all surface vertices with a buffer
+/// of `cell_buffer_` cells, restricted to the simulation grid.
+void soil_simulator::CalcBodyArea(
+    const std::vector<BodySurface>& surfaces, const Grid& grid,
+    const SimParam& sim_param, int body_area[2][2]
+) {
+    // Calculating the 2D bounding box of the body
+    float body_x_min = std::numeric_limits<float>::max();
+    float body_x_max = std::numeric_limits<float>::lowest();
+    float body_y_min = std::numeric_limits<float>::max();
+    float body_y_max = std::numeric_limits<float>::lowest();
+    for (auto nn = 0; nn < surfaces.size(); nn++) {
+        const auto& surface = surfaces[nn];
+        body_x_min = std::min({
+            body_x_min, surface.a[0], surface.b[0], surface.c[0]});
+        body_x_max = std::max({
+            body_x_max, surface.a[0], surface.b[0], surface.c[0]});
+        body_y_min = std::min({
+            body_y_min, surface.a[1], surface.b[1], surface.c[1]});
+        body_y_max = std::max({
+            body_y_max, surface.a[1], surface.b[1], surface.c[1]});
+        if (surface.rectangle) {
+            body_x_min = std::min(body_x_min, surface.d[0]);
+            body_x_max = std::max(body_x_max, surface.d[0]);
+            body_y_min = std::min(body_y_min, surface.d[1]);
+            body_y_max = std::max(body_y_max, surface.d[1]);
+        }
+    }
+
+    // Updating body_area
+    body_area[0][0] = static_cast<int>(std::max(
+        round(body_x_min / grid.cell_size_xy_ +
+            grid.half_length_x_ - sim_param.cell_buffer_)
+        , 1.0));
+    body_area[0][1] = static_cast<int>(std::min(
+        round(body_x_max / grid.cell_size_xy_ +
+            grid.half_length_x_ + sim_param.cell_buffer_)
+        , 2.0 * grid.half_length_x_));
+    body_area[1][0] = static_cast<int>(std::max(
+        round(body_y_min / grid.cell_size_xy_ +
+            grid.half_length_y_ - sim_param.cell_buffer_)
+        , 1.0));
+    body_area[1][1] = static_cast<int>(std::min(
+        round(body_y_max / grid.cell_size_xy_ +
+            grid.half_length_y_ + sim_param.cell_buffer_)
+        , 2.0 * grid.half_length_y_));
+}
+
+void soil_simulator::CalcSurfacePos(
+    const BodySurface& surface, const Grid& grid, float tol,
+    ColumnBuffer* columns, Workspace* workspace
+) {
+    if (surface.rectangle)
+        soil_simulator::CalcRectanglePos(
+            surface.a, surface.b, surface.c, surface.d, grid, tol, columns,
+            workspace);
+    else
+        soil_simulator::CalcTrianglePos(
+            surface.a, surface.b, surface.c, grid, tol, columns, workspace);
+}
+
+/// The type of the body is determined at runtime and the corresponding
+/// overload is called.
+void soil_simulator::CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Body* body, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace
+) {
+    if (auto bucket = dynamic_cast<Bucket*>(body))
+        soil_simulator::CalcBodySurfaces(
+            pos, ori, grid, bucket, tol, surfaces, workspace);
+    else if (auto blade = dynamic_cast<Blade*>(body))
+        soil_simulator::CalcBodySurfaces(
+            pos, ori, grid, blade, tol, surfaces, workspace);
+    else if (auto mesh = dynamic_cast<MeshBody*>(body))
+        soil_simulator::CalcBodySurfaces(
+            pos, ori, grid, mesh, tol, surfaces, workspace);
+    else
+        throw std::invalid_argument("body should be a Bucket, a Blade, or a"
+            " MeshBody");
+}
+
+/// The bucket surfaces are calculated based on its reference pose stored in
 /// the `Bucket` class, as well as the provided position (`pos`) and orientation
 /// (`ori`). `pos` and `ori` are used to apply the appropriate translation and
 /// rotation to the bucket relative to its reference pose. The centre of
 /// rotation is assumed to be the bucket origin. The orientation is provided
 /// using the quaternion definition.
-void soil_simulator::CalcBodyPos(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori, Grid grid,
-    Bucket* bucket, SimParam sim_param, float tol
+void soil_simulator::CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Bucket* bucket, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace
 ) {
-    // Reinitializing bucket position
-    int body_min_x = sim_out->body_area_[0][0];
-    int body_max_x = sim_out->body_area_[0][1];
-    int body_min_y = sim_out->body_area_[1][0];
-    int body_max_y = sim_out->body_area_[1][1];
-    for (auto ii = body_min_x; ii < body_max_x; ii++)
-        for (auto jj = body_min_y; jj < body_max_y; jj++) {
-            sim_out->body_[0][ii][jj] = 0.0;
-            sim_out->body_[1][ii][jj] = 0.0;
-            sim_out->body_[2][ii][jj] = 0.0;
-            sim_out->body_[3][ii][jj] = 0.0;
-        }
-
     // Calculating position of the bucket corners
     auto [j_r_pos, j_l_pos, b_r_pos, b_l_pos, t_r_pos, t_l_pos] =
-        soil_simulator::CalcBodyCornerPos(pos, ori, bucket);
+        soil_simulator::CalcBodyCornerPos(
+            Vec3::FromVector(pos), Quat::FromVector(ori), bucket);
 
     for (auto ii = 0; ii < 3; ii++) {
         // Adding a small increment to all vertices
@@ -64,99 +288,41 @@ void soil_simulator::CalcBodyPos(
             (b_l_pos[ii] - t_l_pos[ii]));
     }
 
-    // Calculating the 2D bounding box of the bucket
-    float body_x_min = std::min({
-        j_r_pos[0], j_l_pos[0], b_r_pos[0], b_l_pos[0], t_r_pos[0], t_l_pos[0]
-    });
-    float body_x_max = std::max({
-        j_r_pos[0], j_l_pos[0], b_r_pos[0], b_l_pos[0], t_r_pos[0], t_l_pos[0]
-    });
-    float body_y_min = std::min({
-        j_r_pos[1], j_l_pos[1], b_r_pos[1], b_l_pos[1], t_r_pos[1], t_l_pos[1]
-    });
-    float body_y_max = std::max({
-        j_r_pos[1], j_l_pos[1], b_r_pos[1], b_l_pos[1], t_r_pos[1], t_l_pos[1]
-    });
-
-    // Updating body_area
-    sim_out->body_area_[0][0] = static_cast<int>(std::max(
-        round(body_x_min / grid.cell_size_xy_ +
-            grid.half_length_x_ - sim_param.cell_buffer_)
-        , 1.0));
-    sim_out->body_area_[0][1] = static_cast<int>(std::min(
-        round(body_x_max / grid.cell_size_xy_ +
-            grid.half_length_x_ + sim_param.cell_buffer_)
-        , 2.0 * grid.half_length_x_));
-    sim_out->body_area_[1][0] = static_cast<int>(std::max(
-        round(body_y_min / grid.cell_size_xy_ +
-            grid.half_length_y_ - sim_param.cell_buffer_)
-        , 1.0));
-    sim_out->body_area_[1][1] = static_cast<int>(std::min(
-        round(body_y_max / grid.cell_size_xy_ +
-            grid.half_length_y_ + sim_param.cell_buffer_)
-        , 2.0 * grid.half_length_y_));
-
-    // Determining where each surface of the bucket is located
-    auto base_pos = soil_simulator::CalcRectanglePos(
-        b_r_pos, b_l_pos, t_l_pos, t_r_pos, grid, tol);
-    auto back_pos = soil_simulator::CalcRectanglePos(
-        b_r_pos, b_l_pos, j_l_pos, j_r_pos, grid, tol);
-    auto right_side_pos = soil_simulator::CalcTrianglePos(
-        j_r_pos, b_r_pos, t_r_pos, grid, tol);
-    auto left_side_pos = soil_simulator::CalcTrianglePos(
-        j_l_pos, b_l_pos, t_l_pos, grid, tol);
-
-    // Sorting all list of cells indices where the bucket is located
-    sort(base_pos.begin(), base_pos.end());
-    sort(back_pos.begin(), back_pos.end());
-    sort(right_side_pos.begin(), right_side_pos.end());
-    sort(left_side_pos.begin(), left_side_pos.end());
-
-    // Updating the bucket position
-    soil_simulator::UpdateBody(base_pos, sim_out, grid, tol);
-    soil_simulator::UpdateBody(back_pos, sim_out, grid, tol);
-    soil_simulator::UpdateBody(right_side_pos, sim_out, grid, tol);
-    soil_simulator::UpdateBody(left_side_pos, sim_out, grid, tol);
+    // Listing the surfaces of the bucket
+    surfaces->clear();
+    surfaces->push_back({b_r_pos, b_l_pos, t_l_pos, t_r_pos, true, false});
+    surfaces->push_back({b_r_pos, b_l_pos, j_l_pos, j_r_pos, true, false});
+    surfaces->push_back({j_r_pos, b_r_pos, t_r_pos, {}, false, false});
+    surfaces->push_back({j_l_pos, b_l_pos, t_l_pos, {}, false, false});
 }
 
-/// The blade position is calculated based on its reference pose stored in
+/// The blade surfaces are calculated based on its reference pose stored in
 /// the `Blade` class, as well as the provided position (`pos`) and orientation
 /// (`ori`). `pos` and `ori` are used to apply the appropriate translation and
 /// rotation to the blade relative to its reference pose. The centre of
 /// rotation is assumed to be the blade origin. The orientation is provided
 /// using the quaternion definition.
-void soil_simulator::CalcBodyPos(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori, Grid grid,
-    Blade* blade, SimParam sim_param, float tol
+void soil_simulator::CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Blade* blade, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace
 ) {
-    // Reinitializing blade position
-    int body_min_x = sim_out->body_area_[0][0];
-    int body_max_x = sim_out->body_area_[0][1];
-    int body_min_y = sim_out->body_area_[1][0];
-    int body_max_y = sim_out->body_area_[1][1];
-    for (auto ii = body_min_x; ii < body_max_x; ii++)
-        for (auto jj = body_min_y; jj < body_max_y; jj++) {
-            sim_out->body_[0][ii][jj] = 0.0;
-            sim_out->body_[1][ii][jj] = 0.0;
-            sim_out->body_[2][ii][jj] = 0.0;
-            sim_out->body_[3][ii][jj] = 0.0;
-        }
-
     // Calculating position of the front blade corners
     auto [j_rf_pos, j_lf_pos, b_rf_pos, b_lf_pos, t_rf_pos, t_lf_pos] =
-        soil_simulator::CalcBodyCornerPos(pos, ori, blade);
+        soil_simulator::CalcBodyCornerPos(
+            Vec3::FromVector(pos), Quat::FromVector(ori), blade);
 
     // Unit vector normal to the blade
     auto normal_side = soil_simulator::CalcNormal(
         j_rf_pos, j_lf_pos, b_lf_pos);
 
     // Calculating position of the back blade corners
-    std::vector<float> j_rb_pos(3);
-    std::vector<float> j_lb_pos(3);
-    std::vector<float> b_rb_pos(3);
-    std::vector<float> b_lb_pos(3);
-    std::vector<float> t_rb_pos(3);
-    std::vector<float> t_lb_pos(3);
+    Vec3 j_rb_pos;
+    Vec3 j_lb_pos;
+    Vec3 b_rb_pos;
+    Vec3 b_lb_pos;
+    Vec3 t_rb_pos;
+    Vec3 t_lb_pos;
     for (auto ii = 0; ii < 3; ii++) {
         j_rb_pos[ii] = j_rf_pos[ii] + grid.cell_size_xy_ * normal_side[ii];
         j_lb_pos[ii] = j_lf_pos[ii] + grid.cell_size_xy_ * normal_side[ii];
@@ -208,63 +374,224 @@ void soil_simulator::CalcBodyPos(
             (b_lb_pos[ii] - t_lb_pos[ii]));
     }
 
-    // Calculating the 2D bounding box of the blade
-    float body_x_min = std::min({
-        j_rf_pos[0], j_lf_pos[0], b_rf_pos[0], b_lf_pos[0], t_rf_pos[0],
-        t_lf_pos[0], j_rb_pos[0], j_lb_pos[0], b_rb_pos[0], b_lb_pos[0],
-        t_rb_pos[0], t_lb_pos[0]});
-    float body_x_max = std::max({
-        j_rf_pos[0], j_lf_pos[0], b_rf_pos[0], b_lf_pos[0], t_rf_pos[0],
-        t_lf_pos[0], j_rb_pos[0], j_lb_pos[0], b_rb_pos[0], b_lb_pos[0],
-        t_rb_pos[0], t_lb_pos[0]});
-    float body_y_min = std::min({
-        j_rf_pos[1], j_lf_pos[1], b_rf_pos[1], b_lf_pos[1], t_rf_pos[1],
-        t_lf_pos[1], j_rb_pos[1], j_lb_pos[1], b_rb_pos[1], b_lb_pos[1],
-        t_rb_pos[1], t_lb_pos[1]});
-    float body_y_max = std::max({
-        j_rf_pos[1], j_lf_pos[1], b_rf_pos[1], b_lf_pos[1], t_rf_pos[1],
-        t_lf_pos[1], j_rb_pos[1], j_lb_pos[1], b_rb_pos[1], b_lb_pos[1],
-        t_rb_pos[1], t_lb_pos[1]});
+    // Listing the surfaces of the blade
+    surfaces->clear();
+    surfaces->push_back({b_rf_pos, b_lf_pos, j_lf_pos, j_rf_pos, true, false});
+    surfaces->push_back({b_rb_pos, b_lb_pos, j_lb_pos, j_rb_pos, true, false});
+    surfaces->push_back({t_rf_pos, t_lf_pos, j_lf_pos, j_rf_pos, true, false});
+    surfaces->push_back({t_rb_pos, t_lb_pos, j_lb_pos, j_rb_pos, true, false});
+}
 
-    // Updating body_area
-    sim_out->body_area_[0][0] = static_cast<int>(std::max(
-        round(body_x_min / grid.cell_size_xy_ +
-            grid.half_length_x_ - sim_param.cell_buffer_)
-        , 1.0));
-    sim_out->body_area_[0][1] = static_cast<int>(std::min(
-        round(body_x_max / grid.cell_size_xy_ +
-            grid.half_length_x_ + sim_param.cell_buffer_)
-        , 2.0 * grid.half_length_x_));
-    sim_out->body_area_[1][0] = static_cast<int>(std::max(
-        round(body_y_min / grid.cell_size_xy_ +
-            grid.half_length_y_ - sim_param.cell_buffer_)
-        , 1.0));
-    sim_out->body_area_[1][1] = static_cast<int>(std::min(
-        round(body_y_max / grid.cell_size_xy_ +
-            grid.half_length_y_ + sim_param.cell_buffer_)
-        , 2.0 * grid.half_length_y_));
+/// The body surfaces are calculated based on the reference pose of the mesh
+/// stored in the `MeshBody` class, as well as the provided position (`pos`)
+/// and orientation (`ori`). `pos` and `ori` are used to apply the appropriate
+/// translation and rotation to the mesh relative to its reference pose. The
+/// centre of rotation is assumed to be the body origin. The orientation is
+/// provided using the quaternion definition.
+///
+/// The bounding volume hierarchy of the mesh is traversed to discard the
+/// triangles located outside the simulation grid, so that only the
+/// remaining triangles are listed. The triangles are marked as the boundary
+/// of a closed body, so that the space they enclose is also occupied by the
+/// body, see `UpdateClosedBody`.
+void soil_simulator::CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, MeshBody* mesh, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Calculating the rotation of the three reference directions
+    auto body_pos = Vec3::FromVector(pos);
+    auto body_ori = Quat::FromVector(ori);
+    Vec3 axis[3];
+    for (auto ii = 0; ii < 3; ii++) {
+        Vec3 unit = {0.0, 0.0, 0.0};
+        unit[ii] = 1.0;
+        axis[ii] = soil_simulator::CalcRotationQuaternion(body_ori, unit);
+    }
 
-    // Determining where each surface of the blade is located
-    auto ankle_f_pos = soil_simulator::CalcRectanglePos(
-        b_rf_pos, b_lf_pos, j_lf_pos, j_rf_pos, grid, tol);
-    auto ankle_b_pos = soil_simulator::CalcRectanglePos(
-        b_rb_pos, b_lb_pos, j_lb_pos, j_rb_pos, grid, tol);
-    auto heel_f_pos = soil_simulator::CalcRectanglePos(
-        t_rf_pos, t_lf_pos, j_lf_pos, j_rf_pos, grid, tol);
-    auto heel_b_pos = soil_simulator::CalcRectanglePos(
-        t_rb_pos, t_lb_pos, j_lb_pos, j_rb_pos, grid, tol);
-
-    // Sorting all list of cells indices where the blade is located
-    sort(ankle_f_pos.begin(), ankle_f_pos.end());
-    sort(ankle_b_pos.begin(), ankle_b_pos.end());
-    sort(heel_f_pos.begin(), heel_f_pos.end());
-    sort(heel_b_pos.begin(), heel_b_pos.end());
-
-    // Updating the blade position
-    soil_simulator::UpdateBody(ankle_f_pos, sim_out, grid, tol);
-    soil_simulator::UpdateBody(ankle_b_pos, sim_out, grid, tol);
-    soil_simulator::UpdateBody(heel_f_pos, sim_out, grid, tol);
-    soil_simulator::UpdateBody(heel_b_pos, sim_out, grid, tol);
+    // Calculating position of the mesh vertices
+    auto& vertices = workspace->mesh_vertices_;
+    int n_vertex = mesh->vertices_.size();
+    vertices.resize(n_vertex);
+    Vec3 center = {0.0, 0.0, 0.0};
+    for (auto nn = 0; nn < n_vertex; nn++) {
+        const auto& vertex = mesh->vertices_[nn];
+        for (auto ii = 0; ii < 3; ii++) {
+            vertices[nn][ii] = (
+                body_pos[ii] + axis[0][ii] * vertex[0] +
+                axis[1][ii] * vertex[1] + axis[2][ii] * vertex[2]);
+            center[ii] += vertices[nn][ii] / n_vertex;
+        }
+    }
+
+    // Adding a small increment to all vertices
+    // This is to account for the edge case where one of the vertex is at
+    // cell border. In that case, the increment would remove any ambiguity
+    for (auto nn = 0; nn < n_vertex; nn++)
+        for (auto ii = 0; ii < 3; ii++)
+            vertices[nn][ii] += tol * (center[ii] - vertices[nn][ii]);
+
+    // Checking whether the bounding box of a node is outside the grid
+    // The bounding box is calculated in the grid frame from its centre and
+    // half extents, and converted into indices
+    float cell_size[3] = {
+        grid.cell_size_xy_, grid.cell_size_xy_, grid.cell_size_z_};
+    float offset[3] = {
+        static_cast<float>(grid.half_length_x_),
+        static_cast<float>(grid.half_length_y_),
+        grid.half_length_z_ - 1.0f};
+    float length[3] = {
+        2.0f * grid.half_length_x_, 2.0f * grid.half_length_y_,
+        2.0f * grid.half_length_z_};
+    auto outside_grid = [&](const BvhNode& node) {
+        for (auto ii = 0; ii < 3; ii++) {
+            float node_center = body_pos[ii];
+            float node_extent = 0.0;
+            for (auto kk = 0; kk < 3; kk++) {
+                float center_kk = 0.5 * (node.box_min[kk] + node.box_max[kk]);
+                float extent_kk = 0.5 * (node.box_max[kk] - node.box_min[kk]);
+                node_center += axis[kk][ii] * center_kk;
+                node_extent += std::abs(axis[kk][ii]) * extent_kk;
+            }
+            float ind_min = (
+                (node_center - node_extent) / cell_size[ii] + offset[ii]);
+            float ind_max = (
+                (node_center + node_extent) / cell_size[ii] + offset[ii]);
+            if ((ind_max < -1.0) || (ind_min > length[ii] + 1.0))
+                return true;
+        }
+        return false;
+    };
+
+    // Listing the triangles of the body that may be inside the grid
+    surfaces->clear();
+    auto& stack = workspace->bvh_stack_;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty()) {
+        int node_ind = stack.back();
+        stack.pop_back();
+        const auto& node = mesh->bvh_[node_ind];
+
+        if (outside_grid(node))
+            continue;
+
+        if (node.count == 0) {
+            // Visiting the two children of the node
+            stack.push_back(node.first);
+            stack.push_back(node_ind + 1);
+            continue;
+        }
+
+        for (auto nn = node.first; nn < node.first + node.count; nn++) {
+            const auto& triangle = mesh->triangles_[nn];
+            surfaces->push_back({
+                vertices[triangle[0]], vertices[triangle[1]],
+                vertices[triangle[2]], {}, false, true});
+        }
+    }
+}
+
+/// The covered columns extend one cell beyond `body_area` in each direction,
+/// as the edges of the body surfaces may be located there, but are restricted
+/// to the simulation grid.
+void soil_simulator::ResetSurfaceColumns(
+    const int body_area[2][2], const Grid& grid, ColumnBuffer* columns
+) {
+    int area[2][2];
+    area[0][0] = std::max(body_area[0][0] - 1, 0);
+    area[0][1] = std::min(
+        body_area[0][1] + 1, 2 * grid.half_length_x_ + 1);
+    area[1][0] = std::max(body_area[1][0] - 1, 0);
+    area[1][1] = std::min(
+        body_area[1][1] + 1, 2 * grid.half_length_y_ + 1);
+    columns->Reset(area);
+}
+
+/// The covered columns include the columns where the body may have been
+/// located at the previous step, that is, `body_area_prev` extended by one
+/// cell, as well as the columns where the new body surfaces may be located.
+void soil_simulator::ResetBodyFootprint(
+    const int body_area[2][2], const int body_area_prev[2][2],
+    const Grid& grid, BodyFootprint* footprint
+) {
+    int area[2][2];
+    area[0][0] = std::max(
+        std::min(body_area_prev[0][0], body_area[0][0]) - 1, 0);
+    area[0][1] = std::min(
+        std::max(body_area_prev[0][1], body_area[0][1]) + 1,
+        2 * grid.half_length_x_ + 1);
+    area[1][0] = std::max(
+        std::min(body_area_prev[1][0], body_area[1][0]) - 1, 0);
+    area[1][1] = std::min(
+        std::max(body_area_prev[1][1], body_area[1][1]) + 1,
+        2 * grid.half_length_y_ + 1);
+    footprint->Reset(area);
+}
+
+/// The columns are compared after conversion to the type used to store
+/// `body_`, so that only the columns whose stored value is modified are
+/// written. The changed cells are listed in `body_changed_cells_` in
+/// row-major order.
+void soil_simulator::ApplyBodyFootprint(
+    const BodyFootprint& footprint, SimOut* sim_out
+) {
+    sim_out->body_changed_cells_.clear();
+
+    int area[2][2];
+    footprint.GetArea(area);
+    for (auto ii = area[0][0]; ii < area[0][1]; ii++)
+        for (auto jj = area[1][0]; jj < area[1][1]; jj++) {
+            // Loading the previous and new body layers of the cell
+            float body_cell[4];
+            sim_out->body_.LoadCell(ii, jj, body_cell);
+            const float* new_cell = footprint.Cell(ii, jj);
+
+            bool changed = false;
+            bool empty = true;
+            for (auto ind = 0; ind < 4; ind++) {
+                float new_h = sim_out->body_.Quantize(new_cell[ind]);
+                changed = changed || (new_h != body_cell[ind]);
+                empty = empty && (new_h == 0.0);
+            }
+
+            if (!changed) {
+                // Body position unchanged
+                continue;
+            }
+
+            // Updating the body position
+            if (empty) {
+                sim_out->body_.ClearCell(ii, jj);
+            } else {
+                for (auto ind = 0; ind < 4; ind++)
+                    sim_out->body_[ind][ii][jj] = new_cell[ind];
+            }
+            sim_out->body_changed_cells_.push_back({ii, jj});
+        }
+}
+
+/// The body walls of `footprint` are merged with the ones already present in
+/// `body_` following `IncludeNewBodyPos`.
+void soil_simulator::IncludeBodyFootprint(
+    const BodyFootprint& footprint, SimOut* sim_out, float tol
+) {
+    int area[2][2];
+    footprint.GetArea(area);
+    for (auto ii = area[0][0]; ii < area[0][1]; ii++)
+        for (auto jj = area[1][0]; jj < area[1][1]; jj++) {
+            const float* body_cell = footprint.Cell(ii, jj);
+            for (auto ind = 0; ind < 4; ind += 2)
+                if ((body_cell[ind] != 0.0) || (body_cell[ind+1] != 0.0))
+                    soil_simulator::IncludeNewBodyPos(
+                        sim_out, ii, jj, body_cell[ind], body_cell[ind+1],
+                        tol);
+        }
 }
 
 /// The rectangle is defined by providing the Cartesian coordinates of its four
@@ -293,15 +620,16 @@ void soil_simulator::CalcBodyPos(
 /// - When the rectangle follows a cell border, the exact location of the
 ///   rectangle becomes ambiguous. It is assumed that the caller resolves
 ///   this ambiguity.
-std::vector<std::vector<int>> soil_simulator::CalcRectanglePos(
-    std::vector<float> a, std::vector<float> b, std::vector<float> c,
-    std::vector<float> d, Grid grid, float tol
+template <typename T>
+void soil_simulator::CalcRectanglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& d,
+    const Grid& grid, float tol, T* rect_pos, Workspace* workspace
 ) {
     // Converting the four rectangle vertices from position to indices
-    std::vector<float> a_ind(3, 0);
-    std::vector<float> b_ind(3, 0);
-    std::vector<float> c_ind(3, 0);
-    std::vector<float> d_ind(3, 0);
+    Vec3 a_ind;
+    Vec3 b_ind;
+    Vec3 c_ind;
+    Vec3 d_ind;
     a_ind[0] = a[0] / grid.cell_size_xy_ + grid.half_length_x_;
     b_ind[0] = b[0] / grid.cell_size_xy_ + grid.half_length_x_;
     c_ind[0] = c[0] / grid.cell_size_xy_ + grid.half_length_x_;
@@ -330,10 +658,10 @@ std::vector<std::vector<int>> soil_simulator::CalcRectanglePos(
     int area_length_y = area_max_y - area_min_y;
 
     // Calculating the basis formed by the rectangle
-    std::vector<float> ab(3, 0.0);
-    std::vector<float> ad(3, 0.0);
-    std::vector<float> ab_ind(3, 0);
-    std::vector<float> ad_ind(3, 0);
+    Vec3 ab;
+    Vec3 ad;
+    Vec3 ab_ind;
+    Vec3 ad_ind;
     for (auto ii = 0; ii < 3; ii++) {
        ab[ii] = b[ii] - a[ii];
        ad[ii] = d[ii] - a[ii];
@@ -346,58 +674,55 @@ std::vector<std::vector<int>> soil_simulator::CalcRectanglePos(
     ad_ind[2] = ad[2] / grid.cell_size_z_;
 
     // Listing cells inside the rectangle area
-    auto [c_ab, c_ad, in_rectangle, n_cell] =
-        soil_simulator::DecomposeVectorRectangle(
-            ab_ind, ad_ind, a_ind, area_min_x, area_min_y, area_length_x,
-            area_length_y, tol);
+    int n_cell = soil_simulator::RasterizeRectangle(
+        ab_ind, ad_ind, a_ind, area_min_x, area_min_y, area_length_x,
+        area_length_y, tol, workspace);
+    const auto& in_rectangle = workspace->in_area_;
+    const auto& height = workspace->area_height_;
 
     // Determining cells where inner portion of the rectangle area is located
-    std::vector<std::vector<int>> rect_pos;
-    rect_pos.resize(n_cell, std::vector<int>(3, 0));
-    int nn_cell = 0;
+    if constexpr (std::is_same_v<T, CellList<3>>)
+        rect_pos->reserve(rect_pos->size() + n_cell);
     for (auto ii = area_min_x; ii < area_max_x; ii++)
         for (auto jj = area_min_y; jj < area_max_y; jj++) {
-            // Calculating corresponding indices
-            int ii_s = ii - area_min_x;
-            int jj_s = jj - area_min_y;
+            // Calculating corresponding index
+            int nn = (ii - area_min_x) * area_length_y + jj - area_min_y;
 
-            if (in_rectangle[ii_s][jj_s] == true) {
+            if (in_rectangle[nn]) {
                 // Cell is inside the rectangle area
-                // Calculating the height index of the rectangle at this corner
-                int kk = static_cast<int>(std::ceil(
-                    a_ind[2] + c_ab[ii_s][jj_s] * ab_ind[2] +
-                    c_ad[ii_s][jj_s] * ad_ind[2]));
+                int kk = height[nn];
 
                 // Adding the four neighbouring cells with the calculated height
-                rect_pos[nn_cell][0] = ii;
-                rect_pos[nn_cell][1] = jj;
-                rect_pos[nn_cell][2] = kk;
-                rect_pos[nn_cell + 1][0] = ii + 1;
-                rect_pos[nn_cell + 1][1] = jj;
-                rect_pos[nn_cell + 1][2] = kk;
-                rect_pos[nn_cell + 2][0] = ii;
-                rect_pos[nn_cell + 2][1] = jj + 1;
-                rect_pos[nn_cell + 2][2] = kk;
-                rect_pos[nn_cell + 3][0] = ii + 1;
-                rect_pos[nn_cell + 3][1] = jj + 1;
-                rect_pos[nn_cell + 3][2] = kk;
-
-                // Incrementing the index
-                nn_cell += 4;
+                rect_pos->push_back({ii, jj, kk});
+                rect_pos->push_back({ii + 1, jj, kk});
+                rect_pos->push_back({ii, jj + 1, kk});
+                rect_pos->push_back({ii + 1, jj + 1, kk});
             }
         }
 
     // Determining the cells where the four edges of the rectangle are located
-    auto ab_pos = soil_simulator::CalcLinePos(a, b, grid);
-    auto bc_pos = soil_simulator::CalcLinePos(b, c, grid);
-    auto cd_pos = soil_simulator::CalcLinePos(c, d, grid);
-    auto da_pos = soil_simulator::CalcLinePos(d, a, grid);
-
-    // Concatenating all cells in rect_pos
-    rect_pos.insert(rect_pos.end(), ab_pos.begin(), ab_pos.end());
-    rect_pos.insert(rect_pos.end(), bc_pos.begin(), bc_pos.end());
-    rect_pos.insert(rect_pos.end(), cd_pos.begin(), cd_pos.end());
-    rect_pos.insert(rect_pos.end(), da_pos.begin(), da_pos.end());
+    soil_simulator::CalcLinePos(a, b, grid, rect_pos);
+    soil_simulator::CalcLinePos(b, c, grid, rect_pos);
+    soil_simulator::CalcLinePos(c, d, grid, rect_pos);
+    soil_simulator::CalcLinePos(d, a, grid, rect_pos);
+}
+template void soil_simulator::CalcRectanglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& d,
+    const Grid& grid, float tol, CellList<3>* rect_pos, Workspace* workspace);
+template void soil_simulator::CalcRectanglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& d,
+    const Grid& grid, float tol, ColumnBuffer* rect_pos, Workspace* workspace);
+
+soil_simulator::CellList<3> soil_simulator::CalcRectanglePos(
+    const std::vector<float>& a, const std::vector<float>& b,
+    const std::vector<float>& c, const std::vector<float>& d, const Grid& grid,
+    float tol
+) {
+    Workspace workspace;
+    CellList<3> rect_pos;
+    soil_simulator::CalcRectanglePos(
+        Vec3::FromVector(a), Vec3::FromVector(b), Vec3::FromVector(c),
+        Vec3::FromVector(d), grid, tol, &rect_pos, &workspace);
 
     return rect_pos;
 }
@@ -447,21 +772,19 @@ std::vector<std::vector<int>> soil_simulator::CalcRectanglePos(
 /// Note:
 /// By convention, the decomposition is done at the top right corner of
 /// each cell.
-std::tuple<
-    std::vector<std::vector<float>>, std::vector<std::vector<float>>,
-    std::vector<std::vector<bool>>, int>
-soil_simulator::DecomposeVectorRectangle(
-    std::vector<float> ab_ind, std::vector<float> ad_ind,
-    std::vector<float> a_ind, int area_min_x, int area_min_y,
-    int area_length_x, int area_length_y, float tol
+int soil_simulator::DecomposeVectorRectangle(
+    const Vec3& ab_ind, const Vec3& ad_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace
 ) {
-    // Setiing up the outputs
-    std::vector<std::vector<float>> c_ab;
-    std::vector<std::vector<float>> c_ad;
-    std::vector<std::vector<bool>> in_rectangle;
-    c_ab.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
-    c_ad.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
-    in_rectangle.resize(area_length_x, std::vector<bool>(area_length_y, false));
+    // Setting up the outputs
+    int n_area = area_length_x * area_length_y;
+    auto& c_ab = workspace->c_ab_;
+    auto& c_ad = workspace->c_ac_;
+    auto& in_rectangle = workspace->in_area_;
+    c_ab.assign(n_area, 0.0);
+    c_ad.assign(n_area, 0.0);
+    in_rectangle.assign(n_area, 0);
 
     // Setting constants for decomposing the cell position into the reference
     // basis of the rectangle
@@ -478,25 +801,127 @@ soil_simulator::DecomposeVectorRectangle(
             // Calculating the indices corresponding to the simulation grid
             float ii = area_min_x + 0.5 + ii_s;
             float jj = area_min_y + 0.5 + jj_s;
+            int nn = ii_s * area_length_y + jj_s;
 
             // Decomposing the cell corner position into the basis formed
             // by the rectangle
-            c_ab[ii_s][jj_s] = (
+            c_ab[nn] = (
                 c_ab_x * (ii - a_ind[0]) - c_ab_y * (jj - a_ind[1]));
-            c_ad[ii_s][jj_s] = (
+            c_ad[nn] = (
                 -c_ad_x * (ii - a_ind[0]) + c_ad_y * (jj - a_ind[1]));
 
-            if ((c_ab[ii_s][jj_s] > tol) && (c_ab[ii_s][jj_s] < 1 - tol) &&
-                (c_ad[ii_s][jj_s] > tol) && (c_ad[ii_s][jj_s] < 1 - tol)) {
+            if ((c_ab[nn] > tol) && (c_ab[nn] < 1 - tol) &&
+                (c_ad[nn] > tol) && (c_ad[nn] < 1 - tol)) {
                 // Cell is inside the rectangle area
-                in_rectangle[ii_s][jj_s] = true;
+                in_rectangle[nn] = 1;
                 n_cell += 4;
             }
         }
 
+    return n_cell;
+}
+
+std::tuple<
+    std::vector<std::vector<float>>, std::vector<std::vector<float>>,
+    std::vector<std::vector<bool>>, int>
+soil_simulator::DecomposeVectorRectangle(
+    const std::vector<float>& ab_ind, const std::vector<float>& ad_ind,
+    const std::vector<float>& a_ind, int area_min_x, int area_min_y,
+    int area_length_x, int area_length_y, float tol
+) {
+    Workspace workspace;
+    int n_cell = soil_simulator::DecomposeVectorRectangle(
+        Vec3::FromVector(ab_ind), Vec3::FromVector(ad_ind),
+        Vec3::FromVector(a_ind), area_min_x, area_min_y, area_length_x,
+        area_length_y, tol, &workspace);
+
+    // Converting the outputs to nested vectors
+    std::vector<std::vector<float>> c_ab;
+    std::vector<std::vector<float>> c_ad;
+    std::vector<std::vector<bool>> in_rectangle;
+    c_ab.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
+    c_ad.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
+    in_rectangle.resize(area_length_x, std::vector<bool>(area_length_y, false));
+    for (auto ii_s = 0; ii_s < area_length_x; ii_s++)
+        for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+            int nn = ii_s * area_length_y + jj_s;
+            c_ab[ii_s][jj_s] = workspace.c_ab_[nn];
+            c_ad[ii_s][jj_s] = workspace.c_ac_[nn];
+            in_rectangle[ii_s][jj_s] = workspace.in_area_[nn];
+        }
+
     return {c_ab, c_ad, in_rectangle, n_cell};
 }
 
+/// The vector decomposition is the same as in `DecomposeVectorRectangle`, but
+/// the height index of the rectangle is calculated in the same pass, so that
+/// the decomposition itself does not need to be stored.
+///
+/// The decomposition is separated into a part depending only on the X index,
+/// calculated once per row, and a part depending only on the Y index,
+/// calculated once per column. The loop over a row is then free of any
+/// dependency between cells, so that it can be vectorized by the compiler,
+/// while giving the same results as `DecomposeVectorRectangle`.
+int soil_simulator::RasterizeRectangle(
+    const Vec3& ab_ind, const Vec3& ad_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace
+) {
+    // Setting up the outputs
+    int n_area = area_length_x * area_length_y;
+    auto& in_rectangle = workspace->in_area_;
+    auto& height = workspace->area_height_;
+    in_rectangle.resize(n_area);
+    height.resize(n_area);
+
+    // Setting constants for decomposing the cell position into the reference
+    // basis of the rectangle
+    float c_ab_x = ad_ind[1] / (ab_ind[0] * ad_ind[1] - ab_ind[1] * ad_ind[0]);
+    float c_ab_y = ad_ind[0] / (ab_ind[0] * ad_ind[1] - ab_ind[1] * ad_ind[0]);
+    float c_ad_x = ab_ind[1] / (ab_ind[0] * ad_ind[1] - ab_ind[1] * ad_ind[0]);
+    float c_ad_y = ab_ind[0] / (ab_ind[0] * ad_ind[1] - ab_ind[1] * ad_ind[0]);
+
+    // Calculating the part of the decomposition depending on the Y index
+    auto& c_ab_col = workspace->c_ab_col_;
+    auto& c_ad_col = workspace->c_ac_col_;
+    c_ab_col.resize(area_length_y);
+    c_ad_col.resize(area_length_y);
+    for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+        float jj = area_min_y + 0.5 + jj_s;
+        c_ab_col[jj_s] = c_ab_y * (jj - a_ind[1]);
+        c_ad_col[jj_s] = c_ad_y * (jj - a_ind[1]);
+    }
+
+    // Iterating over the top right corner of all cells in the specified area
+    int n_cell = 0;
+    for (auto ii_s = 0; ii_s < area_length_x; ii_s++) {
+        // Calculating the part of the decomposition depending on the X index
+        float ii = area_min_x + 0.5 + ii_s;
+        float c_ab_row = c_ab_x * (ii - a_ind[0]);
+        float c_ad_row = -c_ad_x * (ii - a_ind[0]);
+        std::uint8_t* in_row = in_rectangle.data() + ii_s * area_length_y;
+        int* height_row = height.data() + ii_s * area_length_y;
+
+        for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+            // Decomposing the cell corner position into the basis formed
+            // by the rectangle
+            float c_ab = c_ab_row - c_ab_col[jj_s];
+            float c_ad = c_ad_row + c_ad_col[jj_s];
+            bool inside = (
+                (c_ab > tol) && (c_ab < 1 - tol) && (c_ad > tol) &&
+                (c_ad < 1 - tol));
+
+            // Calculating the height index of the rectangle at this corner
+            float h = a_ind[2] + c_ab * ab_ind[2] + c_ad * ad_ind[2];
+            in_row[jj_s] = inside;
+            height_row[jj_s] = inside ? static_cast<int>(std::ceil(h)) : 0;
+            n_cell += 4 * inside;
+        }
+    }
+
+    return n_cell;
+}
+
 /// The triangle is defined by providing the Cartesian coordinates of its three
 /// vertices in the proper order.
 ///
@@ -523,14 +948,15 @@ soil_simulator::DecomposeVectorRectangle(
 /// - When the triangle follows a cell border, the exact location of the
 ///   triangle becomes ambiguous. It is assumed that the caller resolves
 ///   this ambiguity.
-std::vector<std::vector<int>> soil_simulator::CalcTrianglePos(
-    std::vector<float> a, std::vector<float> b, std::vector<float> c,
-    Grid grid, float tol
+template <typename T>
+void soil_simulator::CalcTrianglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Grid& grid, float tol,
+    T* tri_pos, Workspace* workspace
 ) {
     // Converting the three triangle vertices from position to indices
-    std::vector<float> a_ind(3, 0);
-    std::vector<float> b_ind(3, 0);
-    std::vector<float> c_ind(3, 0);
+    Vec3 a_ind;
+    Vec3 b_ind;
+    Vec3 c_ind;
     a_ind[0] = a[0] / grid.cell_size_xy_ + grid.half_length_x_;
     b_ind[0] = b[0] / grid.cell_size_xy_ + grid.half_length_x_;
     c_ind[0] = c[0] / grid.cell_size_xy_ + grid.half_length_x_;
@@ -556,10 +982,10 @@ std::vector<std::vector<int>> soil_simulator::CalcTrianglePos(
     int area_length_y = area_max_y - area_min_y;
 
     // Calculating the basis formed by the triangle
-    std::vector<float> ab(3, 0.0);
-    std::vector<float> ac(3, 0.0);
-    std::vector<float> ab_ind(3, 0);
-    std::vector<float> ac_ind(3, 0);
+    Vec3 ab;
+    Vec3 ac;
+    Vec3 ab_ind;
+    Vec3 ac_ind;
     for (auto ii = 0; ii < 3; ii++) {
        ab[ii] = b[ii] - a[ii];
        ac[ii] = c[ii] - a[ii];
@@ -572,56 +998,53 @@ std::vector<std::vector<int>> soil_simulator::CalcTrianglePos(
     ac_ind[2] = ac[2] / grid.cell_size_z_;
 
     // Listing cells inside the triangle area
-    auto [c_ab, c_ac, in_triangle, n_cell] =
-        soil_simulator::DecomposeVectorTriangle(
-            ab_ind, ac_ind, a_ind, area_min_x, area_min_y, area_length_x,
-            area_length_y, tol);
+    int n_cell = soil_simulator::RasterizeTriangle(
+        ab_ind, ac_ind, a_ind, area_min_x, area_min_y, area_length_x,
+        area_length_y, tol, workspace);
+    const auto& in_triangle = workspace->in_area_;
+    const auto& height = workspace->area_height_;
 
     // Determining cells where inner portion of the triangle area is located
-    std::vector<std::vector<int>> tri_pos;
-    tri_pos.resize(n_cell, std::vector<int>(3, 0));
-    int nn_cell = 0;
+    if constexpr (std::is_same_v<T, CellList<3>>)
+        tri_pos->reserve(tri_pos->size() + n_cell);
     for (auto ii = area_min_x; ii < area_max_x; ii++)
         for (auto jj = area_min_y; jj < area_max_y; jj++) {
-            // Calculating corresponding indices
-            int ii_s = ii - area_min_x;
-            int jj_s = jj - area_min_y;
+            // Calculating corresponding index
+            int nn = (ii - area_min_x) * area_length_y + jj - area_min_y;
 
-            if (in_triangle[ii_s][jj_s] == true) {
+            if (in_triangle[nn]) {
                 // Cell is inside the triangle area
-                // Calculating the height index of the triangle at this corner
-                int kk = static_cast<int>(std::ceil(
-                    a_ind[2] + c_ab[ii_s][jj_s] * ab_ind[2] +
-                    c_ac[ii_s][jj_s] * ac_ind[2]));
+                int kk = height[nn];
 
                 // Adding the four neighbouring cells with the calculated height
-                tri_pos[nn_cell][0] = ii;
-                tri_pos[nn_cell][1] = jj;
-                tri_pos[nn_cell][2] = kk;
-                tri_pos[nn_cell + 1][0] = ii + 1;
-                tri_pos[nn_cell + 1][1] = jj;
-                tri_pos[nn_cell + 1][2] = kk;
-                tri_pos[nn_cell + 2][0] = ii;
-                tri_pos[nn_cell + 2][1] = jj + 1;
-                tri_pos[nn_cell + 2][2] = kk;
-                tri_pos[nn_cell + 3][0] = ii + 1;
-                tri_pos[nn_cell + 3][1] = jj + 1;
-                tri_pos[nn_cell + 3][2] = kk;
-
-                // Incrementing the index
-                nn_cell += 4;
+                tri_pos->push_back({ii, jj, kk});
+                tri_pos->push_back({ii + 1, jj, kk});
+                tri_pos->push_back({ii, jj + 1, kk});
+                tri_pos->push_back({ii + 1, jj + 1, kk});
             }
         }
 
     // Determining the cells where the three edges of the triangle are located
-    auto ab_pos = soil_simulator::CalcLinePos(a, b, grid);
-    auto bc_pos = soil_simulator::CalcLinePos(b, c, grid);
-    auto ca_pos = soil_simulator::CalcLinePos(c, a, grid);
-
-    // Concatenating all cells in tri_pos
-    tri_pos.insert(tri_pos.end(), ab_pos.begin(), ab_pos.end());
-    tri_pos.insert(tri_pos.end(), bc_pos.begin(), bc_pos.end());
-    tri_pos.insert(tri_pos.end(), ca_pos.begin(), ca_pos.end());
+    soil_simulator::CalcLinePos(a, b, grid, tri_pos);
+    soil_simulator::CalcLinePos(b, c, grid, tri_pos);
+    soil_simulator::CalcLinePos(c, a, grid, tri_pos);
+}
+template void soil_simulator::CalcTrianglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Grid& grid, float tol,
+    CellList<3>* tri_pos, Workspace* workspace);
+template void soil_simulator::CalcTrianglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Grid& grid, float tol,
+    ColumnBuffer* tri_pos, Workspace* workspace);
+
+soil_simulator::CellList<3> soil_simulator::CalcTrianglePos(
+    const std::vector<float>& a, const std::vector<float>& b,
+    const std::vector<float>& c, const Grid& grid, float tol
+) {
+    Workspace workspace;
+    CellList<3> tri_pos;
+    soil_simulator::CalcTrianglePos(
+        Vec3::FromVector(a), Vec3::FromVector(b), Vec3::FromVector(c), grid,
+        tol, &tri_pos, &workspace);
 
     return tri_pos;
 }
@@ -672,21 +1095,19 @@ std::vector<std::vector<int>> soil_simulator::CalcTrianglePos(
 /// Note:
 /// By convention, the decomposition is done at the top right corner of
 /// each cell.
-std::tuple<
-    std::vector<std::vector<float>>, std::vector<std::vector<float>>,
-    std::vector<std::vector<bool>>, int>
-soil_simulator::DecomposeVectorTriangle(
-    std::vector<float> ab_ind, std::vector<float> ac_ind,
-    std::vector<float> a_ind, int area_min_x, int area_min_y,
-    int area_length_x, int area_length_y, float tol
+int soil_simulator::DecomposeVectorTriangle(
+    const Vec3& ab_ind, const Vec3& ac_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace
 ) {
-    // Setiing up the outputs
-    std::vector<std::vector<float>> c_ab;
-    std::vector<std::vector<float>> c_ac;
-    std::vector<std::vector<bool>> in_triangle;
-    c_ab.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
-    c_ac.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
-    in_triangle.resize(area_length_x, std::vector<bool>(area_length_y, false));
+    // Setting up the outputs
+    int n_area = area_length_x * area_length_y;
+    auto& c_ab = workspace->c_ab_;
+    auto& c_ac = workspace->c_ac_;
+    auto& in_triangle = workspace->in_area_;
+    c_ab.assign(n_area, 0.0);
+    c_ac.assign(n_area, 0.0);
+    in_triangle.assign(n_area, 0);
 
     // Setting constants for decomposing the cell position into the reference
     // basis of the triangle
@@ -703,25 +1124,126 @@ soil_simulator::DecomposeVectorTriangle(
             // Calculating the indices corresponding to the simulation grid
             float ii = area_min_x + 0.5 + ii_s;
             float jj = area_min_y + 0.5 + jj_s;
+            int nn = ii_s * area_length_y + jj_s;
 
             // Decomposing the cell corner position into the basis formed
             // by the triangle
-            c_ab[ii_s][jj_s] = (
+            c_ab[nn] = (
                 c_ab_x * (ii - a_ind[0]) - c_ab_y * (jj - a_ind[1]));
-            c_ac[ii_s][jj_s] = (
+            c_ac[nn] = (
                 -c_ac_x * (ii - a_ind[0]) + c_ac_y * (jj - a_ind[1]));
 
-            if ((c_ab[ii_s][jj_s] > tol) && (c_ac[ii_s][jj_s] > tol) &&
-                (c_ab[ii_s][jj_s] + c_ac[ii_s][jj_s] < 1.0 - tol)) {
+            if ((c_ab[nn] > tol) && (c_ac[nn] > tol) &&
+                (c_ab[nn] + c_ac[nn] < 1.0 - tol)) {
                 // Cell is inside the triangle area
-                in_triangle[ii_s][jj_s] = true;
+                in_triangle[nn] = 1;
                 n_cell += 4;
             }
         }
 
+    return n_cell;
+}
+
+std::tuple<
+    std::vector<std::vector<float>>, std::vector<std::vector<float>>,
+    std::vector<std::vector<bool>>, int>
+soil_simulator::DecomposeVectorTriangle(
+    const std::vector<float>& ab_ind, const std::vector<float>& ac_ind,
+    const std::vector<float>& a_ind, int area_min_x, int area_min_y,
+    int area_length_x, int area_length_y, float tol
+) {
+    Workspace workspace;
+    int n_cell = soil_simulator::DecomposeVectorTriangle(
+        Vec3::FromVector(ab_ind), Vec3::FromVector(ac_ind),
+        Vec3::FromVector(a_ind), area_min_x, area_min_y, area_length_x,
+        area_length_y, tol, &workspace);
+
+    // Converting the outputs to nested vectors
+    std::vector<std::vector<float>> c_ab;
+    std::vector<std::vector<float>> c_ac;
+    std::vector<std::vector<bool>> in_triangle;
+    c_ab.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
+    c_ac.resize(area_length_x, std::vector<float>(area_length_y, 0.0));
+    in_triangle.resize(area_length_x, std::vector<bool>(area_length_y, false));
+    for (auto ii_s = 0; ii_s < area_length_x; ii_s++)
+        for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+            int nn = ii_s * area_length_y + jj_s;
+            c_ab[ii_s][jj_s] = workspace.c_ab_[nn];
+            c_ac[ii_s][jj_s] = workspace.c_ac_[nn];
+            in_triangle[ii_s][jj_s] = workspace.in_area_[nn];
+        }
+
     return {c_ab, c_ac, in_triangle, n_cell};
 }
 
+/// The vector decomposition is the same as in `DecomposeVectorTriangle`, but
+/// the height index of the triangle is calculated in the same pass, so that
+/// the decomposition itself does not need to be stored.
+///
+/// The decomposition is separated into a part depending only on the X index,
+/// calculated once per row, and a part depending only on the Y index,
+/// calculated once per column. The loop over a row is then free of any
+/// dependency between cells, so that it can be vectorized by the compiler,
+/// while giving the same results as `DecomposeVectorTriangle`.
+int soil_simulator::RasterizeTriangle(
+    const Vec3& ab_ind, const Vec3& ac_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace
+) {
+    // Setting up the outputs
+    int n_area = area_length_x * area_length_y;
+    auto& in_triangle = workspace->in_area_;
+    auto& height = workspace->area_height_;
+    in_triangle.resize(n_area);
+    height.resize(n_area);
+
+    // Setting constants for decomposing the cell position into the reference
+    // basis of the triangle
+    float c_ab_x = ac_ind[1] / (ab_ind[0] * ac_ind[1] - ab_ind[1] * ac_ind[0]);
+    float c_ab_y = ac_ind[0] / (ab_ind[0] * ac_ind[1] - ab_ind[1] * ac_ind[0]);
+    float c_ac_x = ab_ind[1] / (ab_ind[0] * ac_ind[1] - ab_ind[1] * ac_ind[0]);
+    float c_ac_y = ab_ind[0] / (ab_ind[0] * ac_ind[1] - ab_ind[1] * ac_ind[0]);
+
+    // Calculating the part of the decomposition depending on the Y index
+    auto& c_ab_col = workspace->c_ab_col_;
+    auto& c_ac_col = workspace->c_ac_col_;
+    c_ab_col.resize(area_length_y);
+    c_ac_col.resize(area_length_y);
+    for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+        float jj = area_min_y + 0.5 + jj_s;
+        c_ab_col[jj_s] = c_ab_y * (jj - a_ind[1]);
+        c_ac_col[jj_s] = c_ac_y * (jj - a_ind[1]);
+    }
+
+    // Iterating over the top right corner of all cells in the specified area
+    int n_cell = 0;
+    for (auto ii_s = 0; ii_s < area_length_x; ii_s++) {
+        // Calculating the part of the decomposition depending on the X index
+        float ii = area_min_x + 0.5 + ii_s;
+        float c_ab_row = c_ab_x * (ii - a_ind[0]);
+        float c_ac_row = -c_ac_x * (ii - a_ind[0]);
+        std::uint8_t* in_row = in_triangle.data() + ii_s * area_length_y;
+        int* height_row = height.data() + ii_s * area_length_y;
+
+        for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+            // Decomposing the cell corner position into the basis formed
+            // by the triangle
+            float c_ab = c_ab_row - c_ab_col[jj_s];
+            float c_ac = c_ac_row + c_ac_col[jj_s];
+            bool inside = (
+                (c_ab > tol) && (c_ac > tol) && (c_ab + c_ac < 1.0 - tol));
+
+            // Calculating the height index of the triangle at this corner
+            float h = a_ind[2] + c_ab * ab_ind[2] + c_ac * ac_ind[2];
+            in_row[jj_s] = inside;
+            height_row[jj_s] = inside ? static_cast<int>(std::ceil(h)) : 0;
+            n_cell += 4 * inside;
+        }
+    }
+
+    return n_cell;
+}
+
 /// The algorithm implemented in this function comes from the article:
 /// "A Fast Voxel Traversal Algorithm for Ray Tracing" by J. Amanatides and
 /// A. Woo.
@@ -735,8 +1257,9 @@ soil_simulator::DecomposeVectorTriangle(
 /// Note:
 /// When the line follows a cell border, the exact location of the line becomes
 /// ambiguous. It is assumed that the caller resolves this ambiguity.
-std::vector<std::vector<int>> soil_simulator::CalcLinePos(
-    std::vector<float> a, std::vector<float> b, Grid grid
+template <typename T>
+void soil_simulator::CalcLinePos(
+    const Vec3& a, const Vec3& b, const Grid& grid, T* line_pos
 ) {
     // Converting to indices
     float x1 = a[0] / grid.cell_size_xy_ + grid.half_length_x_;
@@ -805,13 +1328,11 @@ std::vector<std::vector<int>> soil_simulator::CalcLinePos(
     // Calculating norm of the vector AB
     float ab_norm = std::sqrt(dx * dx + dy * dy + dz * dz);
 
-    // Creating line_pos and adding the starting point
-    std::vector<std::vector<int>> line_pos;
-    line_pos.resize(1, std::vector<int>(3, 0));
-    line_pos[0] = std::vector<int> {
+    // Adding the starting point to line_pos
+    line_pos->push_back({
         static_cast<int>(round(x1)),
         static_cast<int>(round(y1)),
-        static_cast<int>(std::ceil(z1))};
+        static_cast<int>(std::ceil(z1))});
 
     // Iterating along the line until reaching the end
     while ((t_max_x < ab_norm) || (t_max_y < ab_norm) || (t_max_z < ab_norm)) {
@@ -832,11 +1353,24 @@ std::vector<std::vector<int>> soil_simulator::CalcLinePos(
                 t_max_z += t_delta_z;
             }
         }
-        line_pos.push_back(std::vector<int> {
+        line_pos->push_back({
             static_cast<int>(round(x1)),
             static_cast<int>(round(y1)),
             static_cast<int>(std::ceil(z1))});
     }
+}
+template void soil_simulator::CalcLinePos(
+    const Vec3& a, const Vec3& b, const Grid& grid, CellList<3>* line_pos);
+template void soil_simulator::CalcLinePos(
+    const Vec3& a, const Vec3& b, const Grid& grid, ColumnBuffer* line_pos);
+
+soil_simulator::CellList<3> soil_simulator::CalcLinePos(
+    const std::vector<float>& a, const std::vector<float>& b, const Grid& grid
+) {
+    CellList<3> line_pos;
+    soil_simulator::CalcLinePos(
+        Vec3::FromVector(a), Vec3::FromVector(b), grid, &line_pos);
+
     return line_pos;
 }
 
@@ -845,8 +1379,7 @@ std::vector<std::vector<int>> soil_simulator::CalcLinePos(
 /// height. As a result, this function must be called separately for each body
 /// wall and `area_pos` must be sorted.
 void soil_simulator::UpdateBody(
-    std::vector<std::vector<int>> area_pos, SimOut* sim_out, Grid grid,
-    float tol
+    const CellList<3>& area_pos, SimOut* sim_out, const Grid& grid, float tol
 ) {
     // Initializing cell position and height
     int ii = area_pos[0][0];
@@ -878,36 +1411,237 @@ void soil_simulator::UpdateBody(
     soil_simulator::IncludeNewBodyPos(sim_out, ii, jj, min_h, max_h, tol);
 }
 
+/// Contrary to the `CellList<3>` version, this function does not require any
+/// sorting, as the minimum and maximum height indices of each column are
+/// directly available. It must however also be called separately for each body
+/// wall.
+void soil_simulator::UpdateBody(
+    const ColumnBuffer& columns, SimOut* sim_out, const Grid& grid, float tol
+) {
+    columns.ForEachColumn([&](int ii, int jj, int kk_min, int kk_max) {
+        soil_simulator::IncludeNewBodyPos(
+            sim_out, ii, jj, grid.vect_z_[kk_min] - grid.cell_size_z_,
+            grid.vect_z_[kk_max], tol);
+    });
+}
+
+void soil_simulator::UpdateBody(
+    const ColumnBuffer& columns, BodyFootprint* footprint, const Grid& grid,
+    float tol
+) {
+    columns.ForEachColumn([&](int ii, int jj, int kk_min, int kk_max) {
+        soil_simulator::IncludeNewBodyPos(
+            footprint->Cell(ii, jj), grid.vect_z_[kk_min] - grid.cell_size_z_,
+            grid.vect_z_[kk_max], tol);
+    });
+}
+
+/// The columns around `body_area` are divided into tiles of
+/// `kSurfaceTileSize` x `kSurfaceTileSize` columns and each closed surface is
+/// assigned to the tiles overlapped by its bounding box, so that each tile
+/// only locates the surfaces that may cross it.
+///
+/// Within a tile, the height indices where each surface crosses each column
+/// are first collected. The overlapping crossings of a column are then
+/// merged, and the body occupies the space between the first and the second
+/// crossing, between the third and the fourth crossing, and so on, as a
+/// vertical line successively enters and exits a closed body. When the number
+/// of crossings is odd, which may happen when a surface is only grazing the
+/// column, the body occupies the whole space between the lowest and the
+/// highest crossing.
+///
+/// Note:
+/// - The surfaces that are not part of a closed body are ignored.
+template <typename T>
+void soil_simulator::UpdateClosedBody(
+    const std::vector<BodySurface>& surfaces, const int body_area[2][2],
+    const Grid& grid, float tol, T* body_pos, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Calculating the columns where the surfaces may be located
+    // This follows the convention of ResetSurfaceColumns
+    int area[2][2];
+    area[0][0] = std::max(body_area[0][0] - 1, 0);
+    area[0][1] = std::min(
+        body_area[0][1] + 1, 2 * grid.half_length_x_ + 1);
+    area[1][0] = std::max(body_area[1][0] - 1, 0);
+    area[1][1] = std::min(
+        body_area[1][1] + 1, 2 * grid.half_length_y_ + 1);
+    int n_tile_x = std::max(
+        (area[0][1] - area[0][0] + kSurfaceTileSize - 1) / kSurfaceTileSize, 0);
+    int n_tile_y = std::max(
+        (area[1][1] - area[1][0] + kSurfaceTileSize - 1) / kSurfaceTileSize, 0);
+
+    // Assigning each closed surface to the tiles overlapped by its bounding
+    // box, extended by one cell to be safe
+    auto& tile_surfaces = workspace->tile_surfaces_;
+    if (tile_surfaces.size() < n_tile_x * n_tile_y)
+        tile_surfaces.resize(n_tile_x * n_tile_y);
+    for (auto nn = 0; nn < n_tile_x * n_tile_y; nn++)
+        tile_surfaces[nn].clear();
+    for (auto nn = 0; nn < surfaces.size(); nn++) {
+        const auto& surface = surfaces[nn];
+        if (!surface.closed)
+            continue;
+
+        // Calculating the bounding box of the surface in indices
+        float x_min = std::min({surface.a[0], surface.b[0], surface.c[0]});
+        float x_max = std::max({surface.a[0], surface.b[0], surface.c[0]});
+        float y_min = std::min({surface.a[1], surface.b[1], surface.c[1]});
+        float y_max = std::max({surface.a[1], surface.b[1], surface.c[1]});
+        if (surface.rectangle) {
+            x_min = std::min(x_min, surface.d[0]);
+            x_max = std::max(x_max, surface.d[0]);
+            y_min = std::min(y_min, surface.d[1]);
+            y_max = std::max(y_max, surface.d[1]);
+        }
+        int ii_min = static_cast<int>(std::floor(
+            x_min / grid.cell_size_xy_ + grid.half_length_x_)) - 1;
+        int ii_max = static_cast<int>(std::ceil(
+            x_max / grid.cell_size_xy_ + grid.half_length_x_)) + 1;
+        int jj_min = static_cast<int>(std::floor(
+            y_min / grid.cell_size_xy_ + grid.half_length_y_)) - 1;
+        int jj_max = static_cast<int>(std::ceil(
+            y_max / grid.cell_size_xy_ + grid.half_length_y_)) + 1;
+
+        // Restricting the bounding box to the covered columns
+        ii_min = std::max(ii_min, area[0][0]);
+        ii_max = std::min(ii_max, area[0][1] - 1);
+        jj_min = std::max(jj_min, area[1][0]);
+        jj_max = std::min(jj_max, area[1][1] - 1);
+        if ((ii_min > ii_max) || (jj_min > jj_max))
+            continue;
+
+        for (auto tt_x = (ii_min - area[0][0]) / kSurfaceTileSize;
+            tt_x <= (ii_max - area[0][0]) / kSurfaceTileSize; tt_x++)
+            for (auto tt_y = (jj_min - area[1][0]) / kSurfaceTileSize;
+                tt_y <= (jj_max - area[1][0]) / kSurfaceTileSize; tt_y++)
+                tile_surfaces[tt_x * n_tile_y + tt_y].push_back(nn);
+    }
+
+    // Locating the closed body, one tile at a time
+    auto& columns = workspace->surface_columns_;
+    auto& hits = workspace->surface_hits_;
+    for (auto tt_x = 0; tt_x < n_tile_x; tt_x++)
+        for (auto tt_y = 0; tt_y < n_tile_y; tt_y++) {
+            const auto& tile = tile_surfaces[tt_x * n_tile_y + tt_y];
+            if (tile.empty())
+                continue;
+
+            // Collecting the crossings of all surfaces within the tile
+            int tile_area[2][2];
+            tile_area[0][0] = area[0][0] + tt_x * kSurfaceTileSize;
+            tile_area[0][1] = std::min(
+                tile_area[0][0] + kSurfaceTileSize, area[0][1]);
+            tile_area[1][0] = area[1][0] + tt_y * kSurfaceTileSize;
+            tile_area[1][1] = std::min(
+                tile_area[1][0] + kSurfaceTileSize, area[1][1]);
+            columns.Reset(tile_area);
+            hits.clear();
+            for (auto nn = 0; nn < tile.size(); nn++) {
+                soil_simulator::CalcSurfacePos(
+                    surfaces[tile[nn]], grid, tol, &columns, workspace);
+                columns.ForEachColumn(
+                    [&](int ii, int jj, int kk_min, int kk_max) {
+                        hits.push_back({ii, jj, kk_min, kk_max});
+                    });
+                columns.Clear();
+            }
+
+            // Sorting the crossings by column and by height
+            std::sort(hits.begin(), hits.end());
+
+            // Iterating over the columns of the tile
+            int start = 0;
+            while (start < hits.size()) {
+                int ii = hits[start][0];
+                int jj = hits[start][1];
+
+                // Merging the overlapping crossings of the column in place
+                int n_hit = 1;
+                int nn = start + 1;
+                while (
+                    (nn < hits.size()) && (hits[nn][0] == ii) &&
+                    (hits[nn][1] == jj)
+                ) {
+                    auto& last_hit = hits[start + n_hit - 1];
+                    if (hits[nn][2] <= last_hit[3] + 1) {
+                        // Crossing overlapping with the previous one
+                        last_hit[3] = std::max(last_hit[3], hits[nn][3]);
+                    } else {
+                        hits[start + n_hit] = hits[nn];
+                        n_hit++;
+                    }
+                    nn++;
+                }
+
+                // Updating the body position between entry and exit
+                auto include_body_pos = [&](int kk_min, int kk_max) {
+                    float min_h = grid.vect_z_[kk_min] - grid.cell_size_z_;
+                    float max_h = grid.vect_z_[kk_max];
+                    if constexpr (std::is_same_v<T, SimOut>)
+                        soil_simulator::IncludeNewBodyPos(
+                            body_pos, ii, jj, min_h, max_h, tol);
+                    else
+                        soil_simulator::IncludeNewBodyPos(
+                            body_pos->Cell(ii, jj), min_h, max_h, tol);
+                };
+                if (n_hit % 2 == 1) {
+                    // Ambiguous crossings, the whole column is occupied
+                    include_body_pos(
+                        hits[start][2], hits[start + n_hit - 1][3]);
+                } else {
+                    for (auto mm = start; mm < start + n_hit; mm += 2)
+                        include_body_pos(hits[mm][2], hits[mm + 1][3]);
+                }
+
+                start = nn;
+            }
+        }
+    columns.Clear();
+}
+template void soil_simulator::UpdateClosedBody(
+    const std::vector<BodySurface>& surfaces, const int body_area[2][2],
+    const Grid& grid, float tol, SimOut* body_pos, Workspace* workspace);
+template void soil_simulator::UpdateClosedBody(
+    const std::vector<BodySurface>& surfaces, const int body_area[2][2],
+    const Grid& grid, float tol, BodyFootprint* body_pos,
+    Workspace* workspace);
+
 /// The minimum and maximum heights of the body at that position are given by
 /// `min_h` and `max_h`, respectively.
 /// If the given position overlaps with an existing position, then the existing
 /// position is updated as the union of the two positions. Otherwise, a new
-/// position is added to `body_`.
+/// position is added to `body_cell`.
 void soil_simulator::IncludeNewBodyPos(
-    SimOut* sim_out, int ii, int jj, float min_h, float max_h, float tol
+    float* body_cell, float min_h, float max_h, float tol
 ) {
-    std::vector<int> status(2);
+    int status[2];
     // Iterating over the two body layers and storing their status
     for (auto nn = 0; nn < 2; nn++) {
         int ind = 2 * nn;
         if (
-            (sim_out->body_[ind][ii][jj] == 0.0) &&
-            (sim_out->body_[ind+1][ii][jj] == 0.0)) {
+            (body_cell[ind] == 0.0) &&
+            (body_cell[ind+1] == 0.0)) {
             // No existing position
             status[nn] = 0;
         } else if (
-            (min_h - tol < sim_out->body_[ind][ii][jj]) &&
-            (max_h + tol > sim_out->body_[ind][ii][jj])) {
+            (min_h - tol < body_cell[ind]) &&
+            (max_h + tol > body_cell[ind])) {
             // New position is overlapping with an existing position
             status[nn] = 1;
         } else if (
-            (min_h - tol < sim_out->body_[ind+1][ii][jj]) &&
-            (max_h + tol > sim_out->body_[ind+1][ii][jj])) {
+            (min_h - tol < body_cell[ind+1]) &&
+            (max_h + tol > body_cell[ind+1])) {
             // New position is overlapping with an existing position
             status[nn] = 1;
         } else if (
-            (min_h + tol > sim_out->body_[ind][ii][jj]) &&
-            (max_h - tol < sim_out->body_[ind+1][ii][jj])
+            (min_h + tol > body_cell[ind]) &&
+            (max_h - tol < body_cell[ind+1])
         ) {
             // New position is within an existing position
             return;
@@ -920,58 +1654,78 @@ void soil_simulator::IncludeNewBodyPos(
     // Updating the body position
     if ((status[0] == 1) && (status[1] == 1)) {
         // New position is overlapping with the two existing positions
-        sim_out->body_[0][ii][jj] = std::min(
-            {sim_out->body_[0][ii][jj], sim_out->body_[2][ii][jj], min_h});
-        sim_out->body_[1][ii][jj] = std::max(
-            {sim_out->body_[1][ii][jj], sim_out->body_[3][ii][jj], max_h});
+        body_cell[0] = std::min<float>(
+            {body_cell[0], body_cell[2], min_h});
+        body_cell[1] = std::max<float>(
+            {body_cell[1], body_cell[3], max_h});
 
         // Resetting obsolete body position
-        sim_out->body_[2][ii][jj] = 0.0;
-        sim_out->body_[3][ii][jj] = 0.0;
+        body_cell[2] = 0.0;
+        body_cell[3] = 0.0;
     } else if (status[0] == 1) {
         // New position is overlapping with an existing position
-        sim_out->body_[0][ii][jj] = std::min(sim_out->body_[0][ii][jj], min_h);
-        sim_out->body_[1][ii][jj] = std::max(sim_out->body_[1][ii][jj], max_h);
+        body_cell[0] = std::min<float>(
+            body_cell[0], min_h);
+        body_cell[1] = std::max<float>(
+            body_cell[1], max_h);
     } else if (status[1] == 1) {
         // New position is overlapping with an existing position
-        sim_out->body_[2][ii][jj] = std::min(sim_out->body_[2][ii][jj], min_h);
-        sim_out->body_[3][ii][jj] = std::max(sim_out->body_[3][ii][jj], max_h);
+        body_cell[2] = std::min<float>(
+            body_cell[2], min_h);
+        body_cell[3] = std::max<float>(
+            body_cell[3], max_h);
     } else if (status[0] == 0) {
         // No existing position
-        sim_out->body_[0][ii][jj] = min_h;
-        sim_out->body_[1][ii][jj] = max_h;
+        body_cell[0] = min_h;
+        body_cell[1] = max_h;
     } else if (status[1] == 0) {
         // No existing position
-        sim_out->body_[2][ii][jj] = min_h;
-        sim_out->body_[3][ii][jj] = max_h;
+        body_cell[2] = min_h;
+        body_cell[3] = max_h;
     } else {
         // New position is not overlapping with the two existing positions
         // This may be due to an edge case, in that case we try to fix the issue
         // Calculating distance to the two body layers
-        float dist_0b = std::abs(sim_out->body_[0][ii][jj] - max_h);
-        float dist_0t = std::abs(min_h - sim_out->body_[1][ii][jj]);
-        float dist_2b = std::abs(sim_out->body_[2][ii][jj] - max_h);
-        float dist_2t = std::abs(min_h - sim_out->body_[3][ii][jj]);
+        float dist_0b = std::abs(body_cell[0] - max_h);
+        float dist_0t = std::abs(min_h - body_cell[1]);
+        float dist_2b = std::abs(body_cell[2] - max_h);
+        float dist_2t = std::abs(min_h - body_cell[3]);
 
         // Checking what body layer is closer
         if (std::min(dist_0b, dist_0t) < std::min(dist_2b, dist_2t)) {
             // Merging with first body layer
             if (dist_0b < dist_0t) {
                 // Merging down
-                sim_out->body_[0][ii][jj] = min_h;
+                body_cell[0] = min_h;
             } else {
                 // Merging up
-                sim_out->body_[1][ii][jj] = max_h;
+                body_cell[1] = max_h;
             }
         } else {
             // Merging with second body layer
             if (dist_2b < dist_2t) {
                 // Merging down
-                sim_out->body_[2][ii][jj] = min_h;
+                body_cell[2] = min_h;
             } else {
                 // Merging up
-                sim_out->body_[3][ii][jj] = max_h;
+                body_cell[3] = max_h;
             }
         }
     }
 }
+
+void soil_simulator::IncludeNewBodyPos(
+    SimOut* sim_out, int ii, int jj, float min_h, float max_h, float tol
+) {
+    // Loading all body layers of the cell
+    float body_cell[4];
+    sim_out->body_.LoadCell(ii, jj, body_cell);
+
+    // Updating the body position
+    soil_simulator::IncludeNewBodyPos(body_cell, min_h, max_h, tol);
+
+    // Storing all body layers of the cell
+    for (auto ind = 0; ind < 4; ind++)
+        sim_out->body_[ind][ii][jj] = body_cell[ind];
+}
+
@@ -11,31 +11,172 @@ Copyright, 2023, Vilella Kenny.
 
 namespace soil_simulator {
 
-/// \brief This function determines all the cells where the bucket is located.
+/// \brief This function determines all the cells where the body is located.
 ///
 /// \param sim_out: Class that stores simulation outputs.
-/// \param pos: Cartesian coordinates of the bucket origin. [m]
-/// \param ori: Orientation of the bucket. [Quaternion]
+/// \param pos: Cartesian coordinates of the body origin. [m]
+/// \param ori: Orientation of the body. [Quaternion]
 /// \param grid: Class that stores information related to the simulation grid.
-/// \param bucket: Class that stores information related to the bucket object.
+/// \param body: Class that stores information related to the body object.
+///              It is either a `Bucket`, a `Blade`, a `MeshBody`, or a `Body`
+///              whose type is determined at runtime.
 /// \param sim_param: Class that stores information related to the simulation.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+template <typename T>
 void CalcBodyPos(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori, Grid grid,
-    Bucket* bucket, SimParam sim_param, float tol);
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, T* body,
+    const SimParam& sim_param, float tol, Workspace* workspace = nullptr);
 
-/// \brief This function determines all the cells where the blade is located.
+/// \brief This function determines all the cells where the body described by
+///        `surfaces` is located.
 ///
 /// \param sim_out: Class that stores simulation outputs.
+/// \param surfaces: Surfaces composing the body walls.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcBodyPos(
+    SimOut* sim_out, const std::vector<BodySurface>& surfaces,
+    const Grid& grid, const SimParam& sim_param, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief This function determines the footprint of the body described by
+///        `surfaces`, without modifying `body_`.
+///
+/// \param surfaces: Surfaces composing the body walls.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param body_area: Area where the body is located.
+/// \param footprint: Buffer storing the body position.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcBodyFootprint(
+    const std::vector<BodySurface>& surfaces, const Grid& grid,
+    const SimParam& sim_param, float tol, int body_area[2][2],
+    BodyFootprint* footprint, Workspace* workspace = nullptr);
+
+/// \brief This function calculates the area where the body described by
+///        `surfaces` is located.
+///
+/// \param surfaces: Surfaces composing the body walls.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param body_area: Area where the body is located.
+void CalcBodyArea(
+    const std::vector<BodySurface>& surfaces, const Grid& grid,
+    const SimParam& sim_param, int body_area[2][2]);
+
+/// \brief This function determines the cells where a body surface is located.
+///
+/// \param surface: Surface of the body wall.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param columns: Buffer storing the minimum and maximum height indices of
+///                 the surface for each column.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcSurfacePos(
+    const BodySurface& surface, const Grid& grid, float tol,
+    ColumnBuffer* columns, Workspace* workspace = nullptr);
+
+/// \brief This function lists the surfaces composing the walls of a body
+///        whose type is determined at runtime.
+///
+/// \param pos: Cartesian coordinates of the body origin. [m]
+/// \param ori: Orientation of the body. [Quaternion]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param surfaces: Surfaces composing the body walls.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Body* body, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace = nullptr);
+
+/// \brief This function lists the surfaces composing the bucket walls.
+///
+/// \param pos: Cartesian coordinates of the bucket origin. [m]
+/// \param ori: Orientation of the bucket. [Quaternion]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param bucket: Class that stores information related to the bucket object.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param surfaces: Surfaces composing the bucket walls.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Bucket* bucket, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace = nullptr);
+
+/// \brief This function lists the surfaces composing the blade walls.
+///
 /// \param pos: Cartesian coordinates of the blade origin. [m]
 /// \param ori: Orientation of the blade. [Quaternion]
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param blade: Class that stores information related to the blade object.
-/// \param sim_param: Class that stores information related to the simulation.
 /// \param tol: Small number used to handle numerical approximation errors.
-void CalcBodyPos(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori, Grid grid,
-    Blade* blade, SimParam sim_param, float tol);
+/// \param surfaces: Surfaces composing the blade walls.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Blade* blade, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace = nullptr);
+
+/// \brief This function lists the triangles of a mesh body that may be
+///        located inside the simulation grid, as the boundary of a closed
+///        body.
+///
+/// \param pos: Cartesian coordinates of the body origin. [m]
+/// \param ori: Orientation of the body. [Quaternion]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param mesh: Class that stores information related to the mesh body object.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param surfaces: Triangles of the body.
+/// \param workspace: Reusable buffers for temporary storage.
+void CalcBodySurfaces(
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, MeshBody* mesh, float tol,
+    std::vector<BodySurface>* surfaces, Workspace* workspace = nullptr);
+
+/// \brief This function prepares `columns` to receive the body surfaces
+///        located around `body_area`.
+///
+/// \param body_area: Area where the body is located.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param columns: Buffer storing the minimum and maximum height indices of
+///                 a body surface for each column.
+void ResetSurfaceColumns(
+    const int body_area[2][2], const Grid& grid, ColumnBuffer* columns);
+
+/// \brief This function prepares `footprint` to receive the new body
+///        position when it is updated incrementally.
+///
+/// \param body_area: Area where the body is located.
+/// \param body_area_prev: Area where the body was previously located.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param footprint: Buffer storing the new body position.
+void ResetBodyFootprint(
+    const int body_area[2][2], const int body_area_prev[2][2],
+    const Grid& grid, BodyFootprint* footprint);
+
+/// \brief This function writes into `body_` the columns of `footprint` where
+///        the body position has changed and lists them in
+///        `body_changed_cells_`.
+///
+/// \param footprint: Buffer storing the new body position.
+/// \param sim_out: Class that stores simulation outputs.
+void ApplyBodyFootprint(const BodyFootprint& footprint, SimOut* sim_out);
+
+/// \brief This function includes the body position stored in `footprint`
+///        into `body_`.
+///
+/// \param footprint: Buffer storing the body position.
+/// \param sim_out: Class that stores simulation outputs.
+/// \param tol: Small number used to handle numerical approximation errors.
+void IncludeBodyFootprint(
+    const BodyFootprint& footprint, SimOut* sim_out, float tol);
 
 /// \brief This function determines the cells where a rectangle surface is
 ///        located.
@@ -46,12 +187,24 @@ void CalcBodyPos(
 /// \param d: Cartesian coordinates of one vertex of the rectangle. [m]
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param rect_pos: Collection of cells indices to which the cells where the
+///                  rectangle is located are appended. Result is not sorted
+///                  and duplicates may be present. It is either a
+///                  `CellList<3>` or a `ColumnBuffer`.
+/// \param workspace: Reusable buffers for temporary storage.
+template <typename T>
+void CalcRectanglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& d,
+    const Grid& grid, float tol, T* rect_pos, Workspace* workspace);
+
+/// \brief Overload of `CalcRectanglePos` taking `std::vector` inputs.
 ///
 /// \return Collection of cells indices where the rectangle is located.
 ///         Result is not sorted and duplicates may be present.
-std::vector<std::vector<int>> CalcRectanglePos(
-    std::vector<float> a, std::vector<float> b, std::vector<float> c,
-    std::vector<float> d, Grid grid, float tol);
+CellList<3> CalcRectanglePos(
+    const std::vector<float>& a, const std::vector<float>& b,
+    const std::vector<float>& c, const std::vector<float>& d, const Grid& grid,
+    float tol);
 
 /// \brief This function performs a vector decomposition on a portion of the
 ///        horizontal plane where a rectangle ABCD is located.
@@ -66,6 +219,18 @@ std::vector<std::vector<int>> CalcRectanglePos(
 /// \param area_length_y: Number of grid elements in the Y direction of the
 ///                       specified area.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers where the vector decomposition in terms
+///                   of the AB and AD components, and whether each cell is
+///                   inside the rectangle area, are written. The buffers are
+///                   indexed by `ii_s * area_length_y + jj_s`.
+///
+/// \return Number of cells inside the rectangle area.
+int DecomposeVectorRectangle(
+    const Vec3& ab_ind, const Vec3& ad_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace);
+
+/// \brief Overload of `DecomposeVectorRectangle` taking `std::vector` inputs.
 ///
 /// \return A tuple composed of a vector of vector giving the vector
 ///         decomposition in terms of the AB component, a vector of vector
@@ -76,10 +241,34 @@ std::tuple<
     std::vector<std::vector<float>>, std::vector<std::vector<float>>,
     std::vector<std::vector<bool>>, int>
 DecomposeVectorRectangle(
-    std::vector<float> ab_ind, std::vector<float> ad_ind,
-    std::vector<float> a_ind, int area_min_x, int area_min_y,
+    const std::vector<float>& ab_ind, const std::vector<float>& ad_ind,
+    const std::vector<float>& a_ind, int area_min_x, int area_min_y,
     int area_length_x, int area_length_y, float tol);
 
+/// \brief This function determines the cells inside a rectangle ABCD and the
+///        height index of the rectangle at these cells in a single pass.
+///
+/// \param ab_ind: Indices representing the edge AB of the rectangle.
+/// \param ad_ind: Indices representing the edge AD of the rectangle.
+/// \param a_ind: Indices of the vertex A from which the edges AB and AD start.
+/// \param area_min_x: Minimum index in the X direction of the specified area.
+/// \param area_min_y: Minimum index in the Y direction of the specified area.
+/// \param area_length_x: Number of grid elements in the X direction of the
+///                       specified area.
+/// \param area_length_y: Number of grid elements in the Y direction of the
+///                       specified area.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers where whether each cell is inside the
+///                   rectangle area, and the height index of the rectangle,
+///                   are written. The buffers are indexed by
+///                   `ii_s * area_length_y + jj_s`.
+///
+/// \return Number of cells inside the rectangle area.
+int RasterizeRectangle(
+    const Vec3& ab_ind, const Vec3& ad_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace);
+
 /// \brief This function determines the cells where a triangle surface is
 ///        located.
 ///
@@ -88,12 +277,23 @@ DecomposeVectorRectangle(
 /// \param c: Cartesian coordinates of one vertex of the triangle. [m]
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param tri_pos: Collection of cells indices to which the cells where the
+///                 triangle is located are appended. Result is not sorted and
+///                 duplicates may be present. It is either a `CellList<3>` or
+///                 a `ColumnBuffer`.
+/// \param workspace: Reusable buffers for temporary storage.
+template <typename T>
+void CalcTrianglePos(
+    const Vec3& a, const Vec3& b, const Vec3& c, const Grid& grid, float tol,
+    T* tri_pos, Workspace* workspace);
+
+/// \brief Overload of `CalcTrianglePos` taking `std::vector` inputs.
 ///
 /// \return Collection of cells indices where the triangle is located.
 ///         Result is not sorted and duplicates may be present.
-std::vector<std::vector<int>> CalcTrianglePos(
-    std::vector<float> a, std::vector<float> b, std::vector<float> c,
-    Grid grid, float tol);
+CellList<3> CalcTrianglePos(
+    const std::vector<float>& a, const std::vector<float>& b,
+    const std::vector<float>& c, const Grid& grid, float tol);
 
 /// \brief This function performs a vector decomposition on a portion of the
 ///        horizontal plane where a tritangle ABC is located.
@@ -108,6 +308,18 @@ std::vector<std::vector<int>> CalcTrianglePos(
 /// \param area_length_y: Number of grid elements in the Y direction of the
 ///                       specified area.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers where the vector decomposition in terms
+///                   of the AB and AC components, and whether each cell is
+///                   inside the triangle area, are written. The buffers are
+///                   indexed by `ii_s * area_length_y + jj_s`.
+///
+/// \return Number of cells inside the triangle area.
+int DecomposeVectorTriangle(
+    const Vec3& ab_ind, const Vec3& ac_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace);
+
+/// \brief Overload of `DecomposeVectorTriangle` taking `std::vector` inputs.
 ///
 /// \return A tuple composed of a vector of vector giving the vector
 ///         decomposition in terms of the AB component, a vector of vector
@@ -118,20 +330,51 @@ std::tuple<
     std::vector<std::vector<float>>, std::vector<std::vector<float>>,
     std::vector<std::vector<bool>>, int>
 DecomposeVectorTriangle(
-    std::vector<float> ab_ind, std::vector<float> ac_ind,
-    std::vector<float> a_ind, int area_min_x, int area_min_y,
+    const std::vector<float>& ab_ind, const std::vector<float>& ac_ind,
+    const std::vector<float>& a_ind, int area_min_x, int area_min_y,
     int area_length_x, int area_length_y, float tol);
 
+/// \brief This function determines the cells inside a triangle ABC and the
+///        height index of the triangle at these cells in a single pass.
+///
+/// \param ab_ind: Indices representing the edge AB of the triangle.
+/// \param ac_ind: Indices representing the edge AC of the triangle.
+/// \param a_ind: Indices of the vertex A from which the edges AB and AC start.
+/// \param area_min_x: Minimum index in the X direction of the specified area.
+/// \param area_min_y: Minimum index in the Y direction of the specified area.
+/// \param area_length_x: Number of grid elements in the X direction of the
+///                       specified area.
+/// \param area_length_y: Number of grid elements in the Y direction of the
+///                       specified area.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers where whether each cell is inside the
+///                   triangle area, and the height index of the triangle, are
+///                   written. The buffers are indexed by
+///                   `ii_s * area_length_y + jj_s`.
+///
+/// \return Number of cells inside the triangle area.
+int RasterizeTriangle(
+    const Vec3& ab_ind, const Vec3& ac_ind, const Vec3& a_ind, int area_min_x,
+    int area_min_y, int area_length_x, int area_length_y, float tol,
+    Workspace* workspace);
+
 /// \brief This function determines all the cells that lie on a straight line
 ///        between two Cartesian coordinates.
 ///
 /// \param a: Cartesian coordinates of the first extremity of the line. [m]
 /// \param b: Cartesian coordinates of the second extremity of the line. [m]
 /// \param grid: Class that stores information related to the simulation grid.
+/// \param line_pos: Collection of cells indices to which the cells where the
+///                  line is located are appended. It is either a
+///                  `CellList<3>` or a `ColumnBuffer`.
+template <typename T>
+void CalcLinePos(const Vec3& a, const Vec3& b, const Grid& grid, T* line_pos);
+
+/// \brief Overload of `CalcLinePos` taking `std::vector` inputs.
 ///
 /// \return Collection of cells indices where the line is located.
-std::vector<std::vector<int>> CalcLinePos(
-    std::vector<float> a, std::vector<float> b, Grid grid);
+CellList<3> CalcLinePos(
+    const std::vector<float>& a, const std::vector<float>& b, const Grid& grid);
 
 /// \brief This function updates the body position in `body` following the
 ///        cells composing `area_pos`.
@@ -141,8 +384,43 @@ std::vector<std::vector<int>> CalcLinePos(
 /// \param sim_out: Class that stores simulation outputs.
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param tol: Small number used to handle numerical approximation errors.
-void UpdateBody(std::vector<std::vector<int>> area_pos, SimOut* sim_out,
-    Grid grid, float tol);
+void UpdateBody(
+    const CellList<3>& area_pos, SimOut* sim_out, const Grid& grid, float tol);
+
+/// \brief Overload of `UpdateBody` taking the minimum and maximum height
+///        indices of a body wall for each column.
+///
+/// \param columns: Minimum and maximum height indices of the body wall for
+///                 each column where it is located.
+void UpdateBody(
+    const ColumnBuffer& columns, SimOut* sim_out, const Grid& grid, float tol);
+
+/// \brief Overload of `UpdateBody` writing the body position into `footprint`
+///        instead of `body_`.
+///
+/// \param footprint: Buffer storing the new body position.
+void UpdateBody(
+    const ColumnBuffer& columns, BodyFootprint* footprint, const Grid& grid,
+    float tol);
+
+/// Number of columns in each direction of the tiles used to locate a closed
+/// body.
+constexpr int kSurfaceTileSize = 16;
+
+/// \brief This function updates the body position with the space enclosed
+///        by the surfaces of a closed body.
+///
+/// \param surfaces: Surfaces composing the body walls.
+/// \param body_area: Area where the body is located.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param body_pos: Either the class that stores simulation outputs or the
+///                  buffer storing the new body position.
+/// \param workspace: Reusable buffers for temporary storage.
+template <typename T>
+void UpdateClosedBody(
+    const std::vector<BodySurface>& surfaces, const int body_area[2][2],
+    const Grid& grid, float tol, T* body_pos, Workspace* workspace = nullptr);
 
 /// \brief This function updates the body position in `body` at the
 ///        coordinates (`ii`, `jj`).
@@ -156,4 +434,12 @@ void UpdateBody(std::vector<std::vector<int>> area_pos, SimOut* sim_out,
 void IncludeNewBodyPos(SimOut* sim_out, int ii, int jj, float min_h,
     float max_h, float tol);
 
+/// \brief Overload of `IncludeNewBodyPos` updating the four body layers of a
+///        single cell.
+///
+/// \param body_cell: Body layers of the considered cell, following the
+///                   convention of `body_`. [m]
+void IncludeNewBodyPos(
+    float* body_cell, float min_h, float max_h, float tol);
+
 }  // namespace soil_simulator
@@ -6,10 +6,14 @@ Copyright, 2023, Vilella Kenny.
 */
 #include <glog/logging.h>
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
+#include <span>
+#include <utility>
 #include <vector>
 #include "soil_simulator/body_soil.hpp"
+#include "soil_simulator/relax.hpp"
 #include "soil_simulator/types.hpp"
 #include "soil_simulator/utils.hpp"
 
@@ -33,11 +37,32 @@ Copyright, 2023, Vilella Kenny.
 /// `sim_out.body_soil_pos_` along with the required information using the
 /// `body_soil` struct.
 void soil_simulator::UpdateBodySoil(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori, Grid grid,
-    Body* body, float tol
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Body* body, float tol,
+    Workspace* workspace
 ) {
-    // Copying previous body_soil locations
-    auto old_body_soil_pos = sim_out->body_soil_pos_;
+    soil_simulator::UpdateBodySoil(
+        sim_out, {&pos, 1}, {&ori, 1}, grid, {&body, 1}, tol, workspace);
+}
+
+/// When several bodies are simulated, the soil is moved following the body on
+/// which it is resting, as indicated by the `body` member of `body_soil`. If
+/// the soil ends up resting on another body, its position is converted into
+/// the reference frame of this body.
+void soil_simulator::UpdateBodySoil(
+    SimOut* sim_out, std::span<const std::vector<float>> pos,
+    std::span<const std::vector<float>> ori, const Grid& grid,
+    std::span<Body* const> bodies, float tol, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Moving previous body_soil locations into the workspace
+    // Swapping keeps the memory of both vectors for the next steps
+    auto& old_body_soil_pos = workspace->body_soil_pos_;
+    std::swap(old_body_soil_pos, sim_out->body_soil_pos_);
 
     // Resetting body_soil
     for (auto nn = 0; nn < old_body_soil_pos.size(); nn++) {
@@ -49,8 +74,7 @@ void soil_simulator::UpdateBodySoil(
     }
 
     // Resetting body_soil_pos
-    sim_out->body_soil_pos_.erase(
-        sim_out->body_soil_pos_.begin(), sim_out->body_soil_pos_.end());
+    sim_out->body_soil_pos_.clear();
 
     // Iterating over all XY positions where body_soil is present
     float min_cell_height_diff = grid.cell_size_z_ + tol;
@@ -61,49 +85,76 @@ void soil_simulator::UpdateBodySoil(
         float y_b = old_body_soil_pos[nn].y_b;
         float z_b = old_body_soil_pos[nn].z_b;
         float h_soil = old_body_soil_pos[nn].h_soil;
+        int body_ind = old_body_soil_pos[nn].body;
+        if (body_ind >= bodies.size())
+            body_ind = 0;
+
+        // Converting the new and former pose of the body
+        auto new_pos = Vec3::FromVector(pos[body_ind]);
+        auto new_ori = Quat::FromVector(ori[body_ind]);
+        auto old_pos = Vec3::FromVector(bodies[body_ind]->pos_);
+        auto old_ori = Quat::FromVector(bodies[body_ind]->ori_);
+
+        // Removing the soil from the soil volume ledger
+        // It is added back once the soil has been moved
+        sim_out->body_soil_volume_ -= h_soil;
 
         if (h_soil < 0.9 * grid.cell_size_z_) {
             // No soil to be moved
             // 0.9 has been chosen arbitrarily to account for potential
             // numerical errors, another value could be used
+            sim_out->lost_volume_ += h_soil;
             continue;
         }
 
         // Converting h_soil to a multiple of cell_size_z to deal with
         // accumulating floating errors
+        sim_out->lost_volume_ += h_soil;
         h_soil = grid.cell_size_z_ * round(h_soil / grid.cell_size_z_);
+        sim_out->lost_volume_ -= h_soil;
 
-        // Calculating new cell position
-        std::vector<float> cell_pos = {x_b, y_b, z_b};
+        // Calculating new cell position in global frame
+        Vec3 cell_pos = {x_b, y_b, z_b};
         auto new_cell_pos = soil_simulator::CalcRotationQuaternion(
-            ori, cell_pos);
+            new_ori, cell_pos) + new_pos;
         auto old_cell_pos = soil_simulator::CalcRotationQuaternion(
-            body->ori_, cell_pos);
+            old_ori, cell_pos) + old_pos;
 
-        // Calculating new cell position in global frame
-        new_cell_pos[0] += pos[0];
-        new_cell_pos[1] += pos[1];
-        new_cell_pos[2] += pos[2];
-        old_cell_pos[0] += body->pos_[0];
-        old_cell_pos[1] += body->pos_[1];
-        old_cell_pos[2] += body->pos_[2];
+        // Function adding the new body soil position to body_soil_pos
+        // The position is converted into the frame of the body on which the
+        // soil is now resting when it differs from the original body
+        auto add_body_soil = [&](int ind, int ii_t, int jj_t) {
+            int body_ind_t = body_ind;
+            Vec3 cell_pos_t = cell_pos;
+            if (bodies.size() > 1)
+                body_ind_t = soil_simulator::FindBody(
+                    sim_out, ii_t, jj_t, ind);
+            if (body_ind_t != body_ind) {
+                auto inv_ori = Quat::FromVector(ori[body_ind_t]).Conjugate();
+                cell_pos_t = soil_simulator::CalcRotationQuaternion(
+                    inv_ori, new_cell_pos - Vec3::FromVector(pos[body_ind_t]));
+            }
+            sim_out->body_soil_pos_.push_back(soil_simulator::body_soil
+                {ind, ii_t, jj_t, cell_pos_t[0], cell_pos_t[1], cell_pos_t[2],
+                h_soil, body_ind_t});
+        };
 
         // Establishing order of exploration
-        std::vector<std::vector<int>> directions;
+        std::array<std::array<int, 2>, 9> directions;
         float dx = new_cell_pos[0] - old_cell_pos[0];
         float dy = new_cell_pos[1] - old_cell_pos[1];
         int sx = copysign(1, dx);
         int sy = copysign(1, dy);
         if (std::abs(dx) > std::abs(dy)) {
             // Main direction follows X
-            directions = {
+            directions = {{
                 {0, 0}, {sx, 0}, {sx, sy}, {0, sy}, {sx, -sy},
-                {0, -sy}, {-sx, sy}, {-sx, 0}, {-sx, -sy}};
+                {0, -sy}, {-sx, sy}, {-sx, 0}, {-sx, -sy}}};
         } else {
             // Main direction follows Y
-            directions = {
+            directions = {{
                 {0, 0}, {0, sy}, {sx, sy}, {sx, 0}, {-sx, sy},
-                {-sx, 0}, {sx, -sy}, {0, -sy}, {-sx, -sy}};
+                {-sx, 0}, {sx, -sy}, {0, -sy}, {-sx, -sy}}};
         }
 
         // Calculating new cell indices
@@ -125,30 +176,30 @@ void soil_simulator::UpdateBodySoil(
             int ii_t = ii_n + directions[xy][0];
             int jj_t = jj_n + directions[xy][1];
 
+            // Loading all body layers of the cell
+            float body_cell[4];
+            sim_out->body_.LoadCell(ii_t, jj_t, body_cell);
+
             // Detecting presence of body
             bool body_presence_1 = (
-                (sim_out->body_[0][ii_t][jj_t] != 0.0) ||
-                (sim_out->body_[1][ii_t][jj_t] != 0.0));
+                (body_cell[0] != 0.0) || (body_cell[1] != 0.0));
             bool body_presence_3 = (
-                (sim_out->body_[2][ii_t][jj_t] != 0.0) ||
-                (sim_out->body_[3][ii_t][jj_t] != 0.0));
+                (body_cell[2] != 0.0) || (body_cell[3] != 0.0));
 
             if (body_presence_1) {
                 // First body layer is present
-                float dist = (
-                    std::abs(new_cell_pos[2] - sim_out->body_[1][ii_t][jj_t]));
+                float dist = std::abs(new_cell_pos[2] - body_cell[1]);
                 if (dist < min_cell_height_diff) {
                     // Moving body_soil to new location, this implementation
                     // works regardless of the presence of body_soil
                     sim_out->body_soil_[1][ii_t][jj_t] += (
-                        sim_out->body_[1][ii_t][jj_t] -
+                        body_cell[1] -
                         sim_out->body_soil_[0][ii_t][jj_t] + h_soil);
-                    sim_out->body_soil_[0][ii_t][jj_t] = (
-                        sim_out->body_[1][ii_t][jj_t]);
+                    sim_out->body_soil_[0][ii_t][jj_t] = body_cell[1];
 
                     // Adding position to body_soil_pos
-                    sim_out->body_soil_pos_.push_back(soil_simulator::body_soil
-                        {0, ii_t, jj_t, x_b, y_b, z_b, h_soil});
+                    add_body_soil(0, ii_t, jj_t);
+                    sim_out->body_soil_volume_ += h_soil;
                     soil_moved = true;
                     break;
                 } else if (dist < dist_s) {
@@ -161,20 +212,18 @@ void soil_simulator::UpdateBodySoil(
             }
             if (body_presence_3) {
                 // Second body layer is present
-                float dist = (
-                    std::abs(new_cell_pos[2] - sim_out->body_[3][ii_t][jj_t]));
+                float dist = std::abs(new_cell_pos[2] - body_cell[3]);
                 if (dist < min_cell_height_diff) {
                     // Moving body_soil to new location, this implementation
                     // works regardless of the presence of body_soil
                     sim_out->body_soil_[3][ii_t][jj_t] += (
-                        sim_out->body_[3][ii_t][jj_t] -
+                        body_cell[3] -
                         sim_out->body_soil_[2][ii_t][jj_t] + h_soil);
-                    sim_out->body_soil_[2][ii_t][jj_t] = (
-                        sim_out->body_[3][ii_t][jj_t]);
+                    sim_out->body_soil_[2][ii_t][jj_t] = body_cell[3];
 
                     // Adding position to body_soil_pos
-                    sim_out->body_soil_pos_.push_back(soil_simulator::body_soil
-                         {2, ii_t, jj_t, x_b, y_b, z_b, h_soil});
+                    add_body_soil(2, ii_t, jj_t);
+                    sim_out->body_soil_volume_ += h_soil;
                     soil_moved = true;
                     break;
                 } else if (dist < dist_s) {
@@ -198,12 +247,14 @@ void soil_simulator::UpdateBodySoil(
                     sim_out->body_[ind_s][ii_s][jj_s]);
 
                 // Adding position to body_soil_pos
-                sim_out->body_soil_pos_.push_back(soil_simulator::body_soil
-                     {ind_s-1, ii_s, jj_s, x_b, y_b, z_b, h_soil});
+                add_body_soil(ind_s-1, ii_s, jj_s);
+                sim_out->body_soil_volume_ += h_soil;
             } else {
                 // This should normally not happen, it is only for safety
                 // Moving body_soil to terrain
                 sim_out->terrain_[ii_n][jj_n] += h_soil;
+                MarkDirtyCell(sim_out, ii_n, jj_n);
+                sim_out->terrain_volume_ += h_soil;
                 LOG(WARNING) << "WARNING\nBody soil could not be updated.\n"
                     "Soil is moved to the terrain to maintain mass "
                     "conservation.";
@@ -212,6 +263,44 @@ void soil_simulator::UpdateBodySoil(
     }
 
     // Updating new body position
-    body->pos_ = pos;
-    body->ori_ = ori;
+    for (auto nn = 0; nn < bodies.size(); nn++) {
+        bodies[nn]->pos_ = pos[nn];
+        bodies[nn]->ori_ = ori[nn];
+    }
+}
+
+/// The position of the soil resting on the body is converted from the frame
+/// of the body indicated by the `body` member of `body_soil` into the frame
+/// of the body on which the soil is actually resting. It is required as the
+/// functions moving the soil onto the body only use the first body.
+void soil_simulator::UpdateBodySoilOwner(SimOut* sim_out) {
+    if (sim_out->bodies_.size() <= 1)
+        return;
+
+    for (auto nn = 0; nn < sim_out->body_soil_pos_.size(); nn++) {
+        auto& cell = sim_out->body_soil_pos_[nn];
+        if (cell.body >= sim_out->bodies_.size())
+            cell.body = 0;
+        int body_ind = soil_simulator::FindBody(
+            sim_out, cell.ii, cell.jj, cell.ind);
+        if (body_ind == cell.body)
+            continue;
+
+        // Calculating the cell position in global frame
+        Body* body = sim_out->bodies_[cell.body];
+        Vec3 cell_pos = {cell.x_b, cell.y_b, cell.z_b};
+        cell_pos = soil_simulator::CalcRotationQuaternion(
+            Quat::FromVector(body->ori_), cell_pos) +
+            Vec3::FromVector(body->pos_);
+
+        // Calculating the cell position in the frame of the new body
+        body = sim_out->bodies_[body_ind];
+        cell_pos = soil_simulator::CalcRotationQuaternion(
+            Quat::FromVector(body->ori_).Conjugate(),
+            cell_pos - Vec3::FromVector(body->pos_));
+        cell.x_b = cell_pos[0];
+        cell.y_b = cell_pos[1];
+        cell.z_b = cell_pos[2];
+        cell.body = body_ind;
+    }
 }
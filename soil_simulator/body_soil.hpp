@@ -6,6 +6,7 @@ Copyright, 2023, Vilella Kenny.
 */
 #pragma once
 
+#include <span>
 #include <vector>
 #include "soil_simulator/types.hpp"
 
@@ -20,8 +21,31 @@ namespace soil_simulator {
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param body: Class that stores information related to the body object.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
 void UpdateBodySoil(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori, Grid grid,
-    Body* body, float tol);
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Body* body, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief Overload of `UpdateBodySoil` moving the soil resting on several
+///        bodies following their movement.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param pos: Cartesian coordinates of the origin of each body. [m]
+/// \param ori: Orientation of each body. [Quaternion]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param bodies: Classes that store information related to the bodies.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void UpdateBodySoil(
+    SimOut* sim_out, std::span<const std::vector<float>> pos,
+    std::span<const std::vector<float>> ori, const Grid& grid,
+    std::span<Body* const> bodies, float tol, Workspace* workspace = nullptr);
+
+/// \brief This function assigns the soil resting on the body to the body on
+///        which it is actually resting when several bodies are simulated.
+///
+/// \param sim_out: Class that stores simulation outputs.
+void UpdateBodySoilOwner(SimOut* sim_out);
 
 }  // namespace soil_simulator
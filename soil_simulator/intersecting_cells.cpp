@@ -5,6 +5,7 @@ Copyright, 2023, Vilella Kenny.
 */
 #include <glog/logging.h>
 #include <algorithm>
+#include <array>
 #include <iostream>
 #include <random>
 #include <tuple>
@@ -12,18 +13,21 @@ Copyright, 2023, Vilella Kenny.
 #include <vector>
 #include "soil_simulator/types.hpp"
 #include "soil_simulator/intersecting_cells.hpp"
+#include "soil_simulator/relax.hpp"
 #include "soil_simulator/utils.hpp"
 
 /// Note that `MoveIntersectingBodySoil` must be called before
 /// `MoveIntersectingBody`, otherwise some intersecting soil cells may remain.
 void soil_simulator::MoveIntersectingCells(
-    SimOut* sim_out, Grid grid, Body* body, float tol
+    SimOut* sim_out, const Grid& grid, Body* body, float tol,
+    Workspace* workspace
 ) {
     // Moving body soil intersecting with the body
-    soil_simulator::MoveIntersectingBodySoil(sim_out, grid, body, tol);
+    soil_simulator::MoveIntersectingBodySoil(
+        sim_out, grid, body, tol, workspace);
 
     // Moving terrain intersecting with the body
-    soil_simulator::MoveIntersectingBody(sim_out, tol);
+    soil_simulator::MoveIntersectingBody(sim_out, tol, workspace);
 }
 
 /// This function checks the eight lateral directions surrounding the
@@ -46,12 +50,19 @@ void soil_simulator::MoveIntersectingCells(
 /// Note that the order in which the directions are checked is randomized in
 /// order to avoid asymmetrical results.
 void soil_simulator::MoveIntersectingBodySoil(
-    SimOut* sim_out, Grid grid, Body* body, float tol
+    SimOut* sim_out, const Grid& grid, Body* body, float tol,
+    Workspace* workspace
 ) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
     // Storing all possible directions
-    std::vector<std::vector<int>> directions = {
+    const std::array<std::array<int, 2>, 8> directions_init = {{
         {1, 0}, {-1, 0}, {0, 1}, {0, -1},
-        {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+        {1, 1}, {1, -1}, {-1, 1}, {-1, -1}}};
+    auto directions = directions_init;
 
     // Iterating over body soil cells
     for (auto nn = 0; nn < sim_out->body_soil_pos_.size(); nn++) {
@@ -103,12 +114,19 @@ void soil_simulator::MoveIntersectingBodySoil(
         sim_out->body_soil_[ind+1][ii][jj] -= h_soil;
 
         // Randomizing direction to avoid asymmetry
-        // random_suffle is not used because it is machine dependent,
-        // which makes unit testing difficult
-        for (int aa = directions.size() - 1; aa > 0; aa--) {
-            std::uniform_int_distribution<int> dist(0, aa);
-            int bb = dist(rng);
-            std::swap(directions[aa], directions[bb]);
+        if (workspace->rng_ != nullptr) {
+            // Drawing the directions from the counter of the cell
+            directions = CounterRng::Permute(
+                directions_init, workspace->rng_->Draw(
+                RandomSite::kMoveIntersectingBodySoil, ii, jj, ind));
+        } else {
+            // random_suffle is not used because it is machine dependent,
+            // which makes unit testing difficult
+            for (int aa = directions.size() - 1; aa > 0; aa--) {
+                std::uniform_int_distribution<int> dist(0, aa);
+                int bb = dist(rng);
+                std::swap(directions[aa], directions[bb]);
+            }
         }
 
         // Iterating over the eight lateral directions
@@ -157,6 +175,10 @@ void soil_simulator::MoveIntersectingBodySoil(
                 "layer could be moved.\nThe extra soil has been arbitrarily "
                 "removed.";
         }
+
+        // Updating the soil volume ledger with the soil left to be moved
+        sim_out->body_soil_volume_ -= h_soil;
+        sim_out->lost_volume_ += h_soil;
     }
 }
 
@@ -174,27 +196,35 @@ void soil_simulator::MoveIntersectingBodySoil(
 ///
 /// Note that the order in which the directions are checked is randomized in
 /// order to avoid asymmetrical results.
-void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
+void soil_simulator::MoveIntersectingBody(
+    SimOut* sim_out, float tol, Workspace* workspace
 ) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
     // Locating soil cells intersecting with the body
-    auto intersecting_cells = soil_simulator::LocateIntersectingCells(
-        sim_out, tol);
+    auto& intersecting_cells = workspace->intersecting_cells_;
+    soil_simulator::LocateIntersectingCells(
+        sim_out, tol, &intersecting_cells, workspace->body_changed_cells_);
 
-    if (intersecting_cells.size() == 0) {
+    if (intersecting_cells.Count() == 0) {
         // No intersecting cells
         return;
     }
 
     // Storing all possible directions
-    std::vector<std::vector<int>> directions = {
+    const std::array<std::array<int, 2>, 8> directions_init = {{
         {1, 0}, {-1, 0}, {0, 1}, {0, -1},
-        {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+        {1, 1}, {1, -1}, {-1, 1}, {-1, -1}}};
+    auto directions = directions_init;
 
     // Iterating over intersecting cells
-    for (auto nn = 0; nn < intersecting_cells.size(); nn++) {
-        int ind = intersecting_cells[nn][0];
-        int ii = intersecting_cells[nn][1];
-        int jj = intersecting_cells[nn][2];
+    for (auto cell : intersecting_cells) {
+        int ind = 2 * (cell[1] % 2);
+        int ii = cell[0];
+        int jj = cell[1] / 2;
 
         if (sim_out->terrain_[ii][jj] - tol < sim_out->body_[ind][ii][jj]) {
             // Intersecting soil column has already been moved
@@ -202,12 +232,19 @@ void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
         }
 
         // Randomizing direction to avoid asymmetry
-        // random_suffle is not used because it is machine dependent,
-        // which makes unit testing difficult
-        for (int aa = directions.size() - 1; aa > 0; aa--) {
-            std::uniform_int_distribution<int> dist(0, aa);
-            int bb = dist(rng);
-            std::swap(directions[aa], directions[bb]);
+        if (workspace->rng_ != nullptr) {
+            // Drawing the directions from the counter of the cell
+            directions = CounterRng::Permute(
+                directions_init, workspace->rng_->Draw(
+                RandomSite::kMoveIntersectingBody, ii, jj, ind));
+        } else {
+            // random_suffle is not used because it is machine dependent,
+            // which makes unit testing difficult
+            for (int aa = directions.size() - 1; aa > 0; aa--) {
+                std::uniform_int_distribution<int> dist(0, aa);
+                int bb = dist(rng);
+                std::swap(directions[aa], directions[bb]);
+            }
         }
 
         // Calculating vertical extension of intersecting soil column
@@ -223,17 +260,20 @@ void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
                 int ii_p = ii + directions[xy][0] * pp;
                 int jj_p = jj + directions[xy][1] * pp;
 
+                // Loading all body layers of the cell
+                float body_cell[4];
+                sim_out->body_.LoadCell(ii_p, jj_p, body_cell);
+
                 // Determining presence of body
                 bool body_absence_1 = (
-                    (sim_out->body_[0][ii_p][jj_p] == 0.0) &&
-                    (sim_out->body_[1][ii_p][jj_p] == 0.0));
+                    (body_cell[0] == 0.0) && (body_cell[1] == 0.0));
                 bool body_absence_3 = (
-                    (sim_out->body_[2][ii_p][jj_p] == 0.0) &&
-                    (sim_out->body_[3][ii_p][jj_p] == 0.0));
+                    (body_cell[2] == 0.0) && (body_cell[3] == 0.0));
 
                 if (body_absence_1 && body_absence_3) {
                     // No body
                     sim_out->terrain_[ii_p][jj_p] += h_soil;
+                    MarkDirtyCell(sim_out, ii_p, jj_p);
                     h_soil = 0.0;
                     break;
                 } else {
@@ -241,13 +281,11 @@ void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
                     // Calculating minimum height of body
                     float body_bot;
                     if (body_absence_1)
-                        body_bot = sim_out->body_[2][ii_p][jj_p];
+                        body_bot = body_cell[2];
                     else if (body_absence_3)
-                        body_bot = sim_out->body_[0][ii_p][jj_p];
+                        body_bot = body_cell[0];
                     else
-                        body_bot = std::min(
-                            sim_out->body_[0][ii_p][jj_p],
-                            sim_out->body_[2][ii_p][jj_p]);
+                        body_bot = std::min(body_cell[0], body_cell[2]);
 
                     if (sim_out->terrain_[ii_p][jj_p] + tol < body_bot) {
                         // Space under the body
@@ -258,10 +296,12 @@ void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
                         if (delta_h < h_soil) {
                             // Not enough space
                             sim_out->terrain_[ii_p][jj_p] = body_bot;
+                            MarkDirtyCell(sim_out, ii_p, jj_p);
                             h_soil -= delta_h;
                         } else {
                             // More space than soil
                             sim_out->terrain_[ii_p][jj_p] += h_soil;
+                            MarkDirtyCell(sim_out, ii_p, jj_p);
                             h_soil = 0.0;
                             break;
                         }
@@ -272,6 +312,11 @@ void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
 
         // Removing intersecting soil
         sim_out->terrain_[ii][jj] = sim_out->body_[ind][ii][jj];
+        MarkDirtyCell(sim_out, ii, jj);
+
+        // Updating the soil volume ledger with the soil left to be moved
+        sim_out->terrain_volume_ -= h_soil;
+        sim_out->lost_volume_ += h_soil;
     }
 }
 
@@ -295,7 +340,7 @@ void soil_simulator::MoveIntersectingBody(SimOut* sim_out, float tol
 /// intersecting soil cells, it will be resolved by `MoveIntersectingBody`.
 std::tuple<int, int, int, float, bool> soil_simulator::MoveBodySoil(
     SimOut* sim_out, int ind_p, int ii_p, int jj_p, float max_h, int ii_n,
-    int jj_n, float h_soil, bool wall_presence, Grid grid, Body* body,
+    int jj_n, float h_soil, bool wall_presence, const Grid& grid, Body* body,
     float tol
 ) {
     // Determining presence of body
@@ -309,6 +354,9 @@ std::tuple<int, int, int, float, bool> soil_simulator::MoveBodySoil(
     if (body_absence_1 && body_absence_3) {
         // No body
         sim_out->terrain_[ii_n][jj_n] += h_soil;
+        MarkDirtyCell(sim_out, ii_n, jj_n);
+        sim_out->terrain_volume_ += h_soil;
+        sim_out->body_soil_volume_ -= h_soil;
         return {ind_p, ii_p, jj_p, 0.0, wall_presence};
     } else if (body_absence_1) {
         // Only the second body layer
@@ -321,6 +369,9 @@ std::tuple<int, int, int, float, bool> soil_simulator::MoveBodySoil(
             // soil would intersect with the body and later be moved by
             // the MoveIntersectingBody function
             sim_out->terrain_[ii_n][jj_n] += h_soil;
+            MarkDirtyCell(sim_out, ii_n, jj_n);
+            sim_out->terrain_volume_ += h_soil;
+            sim_out->body_soil_volume_ -= h_soil;
             return {ind_p, ii_p, jj_p, 0.0, wall_presence};
         } else if (sim_out->body_[3][ii_n][jj_n] + tol > max_h) {
             // Body is blocking the movement
@@ -363,6 +414,9 @@ std::tuple<int, int, int, float, bool> soil_simulator::MoveBodySoil(
             // soil would intersect with the body and later be moved by the
             // MoveIntersectingBody function
             sim_out->terrain_[ii_n][jj_n] += h_soil;
+            MarkDirtyCell(sim_out, ii_n, jj_n);
+            sim_out->terrain_volume_ += h_soil;
+            sim_out->body_soil_volume_ -= h_soil;
             return {ind_p, ii_p, jj_p, 0.0, wall_presence};
         } else if (sim_out->body_[1][ii_n][jj_n] + tol > max_h) {
             // Body is blocking the movement
@@ -507,11 +561,70 @@ std::tuple<int, int, int, float, bool> soil_simulator::MoveBodySoil(
     return {ind_p, ii_p, jj_p, h_soil, wall_presence};
 }
 
-std::vector<std::vector<int>> soil_simulator::LocateIntersectingCells(
-    SimOut* sim_out, float tol
+void soil_simulator::LocateIntersectingCells(
+    SimOut* sim_out, float tol, CellList<3>* intersecting_cells
+) {
+    // Locating the intersecting cells
+    CellBitmap intersecting_bitmap;
+    LocateIntersectingCells(sim_out, tol, &intersecting_bitmap);
+
+    // Converting the bitmap into cells indices
+    intersecting_cells->clear();
+    for (auto cell : intersecting_bitmap)
+        intersecting_cells->push_back(
+            {2 * (cell[1] % 2), cell[0], cell[1] / 2});
+}
+
+void soil_simulator::LocateIntersectingCells(
+    SimOut* sim_out, float tol, CellBitmap* intersecting_cells,
+    const CellList<2>* cells
 ) {
     // Initializing
-    std::vector<std::vector<int>> intersecting_cells;
+    int area[2][2] = {
+        {sim_out->body_area_[0][0], sim_out->body_area_[0][1]},
+        {2 * sim_out->body_area_[1][0], 2 * sim_out->body_area_[1][1]}};
+    intersecting_cells->Reset(area);
+
+    // Checking whether the soil intersects with the body at (ii, jj)
+    auto check_cell = [&](int ii, int jj) {
+        if (
+           ((sim_out->body_[0][ii][jj] != 0.0) ||
+           (sim_out->body_[1][ii][jj] != 0.0)) &&
+           (sim_out->terrain_[ii][jj] - tol > sim_out->body_[0][ii][jj])) {
+            // Soil intersecting with the body
+            intersecting_cells->Set(ii, 2 * jj);
+        }
+        if (
+           ((sim_out->body_[2][ii][jj] != 0.0) ||
+           (sim_out->body_[3][ii][jj] != 0.0)) &&
+            (sim_out->terrain_[ii][jj] - tol > sim_out->body_[2][ii][jj])) {
+            // Soil intersecting with the body
+            intersecting_cells->Set(ii, 2 * jj + 1);
+        }
+    };
+
+    if (cells != nullptr) {
+        // Iterating over the provided cells located in body_area
+        auto check_cells = [&](const CellList<2>& cell_list) {
+            for (auto nn = 0; nn < cell_list.size(); nn++) {
+                int ii = cell_list[nn][0];
+                int jj = cell_list[nn][1];
+                if (
+                    (ii >= sim_out->body_area_[0][0]) &&
+                    (ii < sim_out->body_area_[0][1]) &&
+                    (jj >= sim_out->body_area_[1][0]) &&
+                    (jj < sim_out->body_area_[1][1]))
+                    check_cell(ii, jj);
+            }
+        };
+        check_cells(*cells);
+
+        // Iterating over the cells modified since the last relaxation
+        // Soil may have been moved under a body wall that did not change,
+        // for instance by the body soil update
+        check_cells(sim_out->dirty_cells_);
+        return;
+    }
 
     // Iterating over all body position
     for (auto ii = sim_out->body_area_[0][0];
@@ -519,22 +632,16 @@ std::vector<std::vector<int>> soil_simulator::LocateIntersectingCells(
     )
         for (auto jj = sim_out->body_area_[1][0];
             jj < sim_out->body_area_[1][1]; jj++
-        ) {
-            if (
-               ((sim_out->body_[0][ii][jj] != 0.0) ||
-               (sim_out->body_[1][ii][jj] != 0.0)) &&
-               (sim_out->terrain_[ii][jj] - tol > sim_out->body_[0][ii][jj])) {
-                // Soil intersecting with the body
-                intersecting_cells.push_back(std::vector<int> {0, ii, jj});
-            }
-            if (
-               ((sim_out->body_[2][ii][jj] != 0.0) ||
-               (sim_out->body_[3][ii][jj] != 0.0)) &&
-                (sim_out->terrain_[ii][jj] - tol > sim_out->body_[2][ii][jj])) {
-                // Soil intersecting with the body
-                intersecting_cells.push_back(std::vector<int> {2, ii, jj});
-            }
-        }
+        )
+            check_cell(ii, jj);
+}
+
+soil_simulator::CellList<3> soil_simulator::LocateIntersectingCells(
+    SimOut* sim_out, float tol
+) {
+    CellList<3> intersecting_cells;
+    soil_simulator::LocateIntersectingCells(
+        sim_out, tol, &intersecting_cells);
 
     return intersecting_cells;
 }
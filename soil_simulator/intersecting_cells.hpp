@@ -21,8 +21,10 @@ extern std::mt19937 rng;
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param body: Class that stores information related to the body object.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
 void MoveIntersectingCells(
-    SimOut* sim_out, Grid grid, Body* body, float tol);
+    SimOut* sim_out, const Grid& grid, Body* body, float tol,
+    Workspace* workspace = nullptr);
 
 /// \brief This function moves the soil cells resting on the body that
 ///        intersect with another body layer.
@@ -31,15 +33,19 @@ void MoveIntersectingCells(
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param body: Class that stores information related to the body object.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
 void MoveIntersectingBodySoil(
-    SimOut* sim_out, Grid grid, Body* body, float tol);
+    SimOut* sim_out, const Grid& grid, Body* body, float tol,
+    Workspace* workspace = nullptr);
 
 /// \brief This function moves the soil cells in the `terrain_` that intersect
 ///        with a body.
 ///
 /// \param sim_out: Class that stores simulation outputs.
 /// \param tol: Small number used to handle numerical approximation errors.
-void MoveIntersectingBody(SimOut* sim_out, float tol);
+/// \param workspace: Reusable buffers for temporary storage.
+void MoveIntersectingBody(
+    SimOut* sim_out, float tol, Workspace* workspace = nullptr);
 
 /// \brief This function tries to move the soil cells resting on the body
 ///        layer `ind_p` at the location (`ii_p`, `jj_p`) to a new location
@@ -65,7 +71,7 @@ void MoveIntersectingBody(SimOut* sim_out, float tol);
 ///         whether a body wall is blocking the movement.
 std::tuple<int, int, int, float, bool> MoveBodySoil(
     SimOut* sim_out, int ind_p, int ii_p, int jj_p, float max_h, int ii_n,
-    int jj_n, float h_soil, bool wall_presence, Grid grid, Body* body,
+    int jj_n, float h_soil, bool wall_presence, const Grid& grid, Body* body,
     float tol);
 
 /// \brief This function identifies all the soil cells in the `terrain_` that
@@ -73,7 +79,29 @@ std::tuple<int, int, int, float, bool> MoveBodySoil(
 ///
 /// \param sim_out: Class that stores simulation outputs.
 /// \param tol: Small number used to handle numerical approximation errors.
-std::vector<std::vector<int>> LocateIntersectingCells(
+CellList<3> LocateIntersectingCells(
     SimOut* sim_out, float tol);
 
+/// \brief Overload of `LocateIntersectingCells` writing the cells into
+///        `intersecting_cells`, so that its memory can be reused.
+///
+/// \param intersecting_cells: Collection of cells indices intersecting with
+///                            the body. Previous content is discarded.
+void LocateIntersectingCells(
+    SimOut* sim_out, float tol, CellList<3>* intersecting_cells);
+
+/// \brief Overload of `LocateIntersectingCells` storing the cells as a
+///        bitmap covering `body_area_`.
+///
+/// \param intersecting_cells: Set of the body walls intersecting with the
+///                            soil, where the body wall `ind` at (`ii`, `jj`)
+///                            is stored as the cell (`ii`, `2 * jj + ind / 2`).
+///                            Previous content is discarded.
+/// \param cells: Cells to be checked, in addition to the cells of
+///               `dirty_cells_`. All cells in `body_area_` are checked when
+///               it is not provided.
+void LocateIntersectingCells(
+    SimOut* sim_out, float tol, CellBitmap* intersecting_cells,
+    const CellList<2>* cells = nullptr);
+
 }  // namespace soil_simulator
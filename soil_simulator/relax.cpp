@@ -4,8 +4,12 @@ This file implements the functions used for the terrain relaxation.
 Copyright, 2023, Vilella Kenny.
 */
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <string>
 #include <utility>
@@ -14,6 +18,15 @@ Copyright, 2023, Vilella Kenny.
 #include "soil_simulator/types.hpp"
 #include "soil_simulator/utils.hpp"
 
+// The stencil of LocateUnstableTerrainBlock is vectorized with SSE2 when the
+// terrain is stored as a dense array of float
+#if defined(SOIL_SIMULATOR_SIMD) && defined(__SSE2__) && \
+    !defined(SOIL_SIMULATOR_FIXED_POINT_HEIGHT) && \
+    !defined(SOIL_SIMULATOR_TILED_TERRAIN)
+#define SOIL_SIMULATOR_SIMD_STENCIL
+#include <immintrin.h>
+#endif
+
 /// The soil stability is determined by the `repose_angle_`. If the slope formed
 /// by two neighbouring soil columns exceeds the `repose_angle_`, it is
 /// considered unstable, and the soil from the higher column should avalanche to
@@ -40,8 +53,14 @@ Copyright, 2023, Vilella Kenny.
 /// In case (2a), the soil will avalanche on the `terrain_`, while in case (2b),
 /// the soil will avalanche on the body.
 void soil_simulator::RelaxTerrain(
-    SimOut* sim_out, Grid grid, Body* body, SimParam sim_param, float tol
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, Workspace* workspace
 ) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
     // Assuming that the terrain is at equilibrium
     sim_out->equilibrium_ = true;
 
@@ -52,44 +71,312 @@ void soil_simulator::RelaxTerrain(
     dh_max = grid.cell_size_z_ * round(dh_max / grid.cell_size_z_);
 
     // Locating cells requiring relaxation
-    auto unstable_cells = LocateUnstableTerrainCell(sim_out, dh_max, tol);
+    auto& unstable_cells = workspace->unstable_cells_;
+    LocateUnstableTerrainCell(sim_out, dh_max, tol, &unstable_cells);
+
+    // Randomizing unstable cells to reduce asymmetry
+    // random_suffle is not used because it is machine dependent,
+    // which makes unit testing difficult
+    auto shuffle_cells = [&](auto& gen) {
+        for (int aa = unstable_cells.size() - 1; aa > 0; aa--) {
+            std::uniform_int_distribution<int> dist(0, aa);
+            int bb = dist(gen);
+            std::swap(unstable_cells[aa], unstable_cells[bb]);
+        }
+    };
+    if (workspace->rng_ != nullptr) {
+        // Drawing the order from the counter of the relaxation
+        auto gen = workspace->rng_->Stream(
+            RandomSite::kRelaxTerrainOrder, 0, 0);
+        shuffle_cells(gen);
+    } else {
+        shuffle_cells(rng);
+    }
+
+    // Relaxing the unstable cells
+    RelaxTerrainCells(
+        sim_out, unstable_cells, dh_max, grid, body, sim_param, tol,
+        workspace);
+}
+
+/// Contrary to `RelaxTerrain`, only the cells present in `dirty_cells_` are
+/// checked, so that the cost of the function is proportional to the number of
+/// cells modified since the previous call rather than to the size of
+/// `impact_area_`. The cells modified by this function are added back to
+/// `dirty_cells_`.
+void soil_simulator::RelaxDirtyTerrain(
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Assuming that the terrain is at equilibrium
+    sim_out->equilibrium_ = true;
+
+    // Calculating the maximum slope allowed by the repose angle
+    float slope_max = std::tan(sim_param.repose_angle_);
+    // Calculating the maximum height different allowed by the repose angle
+    float dh_max = grid.cell_size_xy_ * slope_max;
+    dh_max = grid.cell_size_z_ * round(dh_max / grid.cell_size_z_);
+
+    // Locating cells requiring relaxation among the dirty cells
+    auto& unstable_bitmap = workspace->unstable_bitmap_;
+    LocateDirtyTerrainCell(sim_out, dh_max, tol, &unstable_bitmap);
+
+    // Relaxing the unstable cells
+    RelaxTerrainCells(
+        sim_out, &unstable_bitmap, dh_max, grid, body, sim_param, tol,
+        workspace);
+}
+
+/// The cells modified are added to `dirty_cells_`, so that their stability
+/// can be checked by the following call to `RelaxDirtyTerrain`.
+void soil_simulator::RelaxTerrainCells(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
 
     if (unstable_cells.size() == 0) {
         // Terrain is already at equilibrium
+        sim_out->relax_regions_.Clear();
         return;
     }
 
-    // Randomizing unstable cells to reduce asymmetry
-    // random_suffle is not used because it is machine dependent,
-    // which makes unit testing difficult
-    for (int aa = unstable_cells.size() - 1; aa > 0; aa--) {
-        std::uniform_int_distribution<int> dist(0, aa);
-        int bb = dist(rng);
-        std::swap(unstable_cells[aa], unstable_cells[bb]);
+    // Updating relax_area and relax_regions to cover the unstable cells
+    UpdateRelaxArea(sim_out, unstable_cells, grid, sim_param);
+
+    if (sim_param.relax_mode_ == RelaxMode::kFlux) {
+        // Relaxing the unstable cells from the fluxes between cells
+        RelaxTerrainFlux(
+            sim_out, unstable_cells, dh_max, grid, body, sim_param, tol,
+            workspace);
+    } else {
+        // Relaxing the unstable cells colour by colour
+        // The same schedule is followed for any number of threads, so that
+        // the result does not depend on n_thread
+        RelaxTerrainParallel(
+            sim_out, unstable_cells, dh_max, grid, body, sim_param, tol,
+            workspace);
     }
+}
 
-    // Storing all possible directions for relaxation
-    std::vector<std::vector<int>> directions = {
-        {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+/// Contrary to the `CellList` overload, the cells are relaxed in a random
+/// order drawn from the counter of the relaxation, or from the global `rng`
+/// when no `CounterRng` is set. The cells are listed in `unstable_cells_` of
+/// the workspace in that order, as the relaxation requires indexed cells.
+void soil_simulator::RelaxTerrainCells(
+    SimOut* sim_out, CellBitmap* unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    if (unstable_cells->Count() == 0) {
+        // Terrain is already at equilibrium
+        sim_out->relax_regions_.Clear();
+        return;
+    }
+
+    // Function relaxing the cells in the order drawn from gen
+    auto relax_cells = [&](auto& gen) {
+        auto& cell_list = workspace->unstable_cells_;
+        cell_list.clear();
+        if (sim_param.relax_mode_ == RelaxMode::kFlux) {
+            // Listing the unstable cells in a random order
+            unstable_cells->ForEachRandom([&](int ii, int jj) {
+                cell_list.push_back({ii, jj}); }, gen);
+            RelaxTerrainCells(
+                sim_out, cell_list, dh_max, grid, body, sim_param, tol,
+                workspace);
+            return;
+        }
 
-    // Initializing the 2D bounding box of the unstable cells
+        // Listing the unstable cells in a random order, the directions of
+        // each cell being drawn when it is visited
+        auto& cell_directions = workspace->cell_directions_;
+        cell_directions.clear();
+        unstable_cells->ForEachRandom([&](int ii, int jj) {
+            cell_list.push_back({ii, jj});
+            cell_directions.push_back(DrawRelaxDirections(ii, jj, workspace));
+        }, gen);
+
+        // Updating relax_area and relax_regions to cover the unstable cells
+        UpdateRelaxArea(sim_out, cell_list, grid, sim_param);
+
+        // Relaxing the unstable cells colour by colour
+        RelaxTerrainColours(
+            sim_out, cell_list, dh_max, grid, body, sim_param, tol, workspace);
+    };
+
+    if (workspace->rng_ != nullptr) {
+        // Drawing the order from the counter of the relaxation
+        auto gen = workspace->rng_->Stream(
+            RandomSite::kRelaxTerrainOrder, 0, 0);
+        relax_cells(gen);
+    } else {
+        relax_cells(rng);
+    }
+}
+
+template <typename T>
+void soil_simulator::UpdateRelaxArea(
+    SimOut* sim_out, const T& cells, const Grid& grid,
+    const SimParam& sim_param
+) {
+    // Initializing the 2D bounding box of the cells
     int relax_min_x = 2 * grid.half_length_x_;
     int relax_max_x = 0;
     int relax_min_y = 2 * grid.half_length_y_;
     int relax_max_y = 0;
 
-    // Iterating over all unstable cells
-    for (auto nn = 0; nn < unstable_cells.size(); nn++) {
-        int ii = unstable_cells[nn][0];
-        int jj = unstable_cells[nn][1];
-
-        // Updating the 2D bounding box of the unstable cells
+    // Reserving the storage of the disjoint areas
+    // Each area is at least cell_buffer_ wide in both directions, which
+    // bounds the number of disjoint areas, so that no allocation is made
+    // once the storage has been reserved
+    std::size_t n_region_max = (
+        static_cast<std::size_t>(2 * grid.half_length_x_ + 1) *
+        (2 * grid.half_length_y_ + 1) /
+        (sim_param.cell_buffer_ * sim_param.cell_buffer_) + 1);
+    sim_out->relax_regions_.Reserve(n_region_max);
+
+    // Calculating the 2D bounding box of the cells and the disjoint
+    // areas covering them
+    sim_out->relax_regions_.Clear();
+    for (auto cell : cells) {
+        int ii = cell[0];
+        int jj = cell[1];
         relax_min_x = std::min(relax_min_x, ii);
         relax_max_x = std::max(relax_max_x, ii);
         relax_min_y = std::min(relax_min_y, jj);
         relax_max_y = std::max(relax_max_y, jj);
 
-        // Randomizing direction to avoid asymmetry
+        int area[2][2];
+        area[0][0] = std::max(ii - sim_param.cell_buffer_, 2);
+        area[0][1] = std::min(
+            ii + sim_param.cell_buffer_, 2 * grid.half_length_x_);
+        area[1][0] = std::max(jj - sim_param.cell_buffer_, 2);
+        area[1][1] = std::min(
+            jj + sim_param.cell_buffer_, 2 * grid.half_length_y_);
+        sim_out->relax_regions_.Add(area);
+    }
+
+    // Updating relax_area
+    sim_out->relax_area_[0][0] = std::max(
+        relax_min_x - sim_param.cell_buffer_, 2);
+    sim_out->relax_area_[0][1] = std::min(
+        relax_max_x + sim_param.cell_buffer_, 2 * grid.half_length_x_);
+    sim_out->relax_area_[1][0] = std::max(
+        relax_min_y - sim_param.cell_buffer_, 2);
+    sim_out->relax_area_[1][1] = std::min(
+        relax_max_y + sim_param.cell_buffer_, 2 * grid.half_length_y_);
+}
+template void soil_simulator::UpdateRelaxArea(
+    SimOut* sim_out, const CellList<2>& cells, const Grid& grid,
+    const SimParam& sim_param);
+template void soil_simulator::UpdateRelaxArea(
+    SimOut* sim_out, const CellBitmap& cells, const Grid& grid,
+    const SimParam& sim_param);
+
+void soil_simulator::RelaxTerrainSerial(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, float tol, Workspace* workspace
+) {
+    // Iterating over all unstable cells
+    for (auto nn = 0; nn < unstable_cells.size(); nn++)
+        RelaxTerrainCell(
+            sim_out, unstable_cells[nn][0], unstable_cells[nn][1], dh_max,
+            grid, body, tol, workspace);
+}
+
+void soil_simulator::RelaxTerrainCell(
+    SimOut* sim_out, int ii, int jj, float dh_max, const Grid& grid,
+    Body* body, float tol, Workspace* workspace
+) {
+    // Randomizing direction to avoid asymmetry
+    auto directions = DrawRelaxDirections(ii, jj, workspace);
+
+    // Iterating over the possible directions
+    for (auto xy = 0; xy < directions.size(); xy++) {
+        int ii_c = ii + directions[xy][0];
+        int jj_c = jj + directions[xy][1];
+
+        // Calculating minimum height allowed surrounding the considered
+        // soil cell
+        float h_min = sim_out->terrain_[ii][jj] - dh_max;
+
+        // Checking if the cell requires relaxation
+        auto status = CheckUnstableTerrainCell(
+            sim_out, ii_c, jj_c, h_min, tol);
+
+        if (status == 0) {
+            // Soil cell already at equilibrium
+            continue;
+        } else {
+            // Soil cell requires relaxation
+            sim_out->equilibrium_ = false;
+        }
+
+        // Relaxing the soil cell
+        RelaxUnstableTerrainCell(
+            sim_out, status, dh_max, ii, jj, ii_c, jj_c, grid, body, tol);
+
+        // Marking the modified cells for the next relaxation
+        MarkDirtyCell(sim_out, ii, jj);
+        MarkDirtyCell(sim_out, ii_c, jj_c);
+    }
+}
+
+/// The directions of all cells are drawn in the order of `unstable_cells`
+/// before the cells are relaxed by `RelaxTerrainColours`.
+void soil_simulator::RelaxTerrainParallel(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Drawing the relaxation directions of all cells
+    // The same directions as the serial relaxation are used
+    auto& cell_directions = workspace->cell_directions_;
+    cell_directions.resize(unstable_cells.size());
+    for (auto nn = 0; nn < unstable_cells.size(); nn++)
+        cell_directions[nn] = DrawRelaxDirections(
+            unstable_cells[nn][0], unstable_cells[nn][1], workspace);
+
+    // Relaxing the unstable cells colour by colour
+    RelaxTerrainColours(
+        sim_out, unstable_cells, dh_max, grid, body, sim_param, tol,
+        workspace);
+}
+
+std::array<std::array<int, 2>, 4> soil_simulator::DrawRelaxDirections(
+    int ii, int jj, Workspace* workspace
+) {
+    // Storing all possible directions for relaxation
+    const std::array<std::array<int, 2>, 4> directions_init = {{
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+    auto directions = directions_init;
+
+    if ((workspace != nullptr) && (workspace->rng_ != nullptr)) {
+        // Drawing the directions from the counter of the cell
+        directions = CounterRng::Permute(
+            directions_init, workspace->rng_->Draw(
+            RandomSite::kRelaxTerrain, ii, jj));
+    } else {
         // random_suffle is not used because it is machine dependent,
         // which makes unit testing difficult
         for (int aa = directions.size() - 1; aa > 0; aa--) {
@@ -97,11 +384,151 @@ void soil_simulator::RelaxTerrain(
             int bb = dist(rng);
             std::swap(directions[aa], directions[bb]);
         }
+    }
+    return directions;
+}
 
-        // Iterating over the possible directions
-        for (auto xy = 0; xy < directions.size(); xy++) {
-            int ii_c = ii + directions[xy][0];
-            int jj_c = jj + directions[xy][1];
+/// The unstable cells are split into five colours following
+/// `(2 * ii + jj) % 5`. Two cells of the same colour are at least three cells
+/// apart, so that the cells and their four adjacent cells do not overlap:
+///
+///                 0 2 4 1 3 0 2
+///                 1 3 0 2 4 1 3
+///                 2 4 1 3 0 2 4
+///                 3 0 2 4 1 3 0
+///
+/// The cells of a given colour can therefore be relaxed concurrently, while
+/// the colours are processed one after the other. A simple checkerboard
+/// colouring is not sufficient, as the soil avalanches to the adjacent cell,
+/// which may be the neighbour of another cell of the same colour.
+///
+/// Only the avalanches onto the `terrain_` are made concurrently, as they do
+/// not modify the body soil or the soil volume ledger. When an avalanche onto
+/// the body is required, the relaxation of the cell is stopped and resumed
+/// in a final serial pass following the order of `unstable_cells`.
+///
+/// The result does not depend on the number of threads, so that the
+/// simulation is reproducible for a given seed. This schedule is therefore
+/// also followed when `n_thread_` is 1, the colours being then relaxed on the
+/// calling thread.
+void soil_simulator::RelaxTerrainColours(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace
+) {
+    int n_cell = unstable_cells.size();
+    const auto& cell_directions = workspace->cell_directions_;
+
+    // Sorting the cells by colour while preserving their order
+    std::array<int, 6> colour_offset = {0, 0, 0, 0, 0, 0};
+    for (auto nn = 0; nn < n_cell; nn++) {
+        int colour = (2 * unstable_cells[nn][0] + unstable_cells[nn][1]) % 5;
+        colour_offset[colour + 1]++;
+    }
+    for (auto cc = 0; cc < 5; cc++)
+        colour_offset[cc + 1] += colour_offset[cc];
+    std::array<int, 5> colour_pos = {
+        colour_offset[0], colour_offset[1], colour_offset[2],
+        colour_offset[3], colour_offset[4]};
+    auto& colour_cells = workspace->colour_cells_;
+    colour_cells.resize(n_cell);
+    for (auto nn = 0; nn < n_cell; nn++) {
+        int colour = (2 * unstable_cells[nn][0] + unstable_cells[nn][1]) % 5;
+        colour_cells[colour_pos[colour]++] = nn;
+    }
+
+    #ifdef SOIL_SIMULATOR_TILED_TERRAIN
+    // Allocating the tiles of the cells that may be modified, as a tile
+    // cannot be allocated concurrently
+    for (auto nn = 0; nn < n_cell; nn++) {
+        int ii = unstable_cells[nn][0];
+        int jj = unstable_cells[nn][1];
+        sim_out->terrain_.Allocate(ii, jj);
+        for (auto xy = 0; xy < 4; xy++)
+            sim_out->terrain_.Allocate(
+                ii + cell_directions[nn][xy][0],
+                jj + cell_directions[nn][xy][1]);
+    }
+    #endif
+
+    // Creating the thread pool if required
+    auto& thread_pool = workspace->thread_pool_;
+    if (!thread_pool || (thread_pool->size() != sim_param.n_thread_))
+        thread_pool = std::make_unique<ThreadPool>(sim_param.n_thread_);
+
+    // By default, all directions are relaxed concurrently
+    auto& next_direction = workspace->next_direction_;
+    next_direction.assign(n_cell, 4);
+    auto& cell_relaxed = workspace->cell_relaxed_;
+    cell_relaxed.assign(n_cell, 0);
+
+    // Iterating over the colours
+    // The stability of the cells is checked through a const reference, so
+    // that the only storage written concurrently is the terrain of the cells
+    const SimOut* sim_out_c = sim_out;
+    for (auto cc = 0; cc < 5; cc++) {
+        int first = colour_offset[cc];
+        thread_pool->ParallelFor(
+            colour_offset[cc + 1] - first, [&](int begin, int end) {
+            for (auto kk = first + begin; kk < first + end; kk++) {
+                int nn = colour_cells[kk];
+                int ii = unstable_cells[nn][0];
+                int jj = unstable_cells[nn][1];
+
+                // Iterating over the possible directions
+                for (auto xy = 0; xy < 4; xy++) {
+                    int ii_c = ii + cell_directions[nn][xy][0];
+                    int jj_c = jj + cell_directions[nn][xy][1];
+
+                    // Calculating minimum height allowed surrounding the
+                    // considered soil cell
+                    float h_min = sim_out_c->terrain_[ii][jj] - dh_max;
+
+                    // Checking if the cell requires relaxation
+                    auto status = CheckUnstableTerrainCell(
+                        sim_out_c, ii_c, jj_c, h_min, tol);
+
+                    if (status == 0) {
+                        // Soil cell already at equilibrium
+                        continue;
+                    } else if (status % 10 != 0) {
+                        // Soil should avalanche on the body
+                        // The relaxation of the cell is made serially
+                        next_direction[nn] = xy;
+                        break;
+                    }
+
+                    // Relaxing the soil cell
+                    cell_relaxed[nn] = 1;
+                    RelaxUnstableTerrainCell(
+                        sim_out, status, dh_max, ii, jj, ii_c, jj_c, grid,
+                        body, tol);
+                }
+            }
+        });
+    }
+
+    // Completing the relaxation serially
+    for (auto nn = 0; nn < n_cell; nn++) {
+        int ii = unstable_cells[nn][0];
+        int jj = unstable_cells[nn][1];
+
+        if (cell_relaxed[nn]) {
+            // Soil has been moved concurrently from the cell
+            sim_out->equilibrium_ = false;
+
+            // Marking the modified cells for the next relaxation
+            MarkDirtyCell(sim_out, ii, jj);
+            for (auto xy = 0; xy < 4; xy++)
+                MarkDirtyCell(
+                    sim_out, ii + cell_directions[nn][xy][0],
+                    jj + cell_directions[nn][xy][1]);
+        }
+
+        // Iterating over the remaining directions
+        for (auto xy = next_direction[nn]; xy < 4; xy++) {
+            int ii_c = ii + cell_directions[nn][xy][0];
+            int jj_c = jj + cell_directions[nn][xy][1];
 
             // Calculating minimum height allowed surrounding the considered
             // soil cell
@@ -122,18 +549,721 @@ void soil_simulator::RelaxTerrain(
             // Relaxing the soil cell
             RelaxUnstableTerrainCell(
                 sim_out, status, dh_max, ii, jj, ii_c, jj_c, grid, body, tol);
+
+            // Marking the modified cells for the next relaxation
+            MarkDirtyCell(sim_out, ii, jj);
+            MarkDirtyCell(sim_out, ii_c, jj_c);
         }
     }
+}
 
-    // Updating relax_area
-    sim_out->relax_area_[0][0] = std::max(
-        relax_min_x - sim_param.cell_buffer_, 2);
-    sim_out->relax_area_[0][1] = std::min(
-        relax_max_x + sim_param.cell_buffer_, 2 * grid.half_length_x_);
-    sim_out->relax_area_[1][0] = std::max(
-        relax_min_y - sim_param.cell_buffer_, 2);
-    sim_out->relax_area_[1][1] = std::min(
-        relax_max_y + sim_param.cell_buffer_, 2 * grid.half_length_y_);
+/// The soil moved from each unstable cell towards its four adjacent cells is
+/// first calculated from the current `terrain_`, without modifying it, and
+/// all the fluxes are then applied in a single pass. Contrary to
+/// `RelaxTerrainSerial`, the result does not depend on the order of the cells,
+/// so that the fluxes can be calculated concurrently.
+///
+/// As a cell may give soil to several cells and receive soil from several
+/// cells during the same pass, the soil moved between two cells is half of
+/// their excess height difference, divided by the largest of the number of
+/// lower neighbours of the giving cell and the number of higher neighbours of
+/// the receiving cell. This prevents the soil from overshooting the
+/// equilibrium. The fluxes are rounded down to a multiple of `cell_size_z_`.
+///
+/// The cells requiring an avalanche onto the body, as well as the cells whose
+/// fluxes are all rounded down to zero, are relaxed afterwards by
+/// `RelaxTerrainSerial`, following the order of `unstable_cells`.
+void soil_simulator::RelaxTerrainFlux(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    int n_cell = unstable_cells.size();
+
+    // Storing all possible directions for relaxation
+    const std::array<std::array<int, 2>, 4> directions = {{
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+
+    #ifdef SOIL_SIMULATOR_TILED_TERRAIN
+    // Allocating the tiles of the cells that may be modified, as a tile
+    // cannot be allocated concurrently
+    for (auto nn = 0; nn < n_cell; nn++) {
+        int ii = unstable_cells[nn][0];
+        int jj = unstable_cells[nn][1];
+        sim_out->terrain_.Allocate(ii, jj);
+        for (auto xy = 0; xy < directions.size(); xy++)
+            sim_out->terrain_.Allocate(
+                ii + directions[xy][0], jj + directions[xy][1]);
+    }
+    #endif
+
+    // Function calculating the fluxes of the cells from begin to end
+    // The storage is only read, so that the cells are independent
+    const SimOut* sim_out_c = sim_out;
+    const auto& terrain = sim_out_c->terrain_;
+    auto& cell_flux = workspace->cell_flux_;
+    cell_flux.resize(n_cell);
+    auto& cell_deferred = workspace->cell_deferred_;
+    cell_deferred.resize(n_cell);
+    auto calc_flux = [&](int begin, int end) {
+        for (auto nn = begin; nn < end; nn++) {
+            int ii = unstable_cells[nn][0];
+            int jj = unstable_cells[nn][1];
+            cell_flux[nn] = {0.0, 0.0, 0.0, 0.0};
+            cell_deferred[nn] = 0;
+
+            // Calculating minimum height allowed surrounding the considered
+            // soil cell
+            float h_min = terrain[ii][jj] - dh_max;
+
+            // Counting the lower neighbours of the cell
+            int n_lower = 0;
+            for (auto xy = 0; xy < 4; xy++)
+                if (
+                    terrain[ii + directions[xy][0]][jj + directions[xy][1]] +
+                    tol < h_min)
+                    n_lower++;
+
+            bool flux_presence = false;
+            for (auto xy = 0; xy < 4; xy++) {
+                int ii_c = ii + directions[xy][0];
+                int jj_c = jj + directions[xy][1];
+
+                // Checking if the cell requires relaxation
+                auto status = CheckUnstableTerrainCell(
+                    sim_out_c, ii_c, jj_c, h_min, tol);
+
+                if (status == 0) {
+                    // Soil cell already at equilibrium
+                    continue;
+                } else if (status != 40) {
+                    // Soil should avalanche on the body
+                    // The relaxation of the cell is made serially
+                    cell_deferred[nn] = 1;
+                    break;
+                }
+
+                // Counting the higher neighbours of the adjacent cell
+                float h_c = terrain[ii_c][jj_c];
+                int n_higher = 0;
+                for (auto xy_c = 0; xy_c < 4; xy_c++)
+                    if (
+                        h_c + tol < terrain[ii_c + directions[xy_c][0]][
+                        jj_c + directions[xy_c][1]] - dh_max)
+                        n_higher++;
+
+                // Calculating the soil moved to the adjacent cell
+                float h_flux = 0.5 * (h_min - h_c) / std::max(
+                    n_lower, n_higher);
+                h_flux = grid.cell_size_z_ * std::floor(
+                    (h_flux + tol) / grid.cell_size_z_);
+                cell_flux[nn][xy] = h_flux;
+                if (h_flux > 0.0)
+                    flux_presence = true;
+            }
+
+            if ((cell_deferred[nn]) || (!flux_presence)) {
+                // The cell is relaxed serially
+                cell_deferred[nn] = 1;
+                cell_flux[nn] = {0.0, 0.0, 0.0, 0.0};
+            }
+        }
+    };
+
+    // Calculating the fluxes of all cells
+    if (sim_param.n_thread_ > 1) {
+        // Creating the thread pool if required
+        auto& thread_pool = workspace->thread_pool_;
+        if (!thread_pool || (thread_pool->size() != sim_param.n_thread_))
+            thread_pool = std::make_unique<ThreadPool>(sim_param.n_thread_);
+
+        thread_pool->ParallelFor(n_cell, calc_flux);
+    } else {
+        calc_flux(0, n_cell);
+    }
+
+    // Applying the fluxes
+    auto& deferred_cells = workspace->deferred_cells_;
+    deferred_cells.clear();
+    for (auto nn = 0; nn < n_cell; nn++) {
+        int ii = unstable_cells[nn][0];
+        int jj = unstable_cells[nn][1];
+
+        if (cell_deferred[nn]) {
+            // Cell is relaxed serially
+            deferred_cells.push_back({ii, jj});
+            continue;
+        }
+
+        // Soil is moved from the cell
+        sim_out->equilibrium_ = false;
+        MarkDirtyCell(sim_out, ii, jj);
+        for (auto xy = 0; xy < 4; xy++) {
+            if (cell_flux[nn][xy] == 0.0)
+                continue;
+
+            // Moving the soil to the adjacent cell
+            int ii_c = ii + directions[xy][0];
+            int jj_c = jj + directions[xy][1];
+            sim_out->terrain_[ii][jj] -= cell_flux[nn][xy];
+            sim_out->terrain_[ii_c][jj_c] += cell_flux[nn][xy];
+
+            // Marking the modified cell for the next relaxation
+            MarkDirtyCell(sim_out, ii_c, jj_c);
+        }
+    }
+
+    // Relaxing serially the remaining cells
+    RelaxTerrainSerial(
+        sim_out, deferred_cells, dh_max, grid, body, tol, workspace);
+}
+
+/// A pile of soil relaxed cell by cell spreads by only one cell per sweep, so
+/// that the number of sweeps required to reach equilibrium is proportional to
+/// the size of the pile. This function accelerates the relaxation by first
+/// redistributing the soil on coarser grids, where each block of
+/// 2^`level` x 2^`level` cells is represented by its total amount of soil.
+///
+/// The levels are processed from the coarsest to the finest. At each level,
+/// the blocks are relaxed following the same flux-based algorithm as
+/// `RelaxTerrainFlux`, the maximum height difference being scaled by the size
+/// of the blocks, until the coarse grid reaches equilibrium. The soil gained
+/// or lost by each block is then spread uniformly over its cells, before
+/// moving to the next finer level. The remaining small-scale instabilities
+/// are resolved by the usual relaxation.
+///
+/// The soil is counted in number of `cell_size_z_`, so that the soil volume is
+/// exactly conserved. Blocks including a cell where the body is present do
+/// not exchange any soil, as the interaction with the body is not handled on
+/// the coarse grids. Cells at the end of `area` that do not form a complete
+/// block are not modified either.
+///
+/// The coarse grids only pay off for deposits spanning several blocks, so that
+/// the number of levels is clamped such that a block of the coarsest grid
+/// does not contain more cells than the number of unstable cells in `area`.
+/// Nothing is done when the deposit is smaller than a block of the finest
+/// coarse grid. The soil is only redistributed in the 2D bounding box of the
+/// unstable cells, extended on each side by its size, rather than in the
+/// whole `area`.
+void soil_simulator::RelaxTerrainMultigrid(
+    SimOut* sim_out, const int area[2][2], const Grid& grid,
+    const SimParam& sim_param, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Calculating the maximum slope allowed by the repose angle
+    float slope_max = std::tan(sim_param.repose_angle_);
+    // Calculating the maximum height different allowed by the repose angle
+    float dh_max = grid.cell_size_xy_ * slope_max;
+    int dh_cell = std::lround(dh_max / grid.cell_size_z_);
+
+    // Calculating the area covered by the unstable cells
+    // The heights are multiples of cell_size_z, so that half of it is used
+    // as tolerance
+    int deposit_area[2][2];
+    int n_unstable = CalcUnstableTerrainArea(
+        sim_out->terrain_, area, grid.cell_size_z_ * dh_cell,
+        0.5 * grid.cell_size_z_, deposit_area);
+    // Clamping the number of levels to the size of the deposit, so that the
+    // blocks of the coarsest grid do not contain more cells than the deposit
+    int n_level = 0;
+    while (
+        (n_level < sim_param.multigrid_levels_) &&
+        ((1 << (2 * (n_level + 1))) <= n_unstable))
+        n_level++;
+    if (n_level == 0) {
+        // Deposit smaller than a block of the finest coarse grid
+        return;
+    }
+
+    // Extending the deposit area by its size, where the soil may spread
+    int margin = std::max(
+        deposit_area[0][1] - deposit_area[0][0],
+        deposit_area[1][1] - deposit_area[1][0]);
+    deposit_area[0][0] = std::max(deposit_area[0][0] - margin, area[0][0]);
+    deposit_area[0][1] = std::min(deposit_area[0][1] + margin, area[0][1]);
+    deposit_area[1][0] = std::max(deposit_area[1][0] - margin, area[1][0]);
+    deposit_area[1][1] = std::min(deposit_area[1][1] + margin, area[1][1]);
+
+    // Redistributing the soil only in the deposit area
+    area = deposit_area;
+
+    // Storing all possible directions for relaxation
+    const std::array<std::array<int, 2>, 4> directions = {{
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+
+    const auto& terrain = sim_out->terrain_;
+    auto& block_soil = workspace->block_soil_;
+    auto& block_soil_init = workspace->block_soil_init_;
+    auto& block_flux = workspace->block_flux_;
+    auto& block_active = workspace->block_active_;
+
+    // Iterating from the coarsest to the finest level
+    for (auto level = n_level; level > 0; level--) {
+        int size_block = 1 << level;
+        int n_block_x = (area[0][1] - area[0][0]) / size_block;
+        int n_block_y = (area[1][1] - area[1][0]) / size_block;
+        int n_block = n_block_x * n_block_y;
+        if ((n_block_x < 2) && (n_block_y < 2)) {
+            // Coarse grid too small
+            continue;
+        }
+
+        // Calculating the soil contained in each block
+        block_soil.assign(n_block, 0);
+        block_active.assign(n_block, 1);
+        for (auto bx = 0; bx < n_block_x; bx++)
+            for (auto by = 0; by < n_block_y; by++) {
+                int nn = bx * n_block_y + by;
+                int ii_s = area[0][0] + bx * size_block;
+                int jj_s = area[1][0] + by * size_block;
+                for (auto ii = ii_s; ii < ii_s + size_block; ii++)
+                    for (auto jj = jj_s; jj < jj_s + size_block; jj++) {
+                        block_soil[nn] += std::lround(
+                            terrain[ii][jj] / grid.cell_size_z_);
+
+                        float body_cell[4];
+                        sim_out->body_.LoadCell(ii, jj, body_cell);
+                        if (
+                            (body_cell[0] != 0.0) || (body_cell[1] != 0.0) ||
+                            (body_cell[2] != 0.0) || (body_cell[3] != 0.0))
+                            // Body is present in the block
+                            block_active[nn] = 0;
+                    }
+            }
+        block_soil_init = block_soil;
+
+        // Maximum difference of soil between two adjacent blocks, the
+        // maximum height difference being scaled by the size of the blocks
+        std::int64_t dh_block = static_cast<std::int64_t>(dh_cell) *
+            size_block * size_block * size_block;
+
+        // Function returning the index of the adjacent block in the direction
+        // xy, or -1 when it does not exist or cannot exchange soil
+        auto adjacent_block = [&](int bx, int by, int xy) {
+            int bx_c = bx + directions[xy][0];
+            int by_c = by + directions[xy][1];
+            if (
+                (bx_c < 0) || (bx_c >= n_block_x) || (by_c < 0) ||
+                (by_c >= n_block_y))
+                return -1;
+            int nn_c = bx_c * n_block_y + by_c;
+            return block_active[nn_c] ? nn_c : -1;
+        };
+
+        // Relaxing the coarse grid until equilibrium
+        for (auto it = 0; it < n_block_x + n_block_y; it++) {
+            block_flux.assign(n_block, 0);
+            bool soil_moved = false;
+            for (auto bx = 0; bx < n_block_x; bx++)
+                for (auto by = 0; by < n_block_y; by++) {
+                    int nn = bx * n_block_y + by;
+                    if (!block_active[nn])
+                        continue;
+
+                    // Counting the lower adjacent blocks
+                    int n_lower = 0;
+                    for (auto xy = 0; xy < 4; xy++) {
+                        int nn_c = adjacent_block(bx, by, xy);
+                        if (
+                            (nn_c >= 0) &&
+                            (block_soil[nn] - block_soil[nn_c] > dh_block))
+                            n_lower++;
+                    }
+
+                    for (auto xy = 0; xy < 4; xy++) {
+                        int nn_c = adjacent_block(bx, by, xy);
+                        if (
+                            (nn_c < 0) ||
+                            (block_soil[nn] - block_soil[nn_c] <= dh_block))
+                            continue;
+
+                        // Counting the higher blocks adjacent to the lower
+                        // block
+                        int bx_c = bx + directions[xy][0];
+                        int by_c = by + directions[xy][1];
+                        int n_higher = 0;
+                        for (auto xy_c = 0; xy_c < 4; xy_c++) {
+                            int nn_cc = adjacent_block(bx_c, by_c, xy_c);
+                            if (
+                                (nn_cc >= 0) &&
+                                (block_soil[nn_cc] - block_soil[nn_c] >
+                                dh_block))
+                                n_higher++;
+                        }
+
+                        // Calculating the soil moved to the lower block
+                        std::int64_t soil = (
+                            block_soil[nn] - block_soil[nn_c] - dh_block) /
+                            (2 * std::max(n_lower, n_higher));
+                        if (soil > 0) {
+                            block_flux[nn] -= soil;
+                            block_flux[nn_c] += soil;
+                            soil_moved = true;
+                        }
+                    }
+                }
+
+            if (!soil_moved) {
+                // Coarse grid at equilibrium
+                break;
+            }
+
+            // Applying the fluxes
+            for (auto nn = 0; nn < n_block; nn++)
+                block_soil[nn] += block_flux[nn];
+        }
+
+        // Spreading uniformly the soil gained or lost by each block
+        int n_cell_block = size_block * size_block;
+        for (auto bx = 0; bx < n_block_x; bx++)
+            for (auto by = 0; by < n_block_y; by++) {
+                int nn = bx * n_block_y + by;
+                std::int64_t dsoil = block_soil[nn] - block_soil_init[nn];
+                if (dsoil == 0)
+                    continue;
+
+                // Calculating the soil added to each cell, the remainder
+                // being added to the first cells of the block
+                std::int64_t dsoil_cell = dsoil / n_cell_block;
+                std::int64_t remainder = dsoil % n_cell_block;
+                if (remainder < 0) {
+                    dsoil_cell--;
+                    remainder += n_cell_block;
+                }
+
+                int ii_s = area[0][0] + bx * size_block;
+                int jj_s = area[1][0] + by * size_block;
+                int kk = 0;
+                for (auto ii = ii_s; ii < ii_s + size_block; ii++)
+                    for (auto jj = jj_s; jj < jj_s + size_block; jj++) {
+                        std::int64_t dsoil_ij = dsoil_cell + (
+                            kk++ < remainder ? 1 : 0);
+                        if (dsoil_ij == 0)
+                            continue;
+
+                        // Updating the terrain
+                        sim_out->terrain_[ii][jj] += (
+                            dsoil_ij * grid.cell_size_z_);
+                        sim_out->equilibrium_ = false;
+
+                        // Marking the modified cell for the next relaxation
+                        MarkDirtyCell(sim_out, ii, jj);
+                    }
+            }
+    }
+}
+
+/// The terrain at equilibrium satisfies the repose angle, that is, the height
+/// difference between two adjacent cells does not exceed `dh_max`. This
+/// function directly calculates such a surface instead of relaxing the
+/// terrain cell by cell.
+///
+/// The soil that must be removed is first determined by calculating the lower
+/// envelope of the terrain satisfying the repose angle, that is, the minimum
+/// over all cells of their height plus `dh_max` times the distance. The cells
+/// where soil is removed are grouped into basins of connected cells, and each
+/// cell of `area` is assigned to the basin closest to it. The soil removed
+/// from a basin is then deposited as a truncated cone centred on the basin,
+/// the surface being the maximum of the envelope and of
+/// `top - dh_max * distance` over the cells assigned to the basin. The height
+/// `top` is determined for each basin by a bisection so that the soil volume
+/// of the basin is conserved, so that separate piles do not exchange soil.
+///
+/// The envelope is calculated exactly by visiting the cells in increasing
+/// order of envelope, merging the cells sorted by height with a queue of the
+/// lowered cells, and the distance is calculated by a breadth-first search
+/// from the basins, so that each cell is visited a bounded number of times.
+///
+/// The soil is counted in number of `cell_size_z_`, so that the soil volume is
+/// exactly conserved. The soil that cannot be spread as a complete layer of
+/// the cone is added to the first cells of its next layer, so that the height
+/// difference may exceed `dh_max` by one `cell_size_z_` at the foot of the
+/// cone. The cells where the body or the soil resting on it is present are
+/// not modified, and the soil cannot be moved across them. The modified cells
+/// are marked in `dirty_cells_`, so that the remaining instabilities, for
+/// instance with the body or with the cells surrounding `area`, are resolved
+/// by the usual relaxation.
+bool soil_simulator::SettleTerrain(
+    SimOut* sim_out, const int area[2][2], const Grid& grid,
+    const SimParam& sim_param, Workspace* workspace
+) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Calculating the maximum slope allowed by the repose angle
+    float slope_max = std::tan(sim_param.repose_angle_);
+    // Calculating the maximum height different allowed by the repose angle
+    float dh_max = grid.cell_size_xy_ * slope_max;
+    std::int64_t dh_cell = std::lround(dh_max / grid.cell_size_z_);
+
+    int area_length_x = area[0][1] - area[0][0];
+    int area_length_y = area[1][1] - area[1][0];
+    if ((area_length_x <= 0) || (area_length_y <= 0))
+        return false;
+    int n_cell = area_length_x * area_length_y;
+    const std::int64_t kFar = std::numeric_limits<std::int64_t>::max() / 4;
+
+    const auto& terrain = sim_out->terrain_;
+    auto& height = workspace->settle_height_;
+    auto& envelope = workspace->settle_envelope_;
+    auto& distance = workspace->settle_distance_;
+    auto& is_free = workspace->settle_free_;
+    height.resize(n_cell);
+    envelope.resize(n_cell);
+    distance.resize(n_cell);
+    is_free.resize(n_cell);
+
+    // Calculating the height of the terrain and the cells that can be modified
+    for (auto ii_s = 0; ii_s < area_length_x; ii_s++)
+        for (auto jj_s = 0; jj_s < area_length_y; jj_s++) {
+            int ii = area[0][0] + ii_s;
+            int jj = area[1][0] + jj_s;
+            int nn = ii_s * area_length_y + jj_s;
+            height[nn] = std::lround(terrain[ii][jj] / grid.cell_size_z_);
+
+            float body_cell[4];
+            float body_soil_cell[4];
+            sim_out->body_.LoadCell(ii, jj, body_cell);
+            sim_out->body_soil_.LoadCell(ii, jj, body_soil_cell);
+            is_free[nn] = 1;
+            for (auto ind = 0; ind < 4; ind++)
+                if ((body_cell[ind] != 0.0) || (body_soil_cell[ind] != 0.0))
+                    // Body is present
+                    is_free[nn] = 0;
+        }
+
+    // Function calling `func(nn_c)` for the is_free cells adjacent to nn
+    auto for_each_neighbour = [&](int nn, auto&& func) {
+        int ii_s = nn / area_length_y;
+        int jj_s = nn % area_length_y;
+        if ((ii_s > 0) && is_free[nn - area_length_y])
+            func(nn - area_length_y);
+        if ((ii_s < area_length_x - 1) && is_free[nn + area_length_y])
+            func(nn + area_length_y);
+        if ((jj_s > 0) && is_free[nn - 1])
+            func(nn - 1);
+        if ((jj_s < area_length_y - 1) && is_free[nn + 1])
+            func(nn + 1);
+    };
+
+    // Sorting the is_free cells by increasing height
+    auto& order = workspace->settle_order_;
+    order.clear();
+    for (auto nn = 0; nn < n_cell; nn++)
+        if (is_free[nn])
+            order.push_back(nn);
+    std::sort(order.begin(), order.end(), [&](int nn_a, int nn_b) {
+        return height[nn_a] < height[nn_b];
+    });
+
+    // Calculating the lower envelope of the terrain satisfying the repose
+    // angle. As all steps are equal to dh_cell, the values pushed to the
+    // queue are increasing, so that merging the sorted heights with the queue
+    // visits the cells in increasing order of envelope, and each cell is
+    // pushed at most once.
+    auto& queue = workspace->settle_queue_;
+    queue.resize(n_cell);
+    int queue_begin = 0;
+    int queue_end = 0;
+    int order_ind = 0;
+    for (auto nn = 0; nn < n_cell; nn++)
+        envelope[nn] = height[nn];
+    while ((order_ind < order.size()) || (queue_begin < queue_end)) {
+        int nn;
+        if (
+            (queue_begin == queue_end) || ((order_ind < order.size()) &&
+            (height[order[order_ind]] <= envelope[queue[queue_begin]]))) {
+            nn = order[order_ind++];
+            if (envelope[nn] != height[nn])
+                // Cell already lowered, it is visited from the queue
+                continue;
+        } else {
+            nn = queue[queue_begin++];
+        }
+        std::int64_t value = envelope[nn];
+        for_each_neighbour(nn, [&](int nn_c) {
+            if (value + dh_cell < envelope[nn_c]) {
+                envelope[nn_c] = value + dh_cell;
+                queue[queue_end++] = nn_c;
+            }
+        });
+    }
+
+    // Labelling the basins, that is, the connected groups of cells where soil
+    // is removed
+    auto& label = workspace->settle_label_;
+    label.assign(n_cell, -1);
+    int n_basin = 0;
+    std::int64_t soil_moved = 0;
+    for (auto nn = 0; nn < n_cell; nn++) {
+        if ((!is_free[nn]) || (height[nn] == envelope[nn]) || (label[nn] >= 0))
+            continue;
+        // Flood filling the basin from the cell
+        queue_end = 0;
+        queue[queue_end++] = nn;
+        label[nn] = n_basin;
+        while (queue_end > 0) {
+            int nn_b = queue[--queue_end];
+            soil_moved += height[nn_b] - envelope[nn_b];
+            for_each_neighbour(nn_b, [&](int nn_c) {
+                if ((label[nn_c] < 0) && (height[nn_c] > envelope[nn_c])) {
+                    label[nn_c] = n_basin;
+                    queue[queue_end++] = nn_c;
+                }
+            });
+        }
+        n_basin++;
+    }
+    if (soil_moved == 0) {
+        // Terrain is already at equilibrium
+        return false;
+    }
+
+    // Calculating the distance to the closest cell where soil is removed,
+    // each reachable cell being assigned to the basin of that cell
+    queue_begin = 0;
+    queue_end = 0;
+    for (auto nn = 0; nn < n_cell; nn++)
+        if (label[nn] >= 0) {
+            distance[nn] = 0;
+            queue[queue_end++] = nn;
+        } else {
+            distance[nn] = kFar;
+        }
+    while (queue_begin < queue_end) {
+        int nn = queue[queue_begin++];
+        for_each_neighbour(nn, [&](int nn_c) {
+            if (distance[nn_c] == kFar) {
+                distance[nn_c] = distance[nn] + 1;
+                label[nn_c] = label[nn];
+                queue[queue_end++] = nn_c;
+            }
+        });
+    }
+
+    // Grouping the cells by basin, in increasing order of index
+    auto& basin_start = workspace->settle_basin_start_;
+    basin_start.assign(n_basin + 1, 0);
+    for (auto nn = 0; nn < n_cell; nn++)
+        if (label[nn] >= 0)
+            basin_start[label[nn] + 1]++;
+    for (auto bb = 0; bb < n_basin; bb++)
+        basin_start[bb + 1] += basin_start[bb];
+    order.resize(basin_start[n_basin]);
+    for (auto nn = 0; nn < n_cell; nn++)
+        if (label[nn] >= 0)
+            order[basin_start[label[nn]]++] = nn;
+    for (auto bb = n_basin; bb > 0; bb--)
+        basin_start[bb] = basin_start[bb - 1];
+    basin_start[0] = 0;
+
+    // Initializing the 2D bounding box of the modified cells
+    int settle_min_x = 2 * grid.half_length_x_;
+    int settle_max_x = 0;
+    int settle_min_y = 2 * grid.half_length_y_;
+    int settle_max_y = 0;
+
+    for (auto bb = 0; bb < n_basin; bb++) {
+        auto basin_begin = order.begin() + basin_start[bb];
+        auto basin_end = order.begin() + basin_start[bb + 1];
+
+        // Calculating the soil volume and the height bounds of the basin
+        std::int64_t soil_total = 0;
+        std::int64_t envelope_min = kFar;
+        std::int64_t height_max = -kFar;
+        for (auto it = basin_begin; it != basin_end; it++) {
+            soil_total += height[*it];
+            envelope_min = std::min(envelope_min, envelope[*it]);
+            height_max = std::max(height_max, height[*it]);
+        }
+
+        // Function calculating the soil volume of the basin with the given
+        // top
+        auto calc_volume = [&](std::int64_t top) {
+            std::int64_t volume = 0;
+            for (auto it = basin_begin; it != basin_end; it++)
+                volume += std::max(
+                    envelope[*it], top - dh_cell * distance[*it]);
+            return volume;
+        };
+
+        // Determining by bisection the highest top for which the soil volume
+        // does not exceed the initial soil volume of the basin
+        std::int64_t top_min = envelope_min;
+        std::int64_t top_max = height_max;
+        while (top_max - top_min > 1) {
+            std::int64_t top = top_min + (top_max - top_min) / 2;
+            if (calc_volume(top) <= soil_total)
+                top_min = top;
+            else
+                top_max = top;
+        }
+        if (calc_volume(top_max) <= soil_total)
+            top_min = top_max;
+        std::int64_t remainder = soil_total - calc_volume(top_min);
+
+        // Updating the terrain
+        for (auto it = basin_begin; it != basin_end; it++) {
+            int nn = *it;
+            std::int64_t cone = top_min - dh_cell * distance[nn];
+            std::int64_t new_height = std::max(envelope[nn], cone);
+            if ((remainder > 0) && (cone + 1 > envelope[nn])) {
+                // Adding the remaining soil to the next layer of the cone
+                new_height++;
+                remainder--;
+            }
+            if (new_height == height[nn])
+                continue;
+
+            int ii = area[0][0] + nn / area_length_y;
+            int jj = area[1][0] + nn % area_length_y;
+            sim_out->terrain_[ii][jj] = new_height * grid.cell_size_z_;
+
+            // Marking the modified cell for the next relaxation
+            MarkDirtyCell(sim_out, ii, jj);
+
+            settle_min_x = std::min(settle_min_x, ii);
+            settle_max_x = std::max(settle_max_x, ii);
+            settle_min_y = std::min(settle_min_y, jj);
+            settle_max_y = std::max(settle_max_y, jj);
+        }
+    }
+    sim_out->equilibrium_ = false;
+
+    // Updating relax_area and relax_regions to include the modified cells
+    int settle_area[2][2] = {
+        {std::max(settle_min_x - sim_param.cell_buffer_, 2),
+            std::min(
+                settle_max_x + sim_param.cell_buffer_,
+                2 * grid.half_length_x_)},
+        {std::max(settle_min_y - sim_param.cell_buffer_, 2),
+            std::min(
+                settle_max_y + sim_param.cell_buffer_,
+                2 * grid.half_length_y_)}};
+    sim_out->relax_regions_.Add(settle_area);
+    sim_out->relax_area_[0][0] = std::max(std::min(
+        sim_out->relax_area_[0][0], settle_min_x - sim_param.cell_buffer_), 2);
+    sim_out->relax_area_[0][1] = std::min(std::max(
+        sim_out->relax_area_[0][1], settle_max_x + sim_param.cell_buffer_),
+        2 * grid.half_length_x_);
+    sim_out->relax_area_[1][0] = std::max(std::min(
+        sim_out->relax_area_[1][0], settle_min_y - sim_param.cell_buffer_), 2);
+    sim_out->relax_area_[1][1] = std::min(std::max(
+        sim_out->relax_area_[1][1], settle_max_y + sim_param.cell_buffer_),
+        2 * grid.half_length_y_);
+
+    return true;
 }
 
 /// The soil stability is determined by the `repose_angle_`. If the slope formed
@@ -155,8 +1285,14 @@ void soil_simulator::RelaxTerrain(
 /// (1) The soil column in the neighbouring cell is low enough.
 /// (2) There is space on the top of the neighbouring soil column.
 void soil_simulator::RelaxBodySoil(
-    SimOut* sim_out, Grid grid, Body* body, SimParam sim_param, float tol
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, Workspace* workspace
 ) {
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
     // Calculating the maximum slope allowed by the repose angle
     float slope_max = std::tan(sim_param.repose_angle_);
     // Calculating the maximum height different allowed by the repose angle
@@ -164,12 +1300,13 @@ void soil_simulator::RelaxBodySoil(
     dh_max = grid.cell_size_z_ * round(dh_max / grid.cell_size_z_);
 
     // Storing all possible directions for relaxation
-    std::vector<std::vector<int>> directions = {
-        {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    const std::array<std::array<int, 2>, 4> directions_init = {{
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+    auto directions = directions_init;
 
     // Initializing queue for new body_soil_pos
-    std::vector<soil_simulator::body_soil> *new_body_soil_pos = (
-        new std::vector<soil_simulator::body_soil>);
+    auto new_body_soil_pos = &workspace->body_soil_pos_;
+    new_body_soil_pos->clear();
 
     // Iterating over all body_soil cells
     for (auto nn = 0; nn < sim_out->body_soil_pos_.size(); nn++) {
@@ -185,12 +1322,19 @@ void soil_simulator::RelaxBodySoil(
         }
 
         // Randomizing direction to avoid asymmetry
-        // random_suffle is not used because it is machine dependent,
-        // which makes unit testing difficult
-        for (int aa = directions.size() - 1; aa > 0; aa--) {
-            std::uniform_int_distribution<int> dist(0, aa);
-            int bb = dist(rng);
-            std::swap(directions[aa], directions[bb]);
+        if (workspace->rng_ != nullptr) {
+            // Drawing the directions from the counter of the cell
+            directions = CounterRng::Permute(
+                directions_init, workspace->rng_->Draw(
+                RandomSite::kRelaxBodySoil, ii, jj, ind));
+        } else {
+            // random_suffle is not used because it is machine dependent,
+            // which makes unit testing difficult
+            for (int aa = directions.size() - 1; aa > 0; aa--) {
+                std::uniform_int_distribution<int> dist(0, aa);
+                int bb = dist(rng);
+                std::swap(directions[aa], directions[bb]);
+            }
         }
 
         // Iterating over the possible directions
@@ -218,6 +1362,10 @@ void soil_simulator::RelaxBodySoil(
             RelaxUnstableBodyCell(
                 sim_out, status, new_body_soil_pos, dh_max, nn, ii, jj, ind,
                 ii_c, jj_c, grid, body, tol);
+
+            // Marking the modified cells for the next relaxation
+            MarkDirtyCell(sim_out, ii, jj);
+            MarkDirtyCell(sim_out, ii_c, jj_c);
         }
     }
 
@@ -225,40 +1373,285 @@ void soil_simulator::RelaxBodySoil(
     for (auto nn = 0; nn < new_body_soil_pos->size(); nn++) {
         sim_out->body_soil_pos_.push_back((*new_body_soil_pos)[nn]);
     }
-    delete new_body_soil_pos;
 }
 
 /// It is important to note that the cells selected by this function are not
 /// necessarily unstable, as a body or the soil resting on it could be
 /// supporting the soil column. This is only a first-order selection of
 /// cells potentially unstable.
-std::vector<std::vector<int>> soil_simulator::LocateUnstableTerrainCell(
-    SimOut* sim_out, float dh_max, float tol
+void soil_simulator::LocateUnstableTerrainCell(
+    SimOut* sim_out, float dh_max, float tol, CellList<2>* unstable_cells
 ) {
     // Initializing
-    std::vector<std::vector<int>> unstable_cells;
+    unstable_cells->clear();
+
+    // Iterating over the parts of impact_area_ covered by impact_regions_
+    const auto& terrain = sim_out->terrain_;
+    for (auto nn = 0; nn < sim_out->impact_regions_.size(); nn++) {
+        int area[2][2];
+        sim_out->impact_regions_.Get(nn, area);
+        area[0][0] = std::max(area[0][0], sim_out->impact_area_[0][0]);
+        area[0][1] = std::min(area[0][1], sim_out->impact_area_[0][1]);
+        area[1][0] = std::max(area[1][0], sim_out->impact_area_[1][0]);
+        area[1][1] = std::min(area[1][1], sim_out->impact_area_[1][1]);
+        AppendUnstableTerrainCell(terrain, area, dh_max, tol, unstable_cells);
+    }
+}
+
+void soil_simulator::LocateUnstableTerrainCell(
+    const terrain_t& terrain, const int area[2][2], float dh_max, float tol,
+    CellList<2>* unstable_cells
+) {
+    // Initializing
+    unstable_cells->clear();
+
+    // Iterating over the terrain within area
+    AppendUnstableTerrainCell(terrain, area, dh_max, tol, unstable_cells);
+}
 
+/// The rows of `area` are processed by blocks of 64 cells, and the unstable
+/// cells of each block are provided as a bitmask by
+/// `LocateUnstableTerrainBlock`. The cells are added to `unstable_cells` in
+/// the same order as a row-major scan of `area`.
+void soil_simulator::AppendUnstableTerrainCell(
+    const terrain_t& terrain, const int area[2][2], float dh_max, float tol,
+    CellList<2>* unstable_cells
+) {
     // Iterating over the terrain
-    int ii_min = sim_out->impact_area_[0][0];
-    int ii_max = sim_out->impact_area_[0][1];
-    int jj_min = sim_out->impact_area_[1][0];
-    int jj_max = sim_out->impact_area_[1][1];
-    for (auto ii = ii_min; ii < ii_max; ii++)
-        for (auto jj = jj_min; jj < jj_max; jj++) {
-            // Calculating the minimum height allowed surrounding
-            // the considered soil cell
-            float h_min = sim_out->terrain_[ii][jj] - dh_max - tol;
+    for (auto ii = area[0][0]; ii < area[0][1]; ii++)
+        for (auto jj = area[1][0]; jj < area[1][1]; jj += 64) {
+            int n_cell = std::min(64, area[1][1] - jj);
+            auto mask = LocateUnstableTerrainBlock(
+                terrain, ii, jj, n_cell, dh_max, tol);
+
+            // Adding the unstable cells of the block
+            while (mask != 0) {
+                int kk = std::countr_zero(mask);
+                unstable_cells->push_back({ii, jj + kk});
+                mask &= mask - 1;
+            }
+        }
+}
 
-            if (
-                (sim_out->terrain_[ii-1][jj] < h_min) ||
-                (sim_out->terrain_[ii+1][jj] < h_min) ||
-                (sim_out->terrain_[ii][jj-1] < h_min) ||
-                (sim_out->terrain_[ii][jj+1] < h_min)
-            ) {
-                // Soil cell is requiring relaxation
-                unstable_cells.push_back(std::vector<int> {ii, jj});
+/// The rows of `area` are processed by blocks of 64 cells with
+/// `LocateUnstableTerrainBlock`, so that the cells are counted without being
+/// listed.
+int soil_simulator::CalcUnstableTerrainArea(
+    const terrain_t& terrain, const int area[2][2], float dh_max, float tol,
+    int unstable_area[2][2]
+) {
+    // Initializing the 2D bounding box to an empty area
+    unstable_area[0][0] = area[0][1];
+    unstable_area[0][1] = area[0][0];
+    unstable_area[1][0] = area[1][1];
+    unstable_area[1][1] = area[1][0];
+
+    // Iterating over the terrain
+    int n_unstable = 0;
+    for (auto ii = area[0][0]; ii < area[0][1]; ii++)
+        for (auto jj = area[1][0]; jj < area[1][1]; jj += 64) {
+            int n_cell = std::min(64, area[1][1] - jj);
+            auto mask = LocateUnstableTerrainBlock(
+                terrain, ii, jj, n_cell, dh_max, tol);
+            if (mask == 0)
+                continue;
+
+            // Adding the unstable cells of the block
+            n_unstable += std::popcount(mask);
+            unstable_area[0][0] = std::min(unstable_area[0][0], ii);
+            unstable_area[0][1] = std::max(unstable_area[0][1], ii + 1);
+            unstable_area[1][0] = std::min(
+                unstable_area[1][0], jj + std::countr_zero(mask));
+            unstable_area[1][1] = std::max(
+                unstable_area[1][1], jj + 64 - std::countl_zero(mask));
+        }
+
+    return n_unstable;
+}
+
+/// When the terrain is stored as a dense array of float, the stencil is
+/// evaluated on four cells at once with SSE2 instructions. The remaining
+/// cells, or all cells for the other storages, are evaluated one by one.
+std::uint64_t soil_simulator::LocateUnstableTerrainBlock(
+    const terrain_t& terrain, int ii, int jj, int n_cell, float dh_max,
+    float tol
+) {
+    std::uint64_t mask = 0;
+    int kk = 0;
+
+    #ifdef SOIL_SIMULATOR_SIMD_STENCIL
+    // Pointers to the block and to the neighbouring rows
+    const float* row = terrain[ii].data() + jj;
+    const float* row_m = terrain[ii-1].data() + jj;
+    const float* row_p = terrain[ii+1].data() + jj;
+    __m128 dh_max_v = _mm_set1_ps(dh_max);
+    __m128 tol_v = _mm_set1_ps(tol);
+
+    for (; kk + 4 <= n_cell; kk += 4) {
+        // Calculating the minimum height allowed surrounding the cells
+        __m128 h_min = _mm_sub_ps(
+            _mm_sub_ps(_mm_loadu_ps(row + kk), dh_max_v), tol_v);
+
+        // Comparing with the four adjacent cells
+        __m128 unstable = _mm_or_ps(
+            _mm_or_ps(
+                _mm_cmplt_ps(_mm_loadu_ps(row_m + kk), h_min),
+                _mm_cmplt_ps(_mm_loadu_ps(row_p + kk), h_min)),
+            _mm_or_ps(
+                _mm_cmplt_ps(_mm_loadu_ps(row + kk - 1), h_min),
+                _mm_cmplt_ps(_mm_loadu_ps(row + kk + 1), h_min)));
+        mask |= static_cast<std::uint64_t>(_mm_movemask_ps(unstable)) << kk;
+    }
+    #endif
+
+    for (; kk < n_cell; kk++) {
+        // Calculating the minimum height allowed surrounding
+        // the considered soil cell
+        float h_min = terrain[ii][jj+kk] - dh_max - tol;
+
+        if (
+            (terrain[ii-1][jj+kk] < h_min) ||
+            (terrain[ii+1][jj+kk] < h_min) ||
+            (terrain[ii][jj+kk-1] < h_min) ||
+            (terrain[ii][jj+kk+1] < h_min)
+        ) {
+            // Soil cell is requiring relaxation
+            mask |= std::uint64_t(1) << kk;
+        }
+    }
+
+    return mask;
+}
+
+void soil_simulator::LocateDirtyTerrainCell(
+    SimOut* sim_out, float dh_max, float tol, CellList<2>* unstable_cells
+) {
+    // Locating the unstable cells
+    CellBitmap unstable_bitmap;
+    LocateDirtyTerrainCell(sim_out, dh_max, tol, &unstable_bitmap);
+
+    // Converting the bitmap into cells indices
+    unstable_cells->clear();
+    for (auto cell : unstable_bitmap)
+        unstable_cells->push_back(cell);
+}
+
+void soil_simulator::LocateDirtyTerrainCell(
+    SimOut* sim_out, float dh_max, float tol, CellBitmap* unstable_cells
+) {
+    // Calculating the 2D bounding box of the dirty cells
+    int area[2][2] = {{0, 0}, {0, 0}};
+    if (sim_out->dirty_cells_.size() != 0) {
+        area[0][0] = sim_out->dirty_mask_.size_x();
+        area[1][0] = sim_out->dirty_mask_.size_y();
+    }
+    for (auto nn = 0; nn < sim_out->dirty_cells_.size(); nn++) {
+        area[0][0] = std::min(area[0][0], sim_out->dirty_cells_[nn][0]);
+        area[0][1] = std::max(area[0][1], sim_out->dirty_cells_[nn][0] + 1);
+        area[1][0] = std::min(area[1][0], sim_out->dirty_cells_[nn][1]);
+        area[1][1] = std::max(area[1][1], sim_out->dirty_cells_[nn][1] + 1);
+    }
+    unstable_cells->Reset(area);
+
+    // Iterating over the dirty cells
+    for (auto nn = 0; nn < sim_out->dirty_cells_.size(); nn++) {
+        int ii = sim_out->dirty_cells_[nn][0];
+        int jj = sim_out->dirty_cells_[nn][1];
+        sim_out->dirty_mask_[ii][jj] = 0;
+
+        // Calculating the minimum height allowed surrounding
+        // the considered soil cell
+        float h_min = sim_out->terrain_[ii][jj] - dh_max - tol;
+
+        if (
+            (sim_out->terrain_[ii-1][jj] < h_min) ||
+            (sim_out->terrain_[ii+1][jj] < h_min) ||
+            (sim_out->terrain_[ii][jj-1] < h_min) ||
+            (sim_out->terrain_[ii][jj+1] < h_min)
+        ) {
+            // Soil cell is requiring relaxation
+            unstable_cells->Set(ii, jj);
+        }
+    }
+
+    // Emptying the dirty cells
+    sim_out->dirty_cells_.clear();
+}
+
+/// The stability of a soil column depends on its four adjacent cells, so that
+/// these cells are also marked. Only the cells with indices in
+/// `[2, size - 2)` are marked, as the stability of the cells on the border of
+/// the grid is not checked.
+void soil_simulator::MarkDirtyCell(SimOut* sim_out, int ii, int jj) {
+    // Storing the cell and its four adjacent cells
+    std::array<std::array<int, 2>, 5> cells = {{
+        {ii, jj}, {ii + 1, jj}, {ii - 1, jj}, {ii, jj + 1}, {ii, jj - 1}}};
+
+    int ii_max = sim_out->dirty_mask_.size_x() - 2;
+    int jj_max = sim_out->dirty_mask_.size_y() - 2;
+    for (auto nn = 0; nn < cells.size(); nn++) {
+        int ii_c = cells[nn][0];
+        int jj_c = cells[nn][1];
+
+        if (
+            (ii_c < 2) || (ii_c >= ii_max) || (jj_c < 2) ||
+            (jj_c >= jj_max) ||
+            (sim_out->dirty_mask_[ii_c][jj_c])
+        ) {
+            // Cell outside the grid or already marked
+            continue;
+        }
+
+        // Marking the cell
+        sim_out->dirty_mask_[ii_c][jj_c] = 1;
+        sim_out->dirty_cells_.push_back({ii_c, jj_c});
+    }
+}
+
+/// Only the cells selected by the first-order stability check of
+/// `LocateDirtyTerrainCell` are marked, so that the number of dirty cells
+/// does not scale with the size of `area`. The cells of `area` modified
+/// afterwards are marked by the function modifying them. The cells on the
+/// border of the grid are not marked, as their neighbours are not all present.
+void soil_simulator::MarkDirtyArea(
+    SimOut* sim_out, const int area[2][2], float dh_max, float tol
+) {
+    // Restricting the area to the cells having four neighbours
+    int ii_min = std::max(area[0][0], 1);
+    int ii_max = std::min(area[0][1], sim_out->dirty_mask_.size_x() - 1);
+    int jj_min = std::max(area[1][0], 1);
+    int jj_max = std::min(area[1][1], sim_out->dirty_mask_.size_y() - 1);
+
+    // Iterating over the terrain by blocks of 64 cells
+    // A const reference is used so that no terrain tile gets allocated
+    const auto& terrain = sim_out->terrain_;
+    for (auto ii = ii_min; ii < ii_max; ii++)
+        for (auto jj = jj_min; jj < jj_max; jj += 64) {
+            int n_cell = std::min(64, jj_max - jj);
+            auto mask = LocateUnstableTerrainBlock(
+                terrain, ii, jj, n_cell, dh_max, tol);
+
+            while (mask != 0) {
+                int jj_c = jj + std::countr_zero(mask);
+                mask &= mask - 1;
+
+                if (sim_out->dirty_mask_[ii][jj_c])
+                    // Cell already marked
+                    continue;
+
+                // Marking the cell
+                sim_out->dirty_mask_[ii][jj_c] = 1;
+                sim_out->dirty_cells_.push_back({ii, jj_c});
             }
         }
+}
+
+soil_simulator::CellList<2> soil_simulator::LocateUnstableTerrainCell(
+    SimOut* sim_out, float dh_max, float tol
+) {
+    CellList<2> unstable_cells;
+    soil_simulator::LocateUnstableTerrainCell(
+        sim_out, dh_max, tol, &unstable_cells);
 
     return unstable_cells;
 }
@@ -286,19 +1679,21 @@ std::vector<std::vector<int>> soil_simulator::LocateUnstableTerrainCell(
 /// Note that not all combinations for `status` are possible.
 /// Some combinations, such as `41` or `23` are impossible.
 int soil_simulator::CheckUnstableTerrainCell(
-    SimOut* sim_out, int ii_c, int jj_c, float h_min, float tol
+    const SimOut* sim_out, int ii_c, int jj_c, float h_min, float tol
 ) {
     // Checking whether soil is low enough, because unstability may have
     // already been solved
     if (sim_out->terrain_[ii_c][jj_c] + tol < h_min) {
         // Adjacent terrain is low enough
+        // Loading all body and body soil layers of the cell
+        float body_cell[4];
+        float body_soil_cell[4];
+        sim_out->body_.LoadCell(ii_c, jj_c, body_cell);
+        sim_out->body_soil_.LoadCell(ii_c, jj_c, body_soil_cell);
+
         // Determining presence of body
-        bool body_absence_1 = (
-            (sim_out->body_[0][ii_c][jj_c] == 0.0) &&
-            (sim_out->body_[1][ii_c][jj_c] == 0.0));
-        bool body_absence_3 = (
-            (sim_out->body_[2][ii_c][jj_c] == 0.0) &&
-            (sim_out->body_[3][ii_c][jj_c] == 0.0));
+        bool body_absence_1 = (body_cell[0] == 0.0) && (body_cell[1] == 0.0);
+        bool body_absence_3 = (body_cell[2] == 0.0) && (body_cell[3] == 0.0);
         int status;
         float column_top;
         float body_bot;
@@ -308,7 +1703,7 @@ int soil_simulator::CheckUnstableTerrainCell(
         } else if (body_absence_1) {
             // Only the second body layer
             status = 20;
-            body_bot = sim_out->body_[2][ii_c][jj_c];
+            body_bot = body_cell[2];
 
             if (sim_out->terrain_[ii_c][jj_c] + tol < body_bot) {
                 // Space under the body
@@ -316,22 +1711,22 @@ int soil_simulator::CheckUnstableTerrainCell(
             } else {
                 // Body is on the terrain
                 if (
-                    (sim_out->body_soil_[2][ii_c][jj_c] != 0.0) ||
-                    (sim_out->body_soil_[3][ii_c][jj_c] != 0.0)
+                    (body_soil_cell[2] != 0.0) ||
+                    (body_soil_cell[3] != 0.0)
                 ) {
                     // Body soil is present
                     status += 1;
-                    column_top = sim_out->body_soil_[3][ii_c][jj_c];
+                    column_top = body_soil_cell[3];
                 } else {
                     // Body soil is not present
                     status += 2;
-                    column_top = sim_out->body_[3][ii_c][jj_c];
+                    column_top = body_cell[3];
                 }
             }
         } else if (body_absence_3) {
             // Only the first body layer
             status = 10;
-            body_bot = sim_out->body_[0][ii_c][jj_c];
+            body_bot = body_cell[0];
 
             if (sim_out->terrain_[ii_c][jj_c] + tol < body_bot) {
                 // Space under the body
@@ -339,16 +1734,16 @@ int soil_simulator::CheckUnstableTerrainCell(
             } else {
                 // Body is on the terrain
                 if (
-                    (sim_out->body_soil_[0][ii_c][jj_c] != 0.0) ||
-                    (sim_out->body_soil_[1][ii_c][jj_c] != 0.0)
+                    (body_soil_cell[0] != 0.0) ||
+                    (body_soil_cell[1] != 0.0)
                 ) {
                     // Body soil is present
                     status += 3;
-                    column_top = sim_out->body_soil_[1][ii_c][jj_c];
+                    column_top = body_soil_cell[1];
                 } else {
                     // Body soil is not present
                     status += 4;
-                    column_top = sim_out->body_[1][ii_c][jj_c];
+                    column_top = body_cell[1];
                 }
             }
         } else {
@@ -358,14 +1753,14 @@ int soil_simulator::CheckUnstableTerrainCell(
             int ind_top;
 
             // Checking which layer is lower
-            if (sim_out->body_[0][ii_c][jj_c] < sim_out->body_[2][ii_c][jj_c]) {
+            if (body_cell[0] < body_cell[2]) {
                 // First body layer is lower
-                body_bot = sim_out->body_[0][ii_c][jj_c];
+                body_bot = body_cell[0];
                 ind_bot = 0;
                 ind_top = 2;
             } else {
                 // Second body layer is lower
-                body_bot = sim_out->body_[2][ii_c][jj_c];
+                body_bot = body_cell[2];
                 ind_bot = 2;
                 ind_top = 0;
             }
@@ -376,35 +1771,32 @@ int soil_simulator::CheckUnstableTerrainCell(
             } else {
                 // Body is on the terrain
                 if (
-                    (sim_out->body_soil_[ind_bot][ii_c][jj_c] != 0.0) ||
-                    (sim_out->body_soil_[ind_bot+1][ii_c][jj_c] != 0.0)) {
+                    (body_soil_cell[ind_bot] != 0.0) ||
+                    (body_soil_cell[ind_bot+1] != 0.0)) {
                     // Body soil is present on the bottom body layer
-                    if (
-                        sim_out->body_soil_[ind_bot+1][ii_c][jj_c] + tol >
-                        sim_out->body_[ind_top][ii_c][jj_c]) {
+                    if (body_soil_cell[ind_bot+1] + tol > body_cell[ind_top]) {
                         // Soil is filling the space between the body layers
                         // Soil may avalanche on the body
                         if (
-                            (sim_out->body_soil_[ind_top][ii_c][jj_c] != 0.0) ||
-                            (sim_out->body_soil_[ind_top+1][ii_c][jj_c] != 0.0)
+                            (body_soil_cell[ind_top] != 0.0) ||
+                            (body_soil_cell[ind_top+1] != 0.0)
                         ) {
                             // Body soil is present on the top body layer
-                            column_top = (
-                                sim_out->body_soil_[ind_top+1][ii_c][jj_c]);
+                            column_top = body_soil_cell[ind_top+1];
                             status += ind_bot + 1;
                         } else {
                             // Body soil is not present on top body layer
-                            column_top = sim_out->body_[ind_top+1][ii_c][jj_c];
+                            column_top = body_cell[ind_top+1];
                             status += ind_bot + 2;
                         }
                     } else {
                         // Soil may relax between the two body layers
-                        column_top = sim_out->body_soil_[ind_bot+1][ii_c][jj_c];
+                        column_top = body_soil_cell[ind_bot+1];
                         status += ind_top + 1;
                     }
                 } else {
                     // Body soil is not present on the bottom body layer
-                    column_top = sim_out->body_[ind_bot+1][ii_c][jj_c];
+                    column_top = body_cell[ind_bot+1];
                     status += ind_top + 2;
                 }
             }
@@ -582,12 +1974,22 @@ int soil_simulator::CheckUnstableBodyCell(
 /// configuration, the soil avalanche below the body to fill the space under
 /// it.
 ///
+/// When the soil avalanches onto the `terrain_`, only the `terrain_` at
+/// (`ii`, `jj`) and (`ii_c`, `jj_c`) is modified and the body layers are only
+/// read through a const reference. The avalanches onto the `terrain_` of
+/// cells whose neighbourhoods do not overlap can therefore be made
+/// concurrently, whatever the container used to store the body layers.
+///
 /// Note that it is assumed that the given `status` is accurate, so no extra
 /// checks are present.
 void soil_simulator::RelaxUnstableTerrainCell(
     SimOut* sim_out, int status, float dh_max, int ii, int jj, int ii_c,
-    int jj_c, Grid grid, Body* body, float tol
+    int jj_c, const Grid& grid, Body* body, float tol
 ) {
+    // The body layers are only read, through a const reference, so that no
+    // storage is modified when the function is called concurrently
+    const auto& body_layers = sim_out->body_;
+
     // Converting status into a string for convenience
     std::string st = std::to_string(status);
 
@@ -612,14 +2014,14 @@ void soil_simulator::RelaxUnstableTerrainCell(
             return;
         } else if (st[0] == '1') {
             // Under the first body layer
-            body_bot = sim_out->body_[0][ii_c][jj_c];
+            body_bot = body_layers[0][ii_c][jj_c];
         } else if (st[0] == '2') {
             // Under the second body layer
-            body_bot = sim_out->body_[2][ii_c][jj_c];
+            body_bot = body_layers[2][ii_c][jj_c];
         } else if (st[0] == '3') {
             // Two body layers present
             body_bot = std::min(
-                {sim_out->body_[0][ii_c][jj_c], sim_out->body_[2][ii_c][jj_c]});
+                {body_layers[0][ii_c][jj_c], body_layers[2][ii_c][jj_c]});
         }
 
         if (h_new_c < body_bot) {
@@ -645,14 +2047,14 @@ void soil_simulator::RelaxUnstableTerrainCell(
 
         if (st[0] == '3') {
             // Two body layers are present
-            if (sim_out->body_[3][ii_c][jj_c] < sim_out->body_[0][ii_c][jj_c]) {
+            if (body_layers[3][ii_c][jj_c] < body_layers[0][ii_c][jj_c]) {
                 // Soil should avalanche between the two body layer
-                if (h_new_c - tol > sim_out->body_[0][ii_c][jj_c]) {
+                if (h_new_c - tol > body_layers[0][ii_c][jj_c]) {
                     // Not enough space for all the soil
                     h_soil = (
-                        sim_out->body_[0][ii_c][jj_c] -
+                        body_layers[0][ii_c][jj_c] -
                         sim_out->body_soil_[3][ii_c][jj_c]);
-                    h_new_c = sim_out->body_[0][ii_c][jj_c];
+                    h_new_c = body_layers[0][ii_c][jj_c];
                     h_new = sim_out->terrain_[ii][jj] - h_soil;
                 }
             }
@@ -664,51 +2066,59 @@ void soil_simulator::RelaxUnstableTerrainCell(
 
         // Calculating pos of cell in body frame
         auto pos = soil_simulator::CalcBodyFramePos(
-            ii_c, jj_c, sim_out->body_[3][ii_c][jj_c], grid, body);
+            ii_c, jj_c, body_layers[3][ii_c][jj_c], grid, body);
 
         // Adding new body soil position to body_soil_pos
         sim_out->body_soil_pos_.push_back(
             soil_simulator::body_soil
             {2, ii_c, jj_c, pos[0], pos[1], pos[2], h_soil});
+
+        // Updating the soil volume ledger
+        sim_out->terrain_volume_ -= h_soil;
+        sim_out->body_soil_volume_ += h_soil;
     } else if (st[1] == '2') {
         // Soil avalanche on the second body layer
         h_new = 0.5 * (
             dh_max + sim_out->terrain_[ii][jj] +
-            sim_out->body_[3][ii_c][jj_c]);
+            body_layers[3][ii_c][jj_c]);
         h_new = grid.cell_size_z_ * std::floor(
             (h_new + tol) / grid.cell_size_z_);
         h_new_c = (
-            sim_out->terrain_[ii][jj] + sim_out->body_[3][ii_c][jj_c] - h_new);
+            sim_out->terrain_[ii][jj] + body_layers[3][ii_c][jj_c] - h_new);
 
         if (st[0] == '3') {
             // Two body layers are present
-            if (sim_out->body_[3][ii_c][jj_c] < sim_out->body_[0][ii_c][jj_c]) {
+            if (body_layers[3][ii_c][jj_c] < body_layers[0][ii_c][jj_c]) {
                 // Soil should avalanche between the two body layer
-                if (h_new_c - tol > sim_out->body_[0][ii_c][jj_c]) {
+                if (h_new_c - tol > body_layers[0][ii_c][jj_c]) {
                     // Not enough space for all the soil
-                    h_new_c = sim_out->body_[0][ii_c][jj_c];
+                    h_new_c = body_layers[0][ii_c][jj_c];
                     h_new = (
                         sim_out->terrain_[ii][jj] -
-                        sim_out->body_[0][ii_c][jj_c] +
-                        sim_out->body_[3][ii_c][jj_c]);
+                        body_layers[0][ii_c][jj_c] +
+                        body_layers[3][ii_c][jj_c]);
                 }
             }
         }
 
         // Updating terrain
         sim_out->terrain_[ii][jj] = h_new;
-        sim_out->body_soil_[2][ii_c][jj_c] = sim_out->body_[3][ii_c][jj_c];
+        sim_out->body_soil_[2][ii_c][jj_c] = body_layers[3][ii_c][jj_c];
         sim_out->body_soil_[3][ii_c][jj_c] = h_new_c;
 
         // Calculating pos of cell in body frame
         auto pos = soil_simulator::CalcBodyFramePos(
-            ii_c, jj_c, sim_out->body_[3][ii_c][jj_c], grid, body);
+            ii_c, jj_c, body_layers[3][ii_c][jj_c], grid, body);
 
         // Adding new body soil position to body_soil_pos
-        h_soil = h_new_c - sim_out->body_[3][ii_c][jj_c];
+        h_soil = h_new_c - body_layers[3][ii_c][jj_c];
         sim_out->body_soil_pos_.push_back(
             soil_simulator::body_soil
             {2, ii_c, jj_c, pos[0], pos[1], pos[2], h_soil});
+
+        // Updating the soil volume ledger
+        sim_out->terrain_volume_ -= h_soil;
+        sim_out->body_soil_volume_ += h_soil;
     } else if (st[1] == '3') {
         // Soil avalanche on the first body soil layer
         h_new = 0.5 * (
@@ -721,14 +2131,14 @@ void soil_simulator::RelaxUnstableTerrainCell(
 
         if (st[0] == '3') {
             // Two body layers are present
-            if (sim_out->body_[1][ii_c][jj_c] < sim_out->body_[2][ii_c][jj_c]) {
+            if (body_layers[1][ii_c][jj_c] < body_layers[2][ii_c][jj_c]) {
                 // Soil should avalanche between the two body layer
-                if (h_new_c - tol > sim_out->body_[2][ii_c][jj_c]) {
+                if (h_new_c - tol > body_layers[2][ii_c][jj_c]) {
                     // Not enough space for all the soil
                     h_soil = (
-                        sim_out->body_[2][ii_c][jj_c] -
+                        body_layers[2][ii_c][jj_c] -
                         sim_out->body_soil_[1][ii_c][jj_c]);
-                    h_new_c = sim_out->body_[2][ii_c][jj_c];
+                    h_new_c = body_layers[2][ii_c][jj_c];
                     h_new = sim_out->terrain_[ii][jj] - h_soil;
                 }
             }
@@ -740,51 +2150,59 @@ void soil_simulator::RelaxUnstableTerrainCell(
 
         // Calculating pos of cell in body frame
         auto pos = soil_simulator::CalcBodyFramePos(
-            ii_c, jj_c, sim_out->body_[1][ii_c][jj_c], grid, body);
+            ii_c, jj_c, body_layers[1][ii_c][jj_c], grid, body);
 
         // Adding new body soil position to body_soil_pos
         sim_out->body_soil_pos_.push_back(
             soil_simulator::body_soil
             {0, ii_c, jj_c, pos[0], pos[1], pos[2], h_soil});
+
+        // Updating the soil volume ledger
+        sim_out->terrain_volume_ -= h_soil;
+        sim_out->body_soil_volume_ += h_soil;
     } else if (st[1] == '4') {
         // Soil avalanche on the first body layer
         h_new = 0.5 * (
             dh_max + sim_out->terrain_[ii][jj] +
-            sim_out->body_[1][ii_c][jj_c]);
+            body_layers[1][ii_c][jj_c]);
         h_new = grid.cell_size_z_ * std::floor(
             (h_new + tol) / grid.cell_size_z_);
         h_new_c = (
-            sim_out->terrain_[ii][jj] + sim_out->body_[1][ii_c][jj_c] - h_new);
+            sim_out->terrain_[ii][jj] + body_layers[1][ii_c][jj_c] - h_new);
 
         if (st[0] == '3') {
             // Two body layers are present
-            if (sim_out->body_[1][ii_c][jj_c] < sim_out->body_[2][ii_c][jj_c]) {
+            if (body_layers[1][ii_c][jj_c] < body_layers[2][ii_c][jj_c]) {
                 // Soil should avalanche between the two body layer
-                if (h_new_c - tol > sim_out->body_[2][ii_c][jj_c]) {
+                if (h_new_c - tol > body_layers[2][ii_c][jj_c]) {
                     // Not enough space for all the soil
-                    h_new_c = sim_out->body_[2][ii_c][jj_c];
+                    h_new_c = body_layers[2][ii_c][jj_c];
                     h_new = (
                         sim_out->terrain_[ii][jj] -
-                        sim_out->body_[2][ii_c][jj_c] +
-                        sim_out->body_[1][ii_c][jj_c]);
+                        body_layers[2][ii_c][jj_c] +
+                        body_layers[1][ii_c][jj_c]);
                 }
             }
         }
 
         // Updating terrain
         sim_out->terrain_[ii][jj] = h_new;
-        sim_out->body_soil_[0][ii_c][jj_c] = sim_out->body_[1][ii_c][jj_c];
+        sim_out->body_soil_[0][ii_c][jj_c] = body_layers[1][ii_c][jj_c];
         sim_out->body_soil_[1][ii_c][jj_c] = h_new_c;
 
         // Calculating pos of cell in body frame
         auto pos = soil_simulator::CalcBodyFramePos(
-            ii_c, jj_c, sim_out->body_[1][ii_c][jj_c], grid, body);
+            ii_c, jj_c, body_layers[1][ii_c][jj_c], grid, body);
 
         // Adding new body soil position to body_soil_pos
-        h_soil = h_new_c - sim_out->body_[1][ii_c][jj_c];
+        h_soil = h_new_c - body_layers[1][ii_c][jj_c];
         sim_out->body_soil_pos_.push_back(
             soil_simulator::body_soil
             {0, ii_c, jj_c, pos[0], pos[1], pos[2], h_soil});
+
+        // Updating the soil volume ledger
+        sim_out->terrain_volume_ -= h_soil;
+        sim_out->body_soil_volume_ += h_soil;
     }
 }
 
@@ -800,7 +2218,7 @@ void soil_simulator::RelaxUnstableTerrainCell(
 void soil_simulator::RelaxUnstableBodyCell(
     SimOut* sim_out, int status, std::vector<body_soil>* body_soil_pos,
     float dh_max, int nn, int ii, int jj, int ind, int ii_c, int jj_c,
-    Grid grid, Body* body, float tol
+    const Grid& grid, Body* body, float tol
 ) {
     // Converting status into a string for convenience
     std::string st = std::to_string(status);
@@ -857,6 +2275,10 @@ void soil_simulator::RelaxUnstableBodyCell(
             sim_out->body_soil_[ind+1][ii][jj] = 0.0;
             sim_out->body_soil_pos_[nn].h_soil = 0.0;
         }
+
+        // Updating the soil volume ledger
+        sim_out->terrain_volume_ += h_soil;
+        sim_out->body_soil_volume_ -= h_soil;
     } else if (st[0] == '1') {
         // Only the first body layer
         if (st[1] == '3') {
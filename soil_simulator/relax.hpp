@@ -5,6 +5,9 @@ Copyright, 2023, Vilella Kenny.
 */
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <random>
 #include <vector>
 #include "soil_simulator/types.hpp"
 
@@ -21,8 +24,203 @@ extern std::mt19937 rng;
 /// \param body: Class that stores information related to the body object.
 /// \param sim_param: Class that stores information related to the simulation.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
 void RelaxTerrain(
-    SimOut* sim_out, Grid grid, Body* body, SimParam sim_param, float tol);
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, Workspace* workspace = nullptr);
+
+/// \brief This function moves the soil in `terrain_` towards a state closer
+///        to equilibrium, only checking the cells in `dirty_cells_`.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxDirtyTerrain(
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, Workspace* workspace = nullptr);
+
+/// \brief This function relaxes the given unstable cells of `terrain_` and
+///        updates `relax_area_`.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable, in the order they should be relaxed.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainCells(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief This function relaxes the given unstable cells of `terrain_` in a
+///        random order and updates `relax_area_`.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param unstable_cells: Set of cells indices that are possibly unstable.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainCells(
+    SimOut* sim_out, CellBitmap* unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief This function updates `relax_area_` and `relax_regions_` to cover
+///        the given cells and the `cell_buffer_` surrounding them.
+///        Previous areas of `relax_regions_` are discarded.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param cells: Collection of cells indices, either a `CellList<2>` or a
+///               `CellBitmap`.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param sim_param: Class that stores information related to the simulation.
+template <typename T>
+void UpdateRelaxArea(
+    SimOut* sim_out, const T& cells, const Grid& grid,
+    const SimParam& sim_param);
+
+/// \brief This function relaxes the unstable cells of `terrain_` one after
+///        the other.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable, in the order they should be relaxed.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainSerial(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, float tol, Workspace* workspace = nullptr);
+
+/// \brief This function relaxes the cell (`ii`, `jj`) of `terrain_` towards
+///        its four adjacent cells, in a random order of directions.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param ii: Index of the possibly unstable cell in the X direction.
+/// \param jj: Index of the possibly unstable cell in the Y direction.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainCell(
+    SimOut* sim_out, int ii, int jj, float dh_max, const Grid& grid,
+    Body* body, float tol, Workspace* workspace = nullptr);
+
+/// \brief This function relaxes the unstable cells of `terrain_`
+///        concurrently on `n_thread_` threads.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable, in the order they should be relaxed.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainParallel(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief This function draws the random order in which the four directions
+///        of the cell (`ii`, `jj`) are relaxed.
+///
+/// \param ii: Index of the cell in the X direction.
+/// \param jj: Index of the cell in the Y direction.
+/// \param workspace: Reusable buffers for temporary storage. The directions
+///                   are drawn from its `CounterRng` when it is set, and
+///                   from the global `rng` otherwise.
+/// \return The four directions in the order they should be relaxed.
+std::array<std::array<int, 2>, 4> DrawRelaxDirections(
+    int ii, int jj, Workspace* workspace = nullptr);
+
+/// \brief This function relaxes the unstable cells of `terrain_` colour by
+///        colour, the cells of a colour being relaxed concurrently on
+///        `n_thread_` threads.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable, in the order they should be relaxed.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage. Its
+///                   `cell_directions_` should store the directions of each
+///                   cell of `unstable_cells`.
+void RelaxTerrainColours(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace);
+
+/// \brief This function relaxes the unstable cells of `terrain_` by applying
+///        simultaneously the fluxes of soil between adjacent cells.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable, in the order the cells requiring an
+///                        avalanche onto the body should be relaxed.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param body: Class that stores information related to the body object.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainFlux(
+    SimOut* sim_out, const CellList<2>& unstable_cells, float dh_max,
+    const Grid& grid, Body* body, const SimParam& sim_param, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief This function redistributes the soil of `terrain_` on a hierarchy of
+///        coarser grids to accelerate the relaxation of large deposits.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param area: Area where the soil is redistributed, given as the minimum
+///              and exclusive maximum indices in the X and Y directions.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param workspace: Reusable buffers for temporary storage.
+void RelaxTerrainMultigrid(
+    SimOut* sim_out, const int area[2][2], const Grid& grid,
+    const SimParam& sim_param, Workspace* workspace = nullptr);
+
+/// \brief This function moves the soil of `terrain_` in `area` to the closest
+///        surface satisfying the repose angle while conserving the soil
+///        volume.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param area: Area where the soil is settled, given as the minimum and
+///              exclusive maximum indices in the X and Y directions.
+/// \param grid: Class that stores information related to the simulation grid.
+/// \param sim_param: Class that stores information related to the simulation.
+/// \param workspace: Reusable buffers for temporary storage.
+///
+/// \return A boolean indicating whether the terrain has been modified.
+bool SettleTerrain(
+    SimOut* sim_out, const int area[2][2], const Grid& grid,
+    const SimParam& sim_param, Workspace* workspace = nullptr);
 
 /// \brief This function moves the soil in `body_soil_` towards a state closer
 ///        to equilibrium.
@@ -32,8 +230,10 @@ void RelaxTerrain(
 /// \param body: Class that stores information related to the body object.
 /// \param sim_param: Class that stores information related to the simulation.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
 void RelaxBodySoil(
-    SimOut* sim_out, Grid grid, Body* body, SimParam sim_param, float tol);
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, Workspace* workspace = nullptr);
 
 /// \brief This function locates all the cells in `terrain_` that have a height
 ///        difference larger than `dh_max` with at least one neighbouring cell.
@@ -44,9 +244,124 @@ void RelaxBodySoil(
 /// \param tol: Small number used to handle numerical approximation errors.
 ///
 /// \return Collection of cells indices that are possibly unstable.
-std::vector<std::vector<int>> LocateUnstableTerrainCell(
+CellList<2> LocateUnstableTerrainCell(
     SimOut* sim_out, float dh_max, float tol);
 
+/// \brief Overload of `LocateUnstableTerrainCell` writing the cells into
+///        `unstable_cells`, so that its memory can be reused.
+///
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable. Previous content is discarded.
+void LocateUnstableTerrainCell(
+    SimOut* sim_out, float dh_max, float tol, CellList<2>* unstable_cells);
+
+/// \brief Overload of `LocateUnstableTerrainCell` checking the cells of
+///        `area` in `terrain`.
+///
+/// \param terrain: Height of the terrain. [m]
+/// \param area: 2D bounding box of the checked cells, following the
+///              convention of `impact_area_`.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable. Previous content is discarded.
+void LocateUnstableTerrainCell(
+    const terrain_t& terrain, const int area[2][2], float dh_max, float tol,
+    CellList<2>* unstable_cells);
+
+/// \brief This function appends to `unstable_cells` the cells of `area` in
+///        `terrain` that have a height difference larger than `dh_max` with
+///        at least one neighbouring cell.
+///
+/// \param terrain: Height of the terrain. [m]
+/// \param area: 2D bounding box of the checked cells, following the
+///              convention of `impact_area_`.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param unstable_cells: Collection of cells indices to which the cells
+///                        possibly unstable are appended.
+void AppendUnstableTerrainCell(
+    const terrain_t& terrain, const int area[2][2], float dh_max, float tol,
+    CellList<2>* unstable_cells);
+
+/// \brief This function calculates the number and the 2D bounding box of the
+///        cells of `area` in `terrain` that have a height difference larger
+///        than `dh_max` with at least one neighbouring cell.
+///
+/// \param terrain: Height of the terrain. [m]
+/// \param area: 2D bounding box of the checked cells, following the
+///              convention of `impact_area_`.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param unstable_area: 2D bounding box of the cells possibly unstable,
+///                       following the convention of `impact_area_`. It is
+///                       empty when no cell is possibly unstable.
+///
+/// \return Number of cells possibly unstable.
+int CalcUnstableTerrainArea(
+    const terrain_t& terrain, const int area[2][2], float dh_max, float tol,
+    int unstable_area[2][2]);
+
+/// \brief This function determines which cells of a block of consecutive cells
+///        in a row of `terrain` have a height difference larger than
+///        `dh_max` with at least one neighbouring cell.
+///
+/// \param terrain: Height of the terrain. [m]
+/// \param ii: Index of the row in the X direction.
+/// \param jj: Index of the first cell of the block in the Y direction.
+/// \param n_cell: Number of cells in the block. It should not exceed 64.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param tol: Small number used to handle numerical approximation errors.
+///
+/// \return Bitmask where the bit `kk` is set when the cell (`ii`, `jj + kk`)
+///         is possibly unstable.
+std::uint64_t LocateUnstableTerrainBlock(
+    const terrain_t& terrain, int ii, int jj, int n_cell, float dh_max,
+    float tol);
+
+/// \brief This function locates the cells in `dirty_cells_` that have a
+///        height difference larger than `dh_max` with at least one
+///        neighbouring cell. `dirty_cells_` is emptied.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param tol: Small number used to handle numerical approximation errors.
+/// \param unstable_cells: Collection of cells indices that are possibly
+///                        unstable, sorted in row-major order. Previous
+///                        content is discarded.
+void LocateDirtyTerrainCell(
+    SimOut* sim_out, float dh_max, float tol, CellList<2>* unstable_cells);
+
+/// \brief Overload of `LocateDirtyTerrainCell` storing the cells as a bitmap
+///        covering the 2D bounding box of `dirty_cells_`.
+///
+/// \param unstable_cells: Set of the cells that are possibly unstable.
+///                        Previous content is discarded.
+void LocateDirtyTerrainCell(
+    SimOut* sim_out, float dh_max, float tol, CellBitmap* unstable_cells);
+
+/// \brief This function adds the cell (`ii`, `jj`) and its four adjacent
+///        cells to `dirty_cells_`, unless they are already present.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param ii: Index of the modified cell in the X direction.
+/// \param jj: Index of the modified cell in the Y direction.
+void MarkDirtyCell(SimOut* sim_out, int ii, int jj);
+
+/// \brief This function adds the cells of `area` that are possibly unstable
+///        to `dirty_cells_`, unless they are already present.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param area: 2D bounding box of the cells to be added, following the
+///              convention of `impact_area_`.
+/// \param dh_max: Maximum height difference allowed between two neighbouring
+///                cells. [m]
+/// \param tol: Small number used to handle numerical approximation errors.
+void MarkDirtyArea(
+    SimOut* sim_out, const int area[2][2], float dh_max, float tol);
+
 /// \brief This function checks the stability of a soil column in `terrain_`
 ///        compared to one of its neighbour (`ii_c`, `jj_c`)
 ///
@@ -59,7 +374,7 @@ std::vector<std::vector<int>> LocateUnstableTerrainCell(
 /// \return Two-digit number indicating how the soil should avalanche.
 ///         `0` is returned if the soil column is stable.
 int CheckUnstableTerrainCell(
-    SimOut* sim_out, int ii_c, int jj_c, float h_min, float tol);
+    const SimOut* sim_out, int ii_c, int jj_c, float h_min, float tol);
 
 /// \brief This function checks the stability of a soil column in the soil
 ///        layer `ind` of `body_soil_` at (`ii`, `jj`) compared to one of its
@@ -96,7 +411,7 @@ int CheckUnstableBodyCell(
 /// \param tol: Small number used to handle numerical approximation errors.
 void RelaxUnstableTerrainCell(
     SimOut* sim_out, int status, float dh_max, int ii, int jj, int ii_c,
-    int jj_c, Grid grid, Body* body, float tol);
+    int jj_c, const Grid& grid, Body* body, float tol);
 
 /// \brief This function moves the soil from the soil layer `ind` of
 ///        `body_soil_` at (`ii`, `jj`) to the soil column in (`ii_c`, `jj_c`).
@@ -118,6 +433,6 @@ void RelaxUnstableTerrainCell(
 void RelaxUnstableBodyCell(
     SimOut* sim_out, int status, std::vector<body_soil>* body_soil_pos,
     float dh_max, int nn, int ii, int jj, int ind, int ii_c, int jj_c,
-    Grid grid, Body* body, float tol);
+    const Grid& grid, Body* body, float tol);
 
 }  // namespace soil_simulator
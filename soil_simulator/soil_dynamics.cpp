@@ -4,7 +4,12 @@ This file implements the main functions of the simulator.
 Copyright, 2023, Vilella Kenny.
 */
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 #include "soil_simulator/soil_dynamics.hpp"
@@ -15,8 +20,13 @@ Copyright, 2023, Vilella Kenny.
 #include "soil_simulator/relax.hpp"
 #include "soil_simulator/utils.hpp"
 
+void soil_simulator::SoilDynamics::Seed(std::uint64_t seed) {
+    rng_.Seed(seed);
+    n_step_ = 0;
+}
+
 void soil_simulator::SoilDynamics::Init(
-    SimOut* sim_out, Grid grid, float amp_noise
+    SimOut* sim_out, const Grid& grid, float amp_noise
 ) {
     // Generating a random permutation table
     std::vector<int> perm_table(256);
@@ -26,117 +36,427 @@ void soil_simulator::SoilDynamics::Init(
     // Randomizing table
     // random_suffle is not used because it is machine dependent,
     // which makes unit testing difficult
+    rng_.SetCounter(0, 0);
+    auto gen = rng_.Stream(RandomSite::kInit, 0, 0);
     for (auto aa = 255; aa > 0; aa--) {
         std::uniform_int_distribution<int> dist(0, aa);
-        int bb = dist(rng);
+        int bb = dist(gen);
         std::swap(perm_table[aa], perm_table[bb]);
     }
 
+    // Function calculating the terrain height at (ii, jj) using Simplex noise
+    auto terrain_noise = [grid, amp_noise, perm_table](int ii, int jj) {
+        // Setting grid position rescaled to [0, 1]
+        float x = (
+            (grid.vect_x_[0] - grid.vect_x_[ii]) / (2 * grid.vect_x_[0]));
+        float y = (
+            (grid.vect_y_[0] - grid.vect_y_[jj]) / (2 * grid.vect_y_[0]));
+
+        // Calculating Simplex noise using several frequencies
+        float noise_value = amp_noise * (
+            0.5 * soil_simulator::simplex_noise(1*x, 1*y, perm_table) +
+            0.25 * soil_simulator::simplex_noise(2*x, 2*y, perm_table) +
+            0.125 * soil_simulator::simplex_noise(4*x, 4*y, perm_table) +
+            0.0625 * soil_simulator::simplex_noise(8*x, 8*y, perm_table));
+
+        // Rounding noise_value to grid values
+        noise_value = (
+            grid.cell_size_z_ * round(noise_value / grid.cell_size_z_));
+        return noise_value;
+    };
+
+#ifdef SOIL_SIMULATOR_TILED_TERRAIN
+    // Generating initial terrain lazily, only when a tile is allocated
+    sim_out->terrain_.Fill(0.0);
+    sim_out->terrain_.SetGenerator(terrain_noise);
+#else
     // Generating initial terrain using Simplex noise
-    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++) {
-        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
-            // Setting grid position rescaled to [0, 1]
-            float x = (
-                (grid.vect_x_[0] - grid.vect_x_[ii]) / (2 * grid.vect_x_[0]));
-            float y = (
-                (grid.vect_y_[0] - grid.vect_y_[jj]) / (2 * grid.vect_y_[0]));
-
-            // Calculating Simplex noise using several frequencies
-            float noise_value = amp_noise * (
-                0.5 * soil_simulator::simplex_noise(1*x, 1*y, perm_table) +
-                0.25 * soil_simulator::simplex_noise(2*x, 2*y, perm_table) +
-                0.125 * soil_simulator::simplex_noise(4*x, 4*y, perm_table) +
-                0.0625 * soil_simulator::simplex_noise(8*x, 8*y, perm_table));
-
-            // Rounding noise_value to grid values
-            noise_value = (
-                grid.cell_size_z_ * round(noise_value / grid.cell_size_z_));
-
-            // Setting terrain with noise
-            sim_out->terrain_[ii][jj] = noise_value;
-        }
-    }
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            sim_out->terrain_[ii][jj] = terrain_noise(ii, jj);
+#endif
+
+    // Initializing the soil volume ledger
+    soil_simulator::InitSoilVolume(sim_out);
 }
 
 template <typename T>
 bool soil_simulator::SoilDynamics::Step(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori,
-    Grid grid, T* body, SimParam sim_param, float tol
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, T* body,
+    const SimParam& sim_param, float tol, float time_budget
 ) {
+    // Calculating the time after which the relaxation is stopped
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (time_budget > 0.0)
+        deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<float>(time_budget));
+
     // Checking movement made by the body
     auto soil_update = soil_simulator::CheckBodyMovement(pos, ori, grid, body);
 
     if (!soil_update) {
+        if ((time_budget > 0.0) && (sim_out->dirty_cells_.size() != 0)) {
+            // Resuming the relaxation carried over from the previous steps
+            // The relaxation of the last step is continued with the same
+            // random numbers as without time budget, unless all its
+            // iterations have been made
+            if (n_iteration_ >= sim_param.max_iterations_) {
+                n_step_++;
+                n_iteration_ = 0;
+                sim_out->equilibrium_ = false;
+            }
+            workspace_.rng_ = &rng_;
+            Relax(sim_out, grid, body, sim_param, tol, deadline);
+            return true;
+        }
+
         // Body has not moved enough
         return false;
     }
 
+    // Drawing the random numbers of the step from the RNG of the simulator
+    n_step_++;
+    n_iteration_ = 0;
+    rng_.SetCounter(n_step_, 0);
+    workspace_.rng_ = &rng_;
+
+    // Forgetting the bodies of previous multi-body steps
+    sim_out->bodies_.clear();
+    sim_out->body_footprints_.clear();
+    sim_out->bodies_area_.clear();
+
     // Updating body position
     soil_simulator::CalcBodyPos(
-        sim_out, pos, ori, grid, body, sim_param, tol);
+        sim_out, pos, ori, grid, body, sim_param, tol, &workspace_);
 
     // Updating position of soil resting on the body
-    soil_simulator::UpdateBodySoil(sim_out, pos, ori, grid, body, tol);
+    soil_simulator::UpdateBodySoil(
+        sim_out, pos, ori, grid, body, tol, &workspace_);
 
     // Moving intersecting soil cells
-    soil_simulator::MoveIntersectingCells(sim_out, grid, body, tol);
+    // When the body position is updated incrementally, the soil can only
+    // intersect with the body where its position has changed
+    workspace_.body_changed_cells_ = nullptr;
+    if (sim_param.incremental_body_)
+        workspace_.body_changed_cells_ = &sim_out->body_changed_cells_;
+    soil_simulator::MoveIntersectingCells(
+        sim_out, grid, body, tol, &workspace_);
+
+    // Preparing the relaxation of the area impacted by the body
+    UpdateImpactRegions(sim_out, grid, sim_param, tol);
+
+    // Relaxing the terrain and the soil resting on the body
+    Relax(sim_out, grid, body, sim_param, tol, deadline);
+
+    return true;
+}
+template bool soil_simulator::SoilDynamics::Step(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Bucket* body,
+    const SimParam& sim_param, float tol, float time_budget);
+template bool soil_simulator::SoilDynamics::Step(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, Blade* body,
+    const SimParam& sim_param, float tol, float time_budget);
+template bool soil_simulator::SoilDynamics::Step(
+    SimOut* sim_out, const std::vector<float>& pos,
+    const std::vector<float>& ori, const Grid& grid, MeshBody* body,
+    const SimParam& sim_param, float tol, float time_budget);
+
+/// The bodies are first rasterized independently into their own footprint,
+/// in parallel when several threads are available. Their footprints are then
+/// merged into `body_`, so that the soil is moved and relaxed in a single pass
+/// for all bodies. The soil moved onto a body by this pass is assigned to the
+/// body on which it is resting using `UpdateBodySoilOwner`.
+///
+/// Note that the body position is not updated incrementally, regardless of
+/// the value of `incremental_body_`.
+bool soil_simulator::SoilDynamics::Step(
+    SimOut* sim_out, const std::vector<std::vector<float>>& pos,
+    const std::vector<std::vector<float>>& ori, const Grid& grid,
+    const std::vector<Body*>& bodies, const SimParam& sim_param, float tol,
+    float time_budget
+) {
+    if (bodies.empty())
+        throw std::invalid_argument("At least one body should be provided");
+    if ((pos.size() != bodies.size()) || (ori.size() != bodies.size()))
+        throw std::invalid_argument("A position and an orientation should be"
+            " provided for each body");
+
+    // Calculating the time after which the relaxation is stopped
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (time_budget > 0.0)
+        deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<float>(time_budget));
+
+    // Checking movement made by the bodies
+    // The soil is always updated when the simulated bodies have changed
+    bool soil_update = (sim_out->bodies_ != bodies);
+    for (auto nn = 0; nn < bodies.size(); nn++)
+        soil_update |= soil_simulator::CheckBodyMovement(
+            pos[nn], ori[nn], grid, bodies[nn]);
+
+    if (!soil_update) {
+        if ((time_budget > 0.0) && (sim_out->dirty_cells_.size() != 0)) {
+            // Resuming the relaxation carried over from the previous steps
+            // The relaxation of the last step is continued with the same
+            // random numbers as without time budget, unless all its
+            // iterations have been made
+            if (n_iteration_ >= sim_param.max_iterations_) {
+                n_step_++;
+                n_iteration_ = 0;
+                sim_out->equilibrium_ = false;
+            }
+            workspace_.rng_ = &rng_;
+            Relax(sim_out, grid, bodies[0], sim_param, tol, deadline);
+            soil_simulator::UpdateBodySoilOwner(sim_out);
+            return true;
+        }
+
+        // Bodies have not moved enough
+        return false;
+    }
+
+    // Drawing the random numbers of the step from the RNG of the simulator
+    n_step_++;
+    n_iteration_ = 0;
+    rng_.SetCounter(n_step_, 0);
+    workspace_.rng_ = &rng_;
+
+    // Reinitializing body position
+    for (auto ii = sim_out->body_area_[0][0]; ii < sim_out->body_area_[0][1];
+        ii++)
+        for (auto jj = sim_out->body_area_[1][0];
+            jj < sim_out->body_area_[1][1]; jj++)
+            sim_out->body_.ClearCell(ii, jj);
+
+    // Function calculating the position of the bodies from begin to end
+    int n_body = bodies.size();
+    sim_out->bodies_ = bodies;
+    sim_out->body_footprints_.resize(n_body);
+    sim_out->bodies_area_.resize(n_body);
+    if (body_workspaces_.size() < n_body)
+        body_workspaces_.resize(n_body);
+    auto calc_body_pos = [&](int begin, int end) {
+        for (auto nn = begin; nn < end; nn++) {
+            auto& workspace = body_workspaces_[nn];
+            soil_simulator::CalcBodySurfaces(
+                pos[nn], ori[nn], grid, bodies[nn], tol,
+                &workspace.body_surfaces_, &workspace);
+            int body_area[2][2];
+            soil_simulator::CalcBodyFootprint(
+                workspace.body_surfaces_, grid, sim_param, tol, body_area,
+                &sim_out->body_footprints_[nn], &workspace);
+            for (auto ii = 0; ii < 2; ii++)
+                for (auto jj = 0; jj < 2; jj++)
+                    sim_out->bodies_area_[nn][ii][jj] = body_area[ii][jj];
+        }
+    };
+
+    // Calculating the position of all bodies
+    if ((sim_param.n_thread_ > 1) && (n_body > 1)) {
+        // Creating the thread pool if required
+        auto& thread_pool = workspace_.thread_pool_;
+        if (!thread_pool || (thread_pool->size() != sim_param.n_thread_))
+            thread_pool = std::make_unique<ThreadPool>(sim_param.n_thread_);
+
+        thread_pool->ParallelFor(n_body, calc_body_pos);
+    } else {
+        calc_body_pos(0, n_body);
+    }
 
+    // Merging the position of all bodies into body_
+    // body_area_ is updated to the 2D bounding box of all bodies
+    sim_out->body_area_[0][0] = 2 * grid.half_length_x_;
+    sim_out->body_area_[0][1] = 0;
+    sim_out->body_area_[1][0] = 2 * grid.half_length_y_;
+    sim_out->body_area_[1][1] = 0;
+    for (auto nn = 0; nn < n_body; nn++) {
+        soil_simulator::IncludeBodyFootprint(
+            sim_out->body_footprints_[nn], sim_out, tol);
+        const auto& body_area = sim_out->bodies_area_[nn];
+        sim_out->body_area_[0][0] = std::min(
+            sim_out->body_area_[0][0], body_area[0][0]);
+        sim_out->body_area_[0][1] = std::max(
+            sim_out->body_area_[0][1], body_area[0][1]);
+        sim_out->body_area_[1][0] = std::min(
+            sim_out->body_area_[1][0], body_area[1][0]);
+        sim_out->body_area_[1][1] = std::max(
+            sim_out->body_area_[1][1], body_area[1][1]);
+    }
+
+    // Updating position of soil resting on the bodies
+    soil_simulator::UpdateBodySoil(
+        sim_out, pos, ori, grid, bodies, tol, &workspace_);
+
+    // Moving intersecting soil cells
+    workspace_.body_changed_cells_ = nullptr;
+    soil_simulator::MoveIntersectingCells(
+        sim_out, grid, bodies[0], tol, &workspace_);
+
+    // Preparing the relaxation of the area impacted by the bodies
+    UpdateImpactRegions(sim_out, grid, sim_param, tol);
+
+    // Relaxing the terrain and the soil resting on the bodies
+    Relax(sim_out, grid, bodies[0], sim_param, tol, deadline);
+
+    // Assigning the soil moved onto the bodies to the appropriate body
+    soil_simulator::UpdateBodySoilOwner(sim_out);
+
+    return true;
+}
+
+void soil_simulator::SoilDynamics::UpdateImpactRegions(
+    SimOut* sim_out, const Grid& grid, const SimParam& sim_param, float tol
+) {
     // Assuming that the terrain is not at equilibrium
     sim_out->equilibrium_ = false;
 
-    // Iterating until equilibrium or maximum number of iterations is reached
-    int it = 0;
-    while (!sim_out->equilibrium_ && it < sim_param.max_iterations_) {
-        it++;
-
-        // Updating impact_area
-        sim_out->impact_area_[0][0] = std::min(
-            sim_out->body_area_[0][0], sim_out->relax_area_[0][0]);
-        sim_out->impact_area_[1][0] = std::min(
-            sim_out->body_area_[1][0], sim_out->relax_area_[1][0]);
-        sim_out->impact_area_[0][1] = std::max(
-            sim_out->body_area_[0][1], sim_out->relax_area_[0][1]);
-        sim_out->impact_area_[1][1] = std::max(
-            sim_out->body_area_[1][1], sim_out->relax_area_[1][1]);
+    // Calculating the maximum height difference allowed by the repose angle
+    float slope_max = std::tan(sim_param.repose_angle_);
+    float dh_max = grid.cell_size_xy_ * slope_max;
+    dh_max = grid.cell_size_z_ * round(dh_max / grid.cell_size_z_);
+
+    // Updating impact_area
+    sim_out->impact_area_[0][0] = std::min(
+        sim_out->body_area_[0][0], sim_out->relax_area_[0][0]);
+    sim_out->impact_area_[1][0] = std::min(
+        sim_out->body_area_[1][0], sim_out->relax_area_[1][0]);
+    sim_out->impact_area_[0][1] = std::max(
+        sim_out->body_area_[0][1], sim_out->relax_area_[0][1]);
+    sim_out->impact_area_[1][1] = std::max(
+        sim_out->body_area_[1][1], sim_out->relax_area_[1][1]);
+
+    // Updating impact_regions
+    // When several bodies are simulated, the area of each body is added
+    // separately so that the cells located between them are not included
+    sim_out->impact_regions_.Clear();
+    if (sim_out->bodies_area_.empty()) {
+        sim_out->impact_regions_.Add(sim_out->body_area_);
+    } else {
+        for (auto nn = 0; nn < sim_out->bodies_area_.size(); nn++) {
+            int area[2][2] = {
+                {sim_out->bodies_area_[nn][0][0],
+                    sim_out->bodies_area_[nn][0][1]},
+                {sim_out->bodies_area_[nn][1][0],
+                    sim_out->bodies_area_[nn][1][1]}};
+            sim_out->impact_regions_.Add(area);
+        }
+    }
+    for (auto nn = 0; nn < sim_out->relax_regions_.size(); nn++) {
+        int area[2][2];
+        sim_out->relax_regions_.Get(nn, area);
+        sim_out->impact_regions_.Add(area);
+    }
+
+    // Forgetting relax_regions now that they are included in impact_regions
+    // They are rebuilt by the following settling and relaxation
+    sim_out->relax_regions_.Clear();
+
+    for (auto nn = 0; nn < sim_out->impact_regions_.size(); nn++) {
+        int area[2][2];
+        sim_out->impact_regions_.Get(nn, area);
+
+        // Marking the cells that may have been modified by the body
+        // This is also done when the body position is updated incrementally,
+        // so that the relaxation order does not depend on this option
+        MarkDirtyArea(sim_out, area, dh_max, tol);
+
+        // Calculating the area where the soil may be redistributed at once
+        area[0][0] = std::max(area[0][0], 1);
+        area[1][0] = std::max(area[1][0], 1);
+        area[0][1] = std::min(area[0][1], 2 * grid.half_length_x_);
+        area[1][1] = std::min(area[1][1], 2 * grid.half_length_y_);
+
+        if (sim_param.fast_settle_) {
+            // Settling directly the terrain to the equilibrium surface
+            SettleTerrain(sim_out, area, grid, sim_param, &workspace_);
+        }
+
+        if (sim_param.multigrid_levels_ > 0) {
+            // Redistributing the soil on the coarse grids
+            RelaxTerrainMultigrid(
+                sim_out, area, grid, sim_param, &workspace_);
+        }
+    }
+}
+
+void soil_simulator::SoilDynamics::Relax(
+    SimOut* sim_out, const Grid& grid, Body* body, const SimParam& sim_param,
+    float tol, std::chrono::steady_clock::time_point deadline
+) {
+    // Iterating until equilibrium is reached, no cell is left to be checked,
+    // maximum number of iterations is reached or the deadline has passed
+    // The cells modified by the relaxation are marked as dirty, so that the
+    // remaining dirty cells are carried over to the next step
+    // At least one iteration is made, so that the relaxation carried over
+    // always progresses
+    bool first_iteration = true;
+    while (
+        !sim_out->equilibrium_ && (sim_out->dirty_cells_.size() != 0) &&
+        (n_iteration_ < sim_param.max_iterations_) && (first_iteration ||
+        (std::chrono::steady_clock::now() < deadline))
+    ) {
+        first_iteration = false;
+        n_iteration_++;
+        rng_.SetCounter(n_step_, n_iteration_);
 
         // Relaxing the terrain
-        RelaxTerrain(sim_out, grid, body, sim_param, tol);
+        RelaxDirtyTerrain(sim_out, grid, body, sim_param, tol, &workspace_);
 
         // Randomizing body_soil_pos_ to reduce asymmetry
         // random_suffle is not used because it is machine dependent,
         // which makes unit testing difficult
+        auto gen = rng_.Stream(RandomSite::kRelaxBodySoilOrder, 0, 0);
         for (int aa = sim_out->body_soil_pos_.size() - 1; aa > 0; aa--) {
             std::uniform_int_distribution<int> dist(0, aa);
-            int bb = dist(rng);
+            int bb = dist(gen);
             std::swap(sim_out->body_soil_pos_[aa], sim_out->body_soil_pos_[bb]);
         }
 
         // Relaxing the soil resting on the body
-        RelaxBodySoil(sim_out, grid, body, sim_param, tol);
+        RelaxBodySoil(sim_out, grid, body, sim_param, tol, &workspace_);
     }
+}
 
-    return true;
+std::size_t soil_simulator::SoilDynamics::RelaxDebt(
+    const SimOut* sim_out
+) const {
+    return sim_out->dirty_cells_.size();
 }
-template bool soil_simulator::SoilDynamics::Step(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori,
-    Grid grid, Bucket* body, SimParam sim_param, float tol);
-template bool soil_simulator::SoilDynamics::Step(
-    SimOut* sim_out, std::vector<float> pos, std::vector<float> ori,
-    Grid grid, Blade* body, SimParam sim_param, float tol);
 
-void soil_simulator::SoilDynamics::Check(
-    SimOut* sim_out, int init_volume, Grid grid, float tol
+bool soil_simulator::SoilDynamics::Settle(
+    SimOut* sim_out, const int area[2][2], const Grid& grid,
+    const SimParam& sim_param
+) {
+    return SettleTerrain(sim_out, area, grid, sim_param, &workspace_);
+}
+
+bool soil_simulator::SoilDynamics::Check(
+    SimOut* sim_out, int init_volume, const Grid& grid, float tol,
+    bool full_check
 ) {
     // Checking mass conservation
-    soil_simulator::CheckVolume(sim_out, init_volume, grid, tol);
+    bool volume_check;
+    if (full_check)
+        volume_check = soil_simulator::CheckVolume(
+            sim_out, init_volume, grid, tol, &workspace_);
+    else
+        volume_check = soil_simulator::CheckVolumeLedger(
+            sim_out, init_volume, grid);
 
     // Checking consistency of simulation outputs
-    soil_simulator::CheckSoil(sim_out, tol);
+    bool soil_check = soil_simulator::CheckSoil(sim_out, tol);
+
+    return volume_check && soil_check;
 }
 
 template <typename T>
 void soil_simulator::SoilDynamics::WriteOutputs(
-    SimOut* sim_out, Grid grid, T* body
+    SimOut* sim_out, const Grid& grid, T* body
 ) {
     // Writing terrain_ and body_soil_
     soil_simulator::WriteSoil(sim_out, grid);
@@ -145,6 +465,8 @@ void soil_simulator::SoilDynamics::WriteOutputs(
     soil_simulator::WriteBody(body);
 }
 template void soil_simulator::SoilDynamics::WriteOutputs(
-    SimOut* sim_out, Grid grid, Bucket* body);
+    SimOut* sim_out, const Grid& grid, Bucket* body);
+template void soil_simulator::SoilDynamics::WriteOutputs(
+    SimOut* sim_out, const Grid& grid, Blade* body);
 template void soil_simulator::SoilDynamics::WriteOutputs(
-    SimOut* sim_out, Grid grid, Blade* body);
+    SimOut* sim_out, const Grid& grid, MeshBody* body);
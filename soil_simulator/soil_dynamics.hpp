@@ -5,6 +5,9 @@ Copyright, 2023, Vilella Kenny.
 */
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <random>
 #include <vector>
 #include "soil_simulator/types.hpp"
@@ -15,18 +18,43 @@ namespace soil_simulator {
 extern std::mt19937 rng;
 
 /// \brief Simulation class.
+///
+/// The random numbers of the simulation are drawn from a counter-based RNG
+/// owned by the instance, so that several simulators can run independently
+/// from different threads. The global `rng` is only used by the functions
+/// called without a `Workspace` referring to a `CounterRng`.
 class SoilDynamics {
  public:
+     /// \brief Create a simulator.
+     ///
+     /// \param seed: Seed of the RNG of the simulator.
+     explicit SoilDynamics(std::uint64_t seed = 0) :
+         rng_(seed), n_step_(0), n_iteration_(0) {}
+
+     /// \brief Set the seed of the RNG of the simulator.
+     ///
+     /// \param seed: Seed of the RNG of the simulator.
+     void Seed(std::uint64_t seed);
+
      /// \brief Initialize the simulator.
      ///
      /// \param sim_out: Class that stores simulation outputs.
      /// \param grid: Class that stores information related to the
      ///              simulation grid.
      /// \param amp_noise: Amplitude of the Simplex noise. [m]
-     void Init(SimOut* sim_out, Grid grid, float amp_noise);
+     void Init(SimOut* sim_out, const Grid& grid, float amp_noise);
 
      /// \brief Step the simulation.
      ///
+     /// When a positive `time_budget` is given, the relaxation is stopped once
+     /// the budget is exhausted, the budget being checked before each
+     /// relaxation iteration. The cells remaining to be relaxed are kept in
+     /// `dirty_cells_` and their relaxation is resumed by the next steps, even
+     /// when the body has not moved, so that the terrain reaches the same
+     /// state as without time budget. The body update, the fast settle, the
+     /// multigrid pre-relaxation and the first relaxation iteration are always
+     /// completed, so that the step may exceed its budget by their duration.
+     ///
      /// \param sim_out: Class that stores simulation outputs.
      /// \param pos: Cartesian coordinates of the body origin. [m]
      /// \param ori: Orientation of the body. [Quaternion]
@@ -36,21 +64,86 @@ class SoilDynamics {
      /// \param sim_param: Class that stores information related to
      ///                   the simulation.
      /// \param tol: Small number used to handle numerical approximation errors.
+     /// \param time_budget: Wall-clock time allowed for the step. The step is
+     ///                     not limited when it is not positive. [s]
      ///
      /// \return A boolean indicating whether soil update has been done.
      template <typename T>
      bool Step(
-         SimOut* sim_out, std::vector<float> pos, std::vector<float> ori,
-         Grid grid, T* body, SimParam sim_param, float tol);
+         SimOut* sim_out, const std::vector<float>& pos,
+         const std::vector<float>& ori, const Grid& grid, T* body,
+         const SimParam& sim_param, float tol, float time_budget = 0.0);
+
+     /// \brief Step the simulation with several bodies.
+     ///
+     /// The soil is updated when any of the bodies has moved enough. The
+     /// bodies can be of different types.
+     ///
+     /// \param sim_out: Class that stores simulation outputs.
+     /// \param pos: Cartesian coordinates of the origin of each body. [m]
+     /// \param ori: Orientation of each body. [Quaternion]
+     /// \param grid: Class that stores information related to the
+     ///              simulation grid.
+     /// \param bodies: Classes that store information related to the bodies.
+     /// \param sim_param: Class that stores information related to
+     ///                   the simulation.
+     /// \param tol: Small number used to handle numerical approximation errors.
+     /// \param time_budget: Wall-clock time allowed for the step. The step is
+     ///                     not limited when it is not positive. [s]
+     ///
+     /// \return A boolean indicating whether soil update has been done.
+     bool Step(
+         SimOut* sim_out, const std::vector<std::vector<float>>& pos,
+         const std::vector<std::vector<float>>& ori, const Grid& grid,
+         const std::vector<Body*>& bodies, const SimParam& sim_param,
+         float tol, float time_budget = 0.0);
+
+     /// \brief Give the relaxation work carried over to the next step.
+     ///
+     /// \param sim_out: Class that stores simulation outputs.
+     ///
+     /// \return Number of cells whose stability remains to be checked.
+     std::size_t RelaxDebt(const SimOut* sim_out) const;
+
+     /// \brief Settle the terrain in the given area to the closest surface
+     ///        satisfying the repose angle.
+     ///
+     /// The soil volume is conserved and the cells where the body is present
+     /// are not modified. The remaining unstable cells are relaxed during the
+     /// next steps.
+     ///
+     /// \param sim_out: Class that stores simulation outputs.
+     /// \param area: Area to be settled, given as the minimum and exclusive
+     ///              maximum indices in the X and Y directions.
+     /// \param grid: Class that stores information related to the
+     ///              simulation grid.
+     /// \param sim_param: Class that stores information related to
+     ///                   the simulation.
+     ///
+     /// \return A boolean indicating whether the terrain has been modified.
+     bool Settle(
+         SimOut* sim_out, const int area[2][2], const Grid& grid,
+         const SimParam& sim_param);
 
      /// \brief Check the validity of the simulation outputs.
      ///
+     /// By default, the mass conservation is checked with the soil volume
+     /// ledger, which does not detect soil created or lost by a kernel while
+     /// moving soil within the terrain. The full scan of `CheckVolume` is made
+     /// instead when `full_check` is set.
+     ///
      /// \param sim_out: Class that stores simulation outputs.
      /// \param init_volume: Initial number of soil cells.
      /// \param grid: Class that stores information related to the
      ///              simulation grid.
      /// \param tol: Small number used to handle numerical approximation errors.
-     void Check(SimOut* sim_out, int init_volume, Grid grid, float tol);
+     /// \param full_check: Whether the soil volume is calculated by iterating
+     ///                    over the whole grid.
+     ///
+     /// \return A boolean indicating whether the simulation outputs are valid.
+     bool Check(
+         SimOut* sim_out, int init_volume, const Grid& grid, float tol,
+         bool full_check = false);
 
      /// \brief Write the simulation outputs into files.
      ///
@@ -59,7 +152,58 @@ class SoilDynamics {
      ///              simulation grid.
      /// \param body: Class that stores information related to the body object.
      template <typename T>
-     void WriteOutputs(SimOut* sim_out, Grid grid, T* body);
+     void WriteOutputs(SimOut* sim_out, const Grid& grid, T* body);
+
+ private:
+     /// \brief Mark the cells impacted by the body movement and redistribute
+     ///        the soil of the impacted area before the relaxation.
+     ///
+     /// \param sim_out: Class that stores simulation outputs.
+     /// \param grid: Class that stores information related to the
+     ///              simulation grid.
+     /// \param sim_param: Class that stores information related to
+     ///                   the simulation.
+     /// \param tol: Small number used to handle numerical approximation errors.
+     void UpdateImpactRegions(
+         SimOut* sim_out, const Grid& grid, const SimParam& sim_param,
+         float tol);
+
+     /// \brief Relax the terrain and the soil resting on the body until no
+     ///        cell is left to be checked, the maximum number of iterations
+     ///        is reached or the deadline has passed.
+     ///
+     /// \param sim_out: Class that stores simulation outputs.
+     /// \param grid: Class that stores information related to the
+     ///              simulation grid.
+     /// \param body: Class that stores information related to the body object.
+     /// \param sim_param: Class that stores information related to
+     ///                   the simulation.
+     /// \param tol: Small number used to handle numerical approximation errors.
+     /// \param deadline: Time after which no relaxation iteration is started,
+     ///                  except the first one.
+     void Relax(
+         SimOut* sim_out, const Grid& grid, Body* body,
+         const SimParam& sim_param, float tol,
+         std::chrono::steady_clock::time_point deadline);
+
+     /// Reusable buffers for the transient data of the simulation, so that
+     /// a step does not perform any heap allocation in steady state.
+     Workspace workspace_;
+
+     /// Reusable buffers used to calculate the position of each body when
+     /// several bodies are simulated.
+     std::vector<Workspace> body_workspaces_;
+
+     /// Counter-based RNG of the simulator.
+     CounterRng rng_;
+
+     /// Number of steps where the soil has been updated.
+     std::uint64_t n_step_;
+
+     /// Number of relaxation iterations made for the step `n_step_`, so that
+     /// a relaxation carried over is resumed with the same random numbers as
+     /// without time budget.
+     int n_iteration_;
 };
 
 }  // namespace soil_simulator
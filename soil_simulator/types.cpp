@@ -6,6 +6,9 @@ Checks are conducted to verify the integrity and validity of the data.
 Copyright, 2023, Vilella Kenny.
 */
 #include <math.h>
+#include <algorithm>
+#include <limits>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
@@ -74,8 +77,8 @@ soil_simulator::Grid::Grid(
 }
 
 soil_simulator::Body::Body(
-    std::vector<float> o_pos_init, std::vector<float> j_pos_init,
-    std::vector<float> b_pos_init, std::vector<float> t_pos_init,
+    const std::vector<float>& o_pos_init, const std::vector<float>& j_pos_init,
+    const std::vector<float>& b_pos_init, const std::vector<float>& t_pos_init,
     float width
 ) {
     if (o_pos_init.size() != 3)
@@ -126,8 +129,171 @@ soil_simulator::Body::Body(
     }
 }
 
+soil_simulator::MeshBody::MeshBody(
+    const std::vector<float>& o_pos_init,
+    const std::vector<std::vector<float>>& vertices,
+    const std::vector<std::vector<int>>& triangles
+) : Body(
+    o_pos_init, {0.0, 0.0, 0.0}, {0.0, 0.0, -1.0}, {1.0, 0.0, -1.0}, 1.0
+) {
+    // The body joint, base, and teeth provided to Body are placeholders,
+    // they are set below once the mesh has been checked
+    int n_vertex = vertices.size();
+    for (auto nn = 0; nn < n_vertex; nn++)
+        if (vertices[nn].size() != 3)
+            throw std::invalid_argument("vertices should be vectors of size 3");
+
+    if (triangles.empty())
+        throw std::invalid_argument("triangles should not be empty");
+
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(3 * triangles.size());
+    for (auto nn = 0; nn < triangles.size(); nn++) {
+        if (triangles[nn].size() != 3)
+            throw std::invalid_argument("triangles should be vectors of size 3");
+
+        for (auto ii = 0; ii < 3; ii++)
+            if ((triangles[nn][ii] < 0) || (triangles[nn][ii] >= n_vertex))
+                throw std::invalid_argument("triangles should only contain"
+                    " indices of existing vertices");
+
+        if (
+            (triangles[nn][0] == triangles[nn][1]) ||
+            (triangles[nn][0] == triangles[nn][2]) ||
+            (triangles[nn][1] == triangles[nn][2]))
+            throw std::invalid_argument("triangles should be made of three"
+                " different vertices");
+
+        // Listing the three edges of the triangle
+        for (auto ii = 0; ii < 3; ii++) {
+            int a = triangles[nn][ii];
+            int b = triangles[nn][(ii + 1) % 3];
+            edges.push_back({std::min(a, b), std::max(a, b)});
+        }
+    }
+
+    // Checking that each edge is shared by exactly two triangles
+    std::sort(edges.begin(), edges.end());
+    for (auto nn = 0; nn < edges.size(); nn += 2)
+        if (
+            (nn + 1 == edges.size()) || (edges[nn] != edges[nn + 1]) ||
+            ((nn + 2 < edges.size()) && (edges[nn] == edges[nn + 2])))
+            throw std::invalid_argument("the mesh should be closed");
+
+    // Storing the mesh relative to the body origin
+    vertices_.resize(n_vertex);
+    Vec3 box_min = {
+        std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max()};
+    Vec3 box_max = {
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest()};
+    for (auto nn = 0; nn < n_vertex; nn++)
+        for (auto ii = 0; ii < 3; ii++) {
+            vertices_[nn][ii] = vertices[nn][ii] - o_pos_init[ii];
+            box_min[ii] = std::min(box_min[ii], vertices_[nn][ii]);
+            box_max[ii] = std::max(box_max[ii], vertices_[nn][ii]);
+        }
+    triangles_.resize(triangles.size());
+    for (auto nn = 0; nn < triangles.size(); nn++)
+        triangles_[nn] = {triangles[nn][0], triangles[nn][1], triangles[nn][2]};
+
+    float length_x = box_max[0] - box_min[0];
+    float length_y = box_max[1] - box_min[1];
+    float length_z = box_max[2] - box_min[2];
+    if ((length_x <= 0.0) || (length_y <= 0.0) || (length_z <= 0.0))
+        throw std::invalid_argument("the mesh should have a non-zero extent in"
+            " all directions");
+
+    // Setting the body joint, base, and teeth such that the triangular prism
+    // they form encloses the bounding box of the mesh
+    float y_mid = 0.5 * (box_min[1] + box_max[1]);
+    j_pos_init_ = {box_min[0], y_mid, box_min[2] + 2.0f * length_z};
+    b_pos_init_ = {box_min[0], y_mid, box_min[2]};
+    t_pos_init_ = {box_min[0] + 2.0f * length_x, y_mid, box_min[2]};
+    width_ = length_y;
+
+    // Building the bounding volume hierarchy
+    bvh_.reserve(2 * triangles_.size());
+    BuildBvh(0, triangles_.size());
+}
+
+/// The triangles are split in two halves along the direction where the
+/// centroids of the triangles are the most spread, until the number of
+/// triangles is not larger than `kLeafSize`.
+int soil_simulator::MeshBody::BuildBvh(
+    int first, int count
+) {
+    int node = bvh_.size();
+    bvh_.push_back({});
+
+    // Calculating the bounding box of the triangles and of their centroids
+    Vec3 box_min = vertices_[triangles_[first][0]];
+    Vec3 box_max = box_min;
+    Vec3 centroid_min = {
+        std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max()};
+    Vec3 centroid_max = {
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest()};
+    for (auto nn = first; nn < first + count; nn++)
+        for (auto ii = 0; ii < 3; ii++) {
+            float centroid = 0.0;
+            for (auto kk = 0; kk < 3; kk++) {
+                float pos = vertices_[triangles_[nn][kk]][ii];
+                box_min[ii] = std::min(box_min[ii], pos);
+                box_max[ii] = std::max(box_max[ii], pos);
+                centroid += pos / 3.0f;
+            }
+            centroid_min[ii] = std::min(centroid_min[ii], centroid);
+            centroid_max[ii] = std::max(centroid_max[ii], centroid);
+        }
+    bvh_[node].box_min = box_min;
+    bvh_[node].box_max = box_max;
+
+    if (count <= kLeafSize) {
+        // Node is a leaf
+        bvh_[node].first = first;
+        bvh_[node].count = count;
+        return node;
+    }
+
+    // Determining the direction where the centroids are the most spread
+    int axis = 0;
+    for (auto ii = 1; ii < 3; ii++)
+        if (
+            centroid_max[ii] - centroid_min[ii] >
+            centroid_max[axis] - centroid_min[axis])
+            axis = ii;
+
+    // Splitting the triangles at the median centroid
+    auto centroid = [&](const std::array<int, 3>& triangle) {
+        return (
+            vertices_[triangle[0]][axis] + vertices_[triangle[1]][axis] +
+            vertices_[triangle[2]][axis]);
+    };
+    int half = count / 2;
+    std::nth_element(
+        triangles_.begin() + first, triangles_.begin() + first + half,
+        triangles_.begin() + first + count,
+        [&](const std::array<int, 3>& a, const std::array<int, 3>& b) {
+            return centroid(a) < centroid(b);
+        });
+
+    // Building the two children
+    BuildBvh(first, half);
+    int second = BuildBvh(first + half, count - half);
+    bvh_[node].first = second;
+    bvh_[node].count = 0;
+    return node;
+}
+
 soil_simulator::SimParam::SimParam(
-    float repose_angle, int max_iterations, int cell_buffer
+    float repose_angle, int max_iterations, int cell_buffer, int n_thread,
+    RelaxMode relax_mode, int multigrid_levels, bool fast_settle,
+    bool incremental_body
 ) {
     if ((repose_angle > std::numbers::pi / 2) || (repose_angle < 0.0))
         throw std::invalid_argument("repose_angle should be betweem 0.0 and"
@@ -141,25 +307,41 @@ soil_simulator::SimParam::SimParam(
         throw std::invalid_argument("cell_buffer should be greater or equal to"
             " 2");
 
+    if (n_thread < 1)
+        throw std::invalid_argument("n_thread should be greater or equal to"
+            " 1");
+
+    if (multigrid_levels < 0)
+        throw std::invalid_argument("multigrid_levels should be greater or"
+            " equal to zero");
+
     repose_angle_ = repose_angle;
     max_iterations_ = max_iterations;
     cell_buffer_ = cell_buffer;
+    n_thread_ = n_thread;
+    relax_mode_ = relax_mode;
+    multigrid_levels_ = multigrid_levels;
+    fast_settle_ = fast_settle;
+    incremental_body_ = incremental_body;
 }
 
 soil_simulator::SimOut::SimOut(
-    Grid grid
+    const Grid& grid, ArrayLayout layout
 ) {
     equilibrium_ = false;
 
-    terrain_.resize(
-        2*grid.half_length_x_+1,
-        std::vector<float>(2*grid.half_length_y_+1, 0.0));
-    body_.resize(
-        4, std::vector<std::vector<float>>(2*grid.half_length_x_+1,
-        std::vector<float>(2*grid.half_length_y_+1, 0.0)));
-    body_soil_.resize(
-        4, std::vector<std::vector<float>>(2*grid.half_length_x_+1,
-        std::vector<float>(2*grid.half_length_y_+1, 0.0)));
+    // The height step is only used when heights are stored as integers
+    float height_step = grid.cell_size_z_ / kHeightSubdivision;
+    terrain_ = terrain_t(
+        2*grid.half_length_x_+1, 2*grid.half_length_y_+1, 0.0, height_step);
+    body_ = body_layers_t(
+        4, 2*grid.half_length_x_+1, 2*grid.half_length_y_+1, 0.0, layout,
+        height_step);
+    body_soil_ = body_layers_t(
+        4, 2*grid.half_length_x_+1, 2*grid.half_length_y_+1, 0.0, layout,
+        height_step);
+    dirty_mask_ = dirty_mask_t(
+        2*grid.half_length_x_+1, 2*grid.half_length_y_+1, 0);
 
     body_area_[0][0] = 1;
     relax_area_[0][0] = 1;
@@ -173,4 +355,97 @@ soil_simulator::SimOut::SimOut(
     body_area_[1][1] = 2 * grid.half_length_y_;
     relax_area_[1][1] = 2 * grid.half_length_y_;
     impact_area_[1][1] = 2 * grid.half_length_y_;
+    relax_regions_.Add(relax_area_);
+    impact_regions_.Add(impact_area_);
+
+    terrain_volume_ = 0.0;
+    body_soil_volume_ = 0.0;
+    lost_volume_ = 0.0;
+}
+
+soil_simulator::ThreadPool::ThreadPool(int n_thread) {
+    if (n_thread < 1)
+        throw std::invalid_argument("n_thread should be greater or equal to"
+            " 1");
+
+    n_thread_ = n_thread;
+    ctx_ = nullptr;
+    task_ = nullptr;
+    n_ = 0;
+    generation_ = 0;
+    n_running_ = 0;
+    stop_ = false;
+
+    // Starting the worker threads
+    for (auto id = 1; id < n_thread_; id++)
+        threads_.emplace_back(&soil_simulator::ThreadPool::Work, this, id);
+}
+
+soil_simulator::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& thread : threads_)
+        thread.join();
+}
+
+void soil_simulator::ThreadPool::Run(int n, const void* ctx, Task task) {
+    if (n_thread_ == 1) {
+        // No worker thread, running serially
+        task(ctx, 0, n);
+        return;
+    }
+
+    // Waking up the worker threads
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ctx_ = ctx;
+        task_ = task;
+        n_ = n;
+        n_running_ = n_thread_ - 1;
+        generation_++;
+    }
+    start_cv_.notify_all();
+
+    // Processing the first chunk on the calling thread
+    task(ctx, 0, n / n_thread_);
+
+    // Waiting for the worker threads to complete their chunk
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return n_running_ == 0; });
+}
+
+void soil_simulator::ThreadPool::Work(int id) {
+    int generation = 0;
+    while (true) {
+        // Waiting for a new loop or for the destruction of the pool
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(
+            lock, [&] { return stop_ || (generation_ != generation); });
+        if (stop_)
+            return;
+        generation = generation_;
+        int begin = static_cast<int64_t>(n_) * id / n_thread_;
+        int end = static_cast<int64_t>(n_) * (id + 1) / n_thread_;
+        const void* ctx = ctx_;
+        Task task = task_;
+        lock.unlock();
+
+        // Processing the chunk of the thread
+        task(ctx, begin, end);
+
+        // Notifying that the chunk has been processed
+        lock.lock();
+        if (--n_running_ == 0)
+            done_cv_.notify_one();
+    }
+}
+
+/// The key of the Squares algorithm is derived from the seed with the
+/// SplitMix64 finalizer, so that close seeds give unrelated keys. The key is
+/// made odd, as recommended by the algorithm.
+void soil_simulator::CounterRng::Seed(std::uint64_t seed) {
+    key_ = Mix(seed + 0x9e3779b97f4a7c15) | 1;
 }
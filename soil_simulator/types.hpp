@@ -5,10 +5,1719 @@ Copyright, 2023, Vilella Kenny.
 */
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <span>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace soil_simulator {
 
+/// \brief Allocator returning memory aligned on a cache line.
+///
+/// This allocator is used by the grid containers so that each row of a grid
+/// starts on a cache line boundary.
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept {}
+
+    template <typename U>
+    explicit AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(
+            ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    friend bool operator==(
+        const AlignedAllocator&, const AlignedAllocator&) { return true; }
+};
+
+/// \brief Height stored as an integer number of vertical cells.
+///
+/// All heights in the simulator are multiples of the vertical cell size, they
+/// can therefore be stored exactly as an integer number of cells. This class
+/// only stores this number as an integer of type `T`, the vertical cell size
+/// used to convert it to meters is held by the container storing the heights.
+///
+/// Note:
+/// - This class is used for the simulation outputs when the simulator is
+///   compiled with the `SOIL_SIMULATOR_FIXED_POINT_HEIGHT` option. In that
+///   case, the cell size is a fraction `kHeightSubdivision` of the vertical
+///   cell size of the grid.
+/// - Heights are rounded to the nearest multiple of the cell size and
+///   saturated to the range of `T`.
+template <typename T>
+class FixedPointHeight {
+ public:
+     /// \brief Create a height equal to zero.
+     FixedPointHeight() : count_(0) {}
+
+     /// \brief Create a height from a value in meters.
+     ///
+     /// \param h: Height. [m]
+     /// \param cell_size_z: Height of a cell. [m]
+     static FixedPointHeight FromMeters(float h, float cell_size_z) {
+         float count = std::round(h / cell_size_z);
+         count = std::clamp(
+             count, static_cast<float>(std::numeric_limits<T>::min()),
+             static_cast<float>(std::numeric_limits<T>::max()));
+         FixedPointHeight height;
+         height.count_ = static_cast<T>(count);
+         return height;
+     }
+
+     /// \brief Convert the height to meters.
+     ///
+     /// \param cell_size_z: Height of a cell. [m]
+     float ToMeters(float cell_size_z) const { return count_ * cell_size_z; }
+
+     /// \brief Number of vertical cells corresponding to the height.
+     T count() const { return count_; }
+
+     bool operator==(const FixedPointHeight&) const = default;
+
+ private:
+     T count_;
+};
+
+/// \brief Whether `T` is a `FixedPointHeight`.
+template <typename T>
+struct IsFixedPointHeight : std::false_type {};
+
+template <typename T>
+struct IsFixedPointHeight<FixedPointHeight<T>> : std::true_type {};
+
+/// \brief Conversion between the type `T` stored in a grid container and the
+///        type of the values read from and written to the container.
+///
+/// The values are stored as is, except for `FixedPointHeight` whose values
+/// are read and written in meters using the vertical cell size `scale` held
+/// by the container.
+template <typename T>
+struct ElementTraits {
+    using value_type = T;
+
+    static T Decode(const T& value, float) { return value; }
+
+    static T Encode(const T& value, float) { return value; }
+};
+
+template <typename T>
+struct ElementTraits<FixedPointHeight<T>> {
+    using value_type = float;
+
+    static float Decode(const FixedPointHeight<T>& value, float scale) {
+        return value.ToMeters(scale);
+    }
+
+    static FixedPointHeight<T> Encode(float value, float scale) {
+        return FixedPointHeight<T>::FromMeters(value, scale);
+    }
+};
+
+/// \brief Reference to one `FixedPointHeight` stored in a grid container.
+///
+/// The reference behaves as a `float` height in meters, the conversion uses
+/// the vertical cell size of the container holding the height.
+template <typename H>
+class FixedPointRef {
+ public:
+     /// \brief Create a reference to `height`.
+     ///
+     /// \param height: Height stored in the container.
+     /// \param scale: Height of a cell. [m]
+     FixedPointRef(H* height, float scale) : height_(height), scale_(scale) {}
+
+     /// \brief Convert the height to meters.
+     operator float() const { return height_->ToMeters(scale_); }
+
+     /// \brief Assign a height in meters.
+     FixedPointRef& operator=(float h) {
+         *height_ = H::FromMeters(h, scale_);
+         return *this;
+     }
+
+     /// \brief Assign the value of another height.
+     FixedPointRef& operator=(const FixedPointRef& other) {
+         return *this = static_cast<float>(other);
+     }
+
+     /// \brief Add a height in meters.
+     FixedPointRef& operator+=(float h) {
+         return *this = static_cast<float>(*this) + h;
+     }
+
+     /// \brief Subtract a height in meters.
+     FixedPointRef& operator-=(float h) {
+         return *this = static_cast<float>(*this) - h;
+     }
+
+ private:
+     H* height_;
+     float scale_;
+};
+
+/// \brief Non-owning view over one row of a grid container.
+///
+/// The elements of the row are separated by `step` elements in memory, `step`
+/// is equal to one when the row is contiguous.
+///
+/// When the elements are `FixedPointHeight`, indexing the row returns their
+/// value in meters, or a `FixedPointRef` if the row is mutable.
+template <typename T>
+class ArrayRow {
+ public:
+     /// \brief Create a new view over a row starting at `data`.
+     ///
+     /// \param data: Pointer to the first element of the row.
+     /// \param size: Number of elements in the row.
+     /// \param step: Distance in elements between two successive elements.
+     /// \param scale: Height of a vertical cell, only used for
+     ///               `FixedPointHeight` elements. [m]
+     ArrayRow(T* data, int size, int step, float scale = 1.0) :
+         data_(data), size_(size), step_(step), scale_(scale) {}
+
+     /// \brief Access the element `jj` of the row.
+     decltype(auto) operator[](int jj) const {
+         T& value = data_[static_cast<std::ptrdiff_t>(jj) * step_];
+         if constexpr (!IsFixedPointHeight<std::remove_const_t<T>>::value)
+             return (value);
+         else if constexpr (std::is_const_v<T>)
+             return value.ToMeters(scale_);
+         else
+             return FixedPointRef<T>(&value, scale_);
+     }
+
+     /// \brief Number of elements in the row.
+     std::size_t size() const { return size_; }
+
+ private:
+     T* data_;
+     int size_;
+     int step_;
+     float scale_;
+};
+
+/// \brief Non-owning view over one 2D plane of a grid container.
+///
+/// The rows of the plane are separated by `stride` elements in memory and the
+/// elements of a row are separated by `step` elements. Indexing a view with
+/// `[ii]` returns the row at the index `ii`, so that an element is accessed
+/// with `[ii][jj]`.
+template <typename T>
+class ArrayView2D {
+ public:
+     /// \brief Create a new view over a plane starting at `data`.
+     ///
+     /// \param data: Pointer to the first element of the plane.
+     /// \param size_x: Number of rows in the plane.
+     /// \param size_y: Number of elements in each row.
+     /// \param stride: Distance in elements between two successive rows.
+     /// \param step: Distance in elements between two successive elements of
+     ///              a row.
+     /// \param scale: Height of a vertical cell, only used for
+     ///               `FixedPointHeight` elements. [m]
+     ArrayView2D(
+         T* data, int size_x, int size_y, int stride, int step = 1,
+         float scale = 1.0
+     ) :
+         data_(data), size_x_(size_x), size_y_(size_y), stride_(stride),
+         step_(step), scale_(scale) {}
+
+     /// \brief Access the row `ii` of the plane.
+     ArrayRow<T> operator[](int ii) const {
+         return {data_ + static_cast<std::ptrdiff_t>(ii) * stride_, size_y_,
+             step_, scale_};
+     }
+
+     /// \brief Number of rows of the plane.
+     std::size_t size() const { return size_x_; }
+
+     /// \brief Distance in elements between two successive rows.
+     int stride() const { return stride_; }
+
+     /// \brief Pointer to the first element of the plane.
+     T* data() const { return data_; }
+
+ private:
+     T* data_;
+     int size_x_;
+     int size_y_;
+     int stride_;
+     int step_;
+     float scale_;
+};
+
+/// \brief Contiguous row-major 2D container used to store grid data.
+///
+/// All elements are stored in a single buffer aligned on a cache line. Each
+/// row is padded such that its first element is also aligned on a cache line,
+/// the distance between two successive rows is given by `stride()`.
+///
+/// The container is indexed as a nested vector would be, that is, the element
+/// at (`ii`, `jj`) is accessed with `[ii][jj]`. When the elements are
+/// `FixedPointHeight`, they are read and written in meters using the vertical
+/// cell size given at construction.
+///
+/// Usage:
+/// \code
+///    soil_simulator::Array2D<float> terrain(161, 161, 0.0);
+///    terrain[10][20] = 0.1;
+/// \endcode
+template <typename T>
+class Array2D {
+ public:
+     using value_type = typename ElementTraits<T>::value_type;
+
+     /// \brief Create an empty container.
+     Array2D() : size_x_(0), size_y_(0), stride_(0), scale_(1.0) {}
+
+     /// \brief Create a container of size `size_x` x `size_y` filled with
+     ///        `value`.
+     ///
+     /// \param size_x: Number of elements in the X direction.
+     /// \param size_y: Number of elements in the Y direction.
+     /// \param value: Initial value of all elements.
+     /// \param scale: Height of a vertical cell, only used for
+     ///               `FixedPointHeight` elements. [m]
+     Array2D(
+         int size_x, int size_y, value_type value = value_type(),
+         float scale = 1.0
+     ) :
+         size_x_(size_x), size_y_(size_y), stride_(PaddedStride(size_y)),
+         scale_(scale),
+         data_(static_cast<std::size_t>(size_x) * stride_,
+             ElementTraits<T>::Encode(value, scale)) {}
+
+     /// \brief Access the row `ii` of the container.
+     auto operator[](int ii) {
+         T* row = data_.data() + static_cast<std::ptrdiff_t>(ii) * stride_;
+         if constexpr (IsFixedPointHeight<T>::value)
+             return ArrayRow<T>(row, size_y_, 1, scale_);
+         else
+             return std::span<T>(row, static_cast<std::size_t>(size_y_));
+     }
+
+     /// \brief Access the row `ii` of the container.
+     auto operator[](int ii) const {
+         const T* row = (
+             data_.data() + static_cast<std::ptrdiff_t>(ii) * stride_);
+         if constexpr (IsFixedPointHeight<T>::value)
+             return ArrayRow<const T>(row, size_y_, 1, scale_);
+         else
+             return std::span<const T>(row, static_cast<std::size_t>(size_y_));
+     }
+
+     /// \brief Number of rows, that is, number of elements in the X direction.
+     std::size_t size() const { return size_x_; }
+
+     /// \brief Number of elements in the X direction.
+     int size_x() const { return size_x_; }
+
+     /// \brief Number of elements in the Y direction.
+     int size_y() const { return size_y_; }
+
+     /// \brief Distance in elements between two successive rows.
+     int stride() const { return stride_; }
+
+     /// \brief Pointer to the first element of the container.
+     T* data() { return data_.data(); }
+
+     /// \brief Pointer to the first element of the container.
+     const T* data() const { return data_.data(); }
+
+     /// \brief Set all elements of the container to `value`.
+     void Fill(value_type value) {
+         std::fill(
+             data_.begin(), data_.end(), ElementTraits<T>::Encode(value, scale_));
+     }
+
+     /// \brief Height of a vertical cell used for `FixedPointHeight`
+     ///        elements. [m]
+     float scale() const { return scale_; }
+
+     /// \brief Calculate the row stride such that each row starts on a cache
+     ///        line boundary.
+     static int PaddedStride(int size_y) {
+         int n = static_cast<int>(64 / sizeof(T));
+         if (n <= 1)
+             return size_y;
+         return ((size_y + n - 1) / n) * n;
+     }
+
+ private:
+     int size_x_;
+     int size_y_;
+     int stride_;
+     float scale_;
+     std::vector<T, AlignedAllocator<T>> data_;
+};
+
+/// \brief Reference to one element of a `TiledArray2D`.
+///
+/// Reading the element never allocates its tile, the tile is only allocated
+/// when a value is written.
+template <typename A>
+class TiledRef {
+ public:
+     using value_type = typename A::value_type;
+
+     /// \brief Create a reference to the element at (`ii`, `jj`).
+     TiledRef(A* array, int ii, int jj) : array_(array), ii_(ii), jj_(jj) {}
+
+     /// \brief Value of the element.
+     operator value_type() const {
+         return static_cast<const A*>(array_)->At(ii_, jj_);
+     }
+
+     /// \brief Assign a value to the element.
+     TiledRef& operator=(value_type value) {
+         array_->Set(ii_, jj_, value);
+         return *this;
+     }
+
+     /// \brief Assign the value of another element.
+     TiledRef& operator=(const TiledRef& other) {
+         return *this = static_cast<value_type>(other);
+     }
+
+     /// \brief Add `value` to the element.
+     TiledRef& operator+=(value_type value) {
+         return *this = static_cast<value_type>(*this) + value;
+     }
+
+     /// \brief Subtract `value` from the element.
+     TiledRef& operator-=(value_type value) {
+         return *this = static_cast<value_type>(*this) - value;
+     }
+
+ private:
+     A* array_;
+     int ii_;
+     int jj_;
+};
+
+/// \brief View over one row of a `TiledArray2D`.
+///
+/// Indexing the row through a non-const container returns a `TiledRef` to
+/// the element, while indexing the row through a const container returns the
+/// value of the element. In both cases, reading the element does not
+/// allocate any tile.
+template <typename A>
+class TiledRow {
+ public:
+     /// \brief Create a new view over the row `ii` of `array`.
+     ///
+     /// \param array: Container holding the row.
+     /// \param ii: Index of the row.
+     TiledRow(A* array, int ii) : array_(array), ii_(ii) {}
+
+     /// \brief Access the element `jj` of the row.
+     auto operator[](int jj) const {
+         if constexpr (std::is_const_v<A>)
+             return array_->At(ii_, jj);
+         else
+             return TiledRef<A>(array_, ii_, jj);
+     }
+
+     /// \brief Number of elements in the row.
+     std::size_t size() const { return array_->size_y(); }
+
+ private:
+     A* array_;
+     int ii_;
+};
+
+/// \brief 2D container split into square tiles that are allocated lazily.
+///
+/// The container is divided into tiles of `kTileSize` x `kTileSize` elements.
+/// A tile is only allocated when one of its elements is written. Elements
+/// located in tiles that have not been allocated are given by a generator
+/// function, if one is provided, or by a default value otherwise.
+///
+/// The container is indexed as `Array2D`, that is, the element at (`ii`, `jj`)
+/// is accessed with `[ii][jj]`.
+///
+/// Note:
+/// - This container allows the use of very large grids as long as the body
+///   only interacts with a small portion of it.
+/// - Reading an element, even through a non-const reference to the container,
+///   never allocates a tile, so that the whole grid can be scanned without
+///   increasing the memory usage.
+/// - Only the terrain is stored in this container. The body and body soil
+///   layers are stored in a dense `Array3D`, unless the simulator is compiled
+///   with the `SOIL_SIMULATOR_SPARSE_BODY` option, so that the memory usage
+///   of very large grids is still dominated by these layers.
+///
+/// Usage:
+/// \code
+///    soil_simulator::TiledArray2D<float> terrain(10001, 10001, 0.0);
+///    terrain[10][20] = 0.1;
+/// \endcode
+///
+/// This would only allocate the tile containing the element (10, 20).
+template <typename T>
+class TiledArray2D {
+ public:
+     using value_type = typename ElementTraits<T>::value_type;
+
+     /// Number of elements in each direction of a tile.
+     static constexpr int kTileSize = 64;
+
+     /// \brief Create an empty container.
+     TiledArray2D() :
+         size_x_(0), size_y_(0), n_tile_x_(0), n_tile_y_(0),
+         value_(value_type()), scale_(1.0) {}
+
+     /// \brief Create a container of size `size_x` x `size_y` whose elements
+     ///        are initially equal to `value`.
+     ///
+     /// \param size_x: Number of elements in the X direction.
+     /// \param size_y: Number of elements in the Y direction.
+     /// \param value: Value of the elements that have not been allocated.
+     /// \param scale: Height of a vertical cell, only used for
+     ///               `FixedPointHeight` elements. [m]
+     TiledArray2D(
+         int size_x, int size_y, value_type value = value_type(),
+         float scale = 1.0
+     ) :
+         size_x_(size_x), size_y_(size_y),
+         n_tile_x_((size_x + kTileSize - 1) / kTileSize),
+         n_tile_y_((size_y + kTileSize - 1) / kTileSize),
+         value_(value), scale_(scale),
+         tiles_(static_cast<std::size_t>(n_tile_x_) * n_tile_y_) {}
+
+     /// \brief Access the row `ii` of the container.
+     TiledRow<TiledArray2D<T>> operator[](int ii) { return {this, ii}; }
+
+     /// \brief Access the row `ii` of the container.
+     TiledRow<const TiledArray2D<T>> operator[](int ii) const {
+         return {this, ii};
+     }
+
+     /// \brief Set the element at (`ii`, `jj`) to `value`, allocating its
+     ///        tile if necessary.
+     void Set(int ii, int jj, value_type value) {
+         Allocate(ii, jj);
+         tiles_[TileIndex(ii, jj)][
+             (ii % kTileSize) * kTileSize + jj % kTileSize] = (
+             ElementTraits<T>::Encode(value, scale_));
+     }
+
+     /// \brief Allocate the tile containing the element at (`ii`, `jj`) if
+     ///        necessary.
+     ///
+     /// As a tile cannot be allocated concurrently, this is used to allocate
+     /// the tiles that may be written by several threads beforehand.
+     void Allocate(int ii, int jj) {
+         if (tiles_[TileIndex(ii, jj)].empty())
+             AllocateTile(ii / kTileSize, jj / kTileSize);
+     }
+
+     /// \brief Value of the element at (`ii`, `jj`).
+     value_type At(int ii, int jj) const {
+         const auto& tile = tiles_[TileIndex(ii, jj)];
+         if (!tile.empty())
+             return ElementTraits<T>::Decode(
+                 tile[(ii % kTileSize) * kTileSize + jj % kTileSize], scale_);
+         return generator_ ? generator_(ii, jj) : value_;
+     }
+
+     /// \brief Set the function giving the value of the elements that have
+     ///        not been allocated.
+     ///
+     /// \param generator: Function returning the value of the element at
+     ///                   (`ii`, `jj`).
+     void SetGenerator(std::function<value_type(int, int)> generator) {
+         generator_ = generator;
+     }
+
+     /// \brief Set all elements of the container to `value` and release all
+     ///        tiles.
+     void Fill(value_type value) {
+         value_ = value;
+         generator_ = nullptr;
+         for (auto& tile : tiles_)
+             std::vector<T, AlignedAllocator<T>>().swap(tile);
+     }
+
+     /// \brief Number of rows, that is, number of elements in the X direction.
+     std::size_t size() const { return size_x_; }
+
+     /// \brief Number of elements in the X direction.
+     int size_x() const { return size_x_; }
+
+     /// \brief Number of elements in the Y direction.
+     int size_y() const { return size_y_; }
+
+     /// \brief Whether the tile containing the element at (`ii`, `jj`) is
+     ///        allocated.
+     bool IsAllocated(int ii, int jj) const {
+         return !tiles_[TileIndex(ii, jj)].empty();
+     }
+
+     /// \brief Number of tiles currently allocated.
+     int AllocatedTiles() const {
+         int count = 0;
+         for (const auto& tile : tiles_)
+             count += !tile.empty();
+         return count;
+     }
+
+     /// \brief Height of a vertical cell used for `FixedPointHeight`
+     ///        elements. [m]
+     float scale() const { return scale_; }
+
+ private:
+     std::size_t TileIndex(int ii, int jj) const {
+         return static_cast<std::size_t>(ii / kTileSize) * n_tile_y_ +
+             jj / kTileSize;
+     }
+
+     void AllocateTile(int tile_x, int tile_y) {
+         auto& tile = tiles_[static_cast<std::size_t>(tile_x) * n_tile_y_ +
+             tile_y];
+         tile.assign(
+             kTileSize * kTileSize, ElementTraits<T>::Encode(value_, scale_));
+         if (generator_) {
+             // Initializing tile with the generator
+             int ii_max = std::min(kTileSize, size_x_ - tile_x * kTileSize);
+             int jj_max = std::min(kTileSize, size_y_ - tile_y * kTileSize);
+             for (auto ii = 0; ii < ii_max; ii++)
+                 for (auto jj = 0; jj < jj_max; jj++)
+                     tile[ii * kTileSize + jj] = ElementTraits<T>::Encode(
+                         generator_(
+                             tile_x * kTileSize + ii, tile_y * kTileSize + jj),
+                         scale_);
+         }
+     }
+
+     int size_x_;
+     int size_y_;
+     int n_tile_x_;
+     int n_tile_y_;
+     value_type value_;
+     float scale_;
+     std::function<value_type(int, int)> generator_;
+     std::vector<std::vector<T, AlignedAllocator<T>>> tiles_;
+};
+
+/// \brief Memory layout of the layers stored in an `Array3D`.
+///
+/// - `kLayerMajor`: Each layer is stored as a separate plane, the values of
+///   the different layers at the same XY position are thus far apart in
+///   memory.
+/// - `kCellMajor`: The values of all layers at the same XY position are packed
+///   next to each other, so that they can be read with a single load.
+enum class ArrayLayout { kLayerMajor, kCellMajor };
+
+/// \brief Contiguous 3D container storing several 2D grid layers.
+///
+/// All layers are stored in a single buffer aligned on a cache line. With the
+/// `kLayerMajor` layout, the layers are stored one plane after the other and
+/// each plane follows the same row-major layout as `Array2D`. With the
+/// `kCellMajor` layout, the values of all layers at a given XY position are
+/// stored contiguously, which is faster when all layers of a cell are read
+/// together.
+///
+/// The container is indexed as a nested vector would be, that is, the element
+/// of the layer `ind` at (`ii`, `jj`) is accessed with `[ind][ii][jj]`,
+/// regardless of the layout. When the elements are `FixedPointHeight`, they
+/// are read and written in meters using the vertical cell size given at
+/// construction.
+///
+/// Usage:
+/// \code
+///    soil_simulator::Array3D<float> body(4, 161, 161, 0.0);
+///    body[1][10][20] = 0.1;
+/// \endcode
+template <typename T>
+class Array3D {
+ public:
+     using value_type = typename ElementTraits<T>::value_type;
+
+     /// \brief Create an empty container.
+     Array3D() :
+         n_layer_(0), size_x_(0), size_y_(0), stride_(0), layer_stride_(0),
+         step_(1), layout_(ArrayLayout::kLayerMajor), scale_(1.0) {}
+
+     /// \brief Create a container of size `n_layer` x `size_x` x `size_y`
+     ///        filled with `value`.
+     ///
+     /// \param n_layer: Number of layers.
+     /// \param size_x: Number of elements in the X direction.
+     /// \param size_y: Number of elements in the Y direction.
+     /// \param value: Initial value of all elements.
+     /// \param layout: Memory layout of the layers.
+     /// \param scale: Height of a vertical cell, only used for
+     ///               `FixedPointHeight` elements. [m]
+     Array3D(
+         int n_layer, int size_x, int size_y, value_type value = value_type(),
+         ArrayLayout layout = ArrayLayout::kLayerMajor, float scale = 1.0
+     ) :
+         n_layer_(n_layer), size_x_(size_x), size_y_(size_y), layout_(layout),
+         scale_(scale) {
+         T stored = ElementTraits<T>::Encode(value, scale);
+         if (layout == ArrayLayout::kCellMajor) {
+             stride_ = Array2D<T>::PaddedStride(size_y * n_layer);
+             layer_stride_ = 1;
+             step_ = n_layer;
+             data_.assign(static_cast<std::size_t>(size_x) * stride_, stored);
+         } else {
+             stride_ = Array2D<T>::PaddedStride(size_y);
+             layer_stride_ = static_cast<std::ptrdiff_t>(size_x) * stride_;
+             step_ = 1;
+             data_.assign(
+                 static_cast<std::size_t>(n_layer) * layer_stride_, stored);
+         }
+     }
+
+     /// \brief Access the layer `ind` of the container.
+     ArrayView2D<T> operator[](int ind) {
+         return {data_.data() + ind * layer_stride_, size_x_, size_y_, stride_,
+             step_, scale_};
+     }
+
+     /// \brief Access the layer `ind` of the container.
+     ArrayView2D<const T> operator[](int ind) const {
+         return {data_.data() + ind * layer_stride_, size_x_, size_y_, stride_,
+             step_, scale_};
+     }
+
+     /// \brief Copy the values of all layers at (`ii`, `jj`) into `out`.
+     ///
+     /// With the `kCellMajor` layout, the values are contiguous in memory and
+     /// are read with a single load.
+     ///
+     /// \param ii: Index of the cell in the X direction.
+     /// \param jj: Index of the cell in the Y direction.
+     /// \param out: Array of at least `n_layer` elements.
+     template <typename U>
+     void LoadCell(int ii, int jj, U* out) const {
+         const T* cell = (
+             data_.data() + static_cast<std::ptrdiff_t>(ii) * stride_ +
+             static_cast<std::ptrdiff_t>(jj) * step_);
+         for (auto ind = 0; ind < n_layer_; ind++)
+             out[ind] = ElementTraits<T>::Decode(
+                 cell[ind * layer_stride_], scale_);
+     }
+
+     /// \brief Set the values of all layers at (`ii`, `jj`) to zero.
+     ///
+     /// \param ii: Index of the cell in the X direction.
+     /// \param jj: Index of the cell in the Y direction.
+     void ClearCell(int ii, int jj) {
+         T* cell = (
+             data_.data() + static_cast<std::ptrdiff_t>(ii) * stride_ +
+             static_cast<std::ptrdiff_t>(jj) * step_);
+         for (auto ind = 0; ind < n_layer_; ind++)
+             cell[ind * layer_stride_] = T();
+     }
+
+     /// \brief Number of layers.
+     std::size_t size() const { return n_layer_; }
+
+     /// \brief Number of elements in the X direction.
+     int size_x() const { return size_x_; }
+
+     /// \brief Number of elements in the Y direction.
+     int size_y() const { return size_y_; }
+
+     /// \brief Distance in elements between two successive rows.
+     int stride() const { return stride_; }
+
+     /// \brief Memory layout of the layers.
+     ArrayLayout layout() const { return layout_; }
+
+     /// \brief Pointer to the first element of the container.
+     T* data() { return data_.data(); }
+
+     /// \brief Pointer to the first element of the container.
+     const T* data() const { return data_.data(); }
+
+     /// \brief Set all elements of the container to `value`.
+     void Fill(value_type value) {
+         std::fill(
+             data_.begin(), data_.end(), ElementTraits<T>::Encode(value, scale_));
+     }
+
+     /// \brief Value that would be read back after writing `value` into the
+     ///        container.
+     value_type Quantize(value_type value) const {
+         return ElementTraits<T>::Decode(
+             ElementTraits<T>::Encode(value, scale_), scale_);
+     }
+
+ private:
+     int n_layer_;
+     int size_x_;
+     int size_y_;
+     int stride_;
+     std::ptrdiff_t layer_stride_;
+     int step_;
+     ArrayLayout layout_;
+     float scale_;
+     std::vector<T, AlignedAllocator<T>> data_;
+};
+
+/// \brief Reference to one element of a `SparseArray3D`.
+///
+/// Reading the element never inserts the cell into the container. Writing a
+/// value different from the background value inserts the cell if necessary,
+/// while writing the background value removes the cell once all its layers
+/// are equal to the background value.
+template <typename A>
+class SparseRef {
+ public:
+     using value_type = typename A::value_type;
+
+     /// \brief Create a reference to the element of the layer `ind` at
+     ///        (`ii`, `jj`).
+     SparseRef(A* array, int ind, int ii, int jj) :
+         array_(array), ind_(ind), ii_(ii), jj_(jj) {}
+
+     /// \brief Value of the element.
+     operator value_type() const {
+         return static_cast<const A*>(array_)->At(ind_, ii_, jj_);
+     }
+
+     /// \brief Assign a value to the element.
+     SparseRef& operator=(value_type value) {
+         array_->Set(ind_, ii_, jj_, value);
+         return *this;
+     }
+
+     /// \brief Assign the value of another element.
+     SparseRef& operator=(const SparseRef& other) {
+         return *this = static_cast<value_type>(other);
+     }
+
+     /// \brief Add `value` to the element.
+     SparseRef& operator+=(value_type value) {
+         return *this = static_cast<value_type>(*this) + value;
+     }
+
+     /// \brief Subtract `value` from the element.
+     SparseRef& operator-=(value_type value) {
+         return *this = static_cast<value_type>(*this) - value;
+     }
+
+ private:
+     A* array_;
+     int ind_;
+     int ii_;
+     int jj_;
+};
+
+/// \brief View over one row of one layer of a `SparseArray3D`.
+///
+/// Indexing the row through a non-const container returns a `SparseRef` to
+/// the element, while indexing the row through a const container returns the
+/// value of the element. In both cases, reading the element does not insert
+/// any cell.
+template <typename A>
+class SparseRow {
+ public:
+     /// \brief Create a new view over the row `ii` of the layer `ind`.
+     SparseRow(A* array, int ind, int ii) : array_(array), ind_(ind), ii_(ii) {}
+
+     /// \brief Access the element `jj` of the row.
+     auto operator[](int jj) const {
+         if constexpr (std::is_const_v<A>)
+             return array_->At(ind_, ii_, jj);
+         else
+             return SparseRef<A>(array_, ind_, ii_, jj);
+     }
+
+     /// \brief Number of elements in the row.
+     std::size_t size() const { return array_->size_y(); }
+
+ private:
+     A* array_;
+     int ind_;
+     int ii_;
+};
+
+/// \brief View over one layer of a `SparseArray3D`.
+template <typename A>
+class SparseLayer {
+ public:
+     /// \brief Create a new view over the layer `ind`.
+     SparseLayer(A* array, int ind) : array_(array), ind_(ind) {}
+
+     /// \brief Access the row `ii` of the layer.
+     SparseRow<A> operator[](int ii) const { return {array_, ind_, ii}; }
+
+     /// \brief Number of rows of the layer.
+     std::size_t size() const { return array_->size_x(); }
+
+ private:
+     A* array_;
+     int ind_;
+};
+
+/// \brief Sparse 3D container storing several 2D grid layers.
+///
+/// Only the cells having at least one layer different from the background
+/// value are stored. The values of all layers of a cell are stored together in
+/// one slot of a single pool shared by all cells, and the offset of the slot
+/// of each cell is given by a lazily tiled 2D index. The presence of a cell
+/// and all its values are therefore obtained with a single lookup, and storing
+/// a cell does not require any allocation once the pool is large enough.
+/// Cells that are not stored are equal to the background value.
+///
+/// The container is indexed as `Array3D`, that is, the element of the layer
+/// `ind` at (`ii`, `jj`) is accessed with `[ind][ii][jj]`. When the elements
+/// are `FixedPointHeight`, they are read and written in meters using the
+/// vertical cell size given at construction.
+///
+/// Note:
+/// - This container is well suited for the body layers, since the body
+///   usually covers a very small portion of the grid.
+/// - Reading an element, even through a non-const reference to the container,
+///   never inserts a cell, so that the kernels can scan the grid without
+///   increasing the memory usage.
+/// - A cell is removed from the container as soon as all its layers are set
+///   back to the background value, or when `ClearCell` is called. Its slot is
+///   then reused by the next inserted cell.
+template <typename T>
+class SparseArray3D {
+ public:
+     using value_type = typename ElementTraits<T>::value_type;
+
+     /// \brief Create an empty container.
+     SparseArray3D() :
+         n_layer_(0), size_x_(0), size_y_(0), value_(T()), scale_(1.0),
+         n_stored_(0) {}
+
+     /// \brief Create a container of size `n_layer` x `size_x` x `size_y`.
+     ///
+     /// \param n_layer: Number of layers.
+     /// \param size_x: Number of elements in the X direction.
+     /// \param size_y: Number of elements in the Y direction.
+     /// \param value: Background value of the cells that are not stored.
+     /// \param layout: Unused, the layers of a cell are always packed.
+     /// \param scale: Height of a vertical cell, only used for
+     ///               `FixedPointHeight` elements. [m]
+     SparseArray3D(
+         int n_layer, int size_x, int size_y, value_type value = value_type(),
+         ArrayLayout layout = ArrayLayout::kCellMajor, float scale = 1.0
+     ) :
+         n_layer_(n_layer), size_x_(size_x), size_y_(size_y),
+         value_(ElementTraits<T>::Encode(value, scale)), scale_(scale),
+         offsets_(size_x, size_y, -1), n_stored_(0) {}
+
+     /// \brief Access the layer `ind` of the container.
+     SparseLayer<SparseArray3D<T>> operator[](int ind) { return {this, ind}; }
+
+     /// \brief Access the layer `ind` of the container.
+     SparseLayer<const SparseArray3D<T>> operator[](int ind) const {
+         return {this, ind};
+     }
+
+     /// \brief Value of the element of the layer `ind` at (`ii`, `jj`).
+     value_type At(int ind, int ii, int jj) const {
+         std::int32_t offset = offsets_.At(ii, jj);
+         return ElementTraits<T>::Decode(
+             (offset < 0) ? value_ : pool_[offset + ind], scale_);
+     }
+
+     /// \brief Set the element of the layer `ind` at (`ii`, `jj`) to `value`.
+     ///
+     /// The cell is inserted if `value` is different from the background
+     /// value, and removed if all its layers are equal to the background
+     /// value afterwards.
+     void Set(int ind, int ii, int jj, value_type new_value) {
+         T value = ElementTraits<T>::Encode(new_value, scale_);
+         std::int32_t offset = offsets_.At(ii, jj);
+         if (offset < 0) {
+             if (value == value_)
+                 return;
+             offset = InsertCell(ii, jj);
+         }
+         T* cell = &pool_[offset];
+         cell[ind] = value;
+         if ((value == value_) && std::all_of(cell, cell + n_layer_,
+                 [&](const T& v) { return v == value_; }))
+             ClearCell(ii, jj);
+     }
+
+     /// \brief Copy the values of all layers at (`ii`, `jj`) into `out`.
+     ///
+     /// \param ii: Index of the cell in the X direction.
+     /// \param jj: Index of the cell in the Y direction.
+     /// \param out: Array of at least `n_layer` elements.
+     template <typename U>
+     void LoadCell(int ii, int jj, U* out) const {
+         std::int32_t offset = offsets_.At(ii, jj);
+         for (auto ind = 0; ind < n_layer_; ind++)
+             out[ind] = ElementTraits<T>::Decode(
+                 (offset < 0) ? value_ : pool_[offset + ind], scale_);
+     }
+
+     /// \brief Remove the cell at (`ii`, `jj`), setting all its layers to
+     ///        the background value.
+     void ClearCell(int ii, int jj) {
+         std::int32_t offset = offsets_.At(ii, jj);
+         if (offset < 0)
+             return;
+         std::fill(
+             pool_.begin() + offset, pool_.begin() + offset + n_layer_, value_);
+         free_slots_.push_back(offset);
+         offsets_.Set(ii, jj, -1);
+         n_stored_--;
+     }
+
+     /// \brief Whether the cell at (`ii`, `jj`) is stored.
+     bool Contains(int ii, int jj) const { return offsets_.At(ii, jj) >= 0; }
+
+     /// \brief Set all elements of the container to `value`.
+     ///
+     /// All cells are removed and `value` becomes the background value.
+     void Fill(value_type value) {
+         value_ = ElementTraits<T>::Encode(value, scale_);
+         offsets_.Fill(-1);
+         pool_.clear();
+         free_slots_.clear();
+         n_stored_ = 0;
+     }
+
+     /// \brief Value that would be read back after writing `value` into the
+     ///        container.
+     value_type Quantize(value_type value) const {
+         return ElementTraits<T>::Decode(
+             ElementTraits<T>::Encode(value, scale_), scale_);
+     }
+
+     /// \brief Number of cells currently stored.
+     std::size_t StoredCells() const { return n_stored_; }
+
+     /// \brief Number of slots of the pool, whether they are used or not.
+     std::size_t PoolSize() const {
+         return (n_layer_ == 0) ? 0 : pool_.size() / n_layer_;
+     }
+
+     /// \brief Number of layers.
+     std::size_t size() const { return n_layer_; }
+
+     /// \brief Number of elements in the X direction.
+     int size_x() const { return size_x_; }
+
+     /// \brief Number of elements in the Y direction.
+     int size_y() const { return size_y_; }
+
+     /// \brief Memory layout of the layers.
+     ArrayLayout layout() const { return ArrayLayout::kCellMajor; }
+
+ private:
+     std::int32_t InsertCell(int ii, int jj) {
+         std::int32_t offset;
+         if (free_slots_.empty()) {
+             // Growing the pool by one slot
+             offset = static_cast<std::int32_t>(pool_.size());
+             pool_.resize(pool_.size() + n_layer_, value_);
+         } else {
+             // Reusing a released slot, already set to the background value
+             offset = free_slots_.back();
+             free_slots_.pop_back();
+         }
+         offsets_.Set(ii, jj, offset);
+         n_stored_++;
+         return offset;
+     }
+
+     int n_layer_;
+     int size_x_;
+     int size_y_;
+     T value_;
+     float scale_;
+     /// Offset in `pool_` of the first layer of each cell, -1 if the cell is
+     /// not stored.
+     TiledArray2D<std::int32_t> offsets_;
+     /// Values of all layers of the stored cells.
+     std::vector<T> pool_;
+     /// Offsets of the slots of `pool_` that are not used by any cell.
+     std::vector<std::int32_t> free_slots_;
+     std::size_t n_stored_;
+};
+
+/// Number of integer steps per vertical cell used to store the heights in the
+/// simulation outputs when they are stored as `FixedPointHeight`.
+///
+/// Heights produced by the simulator are multiples of the vertical cell size,
+/// but heights given by the user, for instance the initial terrain, can be
+/// finer. With `int16_t` and a vertical cell size of 0.1 m, heights are
+/// stored with a resolution of 0.01 m within a range of about 327 m.
+constexpr int kHeightSubdivision = 10;
+
+/// Type used to store the heights in the simulation outputs.
+#ifdef SOIL_SIMULATOR_FIXED_POINT_HEIGHT
+using height_t = FixedPointHeight<int16_t>;
+#else
+using height_t = float;
+#endif
+
+/// Type used to store the body and body soil layers in the simulation outputs.
+#ifdef SOIL_SIMULATOR_SPARSE_BODY
+using body_layers_t = SparseArray3D<height_t>;
+#else
+using body_layers_t = Array3D<height_t>;
+#endif
+
+/// Type used to store the terrain in the simulation outputs.
+#ifdef SOIL_SIMULATOR_TILED_TERRAIN
+using terrain_t = TiledArray2D<height_t>;
+#else
+using terrain_t = Array2D<height_t>;
+#endif
+
+/// Type used to store whether each cell is present in the list of dirty cells.
+/// It follows the storage of the terrain, so that the cells far from the body
+/// do not use any memory when the terrain is tiled.
+#ifdef SOIL_SIMULATOR_TILED_TERRAIN
+using dirty_mask_t = TiledArray2D<std::uint8_t>;
+#else
+using dirty_mask_t = Array2D<std::uint8_t>;
+#endif
+
+/// \brief Cartesian coordinates of a point or a vector in 3D space.
+///
+/// This type is trivially copyable and lives on the stack, it is therefore
+/// used for the geometric calculations instead of `std::vector`. It can be
+/// implicitly converted to a `std::vector` for compatibility purposes.
+///
+/// Usage:
+/// \code
+///     soil_simulator::Vec3 pos = {0.1f, 0.2f, 0.3f};
+/// \endcode
+struct Vec3 {
+    /// Cartesian coordinates of the vector. [m]
+    float v[3];
+
+    /// \brief Create a new `Vec3` from a `std::vector` of size three.
+    ///
+    /// \param a: Cartesian coordinates of the vector. [m]
+    static constexpr Vec3 FromVector(const std::vector<float>& a) {
+        return {a[0], a[1], a[2]};
+    }
+
+    constexpr float& operator[](int ii) { return v[ii]; }
+    constexpr const float& operator[](int ii) const { return v[ii]; }
+    operator std::vector<float>() const { return {v[0], v[1], v[2]}; }
+};
+
+constexpr Vec3 operator+(const Vec3& a, const Vec3& b) {
+    return {a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+}
+
+constexpr Vec3 operator-(const Vec3& a, const Vec3& b) {
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+/// \brief Orientation in 3D space following the quaternion convention.
+///
+/// The scalar part is stored first. Similarly to `Vec3`, this type is
+/// trivially copyable and can be implicitly converted to a `std::vector`.
+struct Quat {
+    /// Components of the quaternion. [Quaternion]
+    float q[4];
+
+    /// \brief Create a new `Quat` from a `std::vector` of size four.
+    ///
+    /// \param a: Components of the quaternion. [Quaternion]
+    static constexpr Quat FromVector(const std::vector<float>& a) {
+        return {a[0], a[1], a[2], a[3]};
+    }
+
+    /// \brief Return the conjugate of the quaternion.
+    constexpr Quat Conjugate() const { return {q[0], -q[1], -q[2], -q[3]}; }
+
+    constexpr float& operator[](int ii) { return q[ii]; }
+    constexpr const float& operator[](int ii) const { return q[ii]; }
+    operator std::vector<float>() const { return {q[0], q[1], q[2], q[3]}; }
+};
+
+/// \brief Flat list of cell indices.
+///
+/// Each entry is composed of `N` indices stored contiguously, so that the
+/// whole list is held in a single buffer. `clear` keeps the allocated memory,
+/// such that a list can be reused without reallocation. The entries are
+/// ordered lexicographically, so that the list can be sorted with `std::sort`.
+///
+/// For compatibility purposes, the list can be implicitly converted from and
+/// to a `std::vector<std::vector<int>>`.
+///
+/// Usage:
+/// \code
+///     soil_simulator::CellList<3> cells;
+///     cells.reserve(10);
+///     cells.push_back({10, 15, 3});
+/// \endcode
+template <int N>
+class CellList {
+ public:
+     using value_type = std::array<int, N>;
+     using iterator = typename std::vector<value_type>::iterator;
+     using const_iterator = typename std::vector<value_type>::const_iterator;
+
+     /// \brief Create an empty list.
+     CellList() {}
+
+     /// \brief Create a list from a collection of cell indices.
+     ///
+     /// \param cells: Collection of cell indices, each of size `N`.
+     CellList(const std::vector<std::vector<int>>& cells) {
+         cells_.reserve(cells.size());
+         for (const auto& cell : cells) {
+             value_type entry;
+             std::copy_n(cell.begin(), N, entry.begin());
+             cells_.push_back(entry);
+         }
+     }
+
+     /// \brief Access the entry `nn` of the list.
+     value_type& operator[](std::size_t nn) { return cells_[nn]; }
+
+     /// \brief Access the entry `nn` of the list.
+     const value_type& operator[](std::size_t nn) const { return cells_[nn]; }
+
+     /// \brief Add an entry at the end of the list.
+     void push_back(const value_type& cell) { cells_.push_back(cell); }
+
+     /// \brief Add all entries of `other` at the end of the list.
+     void Append(const CellList& other) {
+         cells_.insert(cells_.end(), other.cells_.begin(), other.cells_.end());
+     }
+
+     /// \brief Reserve memory for `n` entries.
+     void reserve(std::size_t n) { cells_.reserve(n); }
+
+     /// \brief Remove all entries while keeping the allocated memory.
+     void clear() { cells_.clear(); }
+
+     /// \brief Number of entries in the list.
+     std::size_t size() const { return cells_.size(); }
+
+     /// \brief Whether the list is empty.
+     bool empty() const { return cells_.empty(); }
+
+     iterator begin() { return cells_.begin(); }
+     iterator end() { return cells_.end(); }
+     const_iterator begin() const { return cells_.begin(); }
+     const_iterator end() const { return cells_.end(); }
+
+     operator std::vector<std::vector<int>>() const {
+         std::vector<std::vector<int>> cells;
+         cells.reserve(cells_.size());
+         for (const auto& cell : cells_)
+             cells.emplace_back(cell.begin(), cell.end());
+         return cells;
+     }
+
+ private:
+     std::vector<value_type> cells_;
+};
+
+/// \brief Set of cells within a rectangular area, stored as a bitmap.
+///
+/// Each row of the area is stored in a whole number of 64-bit words, such that
+/// the memory used scales with the area divided by 64, whatever the number of
+/// cells in the set. The cells can be iterated in row-major order, or visited
+/// in a random order that does not require to shuffle a list of cells.
+/// `Reset` keeps the allocated memory, such that a bitmap can be reused
+/// without reallocation.
+///
+/// Usage:
+/// \code
+///     int area[2][2] = {{10, 20}, {30, 45}};
+///     soil_simulator::CellBitmap cells;
+///     cells.Reset(area);
+///     cells.Set(12, 40);
+///     for (auto cell : cells)
+///         std::cout << cell[0] << " " << cell[1] << std::endl;
+/// \endcode
+class CellBitmap {
+ public:
+     /// \brief Iterator over the cells of the set in row-major order.
+     class const_iterator {
+      public:
+          const_iterator(const CellBitmap* bitmap, std::size_t ww) :
+              bitmap_(bitmap), ww_(ww), word_(0) {
+              if (ww_ < bitmap_->words_.size())
+                  word_ = bitmap_->words_[ww_];
+              SkipEmptyWords();
+          }
+
+          std::array<int, 2> operator*() const {
+              return {
+                  bitmap_->min_x_ + static_cast<int>(ww_ / bitmap_->n_word_y_),
+                  bitmap_->min_y_ +
+                      static_cast<int>(ww_ % bitmap_->n_word_y_) * 64 +
+                      std::countr_zero(word_)};
+          }
+
+          const_iterator& operator++() {
+              word_ &= word_ - 1;
+              SkipEmptyWords();
+              return *this;
+          }
+
+          bool operator!=(const const_iterator& other) const {
+              return (ww_ != other.ww_) || (word_ != other.word_);
+          }
+
+      private:
+          void SkipEmptyWords() {
+              while ((word_ == 0) && (ww_ < bitmap_->words_.size())) {
+                  ww_++;
+                  if (ww_ < bitmap_->words_.size())
+                      word_ = bitmap_->words_[ww_];
+              }
+          }
+
+          const CellBitmap* bitmap_;
+          std::size_t ww_;
+          std::uint64_t word_;
+     };
+
+     /// \brief Create an empty bitmap.
+     CellBitmap() : min_x_(0), min_y_(0), size_x_(0), size_y_(0), n_word_y_(0)
+         {}
+
+     /// \brief Cover the cells of `area` and remove all cells from the set.
+     ///
+     /// \param area: 2D bounding box of the covered cells, following the
+     ///              convention of `impact_area_`.
+     void Reset(const int area[2][2]) {
+         min_x_ = area[0][0];
+         min_y_ = area[1][0];
+         size_x_ = std::max(area[0][1] - area[0][0], 0);
+         size_y_ = std::max(area[1][1] - area[1][0], 0);
+         n_word_y_ = (size_y_ + 63) / 64;
+         words_.assign(static_cast<std::size_t>(size_x_) * n_word_y_, 0);
+     }
+
+     /// \brief Add the cell (`ii`, `jj`) to the set.
+     void Set(int ii, int jj) {
+         words_[WordIndex(ii, jj)] |= std::uint64_t(1) << ((jj - min_y_) % 64);
+     }
+
+     /// \brief Add the cells of `mask` to the set, where the bit `kk`
+     ///        corresponds to the cell (`ii`, `jj + kk`). `jj - area[1][0]`
+     ///        should be a multiple of 64.
+     void SetBlock(int ii, int jj, std::uint64_t mask) {
+         words_[WordIndex(ii, jj)] |= mask;
+     }
+
+     /// \brief Whether the cell (`ii`, `jj`) is in the set.
+     bool Test(int ii, int jj) const {
+         return (words_[WordIndex(ii, jj)] >> ((jj - min_y_) % 64)) & 1;
+     }
+
+     /// \brief Number of cells in the set.
+     std::size_t Count() const {
+         std::size_t count = 0;
+         for (auto word : words_)
+             count += std::popcount(word);
+         return count;
+     }
+
+     const_iterator begin() const { return const_iterator(this, 0); }
+     const_iterator end() const { return const_iterator(this, words_.size()); }
+
+     /// \brief Call `func(ii, jj)` for all cells of the set in a random
+     ///        order.
+     ///
+     /// The cells are numbered by their rank in row-major order, and the
+     /// ranks are visited following a permutation drawn at each call. The
+     /// permutation is a four-round Feistel network with random keys on the
+     /// smallest even number of bits covering the number of cells, the values
+     /// outside the set being skipped by cycle walking. The cell of each rank
+     /// is then located from the number of cells preceding each word. No
+     /// random number is drawn when the set contains less than two cells.
+     ///
+     /// \param func: Function called for each cell.
+     /// \param gen: Random number generator.
+     template <typename F, typename URBG>
+     void ForEachRandom(const F& func, URBG& gen) {
+         // Counting the cells preceding each word
+         word_rank_.resize(words_.size() + 1);
+         word_rank_[0] = 0;
+         for (std::size_t ww = 0; ww < words_.size(); ww++)
+             word_rank_[ww + 1] = word_rank_[ww] + std::popcount(words_[ww]);
+         std::uint64_t n_cell = word_rank_.back();
+         if (n_cell < 2) {
+             for (auto cell : *this)
+                 func(cell[0], cell[1]);
+             return;
+         }
+
+         // Drawing the keys of the Feistel network
+         int n_bit_half = (std::bit_width(n_cell - 1) + 1) / 2;
+         std::uint64_t mask = (std::uint64_t(1) << n_bit_half) - 1;
+         std::array<std::uint64_t, 4> keys;
+         for (auto& key : keys)
+             key = static_cast<std::uint64_t>(gen());
+
+         // Function permuting the values lower than 2^(2 * n_bit_half)
+         auto permute = [&](std::uint64_t value) {
+             std::uint64_t left = value >> n_bit_half;
+             std::uint64_t right = value & mask;
+             for (auto key : keys) {
+                 std::uint64_t hash = (right ^ key) * 0x9E3779B97F4A7C15;
+                 hash ^= hash >> 32;
+                 std::uint64_t next = left ^ (hash & mask);
+                 left = right;
+                 right = next;
+             }
+             return (left << n_bit_half) | right;
+         };
+
+         for (std::uint64_t kk = 0; kk < n_cell; kk++) {
+             std::uint64_t rank = permute(kk);
+             while (rank >= n_cell)
+                 rank = permute(rank);
+
+             // Locating the word and the bit of the cell
+             std::size_t ww = std::upper_bound(
+                 word_rank_.begin(), word_rank_.end(), rank) -
+                 word_rank_.begin() - 1;
+             auto word = words_[ww];
+             for (auto bb = word_rank_[ww]; bb < rank; bb++)
+                 word &= word - 1;
+             func(
+                 min_x_ + static_cast<int>(ww / n_word_y_),
+                 min_y_ + static_cast<int>(ww % n_word_y_) * 64 +
+                 std::countr_zero(word));
+         }
+     }
+
+ private:
+     std::size_t WordIndex(int ii, int jj) const {
+         return static_cast<std::size_t>(ii - min_x_) * n_word_y_ +
+             (jj - min_y_) / 64;
+     }
+
+     int min_x_;
+     int min_y_;
+     int size_x_;
+     int size_y_;
+     int n_word_y_;
+     std::vector<std::uint64_t> words_;
+     /// Number of cells preceding each word, used by `ForEachRandom`.
+     std::vector<std::uint64_t> word_rank_;
+};
+
+/// \brief Set of disjoint rectangular areas of the grid.
+///
+/// An area added to the set is merged with all the areas it overlaps or
+/// touches, which are replaced by their 2D bounding box, such that the areas of
+/// the set remain disjoint. Distant areas, for instance a dump pile and a
+/// digging face, are thus kept separate and the cells between them are not
+/// scanned. `Clear` keeps the allocated memory, such that a set can be reused
+/// without reallocation.
+///
+/// Usage:
+/// \code
+///     int area_1[2][2] = {{10, 20}, {30, 45}};
+///     int area_2[2][2] = {{60, 70}, {30, 45}};
+///     soil_simulator::ActiveRegions regions;
+///     regions.Add(area_1);
+///     regions.Add(area_2);
+///     int area[2][2];
+///     for (auto nn = 0; nn < regions.size(); nn++)
+///         regions.Get(nn, area);
+/// \endcode
+class ActiveRegions {
+ public:
+     /// \brief Remove all areas from the set.
+     void Clear() { areas_.clear(); }
+
+     /// \brief Reserve the storage for `n` areas, so that adding up to `n`
+     ///        areas does not allocate memory.
+     void Reserve(std::size_t n) { areas_.reserve(n); }
+
+     /// \brief Add `area` to the set.
+     ///
+     /// \param area: 2D bounding box of the added cells, following the
+     ///              convention of `impact_area_`.
+     void Add(const int area[2][2]) {
+         if ((area[0][1] <= area[0][0]) || (area[1][1] <= area[1][0]))
+             return;
+
+         std::array<int, 4> new_area = {
+             area[0][0], area[0][1], area[1][0], area[1][1]};
+         for (const auto& old_area : areas_)
+             if (
+                 (old_area[0] <= new_area[0]) && (old_area[1] >= new_area[1]) &&
+                 (old_area[2] <= new_area[2]) && (old_area[3] >= new_area[3]))
+                 // Area already included in the set
+                 return;
+
+         // Merging the areas overlapping or touching the new area, until
+         // none is left
+         bool merged = true;
+         while (merged) {
+             merged = false;
+             for (std::size_t nn = 0; nn < areas_.size(); nn++) {
+                 const auto& old_area = areas_[nn];
+                 if (
+                     (old_area[0] <= new_area[1]) &&
+                     (new_area[0] <= old_area[1]) &&
+                     (old_area[2] <= new_area[3]) &&
+                     (new_area[2] <= old_area[3])) {
+                     new_area[0] = std::min(new_area[0], old_area[0]);
+                     new_area[1] = std::max(new_area[1], old_area[1]);
+                     new_area[2] = std::min(new_area[2], old_area[2]);
+                     new_area[3] = std::max(new_area[3], old_area[3]);
+                     areas_[nn] = areas_.back();
+                     areas_.pop_back();
+                     merged = true;
+                     break;
+                 }
+             }
+         }
+         areas_.push_back(new_area);
+     }
+
+     /// \brief Write the area `nn` of the set into `area`, following the
+     ///        convention of `impact_area_`.
+     void Get(std::size_t nn, int area[2][2]) const {
+         area[0][0] = areas_[nn][0];
+         area[0][1] = areas_[nn][1];
+         area[1][0] = areas_[nn][2];
+         area[1][1] = areas_[nn][3];
+     }
+
+     /// \brief Number of areas in the set.
+     std::size_t size() const { return areas_.size(); }
+
+     /// \brief Number of cells covered by the set.
+     std::size_t Count() const {
+         std::size_t count = 0;
+         for (const auto& area : areas_)
+             count += static_cast<std::size_t>(area[1] - area[0]) *
+                 (area[3] - area[2]);
+         return count;
+     }
+
+ private:
+     std::vector<std::array<int, 4>> areas_;
+};
+
+/// \brief Minimum and maximum height indices of a body wall for each column
+///        of a rectangular area.
+///
+/// The cells where a body wall is located are reduced, when they are added,
+/// to the minimum and maximum height indices of each XY position, such that
+/// neither a list of cells nor a sort are required. The area that has been
+/// written since the last `Clear` is tracked, so that `Clear` and
+/// `ForEachColumn` only visit this area. The interface follows the one of
+/// `CellList<3>`, such that both classes can be used to collect the cells
+/// where a body wall is located.
+///
+/// Usage:
+/// \code
+///     int area[2][2] = {{10, 20}, {30, 45}};
+///     soil_simulator::ColumnBuffer columns;
+///     columns.Reset(area);
+///     columns.push_back({12, 40, 5});
+///     columns.push_back({12, 40, 8});
+///     columns.ForEachColumn([](int ii, int jj, int kk_min, int kk_max) {
+///         std::cout << ii << " " << jj << " " << kk_min << " " << kk_max;
+///     });
+/// \endcode
+class ColumnBuffer {
+ public:
+     /// \brief Create an empty buffer.
+     ColumnBuffer() : min_x_(0), min_y_(0), size_x_(0), size_y_(0) {
+         Untouch();
+     }
+
+     /// \brief Cover the columns of `area` and remove all heights.
+     ///
+     /// \param area: 2D bounding box of the covered columns, following the
+     ///              convention of `impact_area_`.
+     void Reset(const int area[2][2]) {
+         min_x_ = area[0][0];
+         min_y_ = area[1][0];
+         size_x_ = std::max(area[0][1] - area[0][0], 0);
+         size_y_ = std::max(area[1][1] - area[1][0], 0);
+         columns_.assign(
+             static_cast<std::size_t>(size_x_) * size_y_, {kEmpty, -kEmpty});
+         Untouch();
+     }
+
+     /// \brief Remove all heights, only visiting the written area.
+     void Clear() {
+         for (auto ii = touched_min_x_; ii <= touched_max_x_; ii++)
+             for (auto jj = touched_min_y_; jj <= touched_max_y_; jj++)
+                 columns_[Index(ii, jj)] = {kEmpty, -kEmpty};
+         Untouch();
+     }
+
+     /// \brief Add the cell (`cell[0]`, `cell[1]`) at the height index
+     ///        `cell[2]`. Cells outside the covered area are ignored.
+     void push_back(const std::array<int, 3>& cell) {
+         int ii = cell[0];
+         int jj = cell[1];
+         if (
+             (ii < min_x_) || (ii >= min_x_ + size_x_) || (jj < min_y_) ||
+             (jj >= min_y_ + size_y_))
+             return;
+
+         auto& column = columns_[Index(ii, jj)];
+         column[0] = std::min(column[0], cell[2]);
+         column[1] = std::max(column[1], cell[2]);
+         touched_min_x_ = std::min(touched_min_x_, ii);
+         touched_max_x_ = std::max(touched_max_x_, ii);
+         touched_min_y_ = std::min(touched_min_y_, jj);
+         touched_max_y_ = std::max(touched_max_y_, jj);
+     }
+
+     /// \brief Call `func(ii, jj, kk_min, kk_max)` for all columns where a
+     ///        cell has been added, in row-major order.
+     template <typename F>
+     void ForEachColumn(const F& func) const {
+         for (auto ii = touched_min_x_; ii <= touched_max_x_; ii++)
+             for (auto jj = touched_min_y_; jj <= touched_max_y_; jj++) {
+                 const auto& column = columns_[Index(ii, jj)];
+                 if (column[0] <= column[1])
+                     func(ii, jj, column[0], column[1]);
+             }
+     }
+
+ private:
+     static constexpr int kEmpty = std::numeric_limits<int>::max();
+
+     std::size_t Index(int ii, int jj) const {
+         return static_cast<std::size_t>(ii - min_x_) * size_y_ + jj - min_y_;
+     }
+
+     void Untouch() {
+         touched_min_x_ = min_x_ + size_x_;
+         touched_max_x_ = min_x_ - 1;
+         touched_min_y_ = min_y_ + size_y_;
+         touched_max_y_ = min_y_ - 1;
+     }
+
+     int min_x_;
+     int min_y_;
+     int size_x_;
+     int size_y_;
+     int touched_min_x_;
+     int touched_max_x_;
+     int touched_min_y_;
+     int touched_max_y_;
+     std::vector<std::array<int, 2>> columns_;
+};
+
+/// \brief Compact buffer storing the four body layers of each column of an
+///        area.
+///
+/// The layers of each column follow the convention of `body_`. It is used to
+/// calculate the new body position before comparing it with `body_`.
+class BodyFootprint {
+ public:
+     /// \brief Create an empty buffer.
+     BodyFootprint() : min_x_(0), min_y_(0), size_x_(0), size_y_(0) {}
+
+     /// \brief Cover the columns of `area` and set all their layers to zero.
+     ///
+     /// \param area: 2D bounding box of the covered columns, following the
+     ///              convention of `impact_area_`.
+     void Reset(const int area[2][2]) {
+         min_x_ = area[0][0];
+         min_y_ = area[1][0];
+         size_x_ = std::max(area[0][1] - area[0][0], 0);
+         size_y_ = std::max(area[1][1] - area[1][0], 0);
+         cells_.assign(
+             static_cast<std::size_t>(size_x_) * size_y_, {0.0, 0.0, 0.0, 0.0});
+     }
+
+     /// \brief Layers of the column at (`ii`, `jj`).
+     float* Cell(int ii, int jj) { return cells_[Index(ii, jj)].data(); }
+
+     /// \brief Layers of the column at (`ii`, `jj`).
+     const float* Cell(int ii, int jj) const {
+         return cells_[Index(ii, jj)].data();
+     }
+
+     /// \brief Whether the column at (`ii`, `jj`) is covered by the buffer.
+     bool Contains(int ii, int jj) const {
+         return (
+             (ii >= min_x_) && (ii < min_x_ + size_x_) && (jj >= min_y_) &&
+             (jj < min_y_ + size_y_));
+     }
+
+     /// \brief Copy the 2D bounding box of the covered columns into `area`.
+     void GetArea(int area[2][2]) const {
+         area[0][0] = min_x_;
+         area[0][1] = min_x_ + size_x_;
+         area[1][0] = min_y_;
+         area[1][1] = min_y_ + size_y_;
+     }
+
+ private:
+     std::size_t Index(int ii, int jj) const {
+         return static_cast<std::size_t>(ii - min_x_) * size_y_ + jj - min_y_;
+     }
+
+     int min_x_;
+     int min_y_;
+     int size_x_;
+     int size_y_;
+     std::vector<std::array<float, 4>> cells_;
+};
+
+/// \brief Surface of a body wall, either a triangle ABC or a rectangle ABCD.
+struct BodySurface {
+    /// Cartesian coordinates of the first vertex of the surface. [m]
+    Vec3 a;
+
+    /// Cartesian coordinates of the second vertex of the surface. [m]
+    Vec3 b;
+
+    /// Cartesian coordinates of the third vertex of the surface. [m]
+    Vec3 c;
+
+    /// Cartesian coordinates of the fourth vertex of the surface, only used
+    /// for a rectangle. [m]
+    Vec3 d;
+
+    /// Indicate whether the surface is a rectangle.
+    bool rectangle;
+
+    /// Indicate whether the surface is part of the boundary of a closed body,
+    /// in which case the space enclosed by the boundary is also occupied by
+    /// the body.
+    bool closed;
+};
+
 /// \brief Store information related to the position of the body soil.
 struct body_soil{
     /// Index of the body soil layer.
@@ -34,6 +1743,10 @@ struct body_soil{
 
     /// Vertical extent of the soil column. [m]
     float h_soil;
+
+    /// Index in `bodies_` of the body on which the soil is resting. It is
+    /// always zero when a single body is simulated.
+    int body = 0;
 };
 
 /// \brief Store all parameters related to the simulation grid.
@@ -189,9 +1902,10 @@ class Body {
      ///                    reference pose. [m]
      /// \param width: Width of the body. [m]
      Body(
-         std::vector<float> o_pos_init, std::vector<float> j_pos_init,
-         std::vector<float> b_pos_init, std::vector<float> t_pos_init,
-         float width);
+         const std::vector<float>& o_pos_init,
+         const std::vector<float>& j_pos_init,
+         const std::vector<float>& b_pos_init,
+         const std::vector<float>& t_pos_init, float width);
 
      /// \brief Destructor.
      virtual ~Body() {}
@@ -357,6 +2071,118 @@ class Blade : public Body {
      ~Blade() {}
 };
 
+/// \brief Node of the bounding volume hierarchy of a `MeshBody`.
+///
+/// The nodes are stored in depth-first order, so that the first child of a
+/// node directly follows it.
+struct BvhNode {
+    /// Minimum Cartesian coordinates of the triangles of the node in the
+    /// reference pose of the body. [m]
+    Vec3 box_min;
+
+    /// Maximum Cartesian coordinates of the triangles of the node in the
+    /// reference pose of the body. [m]
+    Vec3 box_max;
+
+    /// Index of the first triangle of the node when it is a leaf, index of its
+    /// second child otherwise.
+    int first;
+
+    /// Number of triangles of the node when it is a leaf, zero otherwise.
+    int count;
+};
+
+/// \brief Store all parameters related to a body described by a closed
+///        triangle mesh.
+///
+/// Convention:
+/// - The mesh is described by its vertices and by its triangles, each
+///   triangle being given by the indices of its three vertices.
+/// - The mesh should be closed, that is, each edge should be shared by exactly
+///   two triangles.
+/// - Each triangle of the mesh is a body wall.
+/// - The centre of rotation of the body is assumed to be at the body origin
+///   and the mesh vertices are given relative to this origin.
+/// - The provided coordinates are assumed to be the reference pose of the
+///   body, from which the body pose is calculated throughout the code.
+/// - The body joint, base, and teeth, as well as the body width, are derived
+///   from the bounding box of the mesh, such that the triangular prism they
+///   form encloses the mesh. They are only used to follow the movement of the
+///   body.
+/// - The triangles are stored in a bounding volume hierarchy, so that the
+///   triangles located outside the simulation grid can be quickly discarded.
+///   The order of `triangles_` is therefore not the one provided.
+///
+/// Usage:
+/// \code
+///    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+///    std::vector<std::vector<float>> vertices = {
+///        {0.0, 0.0, 0.0}, {0.5, 0.0, 0.0}, {0.0, 0.5, 0.0}, {0.0, 0.0, 0.5}};
+///    std::vector<std::vector<int>> triangles = {
+///        {0, 2, 1}, {0, 1, 3}, {0, 3, 2}, {1, 2, 3}};
+///
+///    soil_simulator::MeshBody body(o_pos, vertices, triangles);
+/// \endcode
+///
+/// This would create a tetrahedron with its centre of rotation at one of its
+/// vertices.
+class MeshBody : public Body {
+ public:
+     /// Cartesian coordinates of the mesh vertices in the reference pose. [m]
+     std::vector<Vec3> vertices_;
+
+     /// Indices of the three vertices of each mesh triangle.
+     std::vector<std::array<int, 3>> triangles_;
+
+     /// Bounding volume hierarchy of the mesh triangles.
+     std::vector<BvhNode> bvh_;
+
+     /// Maximum number of triangles in a leaf of the bounding volume
+     /// hierarchy.
+     static constexpr int kLeafSize = 4;
+
+     /// \brief Create a new instance of `MeshBody` using the reference
+     ///        positions of the body origin and of the mesh vertices.
+     ///
+     /// Requirements:
+     /// - All provided Cartesian coordinates should be a vector of size 3.
+     /// - All triangles should be a vector of size 3 made of three different
+     ///   vertex indices.
+     /// - The mesh should be closed.
+     /// - The mesh should have a non-zero extent in all directions.
+     ///
+     /// \param o_pos_init: Cartesian coordinates of the body origin in its
+     ///                    reference pose. [m]
+     /// \param vertices: Cartesian coordinates of the mesh vertices in the
+     ///                  reference pose of the body. [m]
+     /// \param triangles: Indices of the three vertices of each mesh triangle.
+     MeshBody(
+         const std::vector<float>& o_pos_init,
+         const std::vector<std::vector<float>>& vertices,
+         const std::vector<std::vector<int>>& triangles);
+
+     /// \brief Destructor.
+     ~MeshBody() {}
+
+ private:
+     /// \brief Build the node of the bounding volume hierarchy containing
+     ///        the `count` triangles starting at `first`, as well as all its
+     ///        children.
+     ///
+     /// \return Index of the node in `bvh_`.
+     int BuildBvh(int first, int count);
+};
+
+/// \brief Algorithm used to relax the `terrain_`.
+///
+/// - `kSequential`: The unstable cells are relaxed one after the other in a
+///   random order, each avalanche seeing the result of the previous ones.
+/// - `kFlux`: The soil moved by all avalanches onto the `terrain_` is first
+///   calculated from the current `terrain_`, and then applied in a single
+///   pass, so that all cells can be processed concurrently. The avalanches
+///   onto the body are made sequentially afterwards.
+enum class RelaxMode { kSequential, kFlux };
+
 /// \brief Store all parameters related to the simulation.
 ///
 /// Note
@@ -381,6 +2207,27 @@ class SimParam {
      /// terrain where soil equilibrium is checked.
      int cell_buffer_;
 
+     /// The number of threads used for the terrain relaxation. The result
+     /// of the relaxation does not depend on it.
+     int n_thread_;
+
+     /// The algorithm used to relax the terrain.
+     RelaxMode relax_mode_;
+
+     /// The number of coarse grid levels where the soil is redistributed
+     /// before the relaxation. The multigrid relaxation is disabled when it is
+     /// equal to 0.
+     int multigrid_levels_;
+
+     /// Indicate whether the equilibrium surface of the terrain is directly
+     /// calculated at the beginning of the relaxation.
+     bool fast_settle_;
+
+     /// Indicate whether the body position is updated incrementally, that
+     /// is, only the cells where the body has changed are written into
+     /// `body_`, checked for intersecting soil and marked for relaxation.
+     bool incremental_body_;
+
      /// \brief Create a new instance of `SimParam`.
      ///
      /// Requirements:
@@ -388,6 +2235,8 @@ class SimParam {
      ///   may be extended in the future.
      /// - The `max_iterations` should be greater or equal to zero.
      /// - The `cell_buffer` should be greater or equal to 2.
+     /// - The `n_thread` should be greater or equal to 1.
+     /// - The `multigrid_levels` should be greater or equal to zero.
      ///
      /// \param repose_angle: The repose angle of the considered soil. [rad]
      /// \param max_iterations: The maximum number of relaxation iterations
@@ -395,9 +2244,22 @@ class SimParam {
      /// \param cell_buffer: The number of buffer cells surrounding the body
      ///                     and the relaxed terrain where soil equilibrium
      ///                     is checked.
+     /// \param n_thread: The number of threads used for the terrain
+     ///                  relaxation.
+     /// \param relax_mode: The algorithm used to relax the terrain.
+     /// \param multigrid_levels: The number of coarse grid levels where the
+     ///                          soil is redistributed before the relaxation.
+     /// \param fast_settle: Indicate whether the equilibrium surface of the
+     ///                     terrain is directly calculated at the beginning of
+     ///                     the relaxation.
+     /// \param incremental_body: Indicate whether the body position is
+     ///                          updated incrementally.
      SimParam(
          float repose_angle = 0.85, int max_iterations = 10,
-         int cell_buffer = 4);
+         int cell_buffer = 4, int n_thread = 1,
+         RelaxMode relax_mode = RelaxMode::kSequential,
+         int multigrid_levels = 0, bool fast_settle = false,
+         bool incremental_body = false);
 
      /// \brief Destructor.
      ~SimParam() {}
@@ -408,6 +2270,11 @@ class SimParam {
 /// Convention
 /// - The `terrain_` Matrix stores the height of the terrain at each XY
 ///   position, see the `Grid` class for more details on the simulation grid.
+///   `terrain_`, `body_` and `body_soil_` are stored in contiguous buffers
+///   aligned on a cache line, see the `Array2D` and `Array3D` classes.
+///   The four layers of `body_` and `body_soil_` can optionally be packed per
+///   cell using the `kCellMajor` layout, which speeds up the functions reading
+///   all layers of a cell at once.
 /// - The cells where a body wall is located is stored in `body_`. At each
 ///   XY position, the first layer indicates the lowest height where a body
 ///   wall is located while the second layer indicates the maximum height of
@@ -415,8 +2282,12 @@ class SimParam {
 ///   position, its minimum and maximum height are indicated in the third and
 ///   fourth layers, respectively.
 /// - For each body, there can be only two distinct body walls located at
-///   the same XY position. As a result, the number of layers in the `body_`
-///   vector should be equal to four times the number of body.
+///   the same XY position.
+/// - When several bodies are simulated, the position of each body is stored
+///   separately in `body_footprints_`, following the same convention, and
+///   `body_` stores the union of all body walls. The body walls of different
+///   bodies located at the same XY position are therefore merged when more
+///   than two of them are present.
 /// - Similarly, `body_soil_` stores the location of the soil resting on a
 ///   body wall. The structure of `body_soil_` is identical to `body_`. An
 ///   additional restriction is that the minimum height of the soil resting on
@@ -430,10 +2301,9 @@ class SimParam {
 ///   [0, 1] corresponds to the maximum X index.
 ///   [1, 0] corresponds to the minimum Y index.
 ///   [1, 1] corresponds to the maximum Y index.
-///
-/// Note:
-/// - Currently, only one body at a time is supported, but this restriction
-///   may be removed in the future.
+/// - The active areas are also stored as sets of disjoint areas
+///   (`relax_regions_` and `impact_regions_`), so that distant regions where
+///   the soil may change are handled without scanning the cells between them.
 ///
 /// Usage:
 /// \code
@@ -449,15 +2319,15 @@ class SimOut {
      bool equilibrium_;
 
      /// Height of the terrain. [m]
-     std::vector<std::vector<float>> terrain_;
+     terrain_t terrain_;
 
      /// Store the vertical extension of all body walls for each XY
      /// position. [m]
-     std::vector<std::vector<std::vector<float>>> body_;
+     body_layers_t body_;
 
      /// Store the vertical extension of all soil resting on a body wall for
      /// each XY position. [m]
-     std::vector<std::vector<std::vector<float>>> body_soil_;
+     body_layers_t body_soil_;
 
      /// Store the information related to the soil resting on the body.
      std::vector<body_soil> body_soil_pos_;
@@ -474,14 +2344,432 @@ class SimOut {
      /// to the area where the soil equilibrium is checked.
      int impact_area_[2][2];
 
+     /// Store the disjoint areas where soil has been relaxed with a buffer
+     /// determined by the parameter `cell_buffer_` of `SimParam`.
+     /// `relax_area_` is their 2D bounding box. They are cleared once
+     /// included in `impact_regions_`, and when no cell is relaxed.
+     ActiveRegions relax_regions_;
+
+     /// Store the union of `body_area_` and `relax_regions_` as disjoint
+     /// areas. The soil equilibrium is only checked in the cells of
+     /// `impact_area_` that are covered by these areas.
+     ActiveRegions impact_regions_;
+
+     /// Store the cells where the body position has changed during the last
+     /// incremental update of the body position, in row-major order.
+     CellList<2> body_changed_cells_;
+
+     /// Store the bodies simulated during the last step when several bodies
+     /// are simulated. It is empty when a single body is simulated.
+     std::vector<Body*> bodies_;
+
+     /// Store the position of each body of `bodies_`, following the
+     /// convention of `body_`.
+     std::vector<BodyFootprint> body_footprints_;
+
+     /// Store the 2D bounding box of each body of `bodies_` with a buffer
+     /// determined by the parameter `cell_buffer_` of `SimParam`.
+     /// `body_area_` is their 2D bounding box.
+     std::vector<std::array<std::array<int, 2>, 2>> bodies_area_;
+
+     /// Store the cells whose stability may have changed since it was last
+     /// checked. Each cell is present at most once.
+     CellList<2> dirty_cells_;
+
+     /// Indicates whether each cell is present in `dirty_cells_`.
+     dirty_mask_t dirty_mask_;
+
+     /// Volume of soil in `terrain_`, updated by every soil transfer and
+     /// expressed as the sum of the soil column heights. [m]
+     double terrain_volume_;
+
+     /// Volume of soil in `body_soil_`, updated by every soil transfer and
+     /// expressed as the sum of the soil column heights. [m]
+     double body_soil_volume_;
+
+     /// Cumulative volume of soil removed from the simulation, expressed as
+     /// the sum of the soil column heights. [m]
+     double lost_volume_;
+
      /// \brief Create a new instance of `SimOut`.
      ///
      /// \param grid: Class that stores information related to the simulation
      ///              grid.
-     explicit SimOut(Grid grid = Grid());
+     /// \param layout: Memory layout of the layers of `body_` and
+     ///                `body_soil_`.
+     explicit SimOut(
+         const Grid& grid = Grid(),
+         ArrayLayout layout = ArrayLayout::kLayerMajor);
 
      /// \brief Destructor.
     ~SimOut() {}
 };
 
+/// \brief Pool of worker threads used to run loops in parallel.
+///
+/// The threads are created once and wait for work, so that the cost of
+/// creating the threads is not paid at every parallel loop. The calling thread
+/// takes part in the work, so that `n_thread - 1` worker threads are created.
+///
+/// Usage:
+/// \code
+///     soil_simulator::ThreadPool pool(4);
+///     pool.ParallelFor(100, [&](int begin, int end) {
+///         for (auto ii = begin; ii < end; ii++)
+///             out[ii] = 2 * in[ii];
+///     });
+/// \endcode
+class ThreadPool {
+ public:
+     /// \brief Create a pool running loops on `n_thread` threads.
+     ///
+     /// \param n_thread: Number of threads, including the calling thread.
+     explicit ThreadPool(int n_thread);
+
+     /// \brief Destructor, waiting for all worker threads to terminate.
+     ~ThreadPool();
+
+     ThreadPool(const ThreadPool&) = delete;
+     ThreadPool& operator=(const ThreadPool&) = delete;
+
+     /// \brief Run `func` over the range [0, `n`).
+     ///
+     /// The range is split into one contiguous chunk per thread and
+     /// `func(begin, end)` is called for each chunk. The function returns once
+     /// all chunks have been processed.
+     ///
+     /// \param n: Number of elements in the range.
+     /// \param func: Function processing the elements from `begin` to `end`.
+     template <typename F>
+     void ParallelFor(int n, const F& func) {
+         Run(n, &func, [](const void* ctx, int begin, int end) {
+             (*static_cast<const F*>(ctx))(begin, end);
+         });
+     }
+
+     /// \brief Number of threads, including the calling thread.
+     int size() const { return n_thread_; }
+
+ private:
+     using Task = void (*)(const void*, int, int);
+
+     void Run(int n, const void* ctx, Task task);
+
+     void Work(int id);
+
+     int n_thread_;
+     std::vector<std::thread> threads_;
+     std::mutex mutex_;
+     std::condition_variable start_cv_;
+     std::condition_variable done_cv_;
+     const void* ctx_;
+     Task task_;
+     int n_;
+     int generation_;
+     int n_running_;
+     bool stop_;
+};
+
+/// \brief Part of the simulation drawing random numbers.
+///
+/// It is used to separate the random numbers drawn by the different parts of
+/// the simulation for the same cell.
+enum class RandomSite {
+    kInit, kMoveIntersectingBodySoil, kMoveIntersectingBody, kRelaxTerrain,
+    kRelaxTerrainOrder, kRelaxBodySoil, kRelaxBodySoilOrder };
+
+/// \brief Counter-based random number generator.
+///
+/// Contrary to `std::mt19937`, this generator does not have a sequential
+/// state. Each random number is calculated from a counter identifying the
+/// simulation step, the relaxation iteration, the part of the simulation and
+/// the cell for which it is drawn, so that the random numbers of a cell can
+/// be calculated independently from the other cells. The relaxation of the
+/// cells is therefore not affected by the order in which they are processed,
+/// nor by the number of threads.
+///
+/// The counter is hashed with the SplitMix64 finalizer, and the random
+/// numbers are generated with the Squares algorithm (Widynski, 2020).
+///
+/// Usage:
+/// \code
+///     soil_simulator::CounterRng rng(1234);
+///     rng.SetCounter(step, iteration);
+///     auto directions = soil_simulator::CounterRng::Permute(
+///         directions_init, rng.Draw(RandomSite::kRelaxTerrain, ii, jj));
+/// \endcode
+class CounterRng {
+ public:
+     /// \brief Random number engine drawing successive random numbers from a
+     ///        given counter. It satisfies the `UniformRandomBitGenerator`
+     ///        requirements, so that it can be used with the standard
+     ///        distributions.
+     class Engine {
+      public:
+          using result_type = std::uint32_t;
+
+          Engine(std::uint64_t key, std::uint64_t counter) :
+              key_(key), counter_(counter) {}
+
+          static constexpr result_type min() { return 0; }
+          static constexpr result_type max() { return UINT32_MAX; }
+
+          result_type operator()() { return Squares(counter_++, key_); }
+
+      private:
+          std::uint64_t key_;
+          std::uint64_t counter_;
+     };
+
+     /// \brief Create a generator.
+     ///
+     /// \param seed: Seed of the generator.
+     explicit CounterRng(std::uint64_t seed = 0) : step_(0), iteration_(0) {
+         Seed(seed);
+     }
+
+     /// \brief Set the seed of the generator.
+     void Seed(std::uint64_t seed);
+
+     /// \brief Set the simulation step and the relaxation iteration
+     ///        identifying the following random numbers.
+     void SetCounter(std::uint64_t step, int iteration) {
+         step_ = step;
+         iteration_ = iteration;
+     }
+
+     /// \brief Random number associated with the cell (`ii`, `jj`).
+     ///
+     /// \param site: Part of the simulation drawing the random number.
+     /// \param ii: Index of the cell in the X direction.
+     /// \param jj: Index of the cell in the Y direction.
+     /// \param index: Additional index distinguishing several random numbers
+     ///               drawn for the same cell.
+     std::uint32_t Draw(
+         RandomSite site, int ii, int jj, int index = 0
+     ) const {
+         return Squares(Counter(site, ii, jj, index), key_);
+     }
+
+     /// \brief Engine drawing the random numbers associated with the cell
+     ///        (`ii`, `jj`), see `Draw`.
+     Engine Stream(RandomSite site, int ii, int jj, int index = 0) const {
+         return Engine(key_, Counter(site, ii, jj, index));
+     }
+
+     /// \brief Return a random permutation of `values` determined by `draw`.
+     ///
+     /// A Fisher-Yates shuffle is performed using the successive remainders
+     /// of `draw`, so that a single random number is required. The bias is
+     /// negligible as long as N! is much smaller than 2^32.
+     template <typename T, std::size_t N>
+     static std::array<T, N> Permute(
+         std::array<T, N> values, std::uint32_t draw
+     ) {
+         for (std::size_t aa = N - 1; aa > 0; aa--) {
+             std::size_t bb = draw % (aa + 1);
+             draw /= (aa + 1);
+             std::swap(values[aa], values[bb]);
+         }
+         return values;
+     }
+
+ private:
+     static std::uint64_t Mix(std::uint64_t x) {
+         x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+         x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+         return x ^ (x >> 31);
+     }
+
+     static std::uint32_t Squares(std::uint64_t counter, std::uint64_t key) {
+         std::uint64_t x = counter * key;
+         std::uint64_t y = x;
+         std::uint64_t z = y + key;
+         x = x * x + y;
+         x = (x >> 32) | (x << 32);
+         x = x * x + z;
+         x = (x >> 32) | (x << 32);
+         x = x * x + y;
+         x = (x >> 32) | (x << 32);
+         return (x * x + z) >> 32;
+     }
+
+     std::uint64_t Counter(RandomSite site, int ii, int jj, int index) const {
+         std::uint64_t counter = Mix(
+             step_ ^ Mix((static_cast<std::uint64_t>(iteration_) << 8) |
+             static_cast<std::uint64_t>(site)));
+         counter = Mix(
+             counter ^ (static_cast<std::uint64_t>(
+             static_cast<std::uint32_t>(ii)) << 32) ^
+             static_cast<std::uint32_t>(jj));
+         return Mix(counter ^ static_cast<std::uint32_t>(index));
+     }
+
+     std::uint64_t key_;
+     std::uint64_t step_;
+     int iteration_;
+};
+
+/// \brief Store reusable buffers for the transient data of a simulation step.
+///
+/// The buffers keep their allocated memory between two uses, so that, once
+/// their capacity is large enough, a simulation step does not perform any
+/// heap allocation. A `Workspace` is owned by `SoilDynamics` and passed to the
+/// functions requiring temporary storage. When no `Workspace` is provided,
+/// these functions use a temporary one.
+///
+/// Note:
+/// - The content of the buffers is only meaningful during the call of the
+///   function using it.
+class Workspace {
+ public:
+     /// Vector decomposition of the cells in the area of a body surface in
+     /// terms of its first edge (AB).
+     std::vector<float> c_ab_;
+
+     /// Vector decomposition of the cells in the area of a body surface in
+     /// terms of its second edge (AD for a rectangle, AC for a triangle).
+     std::vector<float> c_ac_;
+
+     /// Indicate whether each cell in the area of a body surface is inside
+     /// the surface.
+     std::vector<std::uint8_t> in_area_;
+
+     /// Height index of the body surface at each cell in the area of the
+     /// body surface. It is only meaningful inside the surface.
+     std::vector<int> area_height_;
+
+     /// Part of the vector decomposition in terms of the first edge of the
+     /// body surface depending only on the Y index of the cells.
+     std::vector<float> c_ab_col_;
+
+     /// Part of the vector decomposition in terms of the second edge of the
+     /// body surface depending only on the Y index of the cells.
+     std::vector<float> c_ac_col_;
+
+     /// Minimum and maximum height indices of the body surface being
+     /// located, for each column of `body_area_`.
+     ColumnBuffer surface_columns_;
+
+     /// New body position, calculated before being compared with `body_`
+     /// when the body position is updated incrementally.
+     BodyFootprint body_footprint_;
+
+     /// Surfaces composing the body walls at the current body pose.
+     std::vector<BodySurface> body_surfaces_;
+
+     /// Cartesian coordinates of the vertices of a `MeshBody` at its current
+     /// pose. [m]
+     std::vector<Vec3> mesh_vertices_;
+
+     /// Nodes of the bounding volume hierarchy of a `MeshBody` left to be
+     /// visited.
+     std::vector<int> bvh_stack_;
+
+     /// Indices of the surfaces of a closed body overlapping each tile of
+     /// columns.
+     std::vector<std::vector<int>> tile_surfaces_;
+
+     /// Minimum and maximum height indices of each surface of a closed body
+     /// in each column of the tile being located, given as
+     /// (ii, jj, kk_min, kk_max).
+     std::vector<std::array<int, 4>> surface_hits_;
+
+     /// Cells where the body position has changed. When it is set, only these
+     /// cells are checked for soil intersecting with the body.
+     const CellList<2>* body_changed_cells_ = nullptr;
+
+     /// Cells in `terrain_` that are possibly unstable.
+     CellList<2> unstable_cells_;
+
+     /// Set of the cells in `terrain_` that are possibly unstable.
+     CellBitmap unstable_bitmap_;
+
+     /// Set of the cells in `terrain_` that intersect with the body.
+     CellBitmap intersecting_cells_;
+
+     /// Temporary copy of the information related to the soil resting on the
+     /// body.
+     std::vector<body_soil> body_soil_pos_;
+
+     /// Pool of threads used by the parallel terrain relaxation. It is
+     /// created on first use.
+     std::unique_ptr<ThreadPool> thread_pool_;
+
+     /// Relaxation directions drawn for each unstable cell.
+     std::vector<std::array<std::array<int, 2>, 4>> cell_directions_;
+
+     /// Indices of the unstable cells sorted by colour.
+     std::vector<int> colour_cells_;
+
+     /// Index of the first direction left to be relaxed serially for each
+     /// unstable cell.
+     std::vector<std::uint8_t> next_direction_;
+
+     /// Indicate whether soil has been moved from each unstable cell.
+     std::vector<std::uint8_t> cell_relaxed_;
+
+     /// Soil moved from each unstable cell towards its four adjacent cells by
+     /// the flux-based relaxation. [m]
+     std::vector<std::array<float, 4>> cell_flux_;
+
+     /// Indicate whether each unstable cell is relaxed serially by the
+     /// flux-based relaxation.
+     std::vector<std::uint8_t> cell_deferred_;
+
+     /// Cells relaxed serially by the flux-based relaxation.
+     CellList<2> deferred_cells_;
+
+     /// Soil contained in each block of a coarse grid level, in number of
+     /// `cell_size_z_`.
+     std::vector<std::int64_t> block_soil_;
+
+     /// Soil contained in each block of a coarse grid level before its
+     /// relaxation, in number of `cell_size_z_`.
+     std::vector<std::int64_t> block_soil_init_;
+
+     /// Soil moved to each block of a coarse grid level during a sweep, in
+     /// number of `cell_size_z_`.
+     std::vector<std::int64_t> block_flux_;
+
+     /// Indicate whether each block of a coarse grid level can exchange soil,
+     /// that is, whether the body is absent from all its cells.
+     std::vector<std::uint8_t> block_active_;
+
+     /// Height of the terrain in the area being settled, in number of
+     /// `cell_size_z_`. The buffer is indexed by `ii_s * area_length_y + jj_s`.
+     std::vector<std::int64_t> settle_height_;
+
+     /// Lower envelope of the terrain satisfying the repose angle in the area
+     /// being settled, in number of `cell_size_z_`.
+     std::vector<std::int64_t> settle_envelope_;
+
+     /// Distance, in number of cells, to the closest cell where soil is
+     /// removed by the settling.
+     std::vector<std::int64_t> settle_distance_;
+
+     /// Indicate whether each cell of the area being settled can be modified,
+     /// that is, whether the body and the soil resting on it are absent.
+     std::vector<std::uint8_t> settle_free_;
+
+     /// Cells of the area being settled, sorted by height when calculating the
+     /// envelope, and then grouped by basin.
+     std::vector<int> settle_order_;
+
+     /// Queue of cells used to calculate the envelope, the basins and the
+     /// distance of the area being settled.
+     std::vector<int> settle_queue_;
+
+     /// Basin to which each cell of the area being settled is assigned, or -1
+     /// if the cell cannot be reached from any basin.
+     std::vector<int> settle_label_;
+
+     /// Index in `settle_order_` of the first cell of each basin.
+     std::vector<int> settle_basin_start_;
+
+     /// Counter-based RNG of the simulator. When it is not set, the random
+     /// numbers are drawn from the global `rng`.
+     const CounterRng* rng_ = nullptr;
+};
+
 }  // namespace soil_simulator
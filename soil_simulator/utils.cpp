@@ -9,35 +9,39 @@ Copyright, 2023, Vilella Kenny.
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <string>
+#include <tuple>
 #include <vector>
 #include "soil_simulator/utils.hpp"
 #include "soil_simulator/types.hpp"
 
+template <std::same_as<soil_simulator::Vec3> V,
+    std::same_as<soil_simulator::Quat> Q>
 std::tuple<
-    std::vector<float>, std::vector<float>, std::vector<float>,
-    std::vector<float>, std::vector<float>, std::vector<float>>
+    soil_simulator::Vec3, soil_simulator::Vec3, soil_simulator::Vec3,
+    soil_simulator::Vec3, soil_simulator::Vec3, soil_simulator::Vec3>
 soil_simulator::CalcBodyCornerPos(
-    std::vector<float> pos, std::vector<float> ori, Body* body
+    const V& pos, const Q& ori, Body* body
 ) {
     // Calculating position of the body vertices
     auto j_pos = soil_simulator::CalcRotationQuaternion(
-        ori, body->j_pos_init_);
+        ori, Vec3::FromVector(body->j_pos_init_));
     auto b_pos = soil_simulator::CalcRotationQuaternion(
-        ori, body->b_pos_init_);
+        ori, Vec3::FromVector(body->b_pos_init_));
     auto t_pos = soil_simulator::CalcRotationQuaternion(
-        ori, body->t_pos_init_);
+        ori, Vec3::FromVector(body->t_pos_init_));
 
     // Unit vector normal to the side of the body
     auto normal_side = soil_simulator::CalcNormal(j_pos, b_pos, t_pos);
 
     // Declaring vectors for each vertex of the body
-    std::vector<float> j_r_pos(3);
-    std::vector<float> j_l_pos(3);
-    std::vector<float> b_r_pos(3);
-    std::vector<float> b_l_pos(3);
-    std::vector<float> t_r_pos(3);
-    std::vector<float> t_l_pos(3);
+    Vec3 j_r_pos;
+    Vec3 j_l_pos;
+    Vec3 b_r_pos;
+    Vec3 b_l_pos;
+    Vec3 t_r_pos;
+    Vec3 t_l_pos;
 
     for (auto ii = 0; ii < 3; ii++) {
         // Adding position of the body origin
@@ -56,6 +60,24 @@ soil_simulator::CalcBodyCornerPos(
 
     return {j_r_pos, j_l_pos, b_r_pos, b_l_pos, t_r_pos, t_l_pos};
 }
+template std::tuple<
+    soil_simulator::Vec3, soil_simulator::Vec3, soil_simulator::Vec3,
+    soil_simulator::Vec3, soil_simulator::Vec3, soil_simulator::Vec3>
+soil_simulator::CalcBodyCornerPos(
+    const Vec3& pos, const Quat& ori, Body* body);
+
+std::tuple<
+    std::vector<float>, std::vector<float>, std::vector<float>,
+    std::vector<float>, std::vector<float>, std::vector<float>>
+soil_simulator::CalcBodyCornerPos(
+    const std::vector<float>& pos, const std::vector<float>& ori, Body* body
+) {
+    auto [j_r_pos, j_l_pos, b_r_pos, b_l_pos, t_r_pos, t_l_pos] =
+        soil_simulator::CalcBodyCornerPos(
+            Vec3::FromVector(pos), Quat::FromVector(ori), body);
+
+    return {j_r_pos, j_l_pos, b_r_pos, b_l_pos, t_r_pos, t_l_pos};
+}
 
 /// This function calculates the maximum distance travelled by any part of the
 /// body since the last soil update. The position of the body during the
@@ -66,15 +88,18 @@ soil_simulator::CalcBodyCornerPos(
 /// Note that if the distance travelled exceeds twice the cell size, a warning
 /// is issued to indicate a potential problem with the soil update.
 bool soil_simulator::CheckBodyMovement(
-    std::vector<float> pos, std::vector<float> ori, Grid grid, Body* body
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Body* body
 ) {
     // Calculating new position of body corners
     auto [j_r_pos_n, j_l_pos_n, b_r_pos_n, b_l_pos_n, t_r_pos_n, t_l_pos_n] =
-        soil_simulator::CalcBodyCornerPos(pos, ori, body);
+        soil_simulator::CalcBodyCornerPos(
+            Vec3::FromVector(pos), Quat::FromVector(ori), body);
 
     // Calculating former position of body corners
     auto [j_r_pos_f, j_l_pos_f, b_r_pos_f, b_l_pos_f, t_r_pos_f, t_l_pos_f] =
-        soil_simulator::CalcBodyCornerPos(body->pos_, body->ori_, body);
+        soil_simulator::CalcBodyCornerPos(
+            Vec3::FromVector(body->pos_), Quat::FromVector(body->ori_), body);
 
     // Calculating distance travelled
     float j_r_dist = std::sqrt(
@@ -120,12 +145,13 @@ bool soil_simulator::CheckBodyMovement(
     return true;
 }
 
-std::vector<float> soil_simulator::CalcNormal(
-    std::vector<float> a, std::vector<float> b, std::vector<float> c
+template <std::same_as<soil_simulator::Vec3> V>
+soil_simulator::Vec3 soil_simulator::CalcNormal(
+    const V& a, const V& b, const V& c
 ) {
     // Declaring vectors
-    std::vector<float> normal(3);
-    std::vector<float> cross(3);
+    Vec3 normal;
+    Vec3 cross;
 
     // Calculating cross product
     cross[0] = (b[1] - a[1]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[1] - a[1]);
@@ -141,19 +167,28 @@ std::vector<float> soil_simulator::CalcNormal(
 
     return normal;
 }
+template soil_simulator::Vec3 soil_simulator::CalcNormal(
+    const Vec3& a, const Vec3& b, const Vec3& c);
+
+std::vector<float> soil_simulator::CalcNormal(
+    const std::vector<float>& a, const std::vector<float>& b,
+    const std::vector<float>& c
+) {
+    return soil_simulator::CalcNormal(
+        Vec3::FromVector(a), Vec3::FromVector(b), Vec3::FromVector(c));
+}
 
-std::vector<float> soil_simulator::CalcBodyFramePos(
-    int ii, int jj, float z, Grid grid, Body* body
+soil_simulator::Vec3 soil_simulator::CalcBodyFramePos(
+    int ii, int jj, float z, const Grid& grid, Body* body
 ) {
     // Calculating cell's position in body frame
-    std::vector<float> cell_pos = {
+    Vec3 cell_pos = {
         grid.vect_x_[ii] - body->pos_[0],
         grid.vect_y_[jj] - body->pos_[1],
         z - body->pos_[2]};
 
     // Inversing rotation
-    std::vector<float> inv_ori = {
-        body->ori_[0], -body->ori_[1], -body->ori_[2], -body->ori_[3]};
+    Quat inv_ori = Quat::FromVector(body->ori_).Conjugate();
 
     // Calculating reference position of cell in body frame
     auto cell_local_pos = soil_simulator::CalcRotationQuaternion(
@@ -162,34 +197,80 @@ std::vector<float> soil_simulator::CalcBodyFramePos(
     return cell_local_pos;
 }
 
+/// As the body walls of different bodies may be merged in `body_`, the body
+/// whose wall top is the closest to the top of the considered body layer is
+/// selected. The first body is selected when no other body is present at this
+/// location.
+int soil_simulator::FindBody(const SimOut* sim_out, int ii, int jj, int ind) {
+    int body_ind = 0;
+    if (sim_out->body_footprints_.size() <= 1)
+        return body_ind;
+
+    // Iterating over the bodies covering the column
+    float dist_min = std::numeric_limits<float>::max();
+    float body_top = sim_out->body_[ind+1][ii][jj];
+    for (auto nn = 0; nn < sim_out->body_footprints_.size(); nn++) {
+        const auto& footprint = sim_out->body_footprints_[nn];
+        if (!footprint.Contains(ii, jj))
+            continue;
+
+        const float* body_cell = footprint.Cell(ii, jj);
+        for (auto kk = 0; kk < 4; kk += 2) {
+            if ((body_cell[kk] == 0.0) && (body_cell[kk+1] == 0.0))
+                // No body wall
+                continue;
+
+            float dist = std::abs(body_cell[kk+1] - body_top);
+            if (dist < dist_min) {
+                // Updating the closest body
+                dist_min = dist;
+                body_ind = nn;
+            }
+        }
+    }
+    return body_ind;
+}
+
 /// The mathematical reasoning behind this implementation can be easily found
 /// in the Wiki page of Quaternion or elsewhere.
-std::vector<float> soil_simulator::CalcRotationQuaternion(
-    std::vector<float> ori, std::vector<float> pos
+template <std::same_as<soil_simulator::Quat> Q,
+    std::same_as<soil_simulator::Vec3> V>
+soil_simulator::Vec3 soil_simulator::CalcRotationQuaternion(
+    const Q& ori, const V& pos
 ) {
     // Declaring vectors
     float norm_ori = (
         ori[0] * ori[0] + ori[1] * ori[1] + ori[2] * ori[2] + ori[3] * ori[3]);
-    std::vector<float> conj_ori = {
+    Quat conj_ori = {
         ori[0] / norm_ori,
         -ori[1] / norm_ori,
         -ori[2] / norm_ori,
         -ori[3] / norm_ori};
-    std::vector<float> temp_pos = {0.0, pos[0], pos[1], pos[2]};
+    Quat temp_pos = {0.0f, pos[0], pos[1], pos[2]};
 
     // Calculating rotation
     auto temp_quat = soil_simulator::MultiplyQuaternion(conj_ori, temp_pos);
     auto quat = soil_simulator::MultiplyQuaternion(temp_quat, ori);
     return {quat[1], quat[2], quat[3]};
 }
+template soil_simulator::Vec3 soil_simulator::CalcRotationQuaternion(
+    const Quat& ori, const Vec3& pos);
+
+std::vector<float> soil_simulator::CalcRotationQuaternion(
+    const std::vector<float>& ori, const std::vector<float>& pos
+) {
+    return soil_simulator::CalcRotationQuaternion(
+        Quat::FromVector(ori), Vec3::FromVector(pos));
+}
 
 /// The mathematical reasoning behind this implementation can be easily found
 /// in the Wiki page of Quaternion or elsewhere.
 ///
 /// Note that this function only works if the Euler angles follow the
 /// ZYX convention.
-std::vector<float> soil_simulator::AngleToQuat(
-    std::vector<float> ori
+template <std::same_as<soil_simulator::Vec3> V>
+soil_simulator::Quat soil_simulator::AngleToQuat(
+    const V& ori
 ) {
     // Compute the sines and cosines of half angle.
     float sin_0 = std::sin(ori[0] / 2.0);
@@ -200,7 +281,7 @@ std::vector<float> soil_simulator::AngleToQuat(
     float cos_2 = std::cos(ori[2] / 2.0);
 
     float q_0 = cos_0 * cos_1 * cos_2 + sin_0 * sin_1 * sin_2;
-    std::vector<float> quat(4);
+    Quat quat;
     if (q_0 > 0) {
         quat[0] = q_0;
         quat[1] = cos_0 * cos_1 * sin_2 - sin_0 * sin_1 * cos_2;
@@ -215,14 +296,22 @@ std::vector<float> soil_simulator::AngleToQuat(
 
     return quat;
 }
+template soil_simulator::Quat soil_simulator::AngleToQuat(const Vec3& ori);
+
+std::vector<float> soil_simulator::AngleToQuat(
+    const std::vector<float>& ori
+) {
+    return soil_simulator::AngleToQuat(Vec3::FromVector(ori));
+}
 
 /// The mathematical reasoning behind this implementation can be easily found
 /// in the Wiki page of Quaternion or elsewhere.
-std::vector<float> soil_simulator::MultiplyQuaternion(
-    std::vector<float> q1, std::vector<float> q2
+template <std::same_as<soil_simulator::Quat> Q>
+soil_simulator::Quat soil_simulator::MultiplyQuaternion(
+    const Q& q1, const Q& q2
 ) {
     // Declaring vectors
-    std::vector<float> quat(4);
+    Quat quat;
 
     // Calculating quaternion multiplication
     quat[0] = q1[0] * q2[0] - q1[1] * q2[1] - q1[2] * q2[2] - q1[3] * q2[3];
@@ -232,71 +321,111 @@ std::vector<float> soil_simulator::MultiplyQuaternion(
 
     return quat;
 }
+template soil_simulator::Quat soil_simulator::MultiplyQuaternion(
+    const Quat& q1, const Quat& q2);
+
+std::vector<float> soil_simulator::MultiplyQuaternion(
+    const std::vector<float>& q1, const std::vector<float>& q2
+) {
+    return soil_simulator::MultiplyQuaternion(
+        Quat::FromVector(q1), Quat::FromVector(q2));
+}
 
 /// The initial number of soil cells (`init_volume`) has to be provided.
 /// The number of soil cells is used instead of volume in order to avoid issue
 /// due to floating number approximation.
 bool soil_simulator::CheckVolume(
-    SimOut* sim_out, int init_volume, Grid grid, float tol
+    SimOut* sim_out, int init_volume, const Grid& grid, float tol,
+    Workspace* workspace
 ) {
-    // Copying body_soil location
-    auto old_body_soil = sim_out->body_soil_;
-
-    // Iterating over all XY positions where body_soil is present
-    for (auto nn = 0; nn < sim_out->body_soil_pos_.size(); nn++) {
-        int ind = sim_out->body_soil_pos_[nn].ind;
-        int ii = sim_out->body_soil_pos_[nn].ii;
-        int jj = sim_out->body_soil_pos_[nn].jj;
-        float h_soil = sim_out->body_soil_pos_[nn].h_soil;
-
-        // Removing soil from old_body_soil
-        old_body_soil[ind+1][ii][jj] -= h_soil;
-    }
+    // Using a temporary workspace if none is provided
+    Workspace local_workspace;
+    if (workspace == nullptr)
+        workspace = &local_workspace;
+
+    // Sorting a copy of body_soil_pos_ by body soil layer, so that the soil
+    // of each layer can be summed without copying body_soil_
+    auto& sorted_pos = workspace->body_soil_pos_;
+    sorted_pos = sim_out->body_soil_pos_;
+    auto pos_key = [](const body_soil& pos) {
+        return std::make_tuple(pos.ii, pos.jj, pos.ind); };
+    std::sort(sorted_pos.begin(), sorted_pos.end(),
+        [&](const body_soil& a, const body_soil& b) {
+            return pos_key(a) < pos_key(b); });
 
     // Checking that volume of soil in body_soil_pos_ corresponds to soil
-    // in body_soil
-    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++) {
+    // in body_soil for the layers listed in body_soil_pos_
+    float body_soil_cell[4];
+    bool consistent = true;
+    for (auto nn = 0; nn < sorted_pos.size();) {
+        int ind = sorted_pos[nn].ind;
+        int ii = sorted_pos[nn].ii;
+        int jj = sorted_pos[nn].jj;
+
+        // Summing the soil of the layer
+        float h_soil = 0.0;
+        for (; nn < sorted_pos.size(); nn++) {
+            if (pos_key(sorted_pos[nn]) != std::make_tuple(ii, jj, ind))
+                break;
+            h_soil += sorted_pos[nn].h_soil;
+        }
+
+        sim_out->body_soil_.LoadCell(ii, jj, body_soil_cell);
+        float dh = body_soil_cell[ind+1] - body_soil_cell[ind] - h_soil;
+        if (std::abs(dh) > tol)
+            consistent = false;
+    }
+
+    // Checking that no soil is present in the layers that are not listed in
+    // body_soil_pos_
+    auto is_listed = [&](int ii, int jj, int ind) {
+        return std::binary_search(
+            sorted_pos.begin(), sorted_pos.end(), body_soil{ind, ii, jj},
+            [&](const body_soil& a, const body_soil& b) {
+                return pos_key(a) < pos_key(b); });
+    };
+    for (auto ii = 0; consistent && (ii < sim_out->terrain_.size()); ii++)
         for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
-            float dh_1 = std::abs(
-                old_body_soil[0][ii][jj] - old_body_soil[1][ii][jj]);
-            float dh_2 = std::abs(
-                old_body_soil[2][ii][jj] - old_body_soil[3][ii][jj]);
-            if ((dh_1 > tol) || (dh_2 > tol)) {
-                // Soil in body_soil_pos_ does not correspond to amount of soil
-                // in body_soil
-                LOG(WARNING) << "WARNING\nVolume of soil in body_soil_pos_ " <<
-                    "is not consistent with the amount of soil in body_soil.\n";
-                return false;
-            }
+            sim_out->body_soil_.LoadCell(ii, jj, body_soil_cell);
+            for (auto ind = 0; ind < 4; ind += 2)
+                if (
+                    (std::abs(body_soil_cell[ind+1] - body_soil_cell[ind]) >
+                    tol) && !is_listed(ii, jj, ind))
+                    consistent = false;
         }
+
+    if (!consistent) {
+        // Soil in body_soil_pos_ does not correspond to amount of soil
+        // in body_soil
+        LOG(WARNING) << "WARNING\nVolume of soil in body_soil_pos_ " <<
+            "is not consistent with the amount of soil in body_soil.\n";
+        return false;
     }
 
     // Calculating number of soil cells in the terrain
+    // A const reference is used so that no terrain tile gets allocated
+    const auto& terrain = sim_out->terrain_;
     int terrain_volume = 0;
-    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
-        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
-            terrain_volume += round(
-                sim_out->terrain_[ii][jj] / grid.cell_size_z_);
+    for (auto ii = 0; ii < terrain.size(); ii++)
+        for (auto jj = 0; jj < terrain[0].size(); jj++)
+            terrain_volume += round(terrain[ii][jj] / grid.cell_size_z_);
 
     // Calculating number of soil cells in body soil
     int body_soil_volume = 0;
-    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
-        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
-            if (
-                (sim_out->body_soil_[0][ii][jj] != 0.0) ||
-                (sim_out->body_soil_[1][ii][jj] != 0.0)) {
+    for (auto ii = 0; ii < terrain.size(); ii++)
+        for (auto jj = 0; jj < terrain[0].size(); jj++) {
+            sim_out->body_soil_.LoadCell(ii, jj, body_soil_cell);
+            if ((body_soil_cell[0] != 0.0) || (body_soil_cell[1] != 0.0)) {
                 // Body soil is present
-                body_soil_volume += round((
-                    sim_out->body_soil_[1][ii][jj] -
-                    sim_out->body_soil_[0][ii][jj]) / grid.cell_size_z_);
+                body_soil_volume += round(
+                    (body_soil_cell[1] - body_soil_cell[0]) /
+                    grid.cell_size_z_);
             }
-            if (
-                (sim_out->body_soil_[2][ii][jj] != 0.0) ||
-                (sim_out->body_soil_[3][ii][jj] != 0.0)) {
+            if ((body_soil_cell[2] != 0.0) || (body_soil_cell[3] != 0.0)) {
                 // Body soil is present
-                body_soil_volume += round((
-                    sim_out->body_soil_[3][ii][jj] -
-                    sim_out->body_soil_[2][ii][jj]) / grid.cell_size_z_);
+                body_soil_volume += round(
+                    (body_soil_cell[3] - body_soil_cell[2]) /
+                    grid.cell_size_z_);
             }
         }
 
@@ -311,6 +440,58 @@ bool soil_simulator::CheckVolume(
     return true;
 }
 
+/// The content of the whole `terrain_` and `body_soil_` is summed, so that
+/// this function should only be called when the soil has been modified outside
+/// of the simulator, for instance after the terrain generation. The soil
+/// transfers made by the simulator then keep the ledger up to date.
+void soil_simulator::InitSoilVolume(SimOut* sim_out) {
+    // Calculating volume of soil in the terrain
+    // A const reference is used so that no terrain tile gets allocated
+    const auto& terrain = sim_out->terrain_;
+    double terrain_volume = 0.0;
+    for (auto ii = 0; ii < terrain.size(); ii++)
+        for (auto jj = 0; jj < terrain[0].size(); jj++)
+            terrain_volume += terrain[ii][jj];
+
+    // Calculating volume of soil in body soil
+    double body_soil_volume = 0.0;
+    float body_soil_cell[4];
+    for (auto ii = 0; ii < terrain.size(); ii++)
+        for (auto jj = 0; jj < terrain[0].size(); jj++) {
+            sim_out->body_soil_.LoadCell(ii, jj, body_soil_cell);
+            body_soil_volume += (
+                (body_soil_cell[1] - body_soil_cell[0]) +
+                (body_soil_cell[3] - body_soil_cell[2]));
+        }
+
+    // Setting the soil volume ledger
+    sim_out->terrain_volume_ = terrain_volume;
+    sim_out->body_soil_volume_ = body_soil_volume;
+    sim_out->lost_volume_ = 0.0;
+}
+
+/// Unlike `CheckVolume`, this function does not iterate over the grid, so that
+/// it can be called at every step. It relies on the soil volume ledger that is
+/// updated by every soil transfer, and therefore does not check the
+/// consistency between `body_soil_pos_` and `body_soil_`.
+bool soil_simulator::CheckVolumeLedger(
+    SimOut* sim_out, int init_volume, const Grid& grid
+) {
+    // Calculating total number of soil cells
+    int total_volume = static_cast<int>(round(
+        (sim_out->terrain_volume_ + sim_out->body_soil_volume_) /
+        grid.cell_size_z_));
+
+    if (total_volume != init_volume) {
+        LOG(WARNING) << "WARNING\nVolume is not conserved!\nInitial number of "
+            "soil cell: " << init_volume << " Current number: " <<
+            total_volume << "\nVolume of soil removed: " <<
+            sim_out->lost_volume_ << " m";
+        return false;
+    }
+    return true;
+}
+
 /// The conventions that are checked by this function include:
 /// - The terrain should not overlap with the body.
 /// - The body should be properly defined, with its maximum height higher than
@@ -490,7 +671,7 @@ bool soil_simulator::CheckSoil(
 /// `terrain_` and `body_soil_` are saved into files named `terrain` and
 /// `body_soil`, respectively, followed by the file number.
 void soil_simulator::WriteSoil(
-    SimOut* sim_out, Grid grid
+    SimOut* sim_out, const Grid& grid
 ) {
     // Finding next filename for the terrain file
     std::source_location location = std::source_location::current();
@@ -542,23 +723,19 @@ void soil_simulator::WriteSoil(
         body_soil_file << grid.vect_x_[0] << "," << grid.vect_y_[0] << ","
                 << grid.vect_z_[0] << "\n";
     } else {
+        float body_soil_cell[4];
         for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
             for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
-                if (
-                    (sim_out->body_soil_[0][ii][jj] != 0.0) ||
-                    (sim_out->body_soil_[1][ii][jj] != 0.0)) {
+                sim_out->body_soil_.LoadCell(ii, jj, body_soil_cell);
+                if ((body_soil_cell[0] != 0.0) || (body_soil_cell[1] != 0.0)) {
                     // Body soil is present
                     body_soil_file << grid.vect_x_[ii] << "," <<
-                        grid.vect_y_[jj] << "," <<
-                        sim_out->body_soil_[1][ii][jj] << "\n";
+                        grid.vect_y_[jj] << "," << body_soil_cell[1] << "\n";
                 }
-                if (
-                    (sim_out->body_soil_[2][ii][jj] != 0.0) ||
-                    (sim_out->body_soil_[3][ii][jj] != 0.0)) {
+                if ((body_soil_cell[2] != 0.0) || (body_soil_cell[3] != 0.0)) {
                     // Body soil is present
                     body_soil_file << grid.vect_x_[ii] << "," <<
-                        grid.vect_y_[jj] << "," <<
-                        sim_out->body_soil_[3][ii][jj] << "\n";
+                        grid.vect_y_[jj] << "," << body_soil_cell[3] << "\n";
                 }
             }
     }
@@ -697,11 +874,59 @@ void soil_simulator::WriteBody(
     blade_file.close();
 }
 
+/// The triangles of the mesh are saved into a file named `mesh` followed by
+/// the file number. The three vertices of each triangle are written one after
+/// the other.
+void soil_simulator::WriteBody(
+    MeshBody* mesh
+) {
+    // Finding next filename for the mesh file
+    std::source_location location = std::source_location::current();
+    std::string filename = location.file_name();
+    std::string path = filename.substr(
+        0, filename.find_last_of("/")) + "/../results/";
+    std::string mesh_filename;
+
+    // Iterating until finding a filename that does not exist
+    for (auto ii = 0; ii < 100000; ii++) {
+        std::string file_number = std::to_string(ii);
+        size_t n = 5;  // Number of digit
+        int nn = n - std::min(n, file_number.size());  // Number of leading 0
+
+        // Setting next filename
+        mesh_filename = (
+            path + "mesh_" + std::string(nn, '0').append(file_number)
+            + ".csv");
+
+        // Checking if file exists
+        std::ifstream infile(mesh_filename);
+        if (!infile.good()) {
+            // File does not exist
+            break;
+        }
+    }
+
+    auto pos = Vec3::FromVector(mesh->pos_);
+    auto ori = Quat::FromVector(mesh->ori_);
+    std::ofstream mesh_file;
+    mesh_file.open(mesh_filename);
+    mesh_file << "x,y,z\n";
+    for (auto nn = 0; nn < mesh->triangles_.size(); nn++)
+        for (auto kk = 0; kk < 3; kk++) {
+            // Calculating position of the triangle vertex
+            auto vertex = soil_simulator::CalcRotationQuaternion(
+                ori, mesh->vertices_[mesh->triangles_[nn][kk]]);
+            mesh_file << vertex[0] + pos[0] << "," << vertex[1] + pos[1] << ","
+                <<  vertex[2] + pos[2] << "\n";
+        }
+    mesh_file.close();
+}
+
 /// This function implements 2D Simplex noise. A lot of material can be found
 /// online concerning this implementation so that the details would not be
 /// explicited here.
 float soil_simulator::simplex_noise(
-    float x, float y, std::vector<int> perm_table
+    float x, float y, const std::vector<int>& perm_table
 ) {
     float grad_0, grad_1, grad_2;
 
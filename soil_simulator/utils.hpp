@@ -5,6 +5,7 @@ Copyright, 2023, Vilella Kenny.
 */
 #pragma once
 
+#include <concepts>
 #include <tuple>
 #include <vector>
 #include "soil_simulator/types.hpp"
@@ -23,11 +24,22 @@ namespace soil_simulator {
 ///         left side of the body joint, right side of the body base, left
 ///         side of the body base, right side of the body teeth, left side
 ///         of the body teeth. [m]
+///
+/// Note:
+/// - The geometry functions of this file take `Vec3` and `Quat` through
+///   constrained template parameters. Braced lists cannot be deduced, so that
+///   calls such as `AngleToQuat({a, b, c})` select the `std::vector`
+///   overload without ambiguity.
+template <std::same_as<Vec3> V, std::same_as<Quat> Q>
+std::tuple<Vec3, Vec3, Vec3, Vec3, Vec3, Vec3> CalcBodyCornerPos(
+    const V& pos, const Q& ori, Body* body);
+
+/// \brief Overload of `CalcBodyCornerPos` taking and returning `std::vector`.
 std::tuple<
     std::vector<float>, std::vector<float>, std::vector<float>,
     std::vector<float>, std::vector<float>, std::vector<float>>
 CalcBodyCornerPos(
-    std::vector<float> pos, std::vector<float> ori, Body* body);
+    const std::vector<float>& pos, const std::vector<float>& ori, Body* body);
 
 /// \brief This function calculates how far the body has travelled since the
 ///        last soil update and checks whether it is necessary to update the
@@ -40,7 +52,8 @@ CalcBodyCornerPos(
 ///
 /// \return A boolean indicating whether the soil should be updated.
 bool CheckBodyMovement(
-    std::vector<float> pos, std::vector<float> ori, Grid grid, Body* body);
+    const std::vector<float>& pos, const std::vector<float>& ori,
+    const Grid& grid, Body* body);
 
 /// \brief This function calculates the unit normal vector of a plane formed by
 ///        three points using the right-hand rule.
@@ -50,8 +63,13 @@ bool CheckBodyMovement(
 /// \param c: Cartesian coordinates of the third point of the plane. [m]
 ///
 /// \return Unit normal vector of the provided plane. [m]
+template <std::same_as<Vec3> V>
+Vec3 CalcNormal(const V& a, const V& b, const V& c);
+
+/// \brief Overload of `CalcNormal` taking and returning `std::vector`.
 std::vector<float> CalcNormal(
-    std::vector<float> a, std::vector<float> b, std::vector<float> c);
+    const std::vector<float>& a, const std::vector<float>& b,
+    const std::vector<float>& c);
 
 /// \brief This function calculates the position of a considered cell in the
 ///        body frame assuming that the body is in its reference position.
@@ -64,8 +82,19 @@ std::vector<float> CalcNormal(
 ///
 /// \return Cartesian coordinates of the considered position in the reference
 ///         body frame.
-std::vector<float> CalcBodyFramePos(
-    int ii, int jj, float z, Grid grid, Body* body);
+Vec3 CalcBodyFramePos(
+    int ii, int jj, float z, const Grid& grid, Body* body);
+
+/// \brief This function determines the body to which a body wall of `body_`
+///        belongs when several bodies are simulated.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param ii: Index of the considered cell in the X direction.
+/// \param jj: Index of the considered cell in the Y direction.
+/// \param ind: Index of the considered body layer.
+///
+/// \return Index in `bodies_` of the body to which the body wall belongs.
+int FindBody(const SimOut* sim_out, int ii, int jj, int ind);
 
 /// \brief This function applies a rotation `ori` to the Cartesian
 ///        coordinates `pos`.
@@ -78,8 +107,13 @@ std::vector<float> CalcBodyFramePos(
 ///
 /// \return Rotated Cartesian coordinates of the input `pos` relative to the
 ///         body origin. [m]
+template <std::same_as<Quat> Q, std::same_as<Vec3> V>
+Vec3 CalcRotationQuaternion(const Q& ori, const V& pos);
+
+/// \brief Overload of `CalcRotationQuaternion` taking and returning
+///        `std::vector`.
 std::vector<float> CalcRotationQuaternion(
-    std::vector<float> ori, std::vector<float> pos);
+    const std::vector<float>& ori, const std::vector<float>& pos);
 
 /// \brief This function converts Euler angles following the ZYX convention to
 ///        a quaternion.
@@ -87,7 +121,11 @@ std::vector<float> CalcRotationQuaternion(
 /// \param ori: Orientation of the body. [Euler angles, ZYX sequence]
 ///
 /// \return Orientation of the body. [Quaternion]
-std::vector<float> AngleToQuat(std::vector<float> ori);
+template <std::same_as<Vec3> V>
+Quat AngleToQuat(const V& ori);
+
+/// \brief Overload of `AngleToQuat` taking and returning `std::vector`.
+std::vector<float> AngleToQuat(const std::vector<float>& ori);
 
 /// \brief This function calculates the product of two quaternions.
 ///
@@ -95,8 +133,12 @@ std::vector<float> AngleToQuat(std::vector<float> ori);
 /// \param q2: Second quaternion. [Quaternion]
 ///
 /// \return Product of the two inputs quaternions. [Quaternion]
+template <std::same_as<Quat> Q>
+Quat MultiplyQuaternion(const Q& q1, const Q& q2);
+
+/// \brief Overload of `MultiplyQuaternion` taking and returning `std::vector`.
 std::vector<float> MultiplyQuaternion(
-    std::vector<float> q1, std::vector<float> q2);
+    const std::vector<float>& q1, const std::vector<float>& q2);
 
 /// \brief This function checks that the volume of soil is conserved and that
 ///        the content of `body_soil_pos_` and `body_soil_` is consistent.
@@ -105,9 +147,28 @@ std::vector<float> MultiplyQuaternion(
 /// \param init_volume: Initial number of soil cells.
 /// \param grid: Class that stores information related to the simulation grid.
 /// \param tol: Small number used to handle numerical approximation errors.
+/// \param workspace: Reusable buffers for temporary storage.
 ///
 /// \return Boolean indicating whether soil is conserved or not.
-bool CheckVolume(SimOut* sim_out, int init_volume, Grid grid, float tol);
+bool CheckVolume(
+    SimOut* sim_out, int init_volume, const Grid& grid, float tol,
+    Workspace* workspace = nullptr);
+
+/// \brief This function initializes the soil volume ledger of `sim_out` from
+///        the current content of `terrain_` and `body_soil_`.
+///
+/// \param sim_out: Class that stores simulation outputs.
+void InitSoilVolume(SimOut* sim_out);
+
+/// \brief This function checks that the volume of soil is conserved using the
+///        soil volume ledger.
+///
+/// \param sim_out: Class that stores simulation outputs.
+/// \param init_volume: Initial number of soil cells.
+/// \param grid: Class that stores information related to the simulation grid.
+///
+/// \return Boolean indicating whether soil is conserved or not.
+bool CheckVolumeLedger(SimOut* sim_out, int init_volume, const Grid& grid);
 
 /// \brief This function checks that all the simulation outputs follow the
 ///        conventions of the simulator.
@@ -123,7 +184,7 @@ bool CheckSoil(SimOut* sim_out, float tol);
 ///
 /// \param sim_out: Class that stores simulation outputs.
 /// \param grid: Class that stores information related to the simulation grid.
-void WriteSoil(SimOut* sim_out, Grid grid);
+void WriteSoil(SimOut* sim_out, const Grid& grid);
 
 /// \brief This function writes the position of all bucket faces into a csv
 ///        located in the `results` directory.
@@ -137,6 +198,12 @@ void WriteBody(Bucket* bucket);
 /// \param blade: Class that stores information related to the blade object.
 void WriteBody(Blade* blade);
 
+/// \brief This function writes the position of all mesh triangles into a csv
+///        located in the `results` directory.
+///
+/// \param mesh: Class that stores information related to the mesh body object.
+void WriteBody(MeshBody* mesh);
+
 /// \brief This function creates simplex noise for more realistic terrain
 ///        generation.
 ///
@@ -146,6 +213,6 @@ void WriteBody(Blade* blade);
 ///                    pseudo-random noise.
 ///
 /// \return A float representing the Simplex noise.
-float simplex_noise(float x, float y, std::vector<int> perm_table);
+float simplex_noise(float x, float y, const std::vector<int>& perm_table);
 
 }  // namespace soil_simulator
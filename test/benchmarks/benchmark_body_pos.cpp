@@ -4,6 +4,9 @@ This file implements benchmarking for the functions in body_pos.cpp.
 Copyright, 2023, Vilella Kenny.
 */
 #include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 #include "soil_simulator/body_pos.hpp"
 
 // -- CalcBodyPos --
@@ -34,6 +37,73 @@ static void BM_CalcBodyPos(benchmark::State& state) {
 }
 BENCHMARK(BM_CalcBodyPos)->Unit(benchmark::kMicrosecond);
 
+// -- CalcBodyPos for a MeshBody --
+// The argument gives the number of divisions of each edge of a box, so that
+// the mesh is composed of 12 * arg * arg triangles
+static void BM_CalcBodyPosMesh(benchmark::State& state) {
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    soil_simulator::SimParam sim_param(0.85, 3, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    int n_div = state.range(0);
+    float size[3] = {0.7, 0.5, 0.5};
+
+    // Tessellating the six faces of the box
+    std::vector<std::vector<float>> vertices;
+    std::vector<std::vector<int>> triangles;
+    for (auto axis = 0; axis < 3; axis++)
+        for (auto side = 0; side < 2; side++) {
+            int ind = vertices.size();
+            int axis_1 = (axis + 1) % 3;
+            int axis_2 = (axis + 2) % 3;
+            for (auto ii = 0; ii < n_div + 1; ii++)
+                for (auto jj = 0; jj < n_div + 1; jj++) {
+                    std::vector<float> vertex(3);
+                    vertex[axis] = side * size[axis];
+                    vertex[axis_1] = size[axis_1] * ii / n_div;
+                    vertex[axis_2] = size[axis_2] * jj / n_div;
+                    vertices.push_back(vertex);
+                }
+            for (auto ii = 0; ii < n_div; ii++)
+                for (auto jj = 0; jj < n_div; jj++) {
+                    int a = ind + ii * (n_div + 1) + jj;
+                    int b = a + n_div + 1;
+                    triangles.push_back({a, b, b + 1});
+                    triangles.push_back({a, b + 1, a + 1});
+                }
+        }
+
+    // Merging the duplicated vertices at the edges of the faces
+    std::vector<std::vector<float>> unique_vertices;
+    for (auto& triangle : triangles)
+        for (auto& ind : triangle) {
+            auto it = std::find(
+                unique_vertices.begin(), unique_vertices.end(),
+                vertices[ind]);
+            if (it == unique_vertices.end()) {
+                unique_vertices.push_back(vertices[ind]);
+                it = unique_vertices.end() - 1;
+            }
+            ind = it - unique_vertices.begin();
+        }
+    std::vector<float> o_pos = {0.0, 0.25, 0.5};
+    soil_simulator::MeshBody *mesh = new soil_simulator::MeshBody(
+        o_pos, unique_vertices, triangles);
+    std::vector<float> ori = {0.707107, 0.0, -0.707107, 0.0};
+    std::vector<float> pos = {0.0, 0.0, -0.1};
+
+    for (auto _ : state)
+        soil_simulator::CalcBodyPos(
+            sim_out, pos, ori, grid, mesh, sim_param, 1.e-5, &workspace);
+    state.counters["triangles"] = triangles.size();
+
+    delete sim_out;
+    delete mesh;
+}
+BENCHMARK(BM_CalcBodyPosMesh)->Arg(1)->Arg(4)->Arg(8)->Unit(
+    benchmark::kMicrosecond);
+
 // -- CalcRectanglePos --
 static void BM_CalcRectanglePos(benchmark::State& state) {
     // Defining inputs
@@ -61,6 +131,53 @@ static void BM_DecomposeVectorRectangle(benchmark::State& state) {
 }
 BENCHMARK(BM_DecomposeVectorRectangle)->Unit(benchmark::kMicrosecond);
 
+// -- RasterizeRectangle --
+static void BM_RasterizeRectangleArea(benchmark::State& state) {
+    // Defining inputs
+    // The rectangle is 0.7 m long and its width is given in cm by the first
+    // argument, for a cell size of 0.05 m
+    float width_ind = state.range(0) / 5.0;
+    soil_simulator::Vec3 a_ind = {20.3, 20.6, 80.0};
+    soil_simulator::Vec3 ab_ind = {13.8, 2.4, -5.0};
+    soil_simulator::Vec3 ad_ind = {-0.17f * width_ind, width_ind, 3.0};
+    int area_min_x = static_cast<int>(std::floor(a_ind[0] + ad_ind[0]));
+    int area_min_y = static_cast<int>(std::floor(a_ind[1]));
+    int area_length_x = static_cast<int>(std::ceil(
+        a_ind[0] + ab_ind[0])) - area_min_x;
+    int area_length_y = static_cast<int>(std::ceil(
+        a_ind[1] + ab_ind[1] + ad_ind[1])) - area_min_y;
+    soil_simulator::Workspace workspace;
+
+    for (auto _ : state) {
+        int sum_kk = 0;
+        if (state.range(1) == 0) {
+            // Decomposing the cells and calculating the height in two passes
+            soil_simulator::DecomposeVectorRectangle(
+                ab_ind, ad_ind, a_ind, area_min_x, area_min_y, area_length_x,
+                area_length_y, 1.e-5, &workspace);
+            const auto& c_ab = workspace.c_ab_;
+            const auto& c_ad = workspace.c_ac_;
+            for (auto nn = 0; nn < area_length_x * area_length_y; nn++)
+                if (workspace.in_area_[nn])
+                    sum_kk += static_cast<int>(std::ceil(
+                        a_ind[2] + c_ab[nn] * ab_ind[2] +
+                        c_ad[nn] * ad_ind[2]));
+        } else {
+            // Calculating the height in the same pass
+            soil_simulator::RasterizeRectangle(
+                ab_ind, ad_ind, a_ind, area_min_x, area_min_y, area_length_x,
+                area_length_y, 1.e-5, &workspace);
+            for (auto nn = 0; nn < area_length_x * area_length_y; nn++)
+                if (workspace.in_area_[nn])
+                    sum_kk += workspace.area_height_[nn];
+        }
+        benchmark::DoNotOptimize(sum_kk);
+    }
+    state.counters["cells"] = area_length_x * area_length_y;
+}
+BENCHMARK(BM_RasterizeRectangleArea)->ArgsProduct({
+    {50, 100, 250, 500}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
 // -- CalcTrianglePos --
 static void BM_CalcTrianglePos(benchmark::State& state) {
     // Defining inputs
@@ -87,6 +204,53 @@ static void BM_DecomposeVectorTriangle(benchmark::State& state) {
 }
 BENCHMARK(BM_DecomposeVectorTriangle)->Unit(benchmark::kMicrosecond);
 
+// -- RasterizeTriangle --
+static void BM_RasterizeTriangleArea(benchmark::State& state) {
+    // Defining inputs
+    // The triangle is 0.7 m long and its width is given in cm by the first
+    // argument, for a cell size of 0.05 m
+    float width_ind = state.range(0) / 5.0;
+    soil_simulator::Vec3 a_ind = {20.3, 20.6, 80.0};
+    soil_simulator::Vec3 ab_ind = {13.8, 2.4, -5.0};
+    soil_simulator::Vec3 ac_ind = {-0.17f * width_ind, width_ind, 3.0};
+    int area_min_x = static_cast<int>(std::floor(a_ind[0] + ac_ind[0]));
+    int area_min_y = static_cast<int>(std::floor(a_ind[1]));
+    int area_length_x = static_cast<int>(std::ceil(
+        a_ind[0] + ab_ind[0])) - area_min_x;
+    int area_length_y = static_cast<int>(std::ceil(
+        a_ind[1] + ab_ind[1] + ac_ind[1])) - area_min_y;
+    soil_simulator::Workspace workspace;
+
+    for (auto _ : state) {
+        int sum_kk = 0;
+        if (state.range(1) == 0) {
+            // Decomposing the cells and calculating the height in two passes
+            soil_simulator::DecomposeVectorTriangle(
+                ab_ind, ac_ind, a_ind, area_min_x, area_min_y, area_length_x,
+                area_length_y, 1.e-5, &workspace);
+            const auto& c_ab = workspace.c_ab_;
+            const auto& c_ac = workspace.c_ac_;
+            for (auto nn = 0; nn < area_length_x * area_length_y; nn++)
+                if (workspace.in_area_[nn])
+                    sum_kk += static_cast<int>(std::ceil(
+                        a_ind[2] + c_ab[nn] * ab_ind[2] +
+                        c_ac[nn] * ac_ind[2]));
+        } else {
+            // Calculating the height in the same pass
+            soil_simulator::RasterizeTriangle(
+                ab_ind, ac_ind, a_ind, area_min_x, area_min_y, area_length_x,
+                area_length_y, 1.e-5, &workspace);
+            for (auto nn = 0; nn < area_length_x * area_length_y; nn++)
+                if (workspace.in_area_[nn])
+                    sum_kk += workspace.area_height_[nn];
+        }
+        benchmark::DoNotOptimize(sum_kk);
+    }
+    state.counters["cells"] = area_length_x * area_length_y;
+}
+BENCHMARK(BM_RasterizeTriangleArea)->ArgsProduct({
+    {50, 100, 250, 500}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
 // -- CalcLinePos --
 static void BM_CalcLinePos(benchmark::State& state) {
     // Defining inputs
@@ -116,6 +280,46 @@ static void BM_UpdateBody(benchmark::State& state) {
 }
 BENCHMARK(BM_UpdateBody)->Unit(benchmark::kMicrosecond);
 
+// -- Rasterization of a body surface --
+static void BM_RasterizeTriangle(benchmark::State& state) {
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    soil_simulator::Vec3 a = {0.0, 0.0, -0.3};
+    soil_simulator::Vec3 b = {1.0, 0.0, 0.0};
+    soil_simulator::Vec3 c = {1.0, 0.5, 0.2};
+    sim_out->body_area_[0][0] = 75;
+    sim_out->body_area_[0][1] = 105;
+    sim_out->body_area_[1][0] = 75;
+    sim_out->body_area_[1][1] = 95;
+    soil_simulator::ResetSurfaceColumns(
+        sim_out->body_area_, grid, &workspace.surface_columns_);
+    soil_simulator::CellList<3> tri_pos;
+
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            // Listing the cells and sorting them
+            tri_pos.clear();
+            soil_simulator::CalcTrianglePos(
+                a, b, c, grid, 1.e-5, &tri_pos, &workspace);
+            std::sort(tri_pos.begin(), tri_pos.end());
+            soil_simulator::UpdateBody(tri_pos, sim_out, grid, 1.e-5);
+        } else {
+            // Writing the cells directly into their column
+            auto& columns = workspace.surface_columns_;
+            soil_simulator::CalcTrianglePos(
+                a, b, c, grid, 1.e-5, &columns, &workspace);
+            soil_simulator::UpdateBody(columns, sim_out, grid, 1.e-5);
+            columns.Clear();
+        }
+    }
+
+    delete sim_out;
+}
+BENCHMARK(BM_RasterizeTriangle)->Arg(0)->Arg(1)->Unit(
+    benchmark::kMicrosecond);
+
 // -- IncludeNewBodyPos --
 static void BM_IncludeNewBodyPos(benchmark::State& state) {
     // Defining inputs
@@ -4,6 +4,7 @@ This file implements benchmarking for the functions in relax.cpp.
 Copyright, 2023, Vilella Kenny.
 */
 #include <benchmark/benchmark.h>
+#include <cmath>
 #include <random>
 #include "soil_simulator/relax.hpp"
 #include "soil_simulator/utils.hpp"
@@ -46,6 +47,153 @@ static void BM_RelaxTerrain(benchmark::State& state) {
 }
 BENCHMARK(BM_RelaxTerrain)->Unit(benchmark::kMicrosecond);
 
+// -- RelaxTerrainParallel --
+static void BM_RelaxTerrainParallel(benchmark::State& state) {
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(0.85, 3, 4, state.range(0));
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    sim_out->impact_area_[0][0] = 2;
+    sim_out->impact_area_[1][0] = 2;
+    sim_out->impact_area_[0][1] = 2 * grid.half_length_x_;
+    sim_out->impact_area_[1][1] = 2 * grid.half_length_y_;
+
+    for (auto _ : state) {
+        // Setting a rough terrain over the whole grid
+        state.PauseTiming();
+        for (auto ii = 2; ii < 2 * grid.half_length_x_; ii++)
+            for (auto jj = 2; jj < 2 * grid.half_length_y_; jj++)
+                sim_out->terrain_[ii][jj] = 0.1 * ((7 * ii + 13 * jj) % 6);
+        state.ResumeTiming();
+
+        soil_simulator::RelaxTerrain(
+            sim_out, grid, bucket, sim_param, 1.e-5, &workspace);
+    }
+
+    delete bucket;
+    delete sim_out;
+}
+BENCHMARK(BM_RelaxTerrainParallel)->Arg(1)->Arg(2)->Arg(4)->Unit(
+    benchmark::kMicrosecond);
+
+// -- RelaxTerrainMultigrid --
+static void BM_RelaxTerrainMultigrid(benchmark::State& state) {
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(
+        0.85, 3, 4, 1, soil_simulator::RelaxMode::kSequential, state.range(1));
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    int radius = state.range(0);
+    int area[2][2] = {
+        {2, 2 * grid.half_length_x_}, {2, 2 * grid.half_length_y_}};
+
+    int n_sweep = 0;
+    for (auto _ : state) {
+        // Setting a conical pile of soil at the center of the grid
+        state.PauseTiming();
+        for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
+                float rr = std::sqrt(
+                    (ii - grid.half_length_x_) * (ii - grid.half_length_x_) +
+                    (jj - grid.half_length_y_) * (jj - grid.half_length_y_));
+                sim_out->terrain_[ii][jj] = (rr < radius) ?
+                    0.01 * std::round(10.0 * (radius - rr)) : 0.0;
+            }
+        for (auto ii = 0; ii < 2; ii++)
+            for (auto jj = 0; jj < 2; jj++)
+                sim_out->impact_area_[ii][jj] = area[ii][jj];
+        sim_out->equilibrium_ = false;
+        state.ResumeTiming();
+
+        // Relaxing the pile until equilibrium
+        if (sim_param.multigrid_levels_ > 0)
+            soil_simulator::RelaxTerrainMultigrid(
+                sim_out, area, grid, sim_param, &workspace);
+        n_sweep = 0;
+        while ((!sim_out->equilibrium_) && (n_sweep < 1000)) {
+            soil_simulator::RelaxTerrain(
+                sim_out, grid, bucket, sim_param, 1.e-5, &workspace);
+            n_sweep++;
+        }
+    }
+
+    // Reporting the number of relaxations required to reach equilibrium
+    state.counters["sweeps"] = n_sweep;
+
+    delete bucket;
+    delete sim_out;
+}
+BENCHMARK(BM_RelaxTerrainMultigrid)->ArgsProduct(
+    {{8, 16, 32}, {0, 3, 5}})->Unit(benchmark::kMillisecond);
+
+// -- SettleTerrain --
+static void BM_SettleTerrain(benchmark::State& state) {
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(0.85, 3, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    int radius = state.range(0);
+    int area[2][2] = {
+        {2, 2 * grid.half_length_x_}, {2, 2 * grid.half_length_y_}};
+
+    int n_sweep = 0;
+    for (auto _ : state) {
+        // Setting a conical pile of soil at the center of the grid
+        state.PauseTiming();
+        for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
+                float rr = std::sqrt(
+                    (ii - grid.half_length_x_) * (ii - grid.half_length_x_) +
+                    (jj - grid.half_length_y_) * (jj - grid.half_length_y_));
+                sim_out->terrain_[ii][jj] = (rr < radius) ?
+                    0.01 * std::round(10.0 * (radius - rr)) : 0.0;
+            }
+        for (auto ii = 0; ii < 2; ii++)
+            for (auto jj = 0; jj < 2; jj++)
+                sim_out->impact_area_[ii][jj] = area[ii][jj];
+        sim_out->equilibrium_ = false;
+        state.ResumeTiming();
+
+        // Settling the pile and relaxing the remaining unstable cells
+        soil_simulator::SettleTerrain(
+            sim_out, area, grid, sim_param, &workspace);
+        n_sweep = 0;
+        while ((!sim_out->equilibrium_) && (n_sweep < 1000)) {
+            soil_simulator::RelaxTerrain(
+                sim_out, grid, bucket, sim_param, 1.e-5, &workspace);
+            n_sweep++;
+        }
+    }
+
+    // Reporting the number of relaxations required to reach equilibrium
+    state.counters["sweeps"] = n_sweep;
+
+    delete bucket;
+    delete sim_out;
+}
+BENCHMARK(BM_SettleTerrain)->Arg(8)->Arg(16)->Unit(benchmark::kMillisecond);
+
 // -- RelaxBodySoil --
 static void BM_RelaxBodySoil(benchmark::State& state) {
     // Defining inputs
@@ -117,6 +265,70 @@ static void BM_LocateUnstableTerrainCell(benchmark::State& state) {
 }
 BENCHMARK(BM_LocateUnstableTerrainCell)->Unit(benchmark::kMicrosecond);
 
+static void BM_LocateUnstableTerrainCellRegions(benchmark::State& state) {
+    // Defining inputs
+    // A dump pile and a digging face located 3 m apart, covered either by
+    // their bounding box or by two disjoint regions
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    int pile_area[2][2] = {{10, 30}, {10, 30}};
+    int face_area[2][2] = {{70, 90}, {130, 150}};
+    for (auto ii = 15; ii < 25; ii++)
+        for (auto jj = 15; jj < 25; jj++)
+            sim_out->terrain_[ii][jj] = 0.4;
+    for (auto ii = 75; ii < 85; ii++)
+        for (auto jj = 135; jj < 145; jj++)
+            sim_out->terrain_[ii][jj] = -0.4;
+    sim_out->impact_area_[0][0] = 10;
+    sim_out->impact_area_[1][0] = 10;
+    sim_out->impact_area_[0][1] = 90;
+    sim_out->impact_area_[1][1] = 150;
+    sim_out->impact_regions_.Clear();
+    if (state.range(0) == 0) {
+        sim_out->impact_regions_.Add(sim_out->impact_area_);
+    } else {
+        sim_out->impact_regions_.Add(pile_area);
+        sim_out->impact_regions_.Add(face_area);
+    }
+    soil_simulator::CellList<2> unstable_cells;
+
+    for (auto _ : state)
+        soil_simulator::LocateUnstableTerrainCell(
+            sim_out, 0.1, 1.e-5, &unstable_cells);
+
+    // Reporting the number of cells scanned
+    state.counters["cells"] = sim_out->impact_regions_.Count();
+
+    delete sim_out;
+}
+BENCHMARK(BM_LocateUnstableTerrainCellRegions)->Arg(0)->Arg(1)->Unit(
+    benchmark::kMicrosecond);
+
+static void BM_LocateUnstableTerrainCellArea(benchmark::State& state) {
+    // Defining inputs
+    // The area is surrounded by one cell as the stencil reads the neighbours
+    int n_cell = state.range(0);
+    soil_simulator::terrain_t terrain(n_cell + 2, n_cell + 2, 0.0);
+    for (auto ii = 0; ii < n_cell + 2; ii++)
+        for (auto jj = 0; jj < n_cell + 2; jj++)
+            terrain[ii][jj] = 0.01 * ((7 * ii + 13 * jj) % 37 == 0);
+    int area[2][2] = {{1, n_cell + 1}, {1, n_cell + 1}};
+    soil_simulator::CellList<2> unstable_cells;
+
+    for (auto _ : state) {
+        unstable_cells.clear();
+        soil_simulator::LocateUnstableTerrainCell(
+            terrain, area, 0.0, 1.e-5, &unstable_cells);
+    }
+
+    // Reporting the number of cells processed per second
+    state.counters["cells_per_second"] = benchmark::Counter(
+        static_cast<double>(n_cell) * n_cell,
+        benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_LocateUnstableTerrainCellArea)->RangeMultiplier(4)->Range(
+    64, 4096)->Unit(benchmark::kMicrosecond);
+
 // -- CheckUnstableTerrainCell --
 static void BM_CheckUnstableTerrainCell(benchmark::State& state) {
     // Defining inputs
@@ -132,6 +344,36 @@ static void BM_CheckUnstableTerrainCell(benchmark::State& state) {
 }
 BENCHMARK(BM_CheckUnstableTerrainCell);
 
+// -- CheckUnstableTerrainCell with layer-major and cell-major layouts --
+static void BM_CheckUnstableTerrainCellLayout(benchmark::State& state) {
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    auto layout = (state.range(0) == 0) ?
+        soil_simulator::ArrayLayout::kLayerMajor :
+        soil_simulator::ArrayLayout::kCellMajor;
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid, layout);
+    for (auto ii = 1; ii < 2 * grid.half_length_x_; ii++)
+        for (auto jj = 1; jj < 2 * grid.half_length_y_; jj++) {
+            sim_out->body_[0][ii][jj] = 0.0;
+            sim_out->body_[1][ii][jj] = 0.1;
+            sim_out->body_[2][ii][jj] = 0.3;
+            sim_out->body_[3][ii][jj] = 0.4;
+            sim_out->body_soil_[0][ii][jj] = 0.1;
+            sim_out->body_soil_[1][ii][jj] = 0.2;
+        }
+
+    for (auto _ : state)
+        for (auto ii = 1; ii < 2 * grid.half_length_x_; ii++)
+            for (auto jj = 1; jj < 2 * grid.half_length_y_; jj++)
+                benchmark::DoNotOptimize(
+                    soil_simulator::CheckUnstableTerrainCell(
+                        sim_out, ii, jj, 0.5, 1.e-5));
+
+    delete sim_out;
+}
+BENCHMARK(BM_CheckUnstableTerrainCellLayout)->Arg(0)->Arg(1)->Unit(
+    benchmark::kMicrosecond);
+
 // -- RelaxUnstableTerrainCell --
 static void BM_RelaxUnstableTerrainCell(benchmark::State& state) {
     // Defining inputs
@@ -0,0 +1,303 @@
+/*
+This file implements benchmarking for the functions in soil_dynamics.cpp.
+
+Copyright, 2023, Vilella Kenny.
+*/
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "soil_simulator/soil_dynamics.hpp"
+
+// Counting the number of heap allocations made by the program
+// All replaceable allocation functions are hooked, including the aligned and
+// array forms, so that no heap allocation escapes the counter
+static std::size_t n_heap_alloc = 0;
+
+static void* CountedAlloc(std::size_t size) {
+    n_heap_alloc++;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+static void* CountedAlignedAlloc(std::size_t size, std::align_val_t align) {
+    n_heap_alloc++;
+    std::size_t alignment = static_cast<std::size_t>(align);
+    std::size_t aligned_size = (
+        (size == 0 ? 1 : size) + alignment - 1) / alignment * alignment;
+    if (void* ptr = std::aligned_alloc(alignment, aligned_size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return CountedAlloc(size); }
+
+void* operator new[](std::size_t size) { return CountedAlloc(size); }
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    return CountedAlignedAlloc(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return CountedAlignedAlloc(size, align);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+// Reporting the number of heap allocations per step and flagging the
+// benchmark as failed when a step allocates after the warm up
+static void ReportAllocations(
+    benchmark::State& state, std::size_t n_alloc, std::size_t n_step
+) {
+    state.counters["allocs_per_step"] = benchmark::Counter(
+        static_cast<double>(n_alloc) / n_step);
+    if (n_alloc != 0)
+        state.SkipWithError("Heap allocation made during a steady-state step");
+}
+
+// -- Step --
+static void BM_Step(benchmark::State& state) {
+    // Writing outputs to stderr instead of logfiles
+    FLAGS_logtostderr = 1;
+
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(0.85, 3, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim;
+    sim.Init(sim_out, grid, 0.0);
+    float tol = 1.e-5;
+
+    // Setting a back and forth trajectory digging into the terrain
+    std::vector<std::vector<float>> trajectory;
+    for (auto ii = 0; ii < 20; ii++)
+        trajectory.push_back({-0.5f + 0.01f * ii, 0.0f, 0.1f - 0.005f * ii});
+    for (auto ii = 20; ii > 0; ii--)
+        trajectory.push_back({-0.5f + 0.01f * ii, 0.0f, 0.1f - 0.005f * ii});
+    std::vector<float> ori = {1.0, 0.0, 0.0, 0.0};
+
+    // Warming up so that all buffers reach their steady-state capacity
+    for (auto it = 0; it < 5; it++)
+        for (auto nn = 0; nn < trajectory.size(); nn++)
+            sim.Step(
+                sim_out, trajectory[nn], ori, grid, bucket, sim_param, tol);
+
+    std::size_t n_step = 0;
+    std::size_t n_alloc_init = n_heap_alloc;
+    for (auto _ : state) {
+        sim.Step(
+            sim_out, trajectory[n_step % trajectory.size()], ori, grid, bucket,
+            sim_param, tol);
+        n_step++;
+    }
+
+    // Checking that no heap allocation was made
+    ReportAllocations(state, n_heap_alloc - n_alloc_init, n_step);
+
+    delete bucket;
+    delete sim_out;
+}
+BENCHMARK(BM_Step)->Unit(benchmark::kMicrosecond);
+
+// -- Step with incremental body update --
+static void BM_StepIncrementalBody(benchmark::State& state) {
+    // Writing outputs to stderr instead of logfiles
+    FLAGS_logtostderr = 1;
+
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(
+        0.85, 3, 4, 1, soil_simulator::RelaxMode::kSequential, 0, false,
+        state.range(0));
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim;
+    sim.Init(sim_out, grid, 0.0);
+    float tol = 1.e-5;
+
+    // Setting a back and forth trajectory digging into the terrain
+    std::vector<std::vector<float>> trajectory;
+    for (auto ii = 0; ii < 20; ii++)
+        trajectory.push_back({-0.5f + 0.01f * ii, 0.0f, 0.1f - 0.005f * ii});
+    for (auto ii = 20; ii > 0; ii--)
+        trajectory.push_back({-0.5f + 0.01f * ii, 0.0f, 0.1f - 0.005f * ii});
+    std::vector<float> ori = {1.0, 0.0, 0.0, 0.0};
+
+    // Warming up so that all buffers reach their steady-state capacity
+    for (auto it = 0; it < 5; it++)
+        for (auto nn = 0; nn < trajectory.size(); nn++)
+            sim.Step(
+                sim_out, trajectory[nn], ori, grid, bucket, sim_param, tol);
+
+    std::size_t n_step = 0;
+    std::size_t n_alloc_init = n_heap_alloc;
+    double changed_cells = 0.0;
+    for (auto _ : state) {
+        sim.Step(
+            sim_out, trajectory[n_step % trajectory.size()], ori, grid, bucket,
+            sim_param, tol);
+        changed_cells += sim_out->body_changed_cells_.size();
+        n_step++;
+    }
+
+    // Checking that no heap allocation was made and reporting the number of
+    // changed cells per step
+    ReportAllocations(state, n_heap_alloc - n_alloc_init, n_step);
+    state.counters["changed_cells"] = changed_cells / n_step;
+
+    delete bucket;
+    delete sim_out;
+}
+BENCHMARK(BM_StepIncrementalBody)->Arg(0)->Arg(1)->Unit(
+    benchmark::kMicrosecond);
+
+// -- Step with time budget --
+static void BM_StepBudget(benchmark::State& state) {
+    // Writing outputs to stderr instead of logfiles
+    FLAGS_logtostderr = 1;
+
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(0.85, 10, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim;
+    sim.Init(sim_out, grid, 0.0);
+    float tol = 1.e-5;
+    float time_budget = 1.e-6 * state.range(0);
+
+    // Setting a back and forth trajectory digging into the terrain
+    std::vector<std::vector<float>> trajectory;
+    for (auto ii = 0; ii < 20; ii++)
+        trajectory.push_back({-0.5f + 0.01f * ii, 0.0f, 0.1f - 0.005f * ii});
+    for (auto ii = 20; ii > 0; ii--)
+        trajectory.push_back({-0.5f + 0.01f * ii, 0.0f, 0.1f - 0.005f * ii});
+    std::vector<float> ori = {1.0, 0.0, 0.0, 0.0};
+
+    std::size_t n_step = 0;
+    double max_latency = 0.0;
+    double total_debt = 0.0;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        sim.Step(
+            sim_out, trajectory[n_step % trajectory.size()], ori, grid, bucket,
+            sim_param, tol, time_budget);
+        std::chrono::duration<double, std::micro> latency =
+            std::chrono::steady_clock::now() - start;
+        max_latency = std::max(max_latency, latency.count());
+        total_debt += sim.RelaxDebt(sim_out);
+        n_step++;
+    }
+
+    // Reporting the maximum latency and the average relaxation debt
+    state.counters["max_latency_us"] = max_latency;
+    state.counters["debt"] = total_debt / n_step;
+
+    delete bucket;
+    delete sim_out;
+}
+BENCHMARK(BM_StepBudget)->Arg(0)->Arg(20000)->Arg(5000)->Unit(
+    benchmark::kMicrosecond);
+
+// -- Step with several bodies --
+static void BM_StepMultiBody(benchmark::State& state) {
+    // Writing outputs to stderr instead of logfiles
+    FLAGS_logtostderr = 1;
+
+    // Defining inputs
+    soil_simulator::Grid grid(4.0, 4.0, 3.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    int n_body = state.range(0);
+    std::vector<soil_simulator::Bucket*> buckets;
+    std::vector<soil_simulator::Body*> bodies;
+    for (auto nn = 0; nn < n_body; nn++) {
+        buckets.push_back(new soil_simulator::Bucket(
+            o_pos, j_pos, b_pos, t_pos, 0.5));
+        bodies.push_back(buckets[nn]);
+    }
+    soil_simulator::SimParam sim_param(0.85, 3, 4, state.range(1));
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim;
+    sim.Init(sim_out, grid, 0.0);
+    float tol = 1.e-5;
+
+    // Setting a back and forth trajectory digging into the terrain for each
+    // body, the bodies being side by side following the Y axis
+    std::vector<std::vector<std::vector<float>>> trajectory;
+    for (auto ii = 0; ii < 40; ii++) {
+        float step = (ii < 20) ? ii : 40 - ii;
+        trajectory.push_back({});
+        for (auto nn = 0; nn < n_body; nn++)
+            trajectory[ii].push_back({
+                -0.5f + 0.01f * step, -1.2f + 0.8f * nn,
+                0.1f - 0.005f * step});
+    }
+    std::vector<std::vector<float>> ori(n_body, {1.0, 0.0, 0.0, 0.0});
+
+    // Warming up so that all buffers reach their steady-state capacity
+    for (auto it = 0; it < 5; it++)
+        for (auto nn = 0; nn < trajectory.size(); nn++)
+            sim.Step(
+                sim_out, trajectory[nn], ori, grid, bodies, sim_param, tol);
+
+    std::size_t n_step = 0;
+    std::size_t n_alloc_init = n_heap_alloc;
+    for (auto _ : state) {
+        sim.Step(
+            sim_out, trajectory[n_step % trajectory.size()], ori, grid,
+            bodies, sim_param, tol);
+        n_step++;
+    }
+
+    // Checking that no heap allocation was made
+    ReportAllocations(state, n_heap_alloc - n_alloc_init, n_step);
+
+    for (auto nn = 0; nn < n_body; nn++)
+        delete buckets[nn];
+    delete sim_out;
+}
+BENCHMARK(BM_StepMultiBody)->Args({1, 1})->Args({2, 1})->Args({4, 1})->Args(
+    {4, 4})->Unit(benchmark::kMicrosecond);
@@ -5,6 +5,7 @@ Copyright, 2023, Vilella Kenny.
 */
 #include <glog/logging.h>
 #include <random>
+#include <string>
 #include "soil_simulator/soil_dynamics.hpp"
 #include "test/example/soil_evolution.hpp"
 
@@ -23,6 +24,11 @@ int main(int argc, char* argv[]) {
     // Writing outputs to stderr instead of logfiles
     FLAGS_logtostderr = 1;
 
+    // Selecting the algorithm used to relax the terrain
+    auto relax_mode = soil_simulator::RelaxMode::kSequential;
+    if ((argc > 1) && (std::string(argv[1]) == "--flux"))
+        relax_mode = soil_simulator::RelaxMode::kFlux;
+
     // Selecting the simulated body object
     if (true) {
         // Simulating a bucket
@@ -36,7 +42,8 @@ int main(int argc, char* argv[]) {
             o_pos_init, j_pos_init, b_pos_init, t_pos_init, bucket_width);
 
         // Launching a simulation
-        soil_simulator::SoilEvolution(body, true, false, true, true, false);
+        soil_simulator::SoilEvolution(
+            body, true, false, true, true, false, relax_mode);
         delete body;
     } else {
         // Simulating a blade
@@ -50,7 +57,8 @@ int main(int argc, char* argv[]) {
             o_pos_init, j_pos_init, b_pos_init, t_pos_init, blade_width);
 
         // Launching a simulation
-        soil_simulator::SoilEvolution(body, true, false, true, true, false);
+        soil_simulator::SoilEvolution(
+            body, true, false, true, true, false, relax_mode);
         delete body;
     }
 
@@ -32,7 +32,7 @@ Copyright, 2023, Vilella Kenny.
 template <typename T>
 void soil_simulator::SoilEvolution(
     T* body, bool set_rng, bool random_trajectory, bool logging,
-    bool check_outputs, bool write_outputs
+    bool check_outputs, bool write_outputs, RelaxMode relax_mode
 ) {
     // Initalizing the simulator
     soil_simulator::SoilDynamics sim;
@@ -41,13 +41,15 @@ void soil_simulator::SoilEvolution(
     soil_simulator::Grid grid(4.0, 4.0, 4.0, 0.05, 0.01);
 
     // Initalizing the simulation parameter
-    soil_simulator::SimParam sim_param(0.85, 3, 4);
+    soil_simulator::SimParam sim_param(0.85, 3, 4, 1, relax_mode);
 
     // Initalizing the simulation outputs class
     soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
 
-    if (set_rng)
+    if (set_rng) {
         soil_simulator::rng.seed(1234);
+        sim.Seed(1234);
+    }
 
     std::vector<std::vector<float>> pos;
     std::vector<std::vector<float>> ori;
@@ -324,7 +326,7 @@ void soil_simulator::SoilEvolution(
 
         // Checking consistency of simulation outputs
         if (check_outputs)
-            sim.Check(sim_out, init_volume, grid, 1e-5);
+            sim.Check(sim_out, init_volume, grid, 1e-5, true);
 
         // Writing simulation outputs into csv files
         if (write_outputs)
@@ -335,10 +337,10 @@ void soil_simulator::SoilEvolution(
 }
 template void soil_simulator::SoilEvolution(
     Bucket* body, bool set_rng, bool random_trajectory, bool logging,
-    bool check_outputs, bool write_outputs);
+    bool check_outputs, bool write_outputs, RelaxMode relax_mode);
 template void soil_simulator::SoilEvolution(
     Blade* body, bool set_rng, bool random_trajectory, bool logging,
-    bool check_outputs, bool write_outputs);
+    bool check_outputs, bool write_outputs, RelaxMode relax_mode);
 
 /// The parabolic trajectory is described by
 ///
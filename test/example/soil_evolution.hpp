@@ -7,6 +7,7 @@ Copyright, 2023, Vilella Kenny.
 
 #include <tuple>
 #include <vector>
+#include "soil_simulator/types.hpp"
 
 namespace soil_simulator {
 
@@ -21,10 +22,12 @@ namespace soil_simulator {
 ///                       at every step.
 /// \param write_outputs: Indicates whether the simulation outputs are written
 ///                       into files at every step.
+/// \param relax_mode: Algorithm used to relax the terrain.
 template <typename T>
 void SoilEvolution(
     T* body, bool set_rng, bool random_trajectory, bool logging,
-    bool check_outputs, bool write_outputs);
+    bool check_outputs, bool write_outputs,
+    RelaxMode relax_mode = RelaxMode::kSequential);
 
 /// \brief This function calculates a parabolic trajectory given the starting
 ///        position (`x_i`, `z_i`) and the deepest position (`x_min`, `z_min`)
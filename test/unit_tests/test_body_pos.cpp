@@ -3,6 +3,7 @@ This file implements unit tests for the functions in body_pos.cpp.
 
 Copyright, 2023, Vilella Kenny.
 */
+#include <algorithm>
 #include <cmath>
 #include "gtest/gtest.h"
 #include "soil_simulator/body_pos.hpp"
@@ -286,6 +287,63 @@ TEST(UnitTestBodyPos, DecomposeVectorRectangle) {
             EXPECT_EQ(in_rec[ii][jj], false);
 }
 
+TEST(UnitTestBodyPos, RasterizeRectangle) {
+    // Setting up the environment
+    float tol = 1.e-5;
+    soil_simulator::Workspace workspace;
+    soil_simulator::Workspace workspace_ref;
+
+    // Declaring variables
+    soil_simulator::Vec3 a_ind = {10.3, 9.6, 12.2};
+    soil_simulator::Vec3 ab_ind;
+    soil_simulator::Vec3 ad_ind;
+    int area_min_x = 5;
+    int area_min_y = 4;
+    int area_length_x = 14;
+    int area_length_y = 15;
+    int nn;
+    int nn_ref;
+
+    // Function checking that the results are identical to the ones of
+    // DecomposeVectorRectangle
+    auto CheckRasterizeRectangle = [&]() {
+        nn = soil_simulator::RasterizeRectangle(
+            ab_ind, ad_ind, a_ind, area_min_x, area_min_y, area_length_x,
+            area_length_y, tol, &workspace);
+        nn_ref = soil_simulator::DecomposeVectorRectangle(
+            ab_ind, ad_ind, a_ind, area_min_x, area_min_y, area_length_x,
+            area_length_y, tol, &workspace_ref);
+        EXPECT_EQ(nn, nn_ref);
+        for (auto ll = 0; ll < area_length_x * area_length_y; ll++) {
+            EXPECT_EQ(workspace.in_area_[ll], workspace_ref.in_area_[ll]);
+            if (workspace_ref.in_area_[ll]) {
+                int kk = static_cast<int>(std::ceil(
+                    a_ind[2] + workspace_ref.c_ab_[ll] * ab_ind[2] +
+                    workspace_ref.c_ac_[ll] * ad_ind[2]));
+                EXPECT_EQ(workspace.area_height_[ll], kk);
+            }
+        }
+    };
+
+    // Test: BP-RR-1
+    ab_ind = {5.0, 0.0, 0.0};
+    ad_ind = {0.0, 5.0, 0.0};
+    CheckRasterizeRectangle();
+    EXPECT_EQ(nn, 25 * 4);
+
+    // Test: BP-RR-2
+    ab_ind = {4.2, 3.1, -2.7};
+    ad_ind = {-3.1, 4.2, 5.3};
+    CheckRasterizeRectangle();
+    EXPECT_GT(nn, 0);
+
+    // Test: BP-RR-3
+    ab_ind = {0.0, 0.0, 0.0};
+    ad_ind = {0.0, 0.0, 0.0};
+    CheckRasterizeRectangle();
+    EXPECT_EQ(nn, 0);
+}
+
 TEST(UnitTestBodyPos, DecomposeVectorTriangle) {
     // Setting up the environment
     float tol = 1.e-5;
@@ -495,6 +553,63 @@ TEST(UnitTestBodyPos, DecomposeVectorTriangle) {
             EXPECT_EQ(in_tri[ii][jj], false);
 }
 
+TEST(UnitTestBodyPos, RasterizeTriangle) {
+    // Setting up the environment
+    float tol = 1.e-5;
+    soil_simulator::Workspace workspace;
+    soil_simulator::Workspace workspace_ref;
+
+    // Declaring variables
+    soil_simulator::Vec3 a_ind = {10.3, 9.6, 12.2};
+    soil_simulator::Vec3 ab_ind;
+    soil_simulator::Vec3 ac_ind;
+    int area_min_x = 5;
+    int area_min_y = 4;
+    int area_length_x = 14;
+    int area_length_y = 15;
+    int nn;
+    int nn_ref;
+
+    // Function checking that the results are identical to the ones of
+    // DecomposeVectorTriangle
+    auto CheckRasterizeTriangle = [&]() {
+        nn = soil_simulator::RasterizeTriangle(
+            ab_ind, ac_ind, a_ind, area_min_x, area_min_y, area_length_x,
+            area_length_y, tol, &workspace);
+        nn_ref = soil_simulator::DecomposeVectorTriangle(
+            ab_ind, ac_ind, a_ind, area_min_x, area_min_y, area_length_x,
+            area_length_y, tol, &workspace_ref);
+        EXPECT_EQ(nn, nn_ref);
+        for (auto ll = 0; ll < area_length_x * area_length_y; ll++) {
+            EXPECT_EQ(workspace.in_area_[ll], workspace_ref.in_area_[ll]);
+            if (workspace_ref.in_area_[ll]) {
+                int kk = static_cast<int>(std::ceil(
+                    a_ind[2] + workspace_ref.c_ab_[ll] * ab_ind[2] +
+                    workspace_ref.c_ac_[ll] * ac_ind[2]));
+                EXPECT_EQ(workspace.area_height_[ll], kk);
+            }
+        }
+    };
+
+    // Test: BP-RT-1
+    ab_ind = {5.0, 0.0, 0.0};
+    ac_ind = {0.0, 5.0, 0.0};
+    CheckRasterizeTriangle();
+    EXPECT_GT(nn, 0);
+
+    // Test: BP-RT-2
+    ab_ind = {6.4, -2.3, 3.9};
+    ac_ind = {1.7, 5.8, -4.1};
+    CheckRasterizeTriangle();
+    EXPECT_GT(nn, 0);
+
+    // Test: BP-RT-3
+    ab_ind = {0.0, 0.0, 0.0};
+    ac_ind = {0.0, 0.0, 0.0};
+    CheckRasterizeTriangle();
+    EXPECT_EQ(nn, 0);
+}
+
 TEST(UnitTestBodyPos, CalcRectanglePos) {
     // Setting up the environment
     soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
@@ -900,6 +1015,32 @@ TEST(UnitTestBodyPos, UpdateBody) {
     EXPECT_NEAR(sim_out->body_[2][10][10], 0.1, 1.e-5);
     EXPECT_NEAR(sim_out->body_[3][10][10], 0.4, 1.e-5);
 
+    // Test: BP-UB-5
+    soil_simulator::SimOut *sim_out_col = new soil_simulator::SimOut(grid);
+    soil_simulator::ColumnBuffer columns;
+    int area[2][2] = {{0, 11}, {0, 11}};
+    columns.Reset(area);
+    std::vector<std::vector<std::vector<int>>> walls = {
+        {{7, 13, 9}, {5, 5, 13}, {10, 10, 9}, {7, 11, 10}, {6, 6, 15},
+         {7, 12, 11}, {5, 5, 9}, {7, 11, 9}, {7, 12, 10}},
+        {{10, 10, 11}, {7, 13, 12}, {4, 4, 9}, {7, 12, 7}, {5, 5, 13},
+         {7, 11, 13}, {6, 6, 8}, {7, 12, 10}, {7, 13, 7}, {7, 11, 10}},
+        {{6, 6, 17}, {6, 6, 6}},
+        {{10, 10, 13}}};
+    for (auto& wall : walls) {
+        for (auto& cell : wall)
+            columns.push_back({cell[0], cell[1], cell[2]});
+        soil_simulator::UpdateBody(columns, sim_out_col, grid, 1e-5);
+        columns.Clear();
+    }
+    for (auto ll = 0; ll < 4; ll++)
+        for (auto ii = 0; ii < 11; ii++)
+            for (auto jj = 0; jj < 11; jj++)
+                EXPECT_NEAR(
+                    sim_out_col->body_[ll][ii][jj], sim_out->body_[ll][ii][jj],
+                    1.e-5);
+    delete sim_out_col;
+
     // Resetting bucket position
     body_pos = {
         {0, 4, 4}, {0, 5, 5}, {0, 6, 6}, {0, 7, 11}, {0, 7, 12}, {0, 7, 13},
@@ -1033,6 +1174,56 @@ TEST(UnitTestBodyPos, CalcBodyPos_bucket) {
         {0, 10, 8}, {0, 10, 9}, {0, 10, 10}, {0, 10, 11}, {0, 10, 12}};
     ResetValueAndTest(sim_out, {}, body_pos, {});
 
+    // Test: BP-CB-Bu-4
+    soil_simulator::SimParam sim_param_inc(
+        0.785, 4, 4, 1, soil_simulator::RelaxMode::kSequential, 0, false,
+        true);
+    soil_simulator::SimOut *sim_out_inc = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    o_pos = {0.0, 0.0, 0.0};
+    j_pos = {0.0, 0.0, 0.0};
+    b_pos = {0.0, 0.0, -0.3};
+    t_pos = {0.3, 0.0, -0.3};
+    *bucket = soil_simulator::Bucket(o_pos, j_pos, b_pos, t_pos, 0.3);
+    ori = {0.966, 0.0, 0.259, 0.0};
+    for (auto nn = 0; nn < 8; nn++) {
+        // Storing the previous body position
+        std::vector<std::vector<std::vector<float>>> body_prev(
+            4, std::vector<std::vector<float>>(
+                21, std::vector<float>(21, 0.0)));
+        for (auto ll = 0; ll < 4; ll++)
+            for (auto ii = 0; ii < 21; ii++)
+                for (auto jj = 0; jj < 21; jj++)
+                    body_prev[ll][ii][jj] = sim_out_inc->body_[ll][ii][jj];
+
+        pos = {-0.2f + 0.06f * nn, 0.02f * nn, 0.3f - 0.03f * nn};
+        CalcBodyPos(sim_out, pos, ori, grid, bucket, sim_param, 1.e-5);
+        CalcBodyPos(
+            sim_out_inc, pos, ori, grid, bucket, sim_param_inc, 1.e-5,
+            &workspace);
+
+        // Checking that the body position and the changed cells are correct
+        std::vector<std::vector<int>> changed_cells;
+        for (auto ii = 0; ii < 21; ii++)
+            for (auto jj = 0; jj < 21; jj++) {
+                bool changed = false;
+                for (auto ll = 0; ll < 4; ll++) {
+                    EXPECT_EQ(
+                        sim_out_inc->body_[ll][ii][jj],
+                        sim_out->body_[ll][ii][jj]);
+                    if (sim_out_inc->body_[ll][ii][jj] != body_prev[ll][ii][jj])
+                        changed = true;
+                }
+                if (changed)
+                    changed_cells.push_back({ii, jj});
+            }
+        std::vector<std::vector<int>> body_changed_cells =
+            sim_out_inc->body_changed_cells_;
+        EXPECT_EQ(body_changed_cells, changed_cells);
+        EXPECT_FALSE(changed_cells.empty());
+    }
+    delete sim_out_inc;
+
     delete bucket;
     delete sim_out;
 }
@@ -1235,3 +1426,206 @@ TEST(UnitTestBodyPos, CalcBodyPos_blade) {
     delete blade;
     delete sim_out;
 }
+
+/// This is for the MeshBody class.
+TEST(UnitTestBodyPos, CalcBodyPos_mesh) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    soil_simulator::SimParam sim_param(0.785, 4, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+
+    // Declaring variables
+    std::vector<float> ori;
+    std::vector<float> pos;
+    std::vector<std::vector<int>> body_pos;
+    std::vector<std::vector<float>> vertices = {
+        {-0.2, -0.2, -0.3}, {0.2, -0.2, -0.3}, {0.2, 0.2, -0.3},
+        {-0.2, 0.2, -0.3}, {-0.2, -0.2, 0.0}, {0.2, -0.2, 0.0},
+        {0.2, 0.2, 0.0}, {-0.2, 0.2, 0.0}};
+    std::vector<std::vector<int>> triangles = {
+        {0, 2, 1}, {0, 3, 2}, {4, 5, 6}, {4, 6, 7}, {0, 1, 5}, {0, 5, 4},
+        {1, 2, 6}, {1, 6, 5}, {2, 3, 7}, {2, 7, 6}, {3, 0, 4}, {3, 4, 7}};
+    soil_simulator::MeshBody *mesh = new soil_simulator::MeshBody(
+        {0.0, 0.0, 0.0}, vertices, triangles);
+
+    // Checking the position of a box located in the columns from ii_min to
+    // ii_max and from jj_min to jj_max, the columns outside the grid being
+    // ignored
+    // The box is closed, so that its inside is also occupied
+    auto CheckBox = [&](int ii_min, int ii_max, int jj_min, int jj_max) {
+        for (auto ii = ii_min; ii < std::min(ii_max + 1, 21); ii++)
+            for (auto jj = jj_min; jj < jj_max + 1; jj++) {
+                EXPECT_NEAR(sim_out->body_[0][ii][jj], -0.3, 1.e-5);
+                EXPECT_NEAR(sim_out->body_[1][ii][jj], 0.1, 1.e-5);
+                EXPECT_NEAR(sim_out->body_[2][ii][jj], 0.0, 1.e-5);
+                EXPECT_NEAR(sim_out->body_[3][ii][jj], 0.0, 1.e-5);
+                body_pos.push_back({0, ii, jj});
+            }
+    };
+
+    // Test: BP-CB-Me-1
+    ori = {1.0, 0.0, 0.0, 0.0};
+    pos = {0.05, 0.05, 0.05};
+    CalcBodyPos(sim_out, pos, ori, grid, mesh, sim_param, 1.e-5);
+    body_pos.clear();
+    CheckBox(9, 12, 9, 12);
+    EXPECT_EQ(sim_out->body_area_[0][0], 5);
+    EXPECT_EQ(sim_out->body_area_[0][1], 16);
+    EXPECT_EQ(sim_out->body_area_[1][0], 5);
+    EXPECT_EQ(sim_out->body_area_[1][1], 16);
+    // Resetting values
+    ResetValueAndTest(sim_out, {}, body_pos, {});
+
+    // Test: BP-CB-Me-2
+    ori = {0.707107, 0.0, 0.0, 0.707107};  // pi/2 rotation around the Z axis
+    pos = {0.05, 0.05, 0.05};
+    CalcBodyPos(sim_out, pos, ori, grid, mesh, sim_param, 1.e-5);
+    body_pos.clear();
+    CheckBox(9, 12, 9, 12);
+    EXPECT_EQ(sim_out->body_area_[0][0], 5);
+    EXPECT_EQ(sim_out->body_area_[0][1], 16);
+    EXPECT_EQ(sim_out->body_area_[1][0], 5);
+    EXPECT_EQ(sim_out->body_area_[1][1], 16);
+    // Resetting values
+    ResetValueAndTest(sim_out, {}, body_pos, {});
+
+    // Test: BP-CB-Me-3
+    ori = {1.0, 0.0, 0.0, 0.0};
+    pos = {0.97, 0.05, 0.05};
+    CalcBodyPos(sim_out, pos, ori, grid, mesh, sim_param, 1.e-5);
+    body_pos.clear();
+    CheckBox(18, 21, 9, 12);
+    EXPECT_EQ(sim_out->body_area_[0][0], 14);
+    EXPECT_EQ(sim_out->body_area_[0][1], 20);
+    EXPECT_EQ(sim_out->body_area_[1][0], 5);
+    EXPECT_EQ(sim_out->body_area_[1][1], 16);
+    // Resetting values
+    ResetValueAndTest(sim_out, {}, body_pos, {});
+
+    // Test: BP-CB-Me-4
+    soil_simulator::SimParam sim_param_inc(
+        0.785, 4, 4, 1, soil_simulator::RelaxMode::kSequential, 0, false,
+        true);
+    soil_simulator::SimOut *sim_out_inc = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    ori = {0.966, 0.0, 0.259, 0.0};
+    for (auto nn = 0; nn < 8; nn++) {
+        pos = {-0.2f + 0.06f * nn, 0.02f * nn, 0.3f - 0.03f * nn};
+        CalcBodyPos(sim_out, pos, ori, grid, mesh, sim_param, 1.e-5);
+        CalcBodyPos(
+            sim_out_inc, pos, ori, grid, mesh, sim_param_inc, 1.e-5,
+            &workspace);
+
+        // Checking that the body position is the same
+        for (auto ll = 0; ll < 4; ll++)
+            for (auto ii = 0; ii < 21; ii++)
+                for (auto jj = 0; jj < 21; jj++)
+                    EXPECT_EQ(
+                        sim_out_inc->body_[ll][ii][jj],
+                        sim_out->body_[ll][ii][jj]);
+    }
+    delete sim_out_inc;
+
+    // Test: BP-CB-Me-5
+    // Two boxes stacked on top of each other, the mesh being still closed
+    std::vector<std::vector<float>> vertices_2 = vertices;
+    std::vector<std::vector<int>> triangles_2 = triangles;
+    for (auto nn = 0; nn < 8; nn++)
+        vertices_2.push_back(
+            {vertices[nn][0], vertices[nn][1], vertices[nn][2] + 0.6f});
+    for (auto nn = 0; nn < 12; nn++)
+        triangles_2.push_back({
+            triangles[nn][0] + 8, triangles[nn][1] + 8, triangles[nn][2] + 8});
+    soil_simulator::MeshBody *mesh_2 = new soil_simulator::MeshBody(
+        {0.0, 0.0, 0.0}, vertices_2, triangles_2);
+    ori = {1.0, 0.0, 0.0, 0.0};
+    pos = {0.05, 0.05, 0.05};
+    CalcBodyPos(sim_out, pos, ori, grid, mesh_2, sim_param, 1.e-5);
+    body_pos.clear();
+    for (auto ii = 9; ii < 13; ii++)
+        for (auto jj = 9; jj < 13; jj++) {
+            float bot_0 = std::min(
+                sim_out->body_[0][ii][jj], sim_out->body_[2][ii][jj]);
+            float top_0 = std::min(
+                sim_out->body_[1][ii][jj], sim_out->body_[3][ii][jj]);
+            float bot_1 = std::max(
+                sim_out->body_[0][ii][jj], sim_out->body_[2][ii][jj]);
+            float top_1 = std::max(
+                sim_out->body_[1][ii][jj], sim_out->body_[3][ii][jj]);
+            EXPECT_NEAR(bot_0, -0.3, 1.e-5);
+            EXPECT_NEAR(top_0, 0.1, 1.e-5);
+            EXPECT_NEAR(bot_1, 0.3, 1.e-5);
+            EXPECT_NEAR(top_1, 0.7, 1.e-5);
+            body_pos.push_back({0, ii, jj});
+            body_pos.push_back({2, ii, jj});
+        }
+    // Resetting values
+    ResetValueAndTest(sim_out, {}, body_pos, {});
+    delete mesh_2;
+
+    delete mesh;
+    delete sim_out;
+}
+
+TEST(UnitTestBodyPos, CalcBodyFootprint) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    soil_simulator::SimParam sim_param(0.785, 4, 4);
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket();
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_b = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_u = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+
+    // Declaring variables
+    std::vector<float> ori = {1.0, 0.0, 0.0, 0.0};
+    std::vector<float> pos = {-0.3, -0.4, 0.3};
+    std::vector<float> pos_b = {-0.3, 0.4, 0.3};
+    std::vector<soil_simulator::BodySurface> surfaces;
+    soil_simulator::BodyFootprint footprint;
+    soil_simulator::BodyFootprint footprint_b;
+    int body_area[2][2];
+    int body_area_b[2][2];
+
+    // Test: BP-CBF-1
+    CalcBodyPos(sim_out, pos, ori, grid, bucket, sim_param, 1.e-5);
+    soil_simulator::CalcBodySurfaces(
+        pos, ori, grid, bucket, 1.e-5, &surfaces, &workspace);
+    EXPECT_EQ(surfaces.size(), 4);
+    soil_simulator::CalcBodyFootprint(
+        surfaces, grid, sim_param, 1.e-5, body_area, &footprint, &workspace);
+    for (auto ii = 0; ii < 2; ii++)
+        for (auto jj = 0; jj < 2; jj++)
+            EXPECT_EQ(body_area[ii][jj], sim_out->body_area_[ii][jj]);
+    for (auto ii = 0; ii < 21; ii++)
+        for (auto jj = 0; jj < 21; jj++)
+            for (auto ll = 0; ll < 4; ll++) {
+                float body_h = 0.0;
+                if (footprint.Contains(ii, jj))
+                    body_h = footprint.Cell(ii, jj)[ll];
+                EXPECT_EQ(
+                    sim_out->body_.Quantize(body_h),
+                    sim_out->body_[ll][ii][jj]);
+            }
+
+    // Test: BP-CBF-2
+    CalcBodyPos(sim_out_b, pos_b, ori, grid, bucket, sim_param, 1.e-5);
+    soil_simulator::CalcBodySurfaces(
+        pos_b, ori, grid, bucket, 1.e-5, &surfaces, &workspace);
+    soil_simulator::CalcBodyFootprint(
+        surfaces, grid, sim_param, 1.e-5, body_area_b, &footprint_b,
+        &workspace);
+    soil_simulator::IncludeBodyFootprint(footprint, sim_out_u, 1.e-5);
+    soil_simulator::IncludeBodyFootprint(footprint_b, sim_out_u, 1.e-5);
+    for (auto ii = 0; ii < 21; ii++)
+        for (auto jj = 0; jj < 21; jj++)
+            for (auto ll = 0; ll < 4; ll++)
+                EXPECT_EQ(
+                    sim_out_u->body_[ll][ii][jj],
+                    sim_out->body_[ll][ii][jj] + sim_out_b->body_[ll][ii][jj]);
+
+    delete bucket;
+    delete sim_out;
+    delete sim_out_b;
+    delete sim_out_u;
+}
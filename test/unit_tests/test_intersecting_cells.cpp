@@ -7571,6 +7571,21 @@ TEST(UnitTestIntersectingCells, LocateIntersectingCells) {
     EXPECT_EQ(intersecting_cells.size(), 2);
     ResetValueAndTest(sim_out, {{10, 16}}, {{0, 10, 16}, {2, 10, 16}}, {});
 
+    // Test: IC-LIC-11
+    SetHeight(sim_out, 10, 13, 0.1, -0.2, 0.0, NAN, NAN, 0.0, 0.3, NAN, NAN);
+    SetHeight(sim_out, 10, 16, 0.1, -0.3, -0.2, NAN, NAN, -0.6, -0.4, NAN, NAN);
+    soil_simulator::CellBitmap intersecting_bitmap;
+    soil_simulator::CellList<2> cells;
+    cells.push_back({10, 16});
+    soil_simulator::LocateIntersectingCells(
+        sim_out, 1e-5, &intersecting_bitmap, &cells);
+    EXPECT_EQ(intersecting_bitmap.Count(), 2);
+    EXPECT_TRUE(intersecting_bitmap.Test(10, 32));
+    EXPECT_TRUE(intersecting_bitmap.Test(10, 33));
+    ResetValueAndTest(
+        sim_out, {{10, 13}, {10, 16}},
+        {{0, 10, 13}, {2, 10, 13}, {0, 10, 16}, {2, 10, 16}}, {});
+
     delete sim_out;
 }
 
@@ -3,7 +3,9 @@ This file implements unit tests for the functions in relax.cpp.
 
 Copyright, 2023, Vilella Kenny.
 */
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <random>
 #include "gtest/gtest.h"
 #include "soil_simulator/relax.hpp"
@@ -103,6 +105,261 @@ TEST(UnitTestRelax, LocateUnstableTerrainCell) {
     EXPECT_EQ(unstable_cells.size(), 3);
     sim_out->terrain_[5][2] = 0.0;
 
+    // Test: RE-LUT-8
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(-3, 3);
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            sim_out->terrain_[ii][jj] = 0.1 * dist(gen);
+    unstable_cells = LocateUnstableTerrainCell(sim_out, 0.1, 1e-5);
+    int nn = 0;
+    for (auto ii = 2; ii < 17; ii++)
+        for (auto jj = 2; jj < 17; jj++) {
+            float h_min = sim_out->terrain_[ii][jj] - 0.1 - 1e-5;
+            if (
+                (sim_out->terrain_[ii-1][jj] < h_min) ||
+                (sim_out->terrain_[ii+1][jj] < h_min) ||
+                (sim_out->terrain_[ii][jj-1] < h_min) ||
+                (sim_out->terrain_[ii][jj+1] < h_min)
+            ) {
+                EXPECT_TRUE((unstable_cells[nn] == std::vector<int> {ii, jj}));
+                nn++;
+            }
+        }
+    EXPECT_EQ(unstable_cells.size(), nn);
+
+    // Test: RE-LUT-9
+    for (auto n_cell = 1; n_cell < 16; n_cell++) {
+        auto mask = soil_simulator::LocateUnstableTerrainBlock(
+            sim_out->terrain_, 5, 2, n_cell, 0.1, 1e-5);
+        std::uint64_t expected_mask = 0;
+        for (auto kk = 0; kk < n_cell; kk++) {
+            float h_min = sim_out->terrain_[5][2+kk] - 0.1 - 1e-5;
+            if (
+                (sim_out->terrain_[4][2+kk] < h_min) ||
+                (sim_out->terrain_[6][2+kk] < h_min) ||
+                (sim_out->terrain_[5][1+kk] < h_min) ||
+                (sim_out->terrain_[5][3+kk] < h_min)
+            )
+                expected_mask |= std::uint64_t(1) << kk;
+        }
+        EXPECT_EQ(mask, expected_mask);
+    }
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            sim_out->terrain_[ii][jj] = 0.0;
+
+    // Test: RE-LUT-10
+    int area_1[2][2] = {{0, 6}, {0, 6}};
+    int area_2[2][2] = {{12, 20}, {10, 20}};
+    sim_out->impact_regions_.Clear();
+    sim_out->impact_regions_.Add(area_1);
+    sim_out->impact_regions_.Add(area_2);
+    sim_out->terrain_[4][4] = 0.2;
+    sim_out->terrain_[9][9] = 0.2;
+    sim_out->terrain_[14][15] = 0.2;
+    unstable_cells = LocateUnstableTerrainCell(sim_out, 0.1, 1e-5);
+    EXPECT_EQ(unstable_cells.size(), 2);
+    EXPECT_TRUE((unstable_cells[0] == std::vector<int> {4, 4}));
+    EXPECT_TRUE((unstable_cells[1] == std::vector<int> {14, 15}));
+    sim_out->terrain_[4][4] = 0.0;
+    sim_out->terrain_[9][9] = 0.0;
+    sim_out->terrain_[14][15] = 0.0;
+
+    // Test: RE-LUT-11
+    int area_3[2][2] = {{2, 20}, {2, 20}};
+    int unstable_area[2][2];
+    int n_unstable = soil_simulator::CalcUnstableTerrainArea(
+        sim_out->terrain_, area_3, 0.1, 1e-5, unstable_area);
+    EXPECT_EQ(n_unstable, 0);
+    EXPECT_GE(unstable_area[0][0], unstable_area[0][1]);
+    EXPECT_GE(unstable_area[1][0], unstable_area[1][1]);
+    sim_out->terrain_[4][4] = 0.2;
+    sim_out->terrain_[14][15] = 0.2;
+    sim_out->terrain_[15][15] = 0.2;
+    n_unstable = soil_simulator::CalcUnstableTerrainArea(
+        sim_out->terrain_, area_3, 0.1, 1e-5, unstable_area);
+    EXPECT_EQ(n_unstable, 3);
+    EXPECT_EQ(unstable_area[0][0], 4);
+    EXPECT_EQ(unstable_area[0][1], 16);
+    EXPECT_EQ(unstable_area[1][0], 4);
+    EXPECT_EQ(unstable_area[1][1], 16);
+    sim_out->terrain_[4][4] = 0.0;
+    sim_out->terrain_[14][15] = 0.0;
+    sim_out->terrain_[15][15] = 0.0;
+
+    // Test: RE-LUT-12
+    sim_out->terrain_[4][4] = 0.2;
+    sim_out->terrain_[14][15] = 0.2;
+    // The areas are kept within impact_area_, as the neighbours are read
+    int area_4[2][2] = {{2, 6}, {2, 6}};
+    int area_5[2][2] = {{12, 17}, {10, 17}};
+    soil_simulator::CellList<2> cell_list;
+    soil_simulator::AppendUnstableTerrainCell(
+        sim_out->terrain_, area_4, 0.1, 1e-5, &cell_list);
+    soil_simulator::AppendUnstableTerrainCell(
+        sim_out->terrain_, area_5, 0.1, 1e-5, &cell_list);
+    EXPECT_EQ(cell_list.size(), 2);
+    EXPECT_TRUE((cell_list[0] == std::array<int, 2> {4, 4}));
+    EXPECT_TRUE((cell_list[1] == std::array<int, 2> {14, 15}));
+    LocateUnstableTerrainCell(
+        sim_out->terrain_, area_5, 0.1, 1e-5, &cell_list);
+    EXPECT_EQ(cell_list.size(), 1);
+    EXPECT_TRUE((cell_list[0] == std::array<int, 2> {14, 15}));
+    sim_out->terrain_[4][4] = 0.0;
+    sim_out->terrain_[14][15] = 0.0;
+
+    delete sim_out;
+}
+
+TEST(UnitTestRelax, MarkDirtyCell) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+
+    // Test: RE-MDC-1
+    soil_simulator::MarkDirtyCell(sim_out, 10, 15);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 5);
+    EXPECT_TRUE((sim_out->dirty_cells_[0] == std::array<int, 2> {10, 15}));
+    EXPECT_EQ(sim_out->dirty_mask_[10][15], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[11][15], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[9][15], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[10][16], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[10][14], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[11][16], 0);
+
+    // Test: RE-MDC-2
+    soil_simulator::MarkDirtyCell(sim_out, 10, 15);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 5);
+    soil_simulator::MarkDirtyCell(sim_out, 10, 16);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 8);
+    EXPECT_EQ(sim_out->dirty_mask_[11][16], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[9][16], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[10][17], 1);
+
+    // Test: RE-MDC-3
+    soil_simulator::MarkDirtyCell(sim_out, 2, 18);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 11);
+    EXPECT_EQ(sim_out->dirty_mask_[2][18], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[3][18], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[2][17], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[1][18], 0);
+    EXPECT_EQ(sim_out->dirty_mask_[2][19], 0);
+
+    // Test: RE-MDC-4
+    int area[2][2] = {{9, 12}, {14, 16}};
+    sim_out->terrain_[11][14] = 0.2;
+    sim_out->terrain_[10][15] = 0.2;
+    soil_simulator::MarkDirtyArea(sim_out, area, 0.1, 1e-5);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 12);
+    EXPECT_TRUE((sim_out->dirty_cells_[11] == std::array<int, 2> {11, 14}));
+    EXPECT_EQ(sim_out->dirty_mask_[11][14], 1);
+    EXPECT_EQ(sim_out->dirty_mask_[9][14], 0);
+    EXPECT_EQ(sim_out->dirty_mask_[11][17], 0);
+    sim_out->terrain_[11][14] = 0.0;
+    sim_out->terrain_[10][15] = 0.0;
+
+    // Test: RE-MDC-5
+    int grid_area[2][2] = {{0, 21}, {0, 21}};
+    soil_simulator::MarkDirtyArea(sim_out, grid_area, 0.1, 1e-5);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 12);
+
+    delete sim_out;
+}
+
+TEST(UnitTestRelax, LocateDirtyTerrainCell) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::CellList<2> unstable_cells;
+
+    // Test: RE-LDT-1
+    sim_out->terrain_[7][13] = 0.2;
+    soil_simulator::LocateDirtyTerrainCell(
+        sim_out, 0.1, 1e-5, &unstable_cells);
+    EXPECT_EQ(unstable_cells.size(), 0);
+
+    // Test: RE-LDT-2
+    soil_simulator::MarkDirtyCell(sim_out, 7, 12);
+    soil_simulator::LocateDirtyTerrainCell(
+        sim_out, 0.1, 1e-5, &unstable_cells);
+    EXPECT_EQ(unstable_cells.size(), 1);
+    EXPECT_TRUE((unstable_cells[0] == std::array<int, 2> {7, 13}));
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 0);
+    for (auto ii = 0; ii < sim_out->dirty_mask_.size_x(); ii++)
+        for (auto jj = 0; jj < sim_out->dirty_mask_.size_y(); jj++)
+            EXPECT_EQ(sim_out->dirty_mask_[ii][jj], 0);
+
+    // Test: RE-LDT-3
+    soil_simulator::LocateDirtyTerrainCell(
+        sim_out, 0.1, 1e-5, &unstable_cells);
+    EXPECT_EQ(unstable_cells.size(), 0);
+    sim_out->terrain_[7][13] = 0.0;
+
+    delete sim_out;
+}
+
+TEST(UnitTestRelax, RelaxDirtyTerrain) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SimParam sim_param(0.785, 3, 4);
+    bucket->pos_ = {0.0, 0.0, 0.0};
+    bucket->ori_ = {1.0, 0.0, 0.0, 0.0};
+    soil_simulator::CellList<2> unstable_cells;
+
+    // Test: RE-RDT-1
+    soil_simulator::rng.seed(200);
+    sim_out->terrain_[10][15] = 0.4;
+    soil_simulator::RelaxDirtyTerrain(sim_out, grid, bucket, sim_param, 1e-5);
+    EXPECT_TRUE(sim_out->equilibrium_);
+    EXPECT_NEAR(sim_out->terrain_[10][15], 0.4, 1e-5);
+
+    // Test: RE-RDT-2
+    soil_simulator::MarkDirtyCell(sim_out, 10, 15);
+    soil_simulator::RelaxDirtyTerrain(sim_out, grid, bucket, sim_param, 1e-5);
+    EXPECT_FALSE(sim_out->equilibrium_);
+    EXPECT_LT(sim_out->terrain_[10][15], 0.4 - 1e-5);
+    EXPECT_GT(sim_out->dirty_cells_.size(), 0);
+    EXPECT_EQ(sim_out->dirty_mask_[10][15], 1);
+
+    // Test: RE-RDT-3
+    int it = 0;
+    while ((sim_out->dirty_cells_.size() != 0) && (it < 100)) {
+        it++;
+        soil_simulator::RelaxDirtyTerrain(
+            sim_out, grid, bucket, sim_param, 1e-5);
+    }
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 0);
+    EXPECT_TRUE(sim_out->equilibrium_);
+    sim_out->impact_area_[0][0] = 1;
+    sim_out->impact_area_[0][1] = 20;
+    sim_out->impact_area_[1][0] = 1;
+    sim_out->impact_area_[1][1] = 20;
+    soil_simulator::LocateUnstableTerrainCell(
+        sim_out, 0.1, 1e-5, &unstable_cells);
+    EXPECT_EQ(unstable_cells.size(), 0);
+    float volume = 0.0;
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            volume += sim_out->terrain_[ii][jj];
+    EXPECT_NEAR(volume, 0.4, 1e-5);
+
+    // Test: RE-RDT-4
+    int relax_area[2][2] = {{5, 10}, {5, 10}};
+    sim_out->relax_regions_.Add(relax_area);
+    soil_simulator::MarkDirtyCell(sim_out, 10, 15);
+    soil_simulator::RelaxDirtyTerrain(sim_out, grid, bucket, sim_param, 1e-5);
+    EXPECT_TRUE(sim_out->equilibrium_);
+    EXPECT_EQ(sim_out->relax_regions_.size(), 0);
+
+    delete bucket;
     delete sim_out;
 }
 
@@ -1235,11 +1492,11 @@ TEST(UnitTestRelax, RelaxTerrain) {
     soil_simulator::RelaxTerrain(sim_out, grid, bucket, sim_param, 1e-5);
     CheckRelaxArea(5, 15, 10, 20);
     EXPECT_NEAR(sim_out->terrain_[10][16], -0.1, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[9][15], -0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[11][15], -0.1, 1e-5);
     CheckHeight(sim_out, 10, 15, -0.1, 0.0, 0.1, NAN, NAN);
     EXPECT_EQ(sim_out->body_soil_pos_.size(), 1);
     ResetValueAndTest(
-        sim_out, {{9, 15}, {10, 15}, {10, 16}}, {{0, 10, 15}, {2, 10, 15}},
+        sim_out, {{10, 15}, {10, 16}, {11, 15}}, {{0, 10, 15}, {2, 10, 15}},
         {{0, 10, 15}});
 
     // Test: RE-RT-22
@@ -1558,10 +1815,10 @@ TEST(UnitTestRelax, RelaxTerrain) {
     EXPECT_NEAR(sim_out->terrain_[10][15], -0.1, 1e-5);
     EXPECT_NEAR(sim_out->terrain_[10][16], -0.3, 1e-5);
     EXPECT_NEAR(sim_out->terrain_[9][15], -0.1, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[10][14], -0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[11][15], -0.1, 1e-5);
     EXPECT_EQ(sim_out->body_soil_pos_.size(), 0);
     ResetValueAndTest(
-        sim_out, {{9, 15}, {10, 14}, {10, 15}, {10, 16}}, {{0, 10, 15}}, {});
+        sim_out, {{9, 15}, {10, 15}, {10, 16}, {11, 15}}, {{0, 10, 15}}, {});
 
     // Test: RE-RT-40
     soil_simulator::rng.seed(200);
@@ -1571,26 +1828,615 @@ TEST(UnitTestRelax, RelaxTerrain) {
     CheckRelaxArea(5, 15, 10, 20);
     EXPECT_NEAR(sim_out->terrain_[10][15], -0.1, 1e-5);
     EXPECT_NEAR(sim_out->terrain_[10][16], -0.2, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[9][15], -0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[11][15], -0.1, 1e-5);
     EXPECT_EQ(sim_out->body_soil_pos_.size(), 0);
-    ResetValueAndTest(sim_out, {{9, 15}, {10, 15}, {10, 16}}, {}, {});
+    ResetValueAndTest(sim_out, {{10, 15}, {10, 16}, {11, 15}}, {}, {});
 
     // Test: RE-RT-41
     soil_simulator::rng.seed(200);
     SetRelaxArea();
-    sim_out->terrain_[10][15] = -0.2;
+    sim_out->terrain_[10][15] = 0.2;
     soil_simulator::RelaxTerrain(sim_out, grid, bucket, sim_param, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[10][15], -0.1, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[10][16], -0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[10][15], 0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[10][16], 0.1, 1e-5);
     EXPECT_EQ(sim_out->body_soil_pos_.size(), 0);
     soil_simulator::rng.seed(201);
-    sim_out->terrain_[10][15] = -0.2;
+    sim_out->terrain_[10][15] = 0.2;
     sim_out->terrain_[10][16] = 0.0;
     soil_simulator::RelaxTerrain(sim_out, grid, bucket, sim_param, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[10][15], -0.1, 1e-5);
-    EXPECT_NEAR(sim_out->terrain_[11][15], -0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[10][15], 0.1, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[10][14], 0.1, 1e-5);
     EXPECT_EQ(sim_out->body_soil_pos_.size(), 0);
-    ResetValueAndTest(sim_out, {{10, 15}, {11, 15}}, {}, {});
+    ResetValueAndTest(sim_out, {{10, 14}, {10, 15}}, {}, {});
+
+    delete bucket;
+    delete sim_out;
+}
+
+TEST(UnitTestRelax, RelaxTerrainParallel) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    bucket->pos_ = {0.0, 0.0, 0.0};
+    bucket->ori_ = {1.0, 0.0, 0.0, 0.0};
+    soil_simulator::SimParam sim_param_1(0.785, 3, 4, 1);
+    soil_simulator::SimParam sim_param_2(0.785, 3, 4, 2);
+    soil_simulator::SimParam sim_param_4(0.785, 3, 4, 4);
+
+    // Creating a lambda function to set a rough terrain partially covered
+    // by the body
+    auto SetRoughTerrain = [&](soil_simulator::SimOut* sim_out) {
+        sim_out->impact_area_[0][0] = 2;
+        sim_out->impact_area_[0][1] = 18;
+        sim_out->impact_area_[1][0] = 2;
+        sim_out->impact_area_[1][1] = 18;
+        for (auto ii = 2; ii < 19; ii++)
+            for (auto jj = 2; jj < 19; jj++)
+                sim_out->terrain_[ii][jj] = 0.1 * ((7 * ii + 13 * jj) % 6);
+        for (auto ii = 8; ii < 12; ii++)
+            for (auto jj = 8; jj < 12; jj++)
+                SetHeight(
+                    sim_out, ii, jj, 0.0, 0.0, 0.1 * ((ii + jj) % 3), NAN,
+                    NAN, NAN, NAN, NAN, NAN);
+    };
+
+    // Creating a lambda function to calculate the total soil volume
+    auto CalcVolume = [&](soil_simulator::SimOut* sim_out) {
+        float volume = 0.0;
+        for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+                volume += sim_out->terrain_[ii][jj];
+        for (auto nn = 0; nn < sim_out->body_soil_pos_.size(); nn++)
+            volume += sim_out->body_soil_pos_[nn].h_soil;
+        return volume;
+    };
+
+    // Test: RE-RTP-1
+    soil_simulator::SimOut *sim_out_1 = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_2 = new soil_simulator::SimOut(grid);
+    for (auto sim_out : {sim_out_1, sim_out_2}) {
+        sim_out->impact_area_[0][0] = 4;
+        sim_out->impact_area_[0][1] = 16;
+        sim_out->impact_area_[1][0] = 9;
+        sim_out->impact_area_[1][1] = 20;
+    }
+    sim_out_1->terrain_[10][15] = 0.2;
+    sim_out_2->terrain_[10][15] = 0.2;
+    soil_simulator::rng.seed(200);
+    soil_simulator::RelaxTerrain(sim_out_1, grid, bucket, sim_param_1, 1e-5);
+    soil_simulator::rng.seed(200);
+    soil_simulator::RelaxTerrain(sim_out_2, grid, bucket, sim_param_2, 1e-5);
+    EXPECT_NEAR(sim_out_2->terrain_[10][15], 0.1, 1e-5);
+    EXPECT_EQ(sim_out_2->equilibrium_, sim_out_1->equilibrium_);
+    for (auto ii = 0; ii < 2; ii++)
+        for (auto jj = 0; jj < 2; jj++)
+            EXPECT_EQ(
+                sim_out_2->relax_area_[ii][jj], sim_out_1->relax_area_[ii][jj]);
+    for (auto ii = 0; ii < sim_out_1->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_1->terrain_[0].size(); jj++)
+            EXPECT_EQ(sim_out_2->terrain_[ii][jj], sim_out_1->terrain_[ii][jj]);
+    delete sim_out_1;
+    delete sim_out_2;
+
+    // Test: RE-RTP-2
+    sim_out_2 = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_4 = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace_2;
+    soil_simulator::Workspace workspace_4;
+    SetRoughTerrain(sim_out_2);
+    SetRoughTerrain(sim_out_4);
+    float init_volume = CalcVolume(sim_out_2);
+    for (auto it = 0; it < 5; it++) {
+        soil_simulator::rng.seed(300 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_2, grid, bucket, sim_param_2, 1e-5, &workspace_2);
+        soil_simulator::rng.seed(300 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_4, grid, bucket, sim_param_4, 1e-5, &workspace_4);
+    }
+    EXPECT_GT(sim_out_2->body_soil_pos_.size(), 0);
+    EXPECT_EQ(
+        sim_out_2->body_soil_pos_.size(), sim_out_4->body_soil_pos_.size());
+    for (auto ii = 0; ii < sim_out_2->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_2->terrain_[0].size(); jj++) {
+            EXPECT_EQ(sim_out_2->terrain_[ii][jj], sim_out_4->terrain_[ii][jj]);
+            for (auto ind = 0; ind < 4; ind++)
+                EXPECT_EQ(
+                    sim_out_2->body_soil_[ind][ii][jj],
+                    sim_out_4->body_soil_[ind][ii][jj]);
+        }
+
+    // Test: RE-RTP-3
+    EXPECT_NEAR(CalcVolume(sim_out_2), init_volume, 1e-4);
+    EXPECT_NEAR(CalcVolume(sim_out_4), init_volume, 1e-4);
+
+    // Test: RE-RTP-4
+    for (auto it = 0; it < 100; it++) {
+        soil_simulator::RelaxTerrain(
+            sim_out_4, grid, bucket, sim_param_4, 1e-5, &workspace_4);
+        if (sim_out_4->equilibrium_)
+            break;
+    }
+    EXPECT_TRUE(sim_out_4->equilibrium_);
+    EXPECT_NEAR(CalcVolume(sim_out_4), init_volume, 1e-4);
+    delete sim_out_2;
+    delete sim_out_4;
+
+    // Test: RE-RTP-5
+    sim_out_2 = new soil_simulator::SimOut(grid);
+    sim_out_4 = new soil_simulator::SimOut(grid);
+    soil_simulator::CounterRng counter_rng(100);
+    workspace_2.rng_ = &counter_rng;
+    workspace_4.rng_ = &counter_rng;
+    SetRoughTerrain(sim_out_2);
+    SetRoughTerrain(sim_out_4);
+    for (auto it = 0; it < 5; it++) {
+        counter_rng.SetCounter(1, it);
+        soil_simulator::rng.seed(400 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_2, grid, bucket, sim_param_2, 1e-5, &workspace_2);
+        soil_simulator::rng.seed(500 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_4, grid, bucket, sim_param_4, 1e-5, &workspace_4);
+    }
+    EXPECT_GT(sim_out_2->body_soil_pos_.size(), 0);
+    EXPECT_EQ(
+        sim_out_2->body_soil_pos_.size(), sim_out_4->body_soil_pos_.size());
+    for (auto ii = 0; ii < sim_out_2->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_2->terrain_[0].size(); jj++) {
+            EXPECT_EQ(sim_out_2->terrain_[ii][jj], sim_out_4->terrain_[ii][jj]);
+            for (auto ind = 0; ind < 4; ind++)
+                EXPECT_EQ(
+                    sim_out_2->body_soil_[ind][ii][jj],
+                    sim_out_4->body_soil_[ind][ii][jj]);
+        }
+    EXPECT_NEAR(CalcVolume(sim_out_2), init_volume, 1e-4);
+
+    delete bucket;
+    delete sim_out_2;
+    delete sim_out_4;
+}
+
+TEST(UnitTestRelax, RelaxTerrainFlux) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    bucket->pos_ = {0.0, 0.0, 0.0};
+    bucket->ori_ = {1.0, 0.0, 0.0, 0.0};
+    auto kFlux = soil_simulator::RelaxMode::kFlux;
+    soil_simulator::SimParam sim_param_1(0.785, 3, 4, 1, kFlux);
+    soil_simulator::SimParam sim_param_4(0.785, 3, 4, 4, kFlux);
+    soil_simulator::SimOut *sim_out_1 = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_4 = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace_1;
+    soil_simulator::Workspace workspace_4;
+
+    // Creating a lambda function to set a rough terrain partially covered
+    // by the body
+    auto SetRoughTerrain = [&](soil_simulator::SimOut* sim_out) {
+        sim_out->impact_area_[0][0] = 2;
+        sim_out->impact_area_[0][1] = 18;
+        sim_out->impact_area_[1][0] = 2;
+        sim_out->impact_area_[1][1] = 18;
+        for (auto ii = 2; ii < 19; ii++)
+            for (auto jj = 2; jj < 19; jj++)
+                sim_out->terrain_[ii][jj] = 0.1 * ((7 * ii + 13 * jj) % 6);
+        for (auto ii = 8; ii < 12; ii++)
+            for (auto jj = 8; jj < 12; jj++)
+                SetHeight(
+                    sim_out, ii, jj, 0.0, 0.0, 0.1 * ((ii + jj) % 3), NAN,
+                    NAN, NAN, NAN, NAN, NAN);
+    };
+
+    // Creating a lambda function to calculate the total soil volume
+    auto CalcVolume = [&](soil_simulator::SimOut* sim_out) {
+        float volume = 0.0;
+        for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+                volume += sim_out->terrain_[ii][jj];
+        for (auto nn = 0; nn < sim_out->body_soil_pos_.size(); nn++)
+            volume += sim_out->body_soil_pos_[nn].h_soil;
+        return volume;
+    };
+
+    // Test: RE-RTF-1
+    sim_out_1->impact_area_[0][0] = 4;
+    sim_out_1->impact_area_[0][1] = 16;
+    sim_out_1->impact_area_[1][0] = 9;
+    sim_out_1->impact_area_[1][1] = 20;
+    sim_out_1->terrain_[10][15] = 0.5;
+    soil_simulator::RelaxTerrain(
+        sim_out_1, grid, bucket, sim_param_1, 1e-5, &workspace_1);
+    EXPECT_NEAR(sim_out_1->terrain_[10][15], 0.3, 1e-5);
+    EXPECT_NEAR(sim_out_1->terrain_[11][15], 0.05, 1e-5);
+    EXPECT_NEAR(sim_out_1->terrain_[9][15], 0.05, 1e-5);
+    EXPECT_NEAR(sim_out_1->terrain_[10][16], 0.05, 1e-5);
+    EXPECT_NEAR(sim_out_1->terrain_[10][14], 0.05, 1e-5);
+    EXPECT_FALSE(sim_out_1->equilibrium_);
+    for (auto ii = 0; ii < sim_out_1->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_1->terrain_[0].size(); jj++)
+            sim_out_1->terrain_[ii][jj] = 0.0;
+
+    // Test: RE-RTF-2
+    sim_out_1->terrain_[10][15] = 0.15;
+    soil_simulator::rng.seed(200);
+    soil_simulator::RelaxTerrain(
+        sim_out_1, grid, bucket, sim_param_1, 1e-5, &workspace_1);
+    EXPECT_NEAR(sim_out_1->terrain_[10][15], 0.1, 1e-5);
+    EXPECT_NEAR(CalcVolume(sim_out_1), 0.15, 1e-5);
+    delete sim_out_1;
+
+    // Test: RE-RTF-3
+    sim_out_1 = new soil_simulator::SimOut(grid);
+    SetRoughTerrain(sim_out_1);
+    SetRoughTerrain(sim_out_4);
+    float init_volume = CalcVolume(sim_out_1);
+    for (auto it = 0; it < 5; it++) {
+        soil_simulator::rng.seed(300 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_1, grid, bucket, sim_param_1, 1e-5, &workspace_1);
+        soil_simulator::rng.seed(300 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_4, grid, bucket, sim_param_4, 1e-5, &workspace_4);
+    }
+    EXPECT_GT(sim_out_1->body_soil_pos_.size(), 0);
+    EXPECT_EQ(
+        sim_out_1->body_soil_pos_.size(), sim_out_4->body_soil_pos_.size());
+    for (auto ii = 0; ii < sim_out_1->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_1->terrain_[0].size(); jj++) {
+            EXPECT_EQ(sim_out_1->terrain_[ii][jj], sim_out_4->terrain_[ii][jj]);
+            for (auto ind = 0; ind < 4; ind++)
+                EXPECT_EQ(
+                    sim_out_1->body_soil_[ind][ii][jj],
+                    sim_out_4->body_soil_[ind][ii][jj]);
+        }
+
+    // Test: RE-RTF-4
+    EXPECT_NEAR(CalcVolume(sim_out_1), init_volume, 1e-4);
+
+    // Test: RE-RTF-5
+    for (auto it = 0; it < 200; it++) {
+        soil_simulator::RelaxTerrain(
+            sim_out_1, grid, bucket, sim_param_1, 1e-5, &workspace_1);
+        if (sim_out_1->equilibrium_)
+            break;
+    }
+    EXPECT_TRUE(sim_out_1->equilibrium_);
+    EXPECT_NEAR(CalcVolume(sim_out_1), init_volume, 1e-4);
+    delete sim_out_1;
+    delete sim_out_4;
+
+    // Test: RE-RTF-6
+    // The two modes follow different avalanche paths, so that the settled
+    // terrains are only expected to be within half of dh_max of each other
+    auto kSequential = soil_simulator::RelaxMode::kSequential;
+    soil_simulator::SimParam sim_param_s(0.785, 3, 4, 1, kSequential);
+    soil_simulator::SimOut *sim_out_s = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace_s;
+    sim_out_1 = new soil_simulator::SimOut(grid);
+    bucket->pos_ = {0.0, 0.0, 5.0};
+    for (auto sim_out : {sim_out_1, sim_out_s}) {
+        sim_out->impact_area_[0][0] = 2;
+        sim_out->impact_area_[0][1] = 18;
+        sim_out->impact_area_[1][0] = 2;
+        sim_out->impact_area_[1][1] = 18;
+        for (auto ii = 8; ii < 13; ii++)
+            for (auto jj = 8; jj < 13; jj++)
+                sim_out->terrain_[ii][jj] = 0.4;
+        sim_out->terrain_[10][10] = 0.8;
+    }
+    soil_simulator::rng.seed(600);
+    for (auto it = 0; it < 100; it++) {
+        soil_simulator::RelaxTerrain(
+            sim_out_1, grid, bucket, sim_param_1, 1e-5, &workspace_1);
+        if (sim_out_1->equilibrium_)
+            break;
+    }
+    for (auto it = 0; it < 100; it++) {
+        soil_simulator::RelaxTerrain(
+            sim_out_s, grid, bucket, sim_param_s, 1e-5, &workspace_s);
+        if (sim_out_s->equilibrium_)
+            break;
+    }
+    EXPECT_TRUE(sim_out_1->equilibrium_);
+    EXPECT_TRUE(sim_out_s->equilibrium_);
+    EXPECT_NEAR(CalcVolume(sim_out_1), CalcVolume(sim_out_s), 1e-4);
+    float dh_max = grid.cell_size_xy_ * std::tan(sim_param_1.repose_angle_);
+    for (auto ii = 0; ii < sim_out_1->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_1->terrain_[0].size(); jj++)
+            EXPECT_NEAR(
+                sim_out_1->terrain_[ii][jj], sim_out_s->terrain_[ii][jj],
+                0.5 * dh_max);
+
+    delete bucket;
+    delete sim_out_1;
+    delete sim_out_s;
+}
+
+TEST(UnitTestRelax, RelaxTerrainMultigrid) {
+    // Setting up the environment
+    soil_simulator::Grid grid(2.0, 2.0, 2.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    bucket->pos_ = {0.0, 0.0, 0.0};
+    bucket->ori_ = {1.0, 0.0, 0.0, 0.0};
+    auto kSequential = soil_simulator::RelaxMode::kSequential;
+    soil_simulator::SimParam sim_param(0.785, 3, 4, 1, kSequential, 3);
+    soil_simulator::SimParam sim_param_0(0.785, 3, 4, 1, kSequential, 0);
+    soil_simulator::SimParam sim_param_5(0.785, 3, 4, 1, kSequential, 5);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_0 = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    int area[2][2] = {{8, 72}, {8, 72}};
+
+    // Creating a lambda function to set a conical pile of soil
+    auto SetPile = [&](soil_simulator::SimOut* sim_out) {
+        sim_out->impact_area_[0][0] = 2;
+        sim_out->impact_area_[0][1] = 79;
+        sim_out->impact_area_[1][0] = 2;
+        sim_out->impact_area_[1][1] = 79;
+        for (auto ii = 34; ii < 47; ii++)
+            for (auto jj = 34; jj < 47; jj++) {
+                float rr = std::sqrt(
+                    (ii - 40) * (ii - 40) + (jj - 40) * (jj - 40));
+                if (rr <= 6.0)
+                    sim_out->terrain_[ii][jj] = 0.01 * std::round(
+                        60.0 * (1.0 - rr / 6.0));
+            }
+    };
+
+    // Creating a lambda function to count the soil in number of cell_size_z
+    auto CountSoil = [&](soil_simulator::SimOut* sim_out) {
+        std::int64_t n_soil = 0;
+        for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+                n_soil += std::lround(sim_out->terrain_[ii][jj] / 0.01);
+        return n_soil;
+    };
+
+    // Test: RE-RTM-1
+    SetPile(sim_out);
+    std::int64_t init_soil = CountSoil(sim_out);
+    soil_simulator::RelaxTerrainMultigrid(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_EQ(CountSoil(sim_out), init_soil);
+    EXPECT_LT(sim_out->terrain_[40][40], 0.6 - 1e-5);
+    EXPECT_FALSE(sim_out->equilibrium_);
+    EXPECT_GT(sim_out->dirty_cells_.size(), 0);
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            if ((ii < 8) || (ii >= 72) || (jj < 8) || (jj >= 72))
+                EXPECT_EQ(sim_out->terrain_[ii][jj], 0.0);
+
+    // Test: RE-RTM-2
+    int n_sweep = 0;
+    for (auto it = 0; it < 500; it++) {
+        soil_simulator::rng.seed(400 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out, grid, bucket, sim_param, 1e-5, &workspace);
+        n_sweep++;
+        if (sim_out->equilibrium_)
+            break;
+    }
+    SetPile(sim_out_0);
+    int n_sweep_0 = 0;
+    for (auto it = 0; it < 500; it++) {
+        soil_simulator::rng.seed(400 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out_0, grid, bucket, sim_param_0, 1e-5, &workspace);
+        n_sweep_0++;
+        if (sim_out_0->equilibrium_)
+            break;
+    }
+    EXPECT_TRUE(sim_out->equilibrium_);
+    EXPECT_TRUE(sim_out_0->equilibrium_);
+    EXPECT_LT(n_sweep, n_sweep_0);
+    EXPECT_EQ(CountSoil(sim_out), init_soil);
+    delete sim_out;
+
+    // Test: RE-RTM-3
+    sim_out = new soil_simulator::SimOut(grid);
+    SetPile(sim_out);
+    for (auto ii = 40; ii < 44; ii++)
+        for (auto jj = 40; jj < 44; jj++)
+            SetHeight(
+                sim_out, ii, jj, NAN, 0.7, 0.9, NAN, NAN, NAN, NAN, NAN, NAN);
+    std::vector<std::vector<float>> terrain_init(
+        sim_out->terrain_.size(),
+        std::vector<float>(sim_out->terrain_[0].size()));
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            terrain_init[ii][jj] = sim_out->terrain_[ii][jj];
+    soil_simulator::RelaxTerrainMultigrid(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_EQ(CountSoil(sim_out), init_soil);
+    EXPECT_GT(sim_out->terrain_[40][32], 1e-5);
+    for (auto ii = 40; ii < 44; ii++)
+        for (auto jj = 40; jj < 44; jj++)
+            EXPECT_EQ(sim_out->terrain_[ii][jj], terrain_init[ii][jj]);
+
+    // Test: RE-RTM-4
+    delete sim_out;
+    sim_out = new soil_simulator::SimOut(grid);
+    sim_out->terrain_[40][40] = 0.6;
+    sim_out->terrain_[41][40] = 0.3;
+    soil_simulator::RelaxTerrainMultigrid(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_NEAR(sim_out->terrain_[40][40], 0.6, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[41][40], 0.3, 1e-5);
+    EXPECT_EQ(CountSoil(sim_out), 90);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 0);
+
+    // Test: RE-RTM-5
+    // The pile is smaller than a block of the coarsest grid
+    delete sim_out;
+    sim_out = new soil_simulator::SimOut(grid);
+    SetPile(sim_out);
+    soil_simulator::RelaxTerrainMultigrid(
+        sim_out, area, grid, sim_param_5, &workspace);
+    EXPECT_EQ(CountSoil(sim_out), init_soil);
+    EXPECT_LT(sim_out->terrain_[40][40], 0.6 - 1e-5);
+    n_sweep = 0;
+    for (auto it = 0; it < 500; it++) {
+        soil_simulator::rng.seed(400 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out, grid, bucket, sim_param_5, 1e-5, &workspace);
+        n_sweep++;
+        if (sim_out->equilibrium_)
+            break;
+    }
+    EXPECT_TRUE(sim_out->equilibrium_);
+    EXPECT_LT(n_sweep, n_sweep_0);
+    EXPECT_EQ(CountSoil(sim_out), init_soil);
+
+    delete bucket;
+    delete sim_out;
+    delete sim_out_0;
+}
+
+TEST(UnitTestRelax, SettleTerrain) {
+    // Setting up the environment
+    soil_simulator::Grid grid(2.0, 2.0, 2.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    bucket->pos_ = {0.0, 0.0, 0.0};
+    bucket->ori_ = {1.0, 0.0, 0.0, 0.0};
+    soil_simulator::SimParam sim_param(0.785, 3, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::Workspace workspace;
+    int area[2][2] = {{8, 72}, {8, 72}};
+    int dh_cell = 5;
+    bool modified;
+
+    // Creating a lambda function to count the soil in number of cell_size_z
+    auto CountSoil = [&](soil_simulator::SimOut* sim_out) {
+        std::int64_t n_soil = 0;
+        for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+                n_soil += std::lround(sim_out->terrain_[ii][jj] / 0.01);
+        return n_soil;
+    };
+
+    // Creating a lambda function to calculate the maximum height difference
+    // between adjacent cells, in number of cell_size_z
+    auto CalcMaxSlope = [&](soil_simulator::SimOut* sim_out) {
+        int dh = 0;
+        for (auto ii = 1; ii < sim_out->terrain_.size(); ii++)
+            for (auto jj = 1; jj < sim_out->terrain_[0].size(); jj++) {
+                int h = std::lround(sim_out->terrain_[ii][jj] / 0.01);
+                int h_x = std::lround(sim_out->terrain_[ii-1][jj] / 0.01);
+                int h_y = std::lround(sim_out->terrain_[ii][jj-1] / 0.01);
+                dh = std::max({dh, std::abs(h - h_x), std::abs(h - h_y)});
+            }
+        return dh;
+    };
+
+    // Test: RE-ST-1
+    sim_out->terrain_[40][40] = 1.0;
+    sim_out->terrain_[41][40] = 0.5;
+    modified = soil_simulator::SettleTerrain(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_TRUE(modified);
+    EXPECT_FALSE(sim_out->equilibrium_);
+    EXPECT_EQ(CountSoil(sim_out), 150);
+    EXPECT_LT(sim_out->terrain_[40][40], 0.5);
+    EXPECT_LE(CalcMaxSlope(sim_out), dh_cell + 1);
+    EXPECT_GT(sim_out->dirty_cells_.size(), 0);
+
+    // Test: RE-ST-2
+    int n_sweep = 0;
+    sim_out->impact_area_[0][0] = 2;
+    sim_out->impact_area_[0][1] = 79;
+    sim_out->impact_area_[1][0] = 2;
+    sim_out->impact_area_[1][1] = 79;
+    for (auto it = 0; it < 10; it++) {
+        soil_simulator::rng.seed(500 + it);
+        soil_simulator::RelaxTerrain(
+            sim_out, grid, bucket, sim_param, 1e-5, &workspace);
+        n_sweep++;
+        if (sim_out->equilibrium_)
+            break;
+    }
+    EXPECT_TRUE(sim_out->equilibrium_);
+    EXPECT_LE(n_sweep, 3);
+    EXPECT_EQ(CountSoil(sim_out), 150);
+
+    // Test: RE-ST-3
+    sim_out->dirty_cells_.clear();
+    modified = soil_simulator::SettleTerrain(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_FALSE(modified);
+    EXPECT_EQ(sim_out->dirty_cells_.size(), 0);
+    delete sim_out;
+
+    // Test: RE-ST-4
+    sim_out = new soil_simulator::SimOut(grid);
+    sim_out->terrain_[40][40] = 1.0;
+    SetHeight(sim_out, 40, 42, NAN, 0.2, 0.4, NAN, NAN, NAN, NAN, NAN, NAN);
+    SetHeight(sim_out, 41, 42, NAN, 0.2, 0.4, NAN, NAN, NAN, NAN, NAN, NAN);
+    SetHeight(sim_out, 39, 42, NAN, 0.2, 0.4, NAN, NAN, NAN, NAN, NAN, NAN);
+    modified = soil_simulator::SettleTerrain(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_TRUE(modified);
+    EXPECT_EQ(CountSoil(sim_out), 100);
+    EXPECT_EQ(sim_out->terrain_[40][42], 0.0);
+    EXPECT_EQ(sim_out->terrain_[41][42], 0.0);
+    EXPECT_EQ(sim_out->terrain_[39][42], 0.0);
+    EXPECT_GT(sim_out->terrain_[40][38], 0.0);
+
+    // Test: RE-ST-5
+    delete sim_out;
+    sim_out = new soil_simulator::SimOut(grid);
+    sim_out->terrain_[40][40] = 1.0;
+    int small_area[2][2] = {{38, 43}, {38, 43}};
+    modified = soil_simulator::SettleTerrain(
+        sim_out, small_area, grid, sim_param, &workspace);
+    EXPECT_TRUE(modified);
+    EXPECT_EQ(CountSoil(sim_out), 100);
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            if ((ii < 38) || (ii >= 43) || (jj < 38) || (jj >= 43))
+                EXPECT_EQ(sim_out->terrain_[ii][jj], 0.0);
+
+    // Test: RE-ST-6
+    delete sim_out;
+    sim_out = new soil_simulator::SimOut(grid);
+    sim_out->terrain_[20][20] = 1.0;
+    sim_out->terrain_[60][60] = 0.5;
+    modified = soil_simulator::SettleTerrain(
+        sim_out, area, grid, sim_param, &workspace);
+    EXPECT_TRUE(modified);
+    std::int64_t n_soil_1 = 0;
+    std::int64_t n_soil_2 = 0;
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++) {
+            if (ii + jj < 80)
+                n_soil_1 += std::lround(sim_out->terrain_[ii][jj] / 0.01);
+            else
+                n_soil_2 += std::lround(sim_out->terrain_[ii][jj] / 0.01);
+        }
+    EXPECT_EQ(n_soil_1, 100);
+    EXPECT_EQ(n_soil_2, 50);
+    EXPECT_GT(sim_out->terrain_[60][60], 0.0);
+    EXPECT_LE(CalcMaxSlope(sim_out), dh_cell + 1);
 
     delete bucket;
     delete sim_out;
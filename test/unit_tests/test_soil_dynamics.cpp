@@ -0,0 +1,190 @@
+/*
+This file implements unit tests for the functions in soil_dynamics.cpp.
+
+Copyright, 2023, Vilella Kenny.
+*/
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "soil_simulator/soil_dynamics.hpp"
+#include "soil_simulator/types.hpp"
+#include "soil_simulator/utils.hpp"
+
+TEST(UnitTestSoilDynamics, Step) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::Bucket *bucket_b = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(0.85, 1000, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_b = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim(1234);
+    soil_simulator::SoilDynamics sim_b(1234);
+    std::vector<float> pos = {0.2, 0.0, 0.6};
+    std::vector<float> ori = {1.0, 0.0, 0.0, 0.0};
+    float tol = 1.e-5;
+
+    // Setting a pile of soil away from the bucket
+    for (auto ii = 8; ii < 15; ii++)
+        for (auto jj = 17; jj < 24; jj++) {
+            sim_out->terrain_[ii][jj] = 0.3;
+            sim_out_b->terrain_[ii][jj] = 0.3;
+        }
+
+    // Test: SD-S-1
+    sim.Step(sim_out, pos, ori, grid, bucket, sim_param, tol);
+    EXPECT_TRUE(sim_out->equilibrium_);
+    sim_b.Step(sim_out_b, pos, ori, grid, bucket_b, sim_param, tol, 1.e-9);
+    EXPECT_NE(sim_b.RelaxDebt(sim_out_b), 0);
+    EXPECT_FALSE(sim_out_b->equilibrium_);
+    // Resuming the relaxation at the same pose until it is completed
+    int n_step = 1;
+    while (
+        !sim_out_b->equilibrium_ && (sim_b.RelaxDebt(sim_out_b) != 0) &&
+        (n_step < 1000)
+    ) {
+        EXPECT_TRUE(sim_b.Step(
+            sim_out_b, pos, ori, grid, bucket_b, sim_param, tol, 1.e-9));
+        n_step++;
+    }
+    EXPECT_GT(n_step, 1);
+    EXPECT_LT(n_step, 1000);
+    EXPECT_TRUE(sim_out_b->equilibrium_);
+    for (auto ii = 0; ii < sim_out->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out->terrain_[0].size(); jj++)
+            EXPECT_EQ(sim_out->terrain_[ii][jj], sim_out_b->terrain_[ii][jj]);
+    EXPECT_EQ(
+        sim_out->body_soil_pos_.size(), sim_out_b->body_soil_pos_.size());
+
+    // Test: SD-S-2
+    soil_simulator::SimParam sim_param_4(0.85, 1000, 4, 4);
+    soil_simulator::SimOut *sim_out_1 = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_4 = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim_1(1234);
+    soil_simulator::SoilDynamics sim_4(1234);
+    for (auto ii = 8; ii < 15; ii++)
+        for (auto jj = 17; jj < 24; jj++) {
+            sim_out_1->terrain_[ii][jj] = 0.3;
+            sim_out_4->terrain_[ii][jj] = 0.3;
+        }
+    // Moving the bucket through the terrain
+    for (auto it = 0; it < 5; it++) {
+        std::vector<float> pos_it = {-0.3f + 0.1f * it, 0.0, 0.35};
+        sim_1.Step(sim_out_1, pos_it, ori, grid, bucket, sim_param, tol);
+        sim_4.Step(sim_out_4, pos_it, ori, grid, bucket_b, sim_param_4, tol);
+    }
+    EXPECT_GT(sim_out_1->body_soil_pos_.size(), 0);
+    for (auto ii = 0; ii < sim_out_1->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_1->terrain_[0].size(); jj++) {
+            EXPECT_EQ(sim_out_1->terrain_[ii][jj], sim_out_4->terrain_[ii][jj]);
+            for (auto ind = 0; ind < 4; ind++)
+                EXPECT_EQ(
+                    sim_out_1->body_soil_[ind][ii][jj],
+                    sim_out_4->body_soil_[ind][ii][jj]);
+        }
+    EXPECT_EQ(
+        sim_out_1->body_soil_pos_.size(), sim_out_4->body_soil_pos_.size());
+
+    // Test: SD-S-3
+    soil_simulator::SimParam sim_param_i(
+        0.85, 1000, 4, 1, soil_simulator::RelaxMode::kSequential, 0, false,
+        true);
+    soil_simulator::SimOut *sim_out_i = new soil_simulator::SimOut(grid);
+    soil_simulator::SimOut *sim_out_f = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim_i(1234);
+    soil_simulator::SoilDynamics sim_f(1234);
+    soil_simulator::Bucket *bucket_i = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::Bucket *bucket_f = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    for (auto ii = 0; ii < sim_out_i->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_i->terrain_[0].size(); jj++) {
+            sim_out_i->terrain_[ii][jj] = 0.01 * ((3 * ii + 7 * jj) % 5);
+            sim_out_f->terrain_[ii][jj] = 0.01 * ((3 * ii + 7 * jj) % 5);
+        }
+    soil_simulator::InitSoilVolume(sim_out_i);
+    soil_simulator::InitSoilVolume(sim_out_f);
+    int init_volume = 0;
+    for (auto ii = 0; ii < sim_out_i->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_i->terrain_[0].size(); jj++)
+            init_volume += (3 * ii + 7 * jj) % 5;
+    // Digging through the terrain with and without incremental body update
+    for (auto it = 0; it < 10; it++) {
+        std::vector<float> pos_it = {
+            -0.6f + 0.02f * it, 0.0f, 0.45f - 0.005f * it};
+        sim_i.Step(
+            sim_out_i, pos_it, ori, grid, bucket_i, sim_param_i, tol);
+        sim_f.Step(sim_out_f, pos_it, ori, grid, bucket_f, sim_param, tol);
+        EXPECT_TRUE(sim_i.Check(sim_out_i, init_volume, grid, tol, true));
+        EXPECT_TRUE(sim_f.Check(sim_out_f, init_volume, grid, tol, true));
+    }
+    EXPECT_GT(sim_out_i->body_soil_pos_.size(), 0);
+    for (auto ii = 0; ii < sim_out_i->terrain_.size(); ii++)
+        for (auto jj = 0; jj < sim_out_i->terrain_[0].size(); jj++) {
+            EXPECT_EQ(sim_out_i->terrain_[ii][jj], sim_out_f->terrain_[ii][jj]);
+            for (auto ind = 0; ind < 4; ind++)
+                EXPECT_EQ(
+                    sim_out_i->body_soil_[ind][ii][jj],
+                    sim_out_f->body_soil_[ind][ii][jj]);
+        }
+    EXPECT_EQ(
+        sim_out_i->body_soil_pos_.size(), sim_out_f->body_soil_pos_.size());
+
+    delete bucket;
+    delete bucket_b;
+    delete sim_out;
+    delete sim_out_b;
+    delete sim_out_1;
+    delete sim_out_4;
+    delete bucket_i;
+    delete bucket_f;
+    delete sim_out_i;
+    delete sim_out_f;
+}
+
+TEST(UnitTestSoilDynamics, Check) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.05, 0.01);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimParam sim_param(0.85, 1000, 4);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    soil_simulator::SoilDynamics sim(1234);
+    std::vector<float> pos = {0.2, 0.0, 0.6};
+    std::vector<float> ori = {1.0, 0.0, 0.0, 0.0};
+    float tol = 1.e-5;
+
+    // Setting a pile of soil away from the bucket
+    for (auto ii = 8; ii < 15; ii++)
+        for (auto jj = 17; jj < 24; jj++)
+            sim_out->terrain_[ii][jj] = 0.3;
+    soil_simulator::InitSoilVolume(sim_out);
+    int init_volume = 49 * 30;
+
+    // Test: SD-C-1
+    sim.Step(sim_out, pos, ori, grid, bucket, sim_param, tol);
+    EXPECT_TRUE(sim.Check(sim_out, init_volume, grid, tol));
+    EXPECT_TRUE(sim.Check(sim_out, init_volume, grid, tol, true));
+
+    // Test: SD-C-2
+    // Creating soil without updating the soil volume ledger
+    sim_out->terrain_[11][20] += 0.05;
+    EXPECT_TRUE(sim.Check(sim_out, init_volume, grid, tol));
+    testing::internal::CaptureStdout();
+    EXPECT_FALSE(sim.Check(sim_out, init_volume, grid, tol, true));
+    std::string warning_msg = testing::internal::GetCapturedStdout();
+    EXPECT_NE(warning_msg.find("Volume is not conserved"), std::string::npos);
+
+    delete bucket;
+    delete sim_out;
+}
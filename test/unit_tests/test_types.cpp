@@ -3,9 +3,13 @@ This file implements unit tests for the classes in types.cpp.
 
 Copyright, 2023, Vilella Kenny.
 */
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <exception>
 #include <iostream>
+#include <random>
 #include "gtest/gtest.h"
 #include "soil_simulator/types.hpp"
 
@@ -233,12 +237,188 @@ TEST(UnitTestTypes, Blade) {
         std::invalid_argument);
 }
 
+TEST(UnitTestTypes, MeshBody) {
+    // Setting up the environment
+    std::vector<float> vect_2 = {0.0, 0.1};
+    std::vector<float> o_pos = {0.0, 0.1, 0.0};
+    std::vector<std::vector<float>> vertices = {
+        {0.0, 0.1, 0.0}, {0.5, 0.1, 0.0}, {0.0, 0.6, 0.0}, {0.0, 0.1, 0.5}};
+    std::vector<std::vector<int>> triangles = {
+        {0, 2, 1}, {0, 1, 3}, {0, 3, 2}, {1, 2, 3}};
+
+    // Test: TY-Me-1
+    soil_simulator::MeshBody mesh(o_pos, vertices, triangles);
+    EXPECT_EQ(mesh.vertices_.size(), 4);
+    for (auto nn = 0; nn < 4; nn++) {
+        EXPECT_NEAR(mesh.vertices_[nn][0], vertices[nn][0], 1e-8);
+        EXPECT_NEAR(mesh.vertices_[nn][1], vertices[nn][1] - o_pos[1], 1e-8);
+        EXPECT_NEAR(mesh.vertices_[nn][2], vertices[nn][2], 1e-8);
+    }
+    EXPECT_NEAR(mesh.j_pos_init_[0], 0.0, 1e-8);
+    EXPECT_NEAR(mesh.j_pos_init_[1], 0.25, 1e-8);
+    EXPECT_NEAR(mesh.j_pos_init_[2], 1.0, 1e-8);
+    EXPECT_NEAR(mesh.b_pos_init_[0], 0.0, 1e-8);
+    EXPECT_NEAR(mesh.b_pos_init_[1], 0.25, 1e-8);
+    EXPECT_NEAR(mesh.b_pos_init_[2], 0.0, 1e-8);
+    EXPECT_NEAR(mesh.t_pos_init_[0], 1.0, 1e-8);
+    EXPECT_NEAR(mesh.t_pos_init_[1], 0.25, 1e-8);
+    EXPECT_NEAR(mesh.t_pos_init_[2], 0.0, 1e-8);
+    EXPECT_NEAR(mesh.width_, 0.5, 1e-8);
+    for (auto ii = 0 ; ii < 3 ; ii++)
+        EXPECT_EQ(mesh.pos_[ii], 0.0);
+    for (auto ii = 0 ; ii < 4 ; ii++)
+        EXPECT_EQ(mesh.ori_[ii], 0.0);
+    std::vector<std::array<int, 3>> mesh_triangles = mesh.triangles_;
+    std::vector<std::array<int, 3>> exp_triangles = {
+        {0, 2, 1}, {0, 1, 3}, {0, 3, 2}, {1, 2, 3}};
+    std::sort(mesh_triangles.begin(), mesh_triangles.end());
+    std::sort(exp_triangles.begin(), exp_triangles.end());
+    EXPECT_EQ(mesh_triangles, exp_triangles);
+    EXPECT_EQ(mesh.bvh_.size(), 1);
+    EXPECT_EQ(mesh.bvh_[0].first, 0);
+    EXPECT_EQ(mesh.bvh_[0].count, 4);
+
+    // Test: TY-Me-2
+    // Tessellating a box with 2 * 8 * 8 triangles per face
+    int n_div = 8;
+    std::vector<std::vector<float>> box_vertices;
+    std::vector<std::vector<int>> box_triangles;
+    auto AddFace = [&](int axis, float side) {
+        int ind = box_vertices.size();
+        int axis_1 = (axis + 1) % 3;
+        int axis_2 = (axis + 2) % 3;
+        for (auto ii = 0; ii < n_div + 1; ii++)
+            for (auto jj = 0; jj < n_div + 1; jj++) {
+                std::vector<float> vertex(3);
+                vertex[axis] = side;
+                vertex[axis_1] = static_cast<float>(ii) / n_div;
+                vertex[axis_2] = static_cast<float>(jj) / n_div;
+                box_vertices.push_back(vertex);
+            }
+        for (auto ii = 0; ii < n_div; ii++)
+            for (auto jj = 0; jj < n_div; jj++) {
+                int a = ind + ii * (n_div + 1) + jj;
+                int b = a + n_div + 1;
+                box_triangles.push_back({a, b, b + 1});
+                box_triangles.push_back({a, b + 1, a + 1});
+            }
+    };
+    for (auto axis = 0; axis < 3; axis++) {
+        AddFace(axis, 0.0);
+        AddFace(axis, 1.0);
+    }
+    // Merging the duplicated vertices at the edges of the faces
+    std::vector<int> vertex_ind(box_vertices.size());
+    std::vector<std::vector<float>> unique_vertices;
+    for (auto nn = 0; nn < box_vertices.size(); nn++) {
+        auto it = std::find(
+            unique_vertices.begin(), unique_vertices.end(), box_vertices[nn]);
+        vertex_ind[nn] = it - unique_vertices.begin();
+        if (it == unique_vertices.end())
+            unique_vertices.push_back(box_vertices[nn]);
+    }
+    for (auto& triangle : box_triangles)
+        for (auto& ind : triangle)
+            ind = vertex_ind[ind];
+    soil_simulator::MeshBody box(
+        {0.0, 0.0, 0.0}, unique_vertices, box_triangles);
+    std::vector<int> n_visit(box_triangles.size(), 0);
+    for (auto nn = 0; nn < box.bvh_.size(); nn++) {
+        const auto& node = box.bvh_[nn];
+        if (node.count > 0) {
+            // Checking that the leaf contains its triangles
+            EXPECT_LE(node.count, soil_simulator::MeshBody::kLeafSize);
+            for (auto mm = node.first; mm < node.first + node.count; mm++) {
+                n_visit[mm]++;
+                for (auto kk = 0; kk < 3; kk++)
+                    for (auto ii = 0; ii < 3; ii++) {
+                        float pos = box.vertices_[box.triangles_[mm][kk]][ii];
+                        EXPECT_LE(node.box_min[ii], pos);
+                        EXPECT_GE(node.box_max[ii], pos);
+                    }
+            }
+        } else {
+            // Checking that the node contains its two children
+            for (auto child : {nn + 1, node.first})
+                for (auto ii = 0; ii < 3; ii++) {
+                    EXPECT_LE(node.box_min[ii], box.bvh_[child].box_min[ii]);
+                    EXPECT_GE(node.box_max[ii], box.bvh_[child].box_max[ii]);
+                }
+        }
+    }
+    for (auto nn = 0; nn < n_visit.size(); nn++)
+        EXPECT_EQ(n_visit[nn], 1);
+
+    // Test: TY-Me-3
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(vect_2, vertices, triangles),
+        std::invalid_argument);
+
+    // Test: TY-Me-4
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos,
+            {{0.0, 0.1, 0.0}, {0.5, 0.1, 0.0}, {0.0, 0.6}, {0.0, 0.1, 0.5}},
+            triangles),
+        std::invalid_argument);
+
+    // Test: TY-Me-5
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos, vertices, {{0, 2, 1}, {0, 1, 3}, {0, 3}, {1, 2, 3}}),
+        std::invalid_argument);
+
+    // Test: TY-Me-6
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos, vertices, {{0, 2, 1}, {0, 1, 3}, {0, 3, 4}, {1, 2, 3}}),
+        std::invalid_argument);
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos, vertices, {{0, 2, 1}, {0, 1, 3}, {0, 3, -1}, {1, 2, 3}}),
+        std::invalid_argument);
+
+    // Test: TY-Me-7
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos, vertices, {{0, 2, 1}, {0, 1, 3}, {0, 3, 3}, {1, 2, 3}}),
+        std::invalid_argument);
+
+    // Test: TY-Me-8
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos, vertices, {{0, 2, 1}, {0, 1, 3}, {1, 2, 3}}),
+        std::invalid_argument);
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(o_pos, vertices, {}),
+        std::invalid_argument);
+
+    // Test: TY-Me-9
+    EXPECT_THROW(
+        soil_simulator::MeshBody mesh(
+            o_pos, {{0.0, 0.1, 0.0}, {0.5, 0.1, 0.0}, {0.0, 0.6, 0.0},
+            {0.5, 0.6, 0.0}}, triangles),
+        std::invalid_argument);
+}
+
 TEST(UnitTestTypes, SimParam) {
     // Test: TY-SP-1
-    soil_simulator::SimParam sim_param(0.85, 5, 4);
+    soil_simulator::SimParam sim_param(
+        0.85, 5, 4, 2, soil_simulator::RelaxMode::kFlux, 3, true, true);
     EXPECT_NEAR(sim_param.repose_angle_, 0.85, 1e-7);
     EXPECT_EQ(sim_param.max_iterations_, 5);
     EXPECT_EQ(sim_param.cell_buffer_, 4);
+    EXPECT_EQ(sim_param.n_thread_, 2);
+    EXPECT_EQ(sim_param.relax_mode_, soil_simulator::RelaxMode::kFlux);
+    EXPECT_EQ(sim_param.multigrid_levels_, 3);
+    EXPECT_TRUE(sim_param.fast_settle_);
+    EXPECT_TRUE(sim_param.incremental_body_);
+    soil_simulator::SimParam sim_param_default;
+    EXPECT_EQ(
+        sim_param_default.relax_mode_, soil_simulator::RelaxMode::kSequential);
+    EXPECT_EQ(sim_param_default.multigrid_levels_, 0);
+    EXPECT_FALSE(sim_param_default.fast_settle_);
+    EXPECT_FALSE(sim_param_default.incremental_body_);
 
     // Test: TY-SP-2
     EXPECT_THROW(
@@ -258,6 +438,502 @@ TEST(UnitTestTypes, SimParam) {
     EXPECT_THROW(
         soil_simulator::SimParam sim_param(0.85, 5, 1),
         std::invalid_argument);
+
+    // Test: TY-SP-5
+    EXPECT_THROW(
+        soil_simulator::SimParam sim_param(0.85, 5, 4, 0),
+        std::invalid_argument);
+
+    // Test: TY-SP-6
+    EXPECT_THROW(
+        soil_simulator::SimParam sim_param(
+            0.85, 5, 4, 1, soil_simulator::RelaxMode::kSequential, -1),
+        std::invalid_argument);
+}
+
+TEST(UnitTestTypes, TiledArray2D) {
+    // Test: TY-TA-1
+    soil_simulator::TiledArray2D<float> array(150, 70, 0.2);
+    EXPECT_EQ(array.size(), 150);
+    EXPECT_EQ(array[0].size(), 70);
+    EXPECT_EQ(array.AllocatedTiles(), 0);
+    const auto& const_array = array;
+    EXPECT_NEAR(const_array[149][69], 0.2, 1e-8);
+    EXPECT_EQ(array.AllocatedTiles(), 0);
+
+    // Test: TY-TA-2
+    array[100][10] = 0.5;
+    EXPECT_EQ(array.AllocatedTiles(), 1);
+    EXPECT_TRUE(array.IsAllocated(64, 0));
+    EXPECT_TRUE(array.IsAllocated(127, 63));
+    EXPECT_FALSE(array.IsAllocated(0, 0));
+    EXPECT_NEAR(array[100][10], 0.5, 1e-8);
+    EXPECT_NEAR(array[100][11], 0.2, 1e-8);
+    array[149][69] += 0.1;
+    EXPECT_EQ(array.AllocatedTiles(), 2);
+    EXPECT_NEAR(const_array[149][69], 0.3, 1e-6);
+
+    // Test: TY-TA-3
+    array.Fill(0.0);
+    EXPECT_EQ(array.AllocatedTiles(), 0);
+    array.SetGenerator([](int ii, int jj) { return 0.01 * (ii + jj); });
+    EXPECT_NEAR(const_array[10][20], 0.3, 1e-6);
+    EXPECT_EQ(array.AllocatedTiles(), 0);
+    array[10][21] += 0.1;
+    EXPECT_EQ(array.AllocatedTiles(), 1);
+    EXPECT_NEAR(array[10][20], 0.3, 1e-6);
+    EXPECT_NEAR(array[10][21], 0.41, 1e-6);
+    EXPECT_NEAR(array[63][63], 1.26, 1e-6);
+
+    // Test: TY-TA-4
+    float value = array[140][60];
+    EXPECT_NEAR(value, 2.0, 1e-6);
+    EXPECT_EQ(array.AllocatedTiles(), 1);
+    array[140][60] = array[10][21];
+    EXPECT_EQ(array.AllocatedTiles(), 2);
+    EXPECT_NEAR(const_array[140][60], 0.41, 1e-6);
+    array.Allocate(100, 5);
+    EXPECT_EQ(array.AllocatedTiles(), 3);
+    EXPECT_TRUE(array.IsAllocated(100, 5));
+    EXPECT_NEAR(const_array[100][5], 1.05, 1e-6);
+}
+
+TEST(UnitTestTypes, SparseArray3D) {
+    // Test: TY-SA-1
+    soil_simulator::SparseArray3D<float> array(4, 150, 70);
+    EXPECT_EQ(array.size(), 4);
+    EXPECT_EQ(array[0].size(), 150);
+    EXPECT_EQ(array[0][0].size(), 70);
+    EXPECT_EQ(array.StoredCells(), 0);
+    const auto& const_array = array;
+    EXPECT_NEAR(const_array[3][149][69], 0.0, 1e-8);
+    EXPECT_FALSE(array.Contains(149, 69));
+    EXPECT_EQ(array.StoredCells(), 0);
+
+    // Test: TY-SA-2
+    array[1][100][10] = 0.5;
+    array[3][100][10] = 0.7;
+    EXPECT_EQ(array.StoredCells(), 1);
+    EXPECT_TRUE(array.Contains(100, 10));
+    EXPECT_FALSE(array.Contains(10, 100));
+    float cell[4];
+    array.LoadCell(100, 10, cell);
+    EXPECT_NEAR(cell[0], 0.0, 1e-8);
+    EXPECT_NEAR(cell[1], 0.5, 1e-5);
+    EXPECT_NEAR(cell[2], 0.0, 1e-8);
+    EXPECT_NEAR(cell[3], 0.7, 1e-5);
+    array[0][101][10] += 0.1;
+    EXPECT_EQ(array.StoredCells(), 2);
+    EXPECT_NEAR(const_array[0][101][10], 0.1, 1e-5);
+
+    // Test: TY-SA-3
+    array.ClearCell(100, 10);
+    EXPECT_EQ(array.StoredCells(), 1);
+    EXPECT_FALSE(array.Contains(100, 10));
+    EXPECT_NEAR(const_array[1][100][10], 0.0, 1e-8);
+    array.Fill(0.0);
+    EXPECT_EQ(array.StoredCells(), 0);
+
+    // Test: TY-SA-4
+    float value = array[2][50][50];
+    EXPECT_NEAR(value, 0.0, 1e-8);
+    EXPECT_EQ(array.StoredCells(), 0);
+    array[2][50][50] = 0.0;
+    EXPECT_EQ(array.StoredCells(), 0);
+    array[0][50][50] = 0.2;
+    array[2][50][50] = 0.3;
+    EXPECT_EQ(array.StoredCells(), 1);
+    array[0][50][50] -= 0.2;
+    EXPECT_EQ(array.StoredCells(), 1);
+    array[2][50][50] = 0.0;
+    EXPECT_EQ(array.StoredCells(), 0);
+    EXPECT_FALSE(array.Contains(50, 50));
+
+    // Test: TY-SA-5
+    array.Fill(0.1);
+    EXPECT_NEAR(array[1][20][20], 0.1, 1e-8);
+    EXPECT_EQ(array.StoredCells(), 0);
+    array[1][20][20] = 0.4;
+    array.LoadCell(20, 20, cell);
+    EXPECT_NEAR(cell[0], 0.1, 1e-8);
+    EXPECT_NEAR(cell[1], 0.4, 1e-8);
+    array[1][20][20] = 0.1;
+    EXPECT_EQ(array.StoredCells(), 0);
+
+    // Test: TY-SA-6
+    array.Fill(0.0);
+    array[0][10][10] = 0.2;
+    array[3][140][60] = 0.3;
+    EXPECT_EQ(array.PoolSize(), 2);
+    array.ClearCell(10, 10);
+    array[2][70][30] = 0.5;
+    EXPECT_EQ(array.StoredCells(), 2);
+    EXPECT_EQ(array.PoolSize(), 2);
+    array.LoadCell(70, 30, cell);
+    EXPECT_NEAR(cell[0], 0.0, 1e-8);
+    EXPECT_NEAR(cell[1], 0.0, 1e-8);
+    EXPECT_NEAR(cell[2], 0.5, 1e-5);
+    EXPECT_NEAR(cell[3], 0.0, 1e-8);
+    EXPECT_NEAR(const_array[3][140][60], 0.3, 1e-5);
+    EXPECT_NEAR(const_array[0][10][10], 0.0, 1e-8);
+}
+
+TEST(UnitTestTypes, FixedPointHeight) {
+    // Test: TY-FPH-1
+    using height_t = soil_simulator::FixedPointHeight<int16_t>;
+    soil_simulator::Array2D<height_t> array(2, 2, 0.0, 0.01);
+    const auto& const_array = array;
+    EXPECT_EQ(array.data()[0].count(), 0);
+    EXPECT_NEAR(array[0][0], 0.0, 1e-8);
+    array[0][0] = 0.3;
+    EXPECT_EQ(array.data()[0].count(), 30);
+    EXPECT_NEAR(const_array[0][0], 0.3, 1e-5);
+
+    // Test: TY-FPH-2
+    array[0][0] = 0.3049;
+    EXPECT_EQ(array.data()[0].count(), 30);
+    array[0][0] = -0.2051;
+    EXPECT_EQ(array.data()[0].count(), -21);
+
+    // Test: TY-FPH-3
+    array[0][0] = 0.3;
+    array[0][0] += 0.1;
+    EXPECT_EQ(array.data()[0].count(), 40);
+    array[0][0] -= 0.5;
+    EXPECT_EQ(array.data()[0].count(), -10);
+    EXPECT_NEAR(array[0][0] + 0.2, 0.1, 1e-5);
+    EXPECT_TRUE(array[0][0] < 0.0);
+
+    // Test: TY-FPH-4
+    array[0][1] = 1000.0;
+    EXPECT_EQ(array.data()[1].count(), 32767);
+    array[0][1] = -1000.0;
+    EXPECT_EQ(array.data()[1].count(), -32768);
+    EXPECT_EQ(height_t::FromMeters(1e9, 0.01).count(), 32767);
+
+    // Test: TY-FPH-5
+    soil_simulator::Array3D<height_t> other(2, 2, 2, 0.0,
+        soil_simulator::ArrayLayout::kLayerMajor, 0.05);
+    other[1][0][0] = 0.3;
+    EXPECT_NEAR(other[1][0][0], 0.3, 1e-5);
+    EXPECT_NEAR(array[0][0], -0.1, 1e-5);
+    array[1][1] = 0.3;
+    EXPECT_EQ(array.data()[array.stride() + 1].count(), 30);
+    float cell[2];
+    other.LoadCell(0, 0, cell);
+    EXPECT_NEAR(cell[1], 0.3, 1e-5);
+    EXPECT_NEAR(other.Quantize(0.32), 0.3, 1e-5);
+}
+
+TEST(UnitTestTypes, Vec3) {
+    // Test: TY-V3-1
+    std::vector<float> a_vec = {0.1, -0.2, 0.3};
+    auto a = soil_simulator::Vec3::FromVector(a_vec);
+    EXPECT_NEAR(a[0], 0.1, 1e-5);
+    EXPECT_NEAR(a[1], -0.2, 1e-5);
+    EXPECT_NEAR(a[2], 0.3, 1e-5);
+    std::vector<float> b_vec = a;
+    EXPECT_EQ(b_vec, a_vec);
+
+    // Test: TY-V3-2
+    soil_simulator::Vec3 b = {0.5f, 0.5f, -0.5f};
+    auto c = a + b;
+    EXPECT_NEAR(c[0], 0.6, 1e-5);
+    EXPECT_NEAR(c[1], 0.3, 1e-5);
+    EXPECT_NEAR(c[2], -0.2, 1e-5);
+    c = a - b;
+    EXPECT_NEAR(c[0], -0.4, 1e-5);
+    EXPECT_NEAR(c[1], -0.7, 1e-5);
+    EXPECT_NEAR(c[2], 0.8, 1e-5);
+}
+
+TEST(UnitTestTypes, Quat) {
+    // Test: TY-Q-1
+    std::vector<float> q_vec = {0.8, -0.4, 0.2, 0.7};
+    auto q = soil_simulator::Quat::FromVector(q_vec);
+    EXPECT_NEAR(q[0], 0.8, 1e-5);
+    EXPECT_NEAR(q[1], -0.4, 1e-5);
+    EXPECT_NEAR(q[2], 0.2, 1e-5);
+    EXPECT_NEAR(q[3], 0.7, 1e-5);
+    std::vector<float> p_vec = q;
+    EXPECT_EQ(p_vec, q_vec);
+
+    // Test: TY-Q-2
+    auto q_conj = q.Conjugate();
+    EXPECT_NEAR(q_conj[0], 0.8, 1e-5);
+    EXPECT_NEAR(q_conj[1], 0.4, 1e-5);
+    EXPECT_NEAR(q_conj[2], -0.2, 1e-5);
+    EXPECT_NEAR(q_conj[3], -0.7, 1e-5);
+}
+
+TEST(UnitTestTypes, CellList) {
+    // Test: TY-CL-1
+    soil_simulator::CellList<3> cells;
+    EXPECT_TRUE(cells.empty());
+    cells.push_back({5, 7, 2});
+    cells.push_back({4, 9, 1});
+    EXPECT_EQ(cells.size(), 2);
+    EXPECT_EQ(cells[0][0], 5);
+    EXPECT_EQ(cells[0][1], 7);
+    EXPECT_EQ(cells[0][2], 2);
+    std::sort(cells.begin(), cells.end());
+    EXPECT_EQ(cells[0][0], 4);
+    EXPECT_EQ(cells[1][0], 5);
+
+    // Test: TY-CL-2
+    std::vector<std::vector<int>> cells_vec = cells;
+    std::vector<std::vector<int>> cells_exp = {{4, 9, 1}, {5, 7, 2}};
+    EXPECT_EQ(cells_vec, cells_exp);
+    soil_simulator::CellList<3> other = cells_vec;
+    EXPECT_EQ(other.size(), 2);
+    EXPECT_EQ(other[1][1], 7);
+
+    // Test: TY-CL-3
+    cells.Append(other);
+    EXPECT_EQ(cells.size(), 4);
+    EXPECT_EQ(cells[3][2], 2);
+    cells.clear();
+    EXPECT_TRUE(cells.empty());
+}
+
+TEST(UnitTestTypes, CellBitmap) {
+    // Test: TY-CB-1
+    soil_simulator::CellBitmap bitmap;
+    int area[2][2] = {{3, 6}, {10, 140}};
+    bitmap.Reset(area);
+    EXPECT_EQ(bitmap.Count(), 0);
+    EXPECT_FALSE(bitmap.begin() != bitmap.end());
+    bitmap.Set(5, 139);
+    bitmap.Set(3, 75);
+    bitmap.Set(5, 10);
+    bitmap.Set(3, 12);
+    bitmap.Set(3, 12);
+    EXPECT_EQ(bitmap.Count(), 4);
+    EXPECT_TRUE(bitmap.Test(3, 12));
+    EXPECT_TRUE(bitmap.Test(5, 139));
+    EXPECT_FALSE(bitmap.Test(4, 12));
+    EXPECT_FALSE(bitmap.Test(3, 13));
+
+    // Test: TY-CB-2
+    std::vector<std::vector<int>> cells;
+    for (auto cell : bitmap)
+        cells.push_back({cell[0], cell[1]});
+    std::vector<std::vector<int>> cells_exp = {
+        {3, 12}, {3, 75}, {5, 10}, {5, 139}};
+    EXPECT_EQ(cells, cells_exp);
+
+    // Test: TY-CB-3
+    bitmap.Reset(area);
+    bitmap.SetBlock(4, 74, (std::uint64_t(1) << 63) | 5);
+    cells.clear();
+    for (auto cell : bitmap)
+        cells.push_back({cell[0], cell[1]});
+    cells_exp = {{4, 74}, {4, 76}, {4, 137}};
+    EXPECT_EQ(cells, cells_exp);
+
+    // Test: TY-CB-4
+    bitmap.Reset(area);
+    for (auto ii = 3; ii < 6; ii++)
+        for (auto jj = 10; jj < 140; jj += 3)
+            bitmap.Set(ii, jj);
+    std::mt19937 gen(42);
+    std::vector<std::vector<int>> cells_random;
+    bitmap.ForEachRandom(
+        [&](int ii, int jj) { cells_random.push_back({ii, jj}); },
+        gen);
+    cells.clear();
+    for (auto cell : bitmap)
+        cells.push_back({cell[0], cell[1]});
+    EXPECT_EQ(cells_random.size(), bitmap.Count());
+    EXPECT_NE(cells_random, cells);
+    std::sort(cells_random.begin(), cells_random.end());
+    EXPECT_EQ(cells_random, cells);
+
+    // Test: TY-CB-5
+    bitmap.Reset(area);
+    bitmap.Set(4, 20);
+    gen.seed(42);
+    cells_random.clear();
+    bitmap.ForEachRandom(
+        [&](int ii, int jj) { cells_random.push_back({ii, jj}); },
+        gen);
+    cells_exp = {{4, 20}};
+    EXPECT_EQ(cells_random, cells_exp);
+    std::mt19937 rng_exp(42);
+    EXPECT_EQ(gen(), rng_exp());
+
+    // Test: TY-CB-6
+    int row_area[2][2] = {{4, 5}, {0, 64}};
+    bitmap.Reset(row_area);
+    bitmap.SetBlock(4, 0, ~std::uint64_t(0));
+    std::vector<int> n_first(64, 0);
+    int n_successor = 0;
+    for (auto it = 0; it < 640; it++) {
+        cells_random.clear();
+        bitmap.ForEachRandom(
+            [&](int ii, int jj) { cells_random.push_back({ii, jj}); },
+            gen);
+        n_first[cells_random[0][1]]++;
+        if (cells_random[1][1] == (cells_random[0][1] + 1) % 64)
+            n_successor++;
+    }
+    EXPECT_LT(*std::max_element(n_first.begin(), n_first.end()), 40);
+    EXPECT_LT(n_successor, 40);
+}
+
+TEST(UnitTestTypes, ActiveRegions) {
+    // Declaring variables
+    soil_simulator::ActiveRegions regions;
+    int area[2][2];
+
+    // Test: TY-AR-1
+    EXPECT_EQ(regions.size(), 0);
+    int area_1[2][2] = {{10, 20}, {30, 45}};
+    int area_2[2][2] = {{60, 70}, {30, 45}};
+    regions.Add(area_1);
+    regions.Add(area_2);
+    EXPECT_EQ(regions.size(), 2);
+    EXPECT_EQ(regions.Count(), 300);
+    regions.Get(1, area);
+    EXPECT_EQ(area[0][0], 60);
+    EXPECT_EQ(area[0][1], 70);
+    EXPECT_EQ(area[1][0], 30);
+    EXPECT_EQ(area[1][1], 45);
+
+    // Test: TY-AR-2
+    int area_3[2][2] = {{12, 15}, {32, 40}};
+    int area_4[2][2] = {{5, 5}, {0, 10}};
+    regions.Add(area_3);
+    regions.Add(area_4);
+    EXPECT_EQ(regions.size(), 2);
+    EXPECT_EQ(regions.Count(), 300);
+
+    // Test: TY-AR-3
+    int area_5[2][2] = {{18, 40}, {44, 50}};
+    regions.Add(area_5);
+    EXPECT_EQ(regions.size(), 2);
+    regions.Get(1, area);
+    EXPECT_EQ(area[0][0], 10);
+    EXPECT_EQ(area[0][1], 40);
+    EXPECT_EQ(area[1][0], 30);
+    EXPECT_EQ(area[1][1], 50);
+
+    // Test: TY-AR-4
+    int area_6[2][2] = {{40, 60}, {35, 36}};
+    regions.Add(area_6);
+    EXPECT_EQ(regions.size(), 1);
+    regions.Get(0, area);
+    EXPECT_EQ(area[0][0], 10);
+    EXPECT_EQ(area[0][1], 70);
+    EXPECT_EQ(area[1][0], 30);
+    EXPECT_EQ(area[1][1], 50);
+
+    // Test: TY-AR-5
+    regions.Clear();
+    EXPECT_EQ(regions.size(), 0);
+    EXPECT_EQ(regions.Count(), 0);
+}
+
+TEST(UnitTestTypes, ColumnBuffer) {
+    // Declaring variables
+    soil_simulator::ColumnBuffer columns;
+    std::vector<std::vector<int>> visited;
+    std::vector<std::vector<int>> visited_exp;
+    auto Visit = [&](int ii, int jj, int kk_min, int kk_max) {
+        visited.push_back({ii, jj, kk_min, kk_max});
+    };
+
+    // Test: TY-CO-1
+    int area[2][2] = {{2, 6}, {3, 8}};
+    columns.Reset(area);
+    columns.push_back({4, 5, 7});
+    columns.push_back({3, 7, 2});
+    columns.push_back({4, 5, 3});
+    columns.push_back({4, 5, 5});
+    columns.push_back({3, 3, 9});
+    columns.ForEachColumn(Visit);
+    visited_exp = {{3, 3, 9, 9}, {3, 7, 2, 2}, {4, 5, 3, 7}};
+    EXPECT_EQ(visited, visited_exp);
+
+    // Test: TY-CO-2
+    visited.clear();
+    columns.push_back({1, 5, 4});
+    columns.push_back({6, 5, 4});
+    columns.push_back({4, 2, 4});
+    columns.push_back({4, 8, 4});
+    columns.ForEachColumn(Visit);
+    EXPECT_EQ(visited, visited_exp);
+
+    // Test: TY-CO-3
+    visited.clear();
+    columns.Clear();
+    columns.ForEachColumn(Visit);
+    EXPECT_TRUE(visited.empty());
+    columns.push_back({5, 7, 1});
+    columns.ForEachColumn(Visit);
+    visited_exp = {{5, 7, 1, 1}};
+    EXPECT_EQ(visited, visited_exp);
+}
+
+TEST(UnitTestTypes, CounterRng) {
+    // Test: TY-CR-1
+    soil_simulator::CounterRng rng_1(42);
+    soil_simulator::CounterRng rng_2(42);
+    rng_1.SetCounter(3, 1);
+    rng_2.SetCounter(3, 1);
+    auto site = soil_simulator::RandomSite::kRelaxTerrain;
+    std::uint32_t draw = rng_1.Draw(site, 10, 12);
+    rng_2.Draw(site, 11, 12);
+    rng_2.Draw(site, 10, 13);
+    EXPECT_EQ(rng_2.Draw(site, 10, 12), draw);
+    EXPECT_EQ(rng_1.Draw(site, 10, 12), draw);
+
+    // Test: TY-CR-2
+    EXPECT_NE(rng_1.Draw(site, 12, 10), draw);
+    EXPECT_NE(rng_1.Draw(site, 10, 12, 1), draw);
+    EXPECT_NE(
+        rng_1.Draw(soil_simulator::RandomSite::kRelaxBodySoil, 10, 12), draw);
+    rng_2.SetCounter(3, 2);
+    EXPECT_NE(rng_2.Draw(site, 10, 12), draw);
+    rng_2.SetCounter(4, 1);
+    EXPECT_NE(rng_2.Draw(site, 10, 12), draw);
+    rng_2.SetCounter(3, 1);
+    rng_2.Seed(43);
+    EXPECT_NE(rng_2.Draw(site, 10, 12), draw);
+
+    // Test: TY-CR-3
+    auto engine_1 = rng_1.Stream(site, 5, 6);
+    auto engine_2 = rng_1.Stream(site, 5, 6);
+    std::uniform_int_distribution<int> dist(0, 9);
+    std::vector<int> count(10, 0);
+    for (auto nn = 0; nn < 10000; nn++) {
+        int value = dist(engine_1);
+        EXPECT_EQ(value, dist(engine_2));
+        count[value]++;
+    }
+    for (auto nn = 0; nn < 10; nn++) {
+        EXPECT_GT(count[nn], 900);
+        EXPECT_LT(count[nn], 1100);
+    }
+
+    // Test: TY-CR-4
+    std::array<int, 4> values = {0, 1, 2, 3};
+    std::vector<int> n_first(4, 0);
+    for (auto nn = 0; nn < 2400; nn++) {
+        auto perm = soil_simulator::CounterRng::Permute(
+            values, rng_1.Draw(site, nn, 0));
+        auto sorted = perm;
+        std::sort(sorted.begin(), sorted.end());
+        EXPECT_EQ(sorted, values);
+        n_first[perm[0]]++;
+    }
+    for (auto nn = 0; nn < 4; nn++) {
+        EXPECT_GT(n_first[nn], 500);
+        EXPECT_LT(n_first[nn], 700);
+    }
+    auto perm = soil_simulator::CounterRng::Permute(values, 0);
+    std::array<int, 4> perm_exp = {1, 2, 3, 0};
+    EXPECT_EQ(perm, perm_exp);
 }
 
 TEST(UnitTestTypes, SimOut) {
@@ -294,4 +970,73 @@ TEST(UnitTestTypes, SimOut) {
     EXPECT_EQ(sim_out.body_area_[1][1], 4);
     EXPECT_EQ(sim_out.relax_area_[1][1], 4);
     EXPECT_EQ(sim_out.impact_area_[1][1], 4);
+    EXPECT_NEAR(sim_out.terrain_volume_, 0.0, 1e-8);
+    EXPECT_NEAR(sim_out.body_soil_volume_, 0.0, 1e-8);
+    EXPECT_NEAR(sim_out.lost_volume_, 0.0, 1e-8);
+    EXPECT_EQ(sim_out.dirty_cells_.size(), 0);
+    EXPECT_EQ(sim_out.dirty_mask_.size_x(), 5);
+    EXPECT_EQ(sim_out.dirty_mask_.size_y(), 5);
+    for (auto ii = 0 ; ii < 5 ; ii++)
+        for (auto jj = 0 ; jj < 5 ; jj++)
+            EXPECT_EQ(sim_out.dirty_mask_[ii][jj], 0);
+
+    // Test: TY-SO-2
+#ifndef SOIL_SIMULATOR_TILED_TERRAIN
+    auto terrain_ptr = reinterpret_cast<std::uintptr_t>(
+        sim_out.terrain_.data());
+    EXPECT_EQ(terrain_ptr % 64, 0);
+    EXPECT_EQ(sim_out.terrain_.stride() % 16, 0);
+#ifndef SOIL_SIMULATOR_FIXED_POINT_HEIGHT
+    for (auto ii = 0 ; ii < 5 ; ii++)
+        EXPECT_EQ(
+            &sim_out.terrain_[ii][0],
+            sim_out.terrain_.data() + ii * sim_out.terrain_.stride());
+#endif
+#endif
+#ifndef SOIL_SIMULATOR_SPARSE_BODY
+    auto body_ptr = reinterpret_cast<std::uintptr_t>(sim_out.body_.data());
+    EXPECT_EQ(body_ptr % 64, 0);
+    EXPECT_EQ(sim_out.body_soil_.stride() % 16, 0);
+#ifndef SOIL_SIMULATOR_FIXED_POINT_HEIGHT
+    for (auto ii = 0 ; ii < 5 ; ii++)
+        for (auto ind = 0 ; ind < 4 ; ind++)
+            EXPECT_EQ(
+                &sim_out.body_soil_[ind][ii][0],
+                sim_out.body_soil_.data() +
+                (ind * 5 + ii) * sim_out.body_soil_.stride());
+#endif
+#endif
+    auto sim_out_copy = sim_out;
+    sim_out_copy.terrain_[1][1] = 0.1;
+    sim_out_copy.body_[2][1][1] = 0.2;
+    EXPECT_NEAR(sim_out.terrain_[1][1], 0.0, 1e-8);
+    EXPECT_NEAR(sim_out.body_[2][1][1], 0.0, 1e-8);
+
+    // Test: TY-SO-3
+    soil_simulator::SimOut sim_out_cell(
+        grid, soil_simulator::ArrayLayout::kCellMajor);
+    EXPECT_EQ(sim_out_cell.body_.layout(),
+        soil_simulator::ArrayLayout::kCellMajor);
+    EXPECT_EQ(sim_out_cell.body_soil_.layout(),
+        soil_simulator::ArrayLayout::kCellMajor);
+    EXPECT_EQ(sim_out_cell.body_.size(), 4);
+    EXPECT_EQ(sim_out_cell.body_[0].size(), 5);
+    EXPECT_EQ(sim_out_cell.body_[0][0].size(), 5);
+    for (auto ind = 0 ; ind < 4 ; ind++)
+        sim_out_cell.body_[ind][2][3] = 0.1 * (ind + 1);
+#if !defined(SOIL_SIMULATOR_SPARSE_BODY) && \
+    !defined(SOIL_SIMULATOR_FIXED_POINT_HEIGHT)
+    for (auto ind = 0 ; ind < 4 ; ind++)
+        EXPECT_EQ(
+            &sim_out_cell.body_[ind][2][3],
+            sim_out_cell.body_.data() + 2 * sim_out_cell.body_.stride() +
+            3 * 4 + ind);
+#endif
+    float body_cell[4];
+    sim_out_cell.body_.LoadCell(2, 3, body_cell);
+    for (auto ind = 0 ; ind < 4 ; ind++)
+        EXPECT_NEAR(body_cell[ind], 0.1 * (ind + 1), 1e-5);
+    sim_out.body_.LoadCell(2, 3, body_cell);
+    for (auto ind = 0 ; ind < 4 ; ind++)
+        EXPECT_NEAR(body_cell[ind], 0.0, 1e-8);
 }
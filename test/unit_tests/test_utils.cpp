@@ -6,6 +6,7 @@ Copyright, 2023, Vilella Kenny.
 #include <cmath>
 #include <string>
 #include "gtest/gtest.h"
+#include "soil_simulator/relax.hpp"
 #include "soil_simulator/utils.hpp"
 #include "test/unit_tests/utility.hpp"
 
@@ -292,6 +293,14 @@ TEST(UnitTestUtils, CalcRotationQuaternion) {
     EXPECT_NEAR(new_pos[0], -0.380155, 1e-5);
     EXPECT_NEAR(new_pos[1], 0.504297, 1e-5);
     EXPECT_NEAR(new_pos[2], -0.29490, 1e-5);
+
+    // Test: UT-CRQ-5
+    auto new_pos_v = soil_simulator::CalcRotationQuaternion(
+        soil_simulator::Quat::FromVector(ori),
+        soil_simulator::Vec3::FromVector(pos));
+    EXPECT_NEAR(new_pos_v[0], new_pos[0], 1e-8);
+    EXPECT_NEAR(new_pos_v[1], new_pos[1], 1e-8);
+    EXPECT_NEAR(new_pos_v[2], new_pos[2], 1e-8);
 }
 
 TEST(UnitTestUtils, AngleToQuat) {
@@ -330,6 +339,16 @@ TEST(UnitTestUtils, AngleToQuat) {
     EXPECT_NEAR(quat[1], -0.265256, 1e-5);
     EXPECT_NEAR(quat[2], 0.50651, 1e-5);
     EXPECT_NEAR(quat[3], 0.295169, 1e-5);
+
+    // Test: UT-AQ-5
+    float angle = 0.53;
+    quat = soil_simulator::AngleToQuat({angle, 1.2f, -0.3f});
+    EXPECT_NEAR(quat[0], 0.765481, 1e-5);
+    EXPECT_NEAR(quat[3], 0.295169, 1e-5);
+    auto quat_v = soil_simulator::AngleToQuat(
+        soil_simulator::Vec3::FromVector(ori));
+    EXPECT_NEAR(quat_v[1], -0.265256, 1e-5);
+    EXPECT_NEAR(quat_v[2], 0.50651, 1e-5);
 }
 
 TEST(UnitTestUtils, CalcBodyFramePos) {
@@ -398,6 +417,56 @@ TEST(UnitTestUtils, CalcBodyFramePos) {
     delete bucket;
 }
 
+TEST(UnitTestUtils, FindBody) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    int area_1[2][2] = {{5, 10}, {5, 10}};
+    int area_2[2][2] = {{8, 15}, {8, 15}};
+    sim_out->body_footprints_.resize(2);
+    sim_out->body_footprints_[0].Reset(area_1);
+    sim_out->body_footprints_[1].Reset(area_2);
+
+    // Test: UT-FB-1
+    sim_out->body_[0][6][6] = 0.0;
+    sim_out->body_[1][6][6] = 0.2;
+    sim_out->body_footprints_[0].Cell(6, 6)[0] = 0.0;
+    sim_out->body_footprints_[0].Cell(6, 6)[1] = 0.2;
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 6, 6, 0), 0);
+    sim_out->body_[2][12][12] = 0.1;
+    sim_out->body_[3][12][12] = 0.3;
+    sim_out->body_footprints_[1].Cell(12, 12)[0] = 0.1;
+    sim_out->body_footprints_[1].Cell(12, 12)[1] = 0.3;
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 12, 12, 2), 1);
+
+    // Test: UT-FB-2
+    sim_out->body_[0][9][9] = -0.2;
+    sim_out->body_[1][9][9] = 0.0;
+    sim_out->body_[2][9][9] = 0.3;
+    sim_out->body_[3][9][9] = 0.5;
+    sim_out->body_footprints_[0].Cell(9, 9)[2] = 0.3;
+    sim_out->body_footprints_[0].Cell(9, 9)[3] = 0.5;
+    sim_out->body_footprints_[1].Cell(9, 9)[0] = -0.2;
+    sim_out->body_footprints_[1].Cell(9, 9)[1] = 0.0;
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 9, 9, 0), 1);
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 9, 9, 2), 0);
+
+    // Test: UT-FB-3
+    sim_out->body_[0][9][9] = -0.2;
+    sim_out->body_[1][9][9] = 0.5;
+    sim_out->body_[2][9][9] = 0.0;
+    sim_out->body_[3][9][9] = 0.0;
+    sim_out->body_footprints_[1].Cell(9, 9)[1] = 0.4;
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 9, 9, 0), 0);
+
+    // Test: UT-FB-4
+    sim_out->body_footprints_.resize(1);
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 9, 9, 0), 0);
+    EXPECT_EQ(soil_simulator::FindBody(sim_out, 12, 12, 2), 0);
+
+    delete sim_out;
+}
+
 TEST(UnitTestUtils, CheckVolume) {
     // Setting up the environment
     soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
@@ -462,6 +531,57 @@ TEST(UnitTestUtils, CheckVolume) {
     delete sim_out;
 }
 
+TEST(UnitTestUtils, CheckVolumeLedger) {
+    // Setting up the environment
+    soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);
+    std::vector<float> o_pos = {0.0, 0.0, 0.0};
+    std::vector<float> j_pos = {0.0, 0.0, 0.0};
+    std::vector<float> b_pos = {0.0, 0.0, -0.5};
+    std::vector<float> t_pos = {0.7, 0.0, -0.5};
+    soil_simulator::Bucket *bucket = new soil_simulator::Bucket(
+        o_pos, j_pos, b_pos, t_pos, 0.5);
+    soil_simulator::SimOut *sim_out = new soil_simulator::SimOut(grid);
+    bucket->pos_ = {0.0, 0.0, 0.0};
+    bucket->ori_ = {1.0, 0.0, 0.0, 0.0};
+
+    // Declaring variables
+    std::string warning_msg;
+    size_t string_loc;
+
+    // Test: UT-CVL-1
+    sim_out->terrain_[1][2] = 0.2;
+    SetHeight(sim_out, 2, 1, NAN, NAN, NAN, NAN, NAN, 0.0, 0.1, 0.1, 0.3);
+    soil_simulator::InitSoilVolume(sim_out);
+    EXPECT_NEAR(sim_out->terrain_volume_, 0.2, 1e-5);
+    EXPECT_NEAR(sim_out->body_soil_volume_, 0.2, 1e-5);
+    EXPECT_NEAR(sim_out->lost_volume_, 0.0, 1e-5);
+    EXPECT_TRUE(soil_simulator::CheckVolumeLedger(sim_out, 4, grid));
+    SetHeight(sim_out, 2, 1, NAN, NAN, NAN, NAN, NAN, 0.0, 0.0, 0.0, 0.0);
+    sim_out->terrain_[1][2] = 0.0;
+
+    // Test: UT-CVL-2
+    testing::internal::CaptureStdout();
+    EXPECT_FALSE(soil_simulator::CheckVolumeLedger(sim_out, 3, grid));
+    warning_msg = testing::internal::GetCapturedStdout();
+    string_loc = warning_msg.find("Volume is not conserved!");
+    EXPECT_TRUE(string_loc != std::string::npos);
+
+    // Test: UT-CVL-3
+    SetHeight(sim_out, 5, 5, 0.4, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN);
+    SetHeight(sim_out, 5, 6, 0.0, 0.0, 0.1, NAN, NAN, NAN, NAN, NAN, NAN);
+    soil_simulator::InitSoilVolume(sim_out);
+    soil_simulator::RelaxUnstableTerrainCell(
+        sim_out, 14, 0.1, 5, 5, 5, 6, grid, bucket, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_[5][5], 0.3, 1e-5);
+    EXPECT_NEAR(sim_out->terrain_volume_, 0.3, 1e-5);
+    EXPECT_NEAR(sim_out->body_soil_volume_, 0.1, 1e-5);
+    EXPECT_NEAR(sim_out->lost_volume_, 0.0, 1e-5);
+    EXPECT_TRUE(soil_simulator::CheckVolumeLedger(sim_out, 4, grid));
+
+    delete bucket;
+    delete sim_out;
+}
+
 TEST(UnitTestUtils, CheckSoil) {
     // Setting up the environment
     soil_simulator::Grid grid(1.0, 1.0, 1.0, 0.1, 0.1);